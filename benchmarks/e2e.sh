@@ -0,0 +1,109 @@
+#!/usr/bin/env bash
+#
+# End to end rb_monitor throughput benchmark.
+#
+# Runs the full rb_monitor binary against the SNMP agents simulator, for
+# every combination of worker threads and sensors, writing messages to a
+# local file instead of kafka/HTTP. Every run appends its report as a JSON
+# line to the report file, and a summary table is printed at the end.
+
+set -euo pipefail
+
+RB_MONITOR=./rb_monitor
+SNMP_SIM=tools/snmp_sim/rb_snmp_sim
+SIM_CONFIG=tools/snmp_sim/example.json
+THREADS="1 4 16"
+SENSORS="100 1000"
+RUN_TIME=60
+SLEEP_MAIN=10
+OUTPUT=/dev/null
+REPORT=e2e_report.jsonl
+
+usage() {
+	cat >&2 <<EOF
+Usage: $0 [-c sim_config] [-t threads] [-n sensors] [-d run_time]
+          [-m sleep_main] [-o output_file] [-r report_file]
+  -c  SNMP simulator config (default $SIM_CONFIG)
+  -t  Space separated worker threads to sweep (default "$THREADS")
+  -n  Space separated sensors to sweep (default "$SENSORS")
+  -d  Seconds every run lasts (default $RUN_TIME)
+  -m  rb_monitor sleep_main, seconds between polls of a sensor
+      (default $SLEEP_MAIN)
+  -o  File rb_monitor writes messages to (default $OUTPUT)
+  -r  File to append runs reports to (default $REPORT)
+EOF
+}
+
+while getopts "c:t:n:d:m:o:r:h" opt; do
+	case "$opt" in
+	c) SIM_CONFIG=$OPTARG ;;
+	t) THREADS=$OPTARG ;;
+	n) SENSORS=$OPTARG ;;
+	d) RUN_TIME=$OPTARG ;;
+	m) SLEEP_MAIN=$OPTARG ;;
+	o) OUTPUT=$OPTARG ;;
+	r) REPORT=$OPTARG ;;
+	h) usage; exit 0 ;;
+	*) usage; exit 1 ;;
+	esac
+done
+
+# Reports are read back to print the table, and stdout is for the table
+if [[ "$REPORT" == "-" || "$OUTPUT" == "-" ]]; then
+	echo "Report and output must be files, not stdout" >&2
+	exit 1
+fi
+
+for bin in "$RB_MONITOR" "$SNMP_SIM"; do
+	if [[ ! -x "$bin" ]]; then
+		echo "$bin not found, run make && make tools" >&2
+		exit 1
+	fi
+done
+
+# Report value of a key of a JSON line
+report_value() {
+	sed -n "s/.*\"$2\": \([0-9.]*\).*/\1/p" <<<"$1"
+}
+
+max_sensors=$(tr ' ' '\n' <<<"$SENSORS" | sort -n | tail -n 1)
+tmp_dir=$(mktemp -d)
+"$SNMP_SIM" -c "$SIM_CONFIG" -n "$max_sensors" -s 0 \
+	2>"$tmp_dir/snmp_sim.log" &
+sim_pid=$!
+trap 'kill $sim_pid 2>/dev/null; rm -rf "$tmp_dir"' EXIT
+sleep 1
+
+: >"$REPORT"
+for sensors in $SENSORS; do
+	for threads in $THREADS; do
+		echo "Running $sensors sensors with $threads threads" \
+			"for ${RUN_TIME}s" >&2
+		"$SNMP_SIM" -c "$SIM_CONFIG" -n "$sensors" -g \
+			-o "threads=$threads" \
+			-o "sleep_main=$SLEEP_MAIN" \
+			-o "run_time=$RUN_TIME" \
+			-o "stats_interval=0" \
+			-o "debug=3" \
+			-o "output_file=$OUTPUT" \
+			-o "benchmark_report=$REPORT" \
+			>"$tmp_dir/rb_monitor.json"
+		# Generated conf logs to stdout
+		"$RB_MONITOR" -c "$tmp_dir/rb_monitor.json" \
+			>>"$tmp_dir/rb_monitor.log" 2>&1
+	done
+done
+
+printf "%8s %8s %12s %12s %10s %10s %10s\n" sensors threads sensors/s \
+	messages/s overruns p50_us p99_us
+while read -r line; do
+	printf "%8s %8s %12.1f %12.1f %4s/%-5s %10s %10s\n" \
+		"$(report_value "$line" sensors)" \
+		"$(report_value "$line" threads)" \
+		"$(report_value "$line" sensors_per_second)" \
+		"$(report_value "$line" messages_per_second)" \
+		"$(report_value "$line" cycle_overruns)" \
+		"$(report_value "$line" cycles)" \
+		"$(report_value "$line" poll_p50_us)" \
+		"$(report_value "$line" poll_p99_us)"
+done <"$REPORT"
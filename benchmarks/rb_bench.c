@@ -0,0 +1,754 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Microbenchmarks of the per-poll hot paths.
+
+  System monitors do not launch any command here: popen is wrapped, and the
+  command string itself is returned as the command output, so the synthetic
+  sensors only measure rb_monitor processing. Allocations are counted
+  wrapping the allocation functions of rb_monitor code, so the ones done
+  inside json-c or libmatheval are not included.
+  */
+
+#include "config.h"
+
+#include "rb_columnar.h"
+#include "rb_message_list.h"
+#include "rb_sensor.h"
+#include "rb_sensor_monitor.h"
+#include "rb_value.h"
+
+#include <json-c/json.h>
+#include <json-c/printbuf.h>
+#include <librd/rd.h>
+#include <librd/rdlog.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/// Default minimum time to run every case
+#define BENCH_DEFAULT_MIN_TIME_S 1.0
+/// Default ns/op increase over baseline that is considered a regression
+#define BENCH_DEFAULT_THRESHOLD_PCT 10.0
+
+/*
+ * ALLOCATION COUNTERS
+ */
+
+/// Allocations done since last reset. Benchmarks are single threaded
+static struct {
+	uint64_t allocs;
+	uint64_t bytes;
+} bench_mem;
+
+#define COMMA ,
+
+#define WRAP_ALLOC_FN(fun, ret_t, args, real_args, size)                       \
+	ret_t __real_##fun(args);                                              \
+	ret_t __wrap_##fun(args);                                              \
+	ret_t __wrap_##fun(args) {                                             \
+		bench_mem.allocs++;                                            \
+		bench_mem.bytes += (size);                                     \
+		return __real_##fun(real_args);                                \
+	}
+
+WRAP_ALLOC_FN(malloc, void *, size_t m, m, m)
+WRAP_ALLOC_FN(calloc, void *, size_t n COMMA size_t m, n COMMA m, n *m)
+WRAP_ALLOC_FN(realloc, void *, void *p COMMA size_t m, p COMMA m, m)
+WRAP_ALLOC_FN(__strdup, char *, const char *str, str, strlen(str) + 1)
+WRAP_ALLOC_FN(strdup, char *, const char *str, str, strlen(str) + 1)
+
+/*
+ * SYSTEM COMMANDS
+ */
+
+FILE *__wrap_popen(const char *command, const char *type);
+FILE *__wrap_popen(const char *command, const char *type) {
+	(void)type;
+	return fmemopen((void *)command, strlen(command), "r");
+}
+
+int __wrap_pclose(FILE *fp);
+int __wrap_pclose(FILE *fp) {
+	return fclose(fp);
+}
+
+/*
+ * SENSORS CASES
+ */
+
+/// Synthetic sensor, processed as a worker would do
+struct bench_sensor {
+	struct _worker_info worker_info;
+	rb_sensor_t *sensor;
+};
+
+/** Start a sensor JSON text
+  @param buf Buffer to print sensor in
+  */
+static void bench_sensor_begin(struct printbuf *buf) {
+	sprintbuf(buf,
+		  "{\"sensor_id\":1,\"timeout\":2,"
+		  "\"sensor_name\":\"bench\",\"sensor_ip\":\"localhost\","
+		  "\"community\":\"public\",\"monitors\":[");
+}
+
+/** Print a vector command output
+  @param buf Buffer to print vector in
+  @param size Number of elements
+  */
+static void bench_print_vector(struct printbuf *buf, size_t size) {
+	for (size_t i = 0; i < size; ++i) {
+		sprintbuf(buf, "%s%zu", i ? ";" : "", i % 100);
+	}
+}
+
+/** Scalars sensor
+  @param buf Buffer to print sensor in
+  @param size Number of monitors
+  */
+static void bench_sensor_scalars(struct printbuf *buf, size_t size) {
+	for (size_t i = 0; i < size; ++i) {
+		sprintbuf(buf,
+			  "%s{\"name\":\"s%zu\",\"system\":\"%zu\","
+			  "\"unit\":\"%%\"}",
+			  i ? "," : "",
+			  i,
+			  i);
+	}
+}
+
+/** Vector sensor, with split operation
+  @param buf Buffer to print sensor in
+  @param size Number of vector elements
+  */
+static void bench_sensor_vector(struct printbuf *buf, size_t size) {
+	sprintbuf(buf, "{\"name\":\"v\",\"system\":\"");
+	bench_print_vector(buf, size);
+	sprintbuf(buf, "\",\"split\":\";\",\"split_op\":\"sum\",\"unit\":\"%%\"}");
+}
+
+/** Vectors operation sensor
+  @param buf Buffer to print sensor in
+  @param size Number of vectors elements
+  */
+static void bench_sensor_vector_op(struct printbuf *buf, size_t size) {
+	for (size_t i = 0; i < 2; ++i) {
+		sprintbuf(buf, "{\"name\":\"v%zu\",\"system\":\"", i);
+		bench_print_vector(buf, size);
+		sprintbuf(buf, "\",\"split\":\";\",\"send\":0},");
+	}
+	sprintbuf(buf,
+		  "{\"name\":\"v\",\"op\":\"v0*v1+1\",\"split_op\":\"mean\","
+		  "\"unit\":\"%%\"}");
+}
+
+/** Operations chain sensor. Every operation depends on the previous one.
+  @param buf Buffer to print sensor in
+  @param size Chain depth
+  */
+static void bench_sensor_op_chain(struct printbuf *buf, size_t size) {
+	sprintbuf(buf, "{\"name\":\"op0\",\"system\":\"1\",\"send\":0}");
+	for (size_t i = 1; i <= size; ++i) {
+		sprintbuf(buf,
+			  ",{\"name\":\"op%zu\",\"op\":\"op%zu*2+1\","
+			  "\"send\":%d}",
+			  i,
+			  i - 1,
+			  i == size);
+	}
+}
+
+/** Create a synthetic sensor
+  @param monitors_cb Callback to print monitors
+  @param size Size of the sensor
+  @return New bench sensor
+  */
+static struct bench_sensor *
+bench_sensor_new(void (*monitors_cb)(struct printbuf *buf, size_t size),
+		 size_t size) {
+	struct bench_sensor *ret = calloc(1, sizeof(*ret));
+	struct printbuf *buf = printbuf_new();
+	if (NULL == ret || NULL == buf) {
+		goto err;
+	}
+
+	snmp_sess_init(&ret->worker_info.default_session);
+	pthread_mutex_init(&ret->worker_info.snmp_session_mutex, NULL);
+
+	bench_sensor_begin(buf);
+	monitors_cb(buf, size);
+	sprintbuf(buf, "]}");
+
+	json_object *json_sensor = json_tokener_parse(buf->buf);
+	if (NULL == json_sensor) {
+		goto err;
+	}
+	ret->sensor = parse_rb_sensor(json_sensor, &ret->worker_info);
+	json_object_put(json_sensor);
+	if (NULL == ret->sensor) {
+		goto err;
+	}
+
+	printbuf_free(buf);
+	return ret;
+
+err:
+	fprintf(stderr, "Couldn't create bench sensor\n");
+	if (buf) {
+		printbuf_free(buf);
+	}
+	free(ret);
+	return NULL;
+}
+
+/** Free all messages of a list
+  @param msgs Messages list
+  */
+static void bench_messages_done(rb_message_list *msgs) {
+	while (!rb_message_list_empty(msgs)) {
+		rb_message_array_t *array = rb_message_list_first(msgs);
+		rb_message_list_remove(msgs, array);
+		for (size_t i = 0; i < array->count; ++i) {
+			free(array->msgs[i].payload);
+		}
+		message_array_done(array);
+	}
+}
+
+static void bench_sensor_run(void *vsensor) {
+	struct bench_sensor *sensor = vsensor;
+	rb_message_list msgs;
+	rb_message_list_init(&msgs);
+	process_rb_sensor(&sensor->worker_info, sensor->sensor, &msgs);
+	bench_messages_done(&msgs);
+}
+
+static void bench_sensor_done(void *vsensor) {
+	struct bench_sensor *sensor = vsensor;
+	rb_sensor_put(sensor->sensor);
+	pthread_mutex_destroy(&sensor->worker_info.snmp_session_mutex);
+	free(sensor);
+}
+
+static void *bench_sensor_scalars_new(size_t size) {
+	return bench_sensor_new(bench_sensor_scalars, size);
+}
+
+static void *bench_sensor_vector_new(size_t size) {
+	return bench_sensor_new(bench_sensor_vector, size);
+}
+
+static void *bench_sensor_vector_op_new(size_t size) {
+	return bench_sensor_new(bench_sensor_vector_op, size);
+}
+
+static void *bench_sensor_op_chain_new(size_t size) {
+	return bench_sensor_new(bench_sensor_op_chain, size);
+}
+
+/*
+ * PRINT CASES
+ */
+
+/// Monitor value to print
+struct bench_print {
+	rb_monitor_t *monitor;
+	struct monitor_value *value;
+	struct monitor_value_print_ctx ctx;
+	/// Common keys cache, as sensors keep them
+	struct monitor_value_common_keys common_keys[RB_MESSAGE_ENCODING__MAX];
+};
+
+/** Create a print case
+  @param size 0 for a scalar value, number of vector elements if not
+  @param encodings Encodings to print
+  @return New print case
+  */
+static void *bench_print_new0(size_t size, unsigned encodings) {
+	struct bench_print *ret = calloc(1, sizeof(*ret));
+	if (NULL == ret) {
+		return NULL;
+	}
+
+	ret->ctx.encodings = encodings;
+	ret->ctx.common_keys = ret->common_keys;
+
+	json_object *json_monitor = json_tokener_parse(
+			size ? "{\"name\":\"v\",\"system\":\"0\",\"split\":\";\","
+			       "\"unit\":\"%\",\"group_id\":\"3\"}"
+			     : "{\"name\":\"s\",\"system\":\"0\","
+			       "\"unit\":\"%\",\"group_id\":\"3\"}");
+	ret->monitor = parse_rb_monitor(json_monitor);
+	json_object_put(json_monitor);
+
+	const time_t now = time(NULL);
+	if (0 == size) {
+		ret->value = new_monitor_value(42.5, now);
+	} else {
+		ret->value = new_monitor_value_array(size);
+		for (size_t i = 0; ret->value && i < size; ++i) {
+			rb_monitor_value_children_push(
+					ret->value, true, (double)(i % 100), now);
+		}
+	}
+
+	if (NULL == ret->monitor || NULL == ret->value) {
+		fprintf(stderr, "Couldn't create print bench\n");
+		free(ret);
+		return NULL;
+	}
+
+	return ret;
+}
+
+static void *bench_print_new(size_t size) {
+	return bench_print_new0(size, RB_MESSAGE_F_JSON);
+}
+
+static void *bench_print_msgpack_new(size_t size) {
+	return bench_print_new0(size, RB_MESSAGE_F_MSGPACK);
+}
+
+static void bench_print_run(void *vprint) {
+	struct bench_print *print = vprint;
+	rb_message_array_t *msgs = print_monitor_value(
+			print->value, print->monitor, &print->ctx);
+	if (msgs) {
+		for (size_t i = 0; i < msgs->count; ++i) {
+			free(msgs->msgs[i].payload);
+			free(msgs->msgs[i].msgpack);
+		}
+		message_array_done(msgs);
+	}
+}
+
+static void bench_print_done(void *vprint) {
+	struct bench_print *print = vprint;
+	monitor_value_common_keys_done(print->common_keys);
+	rb_monitor_value_done(print->value);
+	rb_monitor_done(print->monitor);
+	free(print);
+}
+
+/*
+ * COLUMNAR CASES
+ */
+
+/** Create a columnar case
+  @param size Number of vector elements
+  @return New columnar case
+  */
+static void *bench_columnar_new(size_t size) {
+	return bench_print_new0(size, RB_MESSAGE_F_COLUMNAR);
+}
+
+/** Print a vector in columnar rows and encode them in a block, like workers
+  do with sensor messages of a cycle */
+static void bench_columnar_run(void *vprint) {
+	struct bench_print *print = vprint;
+	struct rb_columnar *batch = rb_columnar_new();
+	if (NULL == batch) {
+		return;
+	}
+
+	rb_message_array_t *msgs = print_monitor_value(
+			print->value, print->monitor, &print->ctx);
+	if (msgs) {
+		for (size_t i = 0; i < msgs->count; ++i) {
+			rb_columnar_add_row(batch, msgs->msgs[i].row);
+		}
+		message_array_done(msgs);
+	}
+
+	size_t len = 0;
+	free(rb_columnar_encode(batch, &len));
+	rb_columnar_done(batch);
+}
+
+/*
+ * ARRAY SELECT CASES
+ */
+
+/// Values array and positions to select
+struct bench_select {
+	rb_monitor_value_array_t *array;
+	ssize_t *pos;
+};
+
+/** Create a select case
+  @param size Number of values. Half of them will be selected
+  @return New select case
+  */
+static void *bench_select_new(size_t size) {
+	struct bench_select *ret = calloc(1, sizeof(*ret));
+	if (NULL == ret) {
+		return NULL;
+	}
+
+	ret->array = rb_monitor_value_array_new(size);
+	ret->pos = calloc(size / 2 + 1, sizeof(ret->pos[0]));
+	if (NULL == ret->array || NULL == ret->pos) {
+		fprintf(stderr, "Couldn't create select bench\n");
+		free(ret->pos);
+		free(ret);
+		return NULL;
+	}
+
+	const time_t now = time(NULL);
+	for (size_t i = 0; i < size; ++i) {
+		rb_monitor_value_array_add(ret->array,
+					   new_monitor_value((double)i, now));
+	}
+	for (size_t i = 0; i < size / 2; ++i) {
+		ret->pos[i] = (ssize_t)(2 * i);
+	}
+	ret->pos[size / 2] = -1;
+
+	return ret;
+}
+
+static void bench_select_run(void *vselect) {
+	struct bench_select *select = vselect;
+	rb_monitor_value_array_t *selected = rb_monitor_value_array_select(
+			select->array, select->pos);
+	if (selected) {
+		rb_monitor_value_array_done(selected);
+	}
+}
+
+static void bench_select_done(void *vselect) {
+	struct bench_select *select = vselect;
+	for (size_t i = 0; i < select->array->count; ++i) {
+		rb_monitor_value_done(
+				rb_monitor_value_array_at(select->array, i));
+	}
+	rb_monitor_value_array_done(select->array);
+	free(select->pos);
+	free(select);
+}
+
+/*
+ * DRIVER
+ */
+
+/// Benchmark case
+struct bench_case {
+	const char *name;		///< Case name, key of baselines
+	void *(*init)(size_t size);     ///< Create case context
+	void (*run)(void *ctx);		///< Run one operation
+	void (*done)(void *ctx);	///< Release case context
+	size_t size;			///< Case size
+};
+
+#define BENCH_SENSOR_CASE(name, type, size)                                    \
+	{                                                                      \
+		name, bench_sensor_##type##_new, bench_sensor_run,             \
+				bench_sensor_done, size                        \
+	}
+
+// clang-format off
+static const struct bench_case bench_cases[] = {
+	BENCH_SENSOR_CASE("sensor_scalars_1", scalars, 1),
+	BENCH_SENSOR_CASE("sensor_scalars_64", scalars, 64),
+	BENCH_SENSOR_CASE("sensor_vector_1k", vector, 1000),
+	BENCH_SENSOR_CASE("sensor_vector_op_1k", vector_op, 1000),
+	BENCH_SENSOR_CASE("sensor_op_chain_32", op_chain, 32),
+	{"print_scalar", bench_print_new, bench_print_run, bench_print_done, 0},
+	{"print_vector_1k", bench_print_new, bench_print_run, bench_print_done,
+									1000},
+	{"print_scalar_msgpack", bench_print_msgpack_new, bench_print_run,
+							bench_print_done, 0},
+	{"print_vector_1k_msgpack", bench_print_msgpack_new, bench_print_run,
+							bench_print_done, 1000},
+	{"columnar_vector_1k", bench_columnar_new, bench_columnar_run,
+							bench_print_done, 1000},
+	{"array_select_1k", bench_select_new, bench_select_run,
+							bench_select_done, 1000},
+};
+// clang-format on
+
+/// Case result
+struct bench_result {
+	char name[64];	///< Case name
+	uint64_t iterations; ///< Number of operations done
+	double ns_op;	 ///< Nanoseconds per operation
+	double allocs_op;    ///< Allocations per operation
+	double bytes_op;     ///< Allocated bytes per operation
+};
+
+static uint64_t bench_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/** Run a benchmark case, doubling iterations until it lasts enough
+  @param bench_case Case to run
+  @param min_time_ns Minimum time to run case
+  @param result Case result
+  @return true if case could be run
+  */
+static bool bench_case_run(const struct bench_case *bench_case,
+			   uint64_t min_time_ns,
+			   struct bench_result *result) {
+	void *ctx = bench_case->init(bench_case->size);
+	if (NULL == ctx) {
+		return false;
+	}
+
+	/* Warm up caches and lazy initializations */
+	bench_case->run(ctx);
+
+	uint64_t elapsed = 0, iterations;
+	for (iterations = 1;; iterations *= 2) {
+		memset(&bench_mem, 0, sizeof(bench_mem));
+		const uint64_t start = bench_now_ns();
+		for (uint64_t i = 0; i < iterations; ++i) {
+			bench_case->run(ctx);
+		}
+		elapsed = bench_now_ns() - start;
+		if (elapsed >= min_time_ns) {
+			break;
+		}
+	}
+
+	snprintf(result->name, sizeof(result->name), "%s", bench_case->name);
+	result->iterations = iterations;
+	result->ns_op = (double)elapsed / (double)iterations;
+	result->allocs_op = (double)bench_mem.allocs / (double)iterations;
+	result->bytes_op = (double)bench_mem.bytes / (double)iterations;
+
+	bench_case->done(ctx);
+	return true;
+}
+
+/** Load a baseline file
+  @param path Baseline path
+  @param count Number of results loaded
+  @return Baseline results, or NULL if error
+  */
+static struct bench_result *bench_baseline_load(const char *path,
+						size_t *count) {
+	FILE *fp = fopen(path, "r");
+	if (NULL == fp) {
+		fprintf(stderr,
+			"Couldn't open baseline %s: %s\n",
+			path,
+			strerror(errno));
+		return NULL;
+	}
+
+	struct bench_result *ret = NULL;
+	size_t size = 0;
+	*count = 0;
+	char line[BUFSIZ];
+	while (fgets(line, sizeof(line), fp)) {
+		struct bench_result result;
+		if ('#' == line[0] ||
+		    4 != sscanf(line,
+				"%63s %lf %lf %lf",
+				result.name,
+				&result.ns_op,
+				&result.allocs_op,
+				&result.bytes_op)) {
+			continue;
+		}
+
+		if (*count == size) {
+			size = size ? 2 * size : RD_ARRAYSIZE(bench_cases);
+			struct bench_result *tmp =
+					realloc(ret, size * sizeof(ret[0]));
+			if (NULL == tmp) {
+				break;
+			}
+			ret = tmp;
+		}
+		ret[(*count)++] = result;
+	}
+
+	fclose(fp);
+	return ret;
+}
+
+/** Save results as baseline
+  @param path Baseline path
+  @param results Results to save
+  @param count Number of results
+  @return true if saved
+  */
+static bool bench_baseline_save(const char *path,
+				const struct bench_result *results,
+				size_t count) {
+	FILE *fp = fopen(path, "w");
+	if (NULL == fp) {
+		fprintf(stderr,
+			"Couldn't save baseline %s: %s\n",
+			path,
+			strerror(errno));
+		return false;
+	}
+
+	fprintf(fp, "# case ns/op allocs/op bytes/op\n");
+	for (size_t i = 0; i < count; ++i) {
+		fprintf(fp,
+			"%s %.1f %.2f %.1f\n",
+			results[i].name,
+			results[i].ns_op,
+			results[i].allocs_op,
+			results[i].bytes_op);
+	}
+
+	fclose(fp);
+	return true;
+}
+
+/** Search a result by name
+  @param results Results
+  @param count Number of results
+  @param name Name to search
+  @return Result, or NULL if not found
+  */
+static const struct bench_result *bench_result_find(
+		const struct bench_result *results, size_t count, const char *name) {
+	for (size_t i = 0; results && i < count; ++i) {
+		if (0 == strcmp(results[i].name, name)) {
+			return &results[i];
+		}
+	}
+	return NULL;
+}
+
+static void usage(const char *progname) {
+	fprintf(stderr,
+		"Usage: %s [-t min_seconds] [-f filter] [-s save_baseline] "
+		"[-c compare_baseline] [-r threshold_pct]\n"
+		"  -t  Minimum time to run every case (default %.1f)\n"
+		"  -f  Only run cases that contains filter\n"
+		"  -s  Save results in this baseline file\n"
+		"  -c  Compare results with this baseline file, and exit with\n"
+		"      error if any case regressed\n"
+		"  -r  ns/op increase considered a regression, in percent\n"
+		"      (default %.1f). An allocs/op increase always is.\n",
+		progname,
+		BENCH_DEFAULT_MIN_TIME_S,
+		BENCH_DEFAULT_THRESHOLD_PCT);
+}
+
+int main(int argc, char *argv[]) {
+	double min_time_s = BENCH_DEFAULT_MIN_TIME_S;
+	double threshold_pct = BENCH_DEFAULT_THRESHOLD_PCT;
+	const char *filter = NULL, *save_path = NULL, *compare_path = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:f:s:c:r:h")) != -1) {
+		switch (opt) {
+		case 't':
+			min_time_s = atof(optarg);
+			break;
+		case 'f':
+			filter = optarg;
+			break;
+		case 's':
+			save_path = optarg;
+			break;
+		case 'c':
+			compare_path = optarg;
+			break;
+		case 'r':
+			threshold_pct = atof(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			return 'h' == opt ? 0 : 1;
+		};
+	}
+
+	rd_log_set_severity(LOG_ERR);
+
+	size_t baseline_count = 0;
+	struct bench_result *baseline = NULL;
+	if (compare_path) {
+		baseline = bench_baseline_load(compare_path, &baseline_count);
+		if (NULL == baseline) {
+			return 1;
+		}
+	}
+
+	struct bench_result results[RD_ARRAYSIZE(bench_cases)];
+	size_t results_count = 0;
+	int rc = 0;
+
+	printf("%-24s %12s %12s %12s", "case", "ns/op", "allocs/op", "bytes/op");
+	printf(compare_path ? " %12s %8s\n" : "\n", "base ns/op", "delta");
+	for (size_t i = 0; i < RD_ARRAYSIZE(bench_cases); ++i) {
+		if (filter && NULL == strstr(bench_cases[i].name, filter)) {
+			continue;
+		}
+
+		struct bench_result *result = &results[results_count];
+		if (!bench_case_run(&bench_cases[i],
+				    (uint64_t)(min_time_s * 1e9),
+				    result)) {
+			rc = 1;
+			continue;
+		}
+		results_count++;
+
+		printf("%-24s %12.1f %12.2f %12.1f",
+		       result->name,
+		       result->ns_op,
+		       result->allocs_op,
+		       result->bytes_op);
+
+		const struct bench_result *base = bench_result_find(
+				baseline, baseline_count, result->name);
+		if (base) {
+			const double delta_pct =
+					100 * (result->ns_op - base->ns_op) /
+					base->ns_op;
+			const bool regression =
+					delta_pct > threshold_pct ||
+					result->allocs_op >
+							base->allocs_op + 0.01;
+			printf(" %12.1f %+7.1f%%%s",
+			       base->ns_op,
+			       delta_pct,
+			       regression ? " REGRESSION" : "");
+			if (regression) {
+				rc = 1;
+			}
+		}
+		printf("\n");
+		fflush(stdout);
+	}
+
+	if (save_path &&
+	    !bench_baseline_save(save_path, results, results_count)) {
+		rc = 1;
+	}
+
+	free(baseline);
+	return rc;
+}
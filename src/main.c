@@ -18,8 +18,15 @@
 
 #include "config.h"
 
+#include "rb_admin.h"
+#include "rb_columnar.h"
+#include "rb_hash.h"
+#include "rb_json.h"
+#include "rb_monitors_template.h"
+#include "rb_msgpack.h"
 #include "rb_sensor.h"
 #include "rb_sensor_queue.h"
+#include "rb_stats.h"
 
 #ifdef HAVE_ZOOKEEPER
 #include "rb_monitor_zk.h"
@@ -45,7 +52,10 @@
 #include <math.h>
 #include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
 #ifndef NDEBUG
@@ -55,6 +65,7 @@
 static const char CONFIG_RDKAFKA_KEY[] = "rdkafka.";
 static const char CONFIG_ZOOKEEPER_KEY[] = "zookeeper";
 static const char CONFIG_SENSORS_KEY[] = "sensors";
+static const char CONFIG_MONITORS_TEMPLATES_KEY[] = "monitors_templates";
 
 static const char ENABLE_RBHTTP_CONFIGURE_OPT[] = "--enable-rbhttp";
 
@@ -72,15 +83,45 @@ static const char *str_default_config = /* "conf:" */ "{"
 "}";
 // clang-format on
 
+/// Default number of slowest sensors reported in each stats emission
+#define SLOW_SENSORS_TOP_DEFAULT 10
+
 struct _main_info {
 	const char *syslog_indent;
 	uint64_t sleep_main, threads;
 #ifdef HAVE_ZOOKEEPER
 	struct rb_monitor_zk *zk;
+	uint64_t zk_generation;  ///< Generation of zk_sensors
+	json_object *zk_sensors; ///< ZooKeeper sensors this instance owns
 #endif
+	json_object *config; ///< Last loaded config file, to rebuild sensors
+	/// rb_monitor own stats
+	struct {
+		uint64_t interval;	///< Seconds between emissions. 0 to disable
+		const char *sensor_name; ///< sensor_name of stats messages
+		char hostname[256];	///< Default sensor_name
+		time_t next;		 ///< Next emission
+		struct rb_stats_snapshot *prev; ///< Last emitted snapshot
+		/// Number of slowest sensors to report. 0 to disable
+		uint64_t slow_sensors_top;
+	} stats;
+	const char *admin_socket; ///< Admin listener socket path
+	/// Benchmark run: fixed duration and throughput report at exit
+	struct {
+		uint64_t run_time;	///< Seconds to run. 0 to run until signal
+		const char *report_file; ///< Report output, "-" for stdout
+		uint64_t start;		 ///< Main loop start, as rb_stats_now
+		uint64_t cycles;	 ///< Passes over all sensors
+		/// Cycles that started before the previous one was polled
+		uint64_t cycle_overruns;
+		uint64_t skipped;	///< Sensors skipped at last cycle start
+		int max_pending_sensors; ///< Max queue depth at cycle start
+	} benchmark;
 };
 
 static int run = 1;
+/// Config file needs to be reloaded
+static volatile sig_atomic_t reload = 0;
 
 static void sigproc(int sig) {
 	static int called = 0;
@@ -92,6 +133,11 @@ static void sigproc(int sig) {
 	(void)sig;
 }
 
+static void sighup_proc(int sig) {
+	reload = 1;
+	(void)sig;
+}
+
 static void printHelp(const char *progName) {
 	fprintf(stderr,
 		"Usage: %s [-c path/to/config/file] [-g] [-v]"
@@ -150,13 +196,39 @@ static void parse_rdkafka_config_json(struct _worker_info *worker_info,
 				    value);
 }
 
+/** Parse the messages encoding of a sink
+  @param key Config key
+  @param val Config value
+  @param encoding Sink encoding. It is not changed if value is invalid.
+  */
+static void parse_message_encoding(const char *key,
+				   json_object *val,
+				   enum rb_message_encoding *encoding) {
+	const char *sval = json_object_get_string(val);
+	if (!sval) {
+		rdlog(LOG_ERR, "Invalid %s", key);
+	} else if (0 == strcmp(sval, "json")) {
+		*encoding = RB_MESSAGE_ENCODING_JSON;
+	} else if (0 == strcmp(sval, "msgpack")) {
+		*encoding = RB_MESSAGE_ENCODING_MSGPACK;
+	} else if (0 == strcmp(sval, "columnar")) {
+		*encoding = RB_MESSAGE_ENCODING_COLUMNAR;
+	} else {
+		rdlog(LOG_ERR, "Invalid %s %s", key, sval);
+	}
+}
+
 #ifdef HAVE_ZOOKEEPER
 static void parse_zookeeper_json(struct _main_info *main_info,
 				 struct _worker_info *worker_info,
 				 json_object *zk_config) {
 	char *host = NULL;
-	int64_t pop_watcher_timeout = 0, push_timeout = 0;
+	int64_t pop_watcher_timeout = 0, push_timeout = 0, ring_vnodes = 0,
+		push_chunk_sensors = 0;
 	json_object *zk_sensors = NULL;
+	struct rb_monitor_zk_config zk_config_s = {
+			.distribution = RB_MONITOR_ZK_DISTRIBUTION_QUEUE,
+	};
 
 	json_object_object_foreach(zk_config, key, val) {
 		if (0 == strcmp(key, "host")) {
@@ -165,8 +237,32 @@ static void parse_zookeeper_json(struct _main_info *main_info,
 			pop_watcher_timeout = json_object_get_int64(val);
 		} else if (0 == strcmp(key, "push_timeout")) {
 			push_timeout = json_object_get_int64(val);
+		} else if (0 == strcmp(key, "push_chunk_sensors")) {
+			push_chunk_sensors = json_object_get_int64(val);
 		} else if (0 == strcmp(key, "sensors")) {
 			zk_sensors = val;
+		} else if (0 == strcmp(key, "distribution")) {
+			const char *distribution = json_object_get_string(val);
+			if (!distribution) {
+				rdlog(LOG_ERR,
+				      "Invalid zookeeper distribution, using "
+				      "queue");
+			} else if (0 == strcmp(distribution, "hash_ring")) {
+				zk_config_s.distribution =
+						RB_MONITOR_ZK_DISTRIBUTION_HASH_RING;
+			} else if (0 == strcmp(distribution, "queue")) {
+				zk_config_s.distribution =
+						RB_MONITOR_ZK_DISTRIBUTION_QUEUE;
+			} else {
+				rdlog(LOG_ERR,
+				      "Unknown zookeeper distribution %s, "
+				      "using queue",
+				      distribution);
+			}
+		} else if (0 == strcmp(key, "member_id")) {
+			zk_config_s.member_id = json_object_get_string(val);
+		} else if (0 == strcmp(key, "ring_vnodes")) {
+			ring_vnodes = json_object_get_int64(val);
 		} else {
 			rdlog(LOG_ERR,
 			      "Don't know what zookeeper config.%s "
@@ -186,6 +282,30 @@ static void parse_zookeeper_json(struct _main_info *main_info,
 	if (!host) {
 		rdlog(LOG_ERR, "No zookeeper host specified. Can't use ZK.");
 		return;
+	} else if (!zk_sensors ||
+		   !json_object_is_type(zk_sensors, json_type_array)) {
+		rdlog(LOG_ERR, "No zookeeper sensors array. Can't use ZK.");
+		free(host);
+		return;
+	} else if (push_chunk_sensors < 0) {
+		rdlog(LOG_ERR,
+		      "Can't set zk push chunk sensors < 0 (%" PRId64 ")",
+		      push_chunk_sensors);
+		free(host);
+		return;
+	} else if (ring_vnodes < 0) {
+		rdlog(LOG_ERR,
+		      "Can't set zk ring vnodes < 0 (%" PRId64 ")",
+		      ring_vnodes);
+		free(host);
+		return;
+	} else if (RB_MONITOR_ZK_DISTRIBUTION_HASH_RING ==
+		   zk_config_s.distribution) {
+		if (push_timeout) {
+			rdlog(LOG_WARNING,
+			      "zookeeper push_timeout is only used in queue "
+			      "distribution");
+		}
 	} else if (0 == push_timeout) {
 		rdlog(LOG_INFO,
 		      "No pop push_timeout specified. We will never "
@@ -202,11 +322,14 @@ static void parse_zookeeper_json(struct _main_info *main_info,
 		      pop_watcher_timeout);
 	}
 
-	main_info->zk = init_rbmon_zk(host,
-				      (uint64_t)pop_watcher_timeout,
-				      (uint64_t)push_timeout,
+	zk_config_s.host = host;
+	zk_config_s.pop_watcher_timeout = (uint64_t)pop_watcher_timeout;
+	zk_config_s.push_timeout = (uint64_t)push_timeout;
+	zk_config_s.push_chunk_sensors = (uint64_t)push_chunk_sensors;
+	zk_config_s.ring_vnodes = (uint64_t)ring_vnodes;
+	main_info->zk = init_rbmon_zk(&zk_config_s,
 				      zk_sensors,
-				      worker_info->queue);
+				      worker_info);
 }
 #endif
 
@@ -267,6 +390,53 @@ static json_bool parse_json_config(json_object *config,
 			worker_info->kafka_topic = json_object_get_string(val);
 		} else if (0 == strcmp(key, "kafka_timeout")) {
 			worker_info->kafka_timeout = json_object_get_int64(val);
+		} else if (0 == strcmp(key, "kafka_encoding")) {
+			parse_message_encoding(
+					key, val, &worker_info->kafka_encoding);
+		} else if (0 == strcmp(key, "stats_interval")) {
+			int64_t interval = json_object_get_int64(val);
+			if (interval < 0) {
+				rdlog(LOG_WARNING,
+				      "Can't emit stats every %" PRId64 "\"",
+				      interval);
+			} else {
+				main_info->stats.interval = (uint64_t)interval;
+			}
+		} else if (0 == strcmp(key, "stats_sensor_name")) {
+			main_info->stats.sensor_name =
+					json_object_get_string(val);
+		} else if (0 == strcmp(key, "slow_sensors_top")) {
+			int64_t top = json_object_get_int64(val);
+			if (top < 0) {
+				rdlog(LOG_WARNING,
+				      "Can't report %" PRId64 " slow sensors",
+				      top);
+			} else {
+				main_info->stats.slow_sensors_top = (uint64_t)top;
+			}
+		} else if (0 == strcmp(key, "admin_socket")) {
+			main_info->admin_socket = json_object_get_string(val);
+		} else if (0 == strcmp(key, "output_file")) {
+			worker_info->output_file_path =
+					json_object_get_string(val);
+		} else if (0 == strcmp(key, "output_file_encoding")) {
+			parse_message_encoding(
+					key,
+					val,
+					&worker_info->output_file_encoding);
+		} else if (0 == strcmp(key, "run_time")) {
+			int64_t run_time = json_object_get_int64(val);
+			if (run_time < 0) {
+				rdlog(LOG_WARNING,
+				      "Can't run for %" PRId64 "\"",
+				      run_time);
+			} else {
+				main_info->benchmark.run_time =
+						(uint64_t)run_time;
+			}
+		} else if (0 == strcmp(key, "benchmark_report")) {
+			main_info->benchmark.report_file =
+					json_object_get_string(val);
 		} else if (0 == strcmp(key, "sleep_worker")) {
 			worker_info->sleep_worker = json_object_get_int64(val);
 		} else if (0 == strcmp(key, "http_endpoint")) {
@@ -302,6 +472,18 @@ static json_bool parse_json_config(json_object *config,
 			      "compile it with %s",
 			      key,
 			      ENABLE_RBHTTP_CONFIGURE_OPT);
+#endif
+		} else if (0 == strcmp(key, "http_encoding")) {
+#ifdef HAVE_RBHTTP
+			parse_message_encoding(
+					key, val, &worker_info->http_encoding);
+#else
+			rdlog(LOG_ERR,
+			      "rb_monitor does not have librbhttp "
+			      "support, so %s key is invalid. Please "
+			      "compile it with %s",
+			      key,
+			      ENABLE_RBHTTP_CONFIGURE_OPT);
 #endif
 		} else if (0 == strcmp(key, "rb_http_max_messages")) {
 			worker_info->rb_http_max_messages =
@@ -491,61 +673,232 @@ static void process_rb_http_options(struct _worker_info *worker_info) {
 
 #endif
 
+/** Log a message at debug level
+  @param sink Sink name
+  @param encoding Message encoding
+  @param payload Message payload
+  @param len Payload length
+  */
+static void log_debug_message(const char *sink,
+			      enum rb_message_encoding encoding,
+			      const char *payload,
+			      size_t len) {
+	if (RB_MESSAGE_ENCODING_JSON == encoding) {
+		rdlog(LOG_DEBUG, "[%s] %.*s\n", sink, (int)len, payload);
+	} else if (RB_MESSAGE_ENCODING_COLUMNAR == encoding) {
+		rdlog(LOG_DEBUG, "[%s] Columnar block, %zu bytes", sink, len);
+	} else {
+		rdlog(LOG_DEBUG,
+		      "[%s] MessagePack message, %zu bytes",
+		      sink,
+		      len);
+	}
+}
+
+/** Send a payload to kafka
+  @param worker_info Worker info
+  @param payload Payload, in kafka encoding
+  @param len Payload length
+  */
+static void send_message_kafka(struct _worker_info *worker_info,
+			       void *payload,
+			       size_t len) {
+	log_debug_message("Kafka", worker_info->kafka_encoding, payload, len);
+	const int produce_rc = rd_kafka_produce(
+			worker_info->rkt,
+			RD_KAFKA_PARTITION_UA,
+			RD_KAFKA_MSG_F_COPY,
+			/* Payload and length */
+			payload,
+			len,
+			/* Optional key and its length */
+			NULL,
+			0,
+			/* Message opaque, provided in delivery report callback
+			 * as msg_opaque. */
+			NULL);
+	if (0 != produce_rc) {
+		rb_stats_counter_inc(RB_STATS_C__PRODUCE_ERRORS);
+		rdlog(LOG_ERR,
+		      "[Kafka] Cannot produce kafka message: %s",
+		      rd_kafka_err2str(rd_kafka_errno2err(errno)));
+	}
+}
+
+#ifdef HAVE_RBHTTP
+/** Send a payload via HTTP
+  @param worker_info Worker info
+  @param payload Payload, in HTTP encoding
+  @param len Payload length
+  */
+static void send_message_http(struct _worker_info *worker_info,
+			      void *payload,
+			      size_t len) {
+	char err[BUFSIZ];
+
+	log_debug_message("HTTP", worker_info->http_encoding, payload, len);
+	const int produce_rc = rb_http_produce(worker_info->http_handler,
+					       payload,
+					       len,
+					       RB_HTTP_MESSAGE_F_COPY,
+					       err,
+					       sizeof(err),
+					       NULL);
+	if (0 != produce_rc) {
+		rb_stats_counter_inc(RB_STATS_C__PRODUCE_ERRORS);
+		rdlog(LOG_ERR, "[HTTP] Cannot produce message: %s", err);
+	}
+}
+#endif
+
+/** Write a payload to output file
+  @param worker_info Worker info
+  @param payload Payload, in output file encoding
+  @param len Payload length
+  */
+static void send_message_file(struct _worker_info *worker_info,
+			      const void *payload,
+			      size_t len) {
+	FILE *out = worker_info->output_file;
+
+	/* MessagePack messages and columnar blocks are self delimited, JSON
+	ones go in their own line */
+	const bool newline = RB_MESSAGE_ENCODING_JSON ==
+			     worker_info->output_file_encoding;
+
+	/* Keep messages of different workers in their own lines */
+	flockfile(out);
+	if (len != fwrite_unlocked(payload, 1, len, out) ||
+	    (newline && EOF == putc_unlocked('\n', out))) {
+		rb_stats_counter_inc(RB_STATS_C__PRODUCE_ERRORS);
+		rdlog(LOG_ERR,
+		      "[File] Cannot write message: %s",
+		      strerror(errno));
+	}
+	funlockfile(out);
+}
+
+/** Send a payload to the sinks that use its encoding
+  @param worker_info Worker info
+  @param encoding Payload encoding
+  @param payload Payload
+  @param len Payload length
+  */
+static void send_payload(struct _worker_info *worker_info,
+			 enum rb_message_encoding encoding,
+			 void *payload,
+			 size_t len) {
+	bool sent = false;
+
+	if (worker_info->kafka_broker &&
+	    encoding == worker_info->kafka_encoding) {
+		send_message_kafka(worker_info, payload, len);
+		sent = true;
+	}
+
+#ifdef HAVE_RBHTTP
+	if (worker_info->http_handler &&
+	    encoding == worker_info->http_encoding) {
+		send_message_http(worker_info, payload, len);
+		sent = true;
+	}
+#endif
+
+	if (worker_info->output_file &&
+	    encoding == worker_info->output_file_encoding) {
+		send_message_file(worker_info, payload, len);
+		sent = true;
+	}
+
+	if (sent) {
+		rb_stats_counter_add(RB_STATS_C__BYTES, len);
+	}
+}
+
+/// Columnar batch of the sensor that this worker thread is processing
+static __thread struct rb_columnar *worker_columnar_batch;
+
+/** Encode a columnar batch and send it to columnar sinks
+  @param worker_info Worker info
+  @param batch Batch
+  */
+static void send_columnar_batch(struct _worker_info *worker_info,
+				const struct rb_columnar *batch) {
+	size_t len = 0;
+	if (0 == rb_columnar_rows(batch)) {
+		return;
+	}
+
+	char *block = rb_columnar_encode(batch, &len);
+	if (NULL == block) {
+		rb_stats_counter_inc(RB_STATS_C__PRODUCE_ERRORS);
+		return;
+	}
+
+	send_payload(worker_info, RB_MESSAGE_ENCODING_COLUMNAR, block, len);
+	free(block);
+}
+
 int worker_process_sensor_send_array(struct _worker_info *worker_info,
-					    rb_message_array_t *msgs) {
+				     rb_message_array_t *msgs) {
+	const uint64_t start = rb_stats_now();
+	const unsigned encodings = worker_info->message_encodings;
+	/* Messages sent out of a sensor processing, like internal stats, go
+	in their own block */
+	struct rb_columnar *batch = worker_columnar_batch;
+	if (NULL == batch && (encodings & RB_MESSAGE_F_COLUMNAR)) {
+		batch = rb_columnar_new();
+	}
+
+	rb_stats_counter_add(RB_STATS_C__MESSAGES, msgs->count);
 	for (size_t i = 0; i < msgs->count; ++i) {
-		char *msg = msgs->msgs[i].payload;
-		size_t len = msgs->msgs[i].len;
-
-		if (worker_info->kafka_broker) {
-			rdlog(LOG_DEBUG, "[Kafka] %s\n", msg);
-			const int produce_rc = rd_kafka_produce(
-					worker_info->rkt,
-					RD_KAFKA_PARTITION_UA,
-					RD_KAFKA_MSG_F_COPY,
-					/* Payload and length */
-					msg,
-					len,
-					/* Optional key and its length */
-					NULL,
-					0,
-					/* Message opaque, provided in delivery
-					 * report
-					 * callback as
-					 * msg_opaque. */
-					NULL);
-			if (0 != produce_rc) {
-				rdlog(LOG_ERR,
-				      "[Kafka] Cannot produce kafka message: "
-				      "%s",
-				      rd_kafka_err2str(rd_kafka_errno2err(
-						      errno)));
-			}
-		} /* if kafka */
+		rb_message *message = &msgs->msgs[i];
+		if ((encodings & RB_MESSAGE_F_MSGPACK) &&
+		    NULL == message->msgpack && NULL != message->payload) {
+			/* Messages only printed in JSON, like internal stats */
+			message->msgpack = rb_msgpack_from_json_text(
+					message->payload,
+					&message->msgpack_len);
+		}
 
-#ifdef HAVE_RBHTTP
-		if (worker_info->http_handler) {
-			char err[BUFSIZ];
-			rdlog(LOG_DEBUG, "[HTTP] %s\n", msg);
-			const int produce_rc = rb_http_produce(
-					worker_info->http_handler,
-					msg,
-					len,
-					RB_HTTP_MESSAGE_F_COPY,
-					err,
-					sizeof(err),
-					NULL);
-			if (0 != produce_rc) {
-				rdlog(LOG_ERR,
-				      "[HTTP] Cannot produce message: %s",
-				      err);
+		for (size_t e = 0; e < RB_MESSAGE_ENCODING__MAX; ++e) {
+			size_t len = 0;
+			void *payload = NULL;
+			if (encodings & RB_MESSAGE_F(e)) {
+				payload = rb_message_payload(
+						message,
+						(enum rb_message_encoding)e,
+						&len);
+			}
+			if (payload) {
+				send_payload(worker_info,
+					     (enum rb_message_encoding)e,
+					     payload,
+					     len);
 			}
 		}
-#endif
-		free(msg);
+
+		if (batch && message->row) {
+			/* Batch owns the row now */
+			rb_columnar_add_row(batch, message->row);
+		} else if (batch && message->payload) {
+			/* Messages only printed in JSON, like internal stats */
+			rb_columnar_add_json_text(batch, message->payload);
+		} else if (message->row) {
+			json_object_put(message->row);
+		}
+
+		free(message->payload);
+		free(message->msgpack);
+	}
+
+	if (batch && batch != worker_columnar_batch) {
+		send_columnar_batch(worker_info, batch);
+		rb_columnar_done(batch);
 	}
 
 	message_array_done(msgs);
+	rb_stats_histogram_since(RB_STATS_H__PRODUCE, start);
 	return 0;
 }
 
@@ -576,17 +929,39 @@ worker_process_sensor(struct _worker_info *worker_info, rb_sensor_t *sensor) {
 	if (0 != rb_sensor_trylock(sensor)) {
 		rdlog(LOG_INFO, "Sensor %s is already being processed. Skipping.",
 		      rb_sensor_name(sensor));
+		rb_stats_counter_inc(RB_STATS_C__SENSORS_SKIPPED);
+		rb_sensor_stats_skipped(sensor);
 		rb_sensor_put(sensor);
 		return 0;
 	}
 
+	/* Sensor messages of this cycle go to the same columnar block */
+	if (worker_info->message_encodings & RB_MESSAGE_F_COLUMNAR) {
+		worker_columnar_batch = rb_columnar_new();
+	}
+
+	struct rb_stats_cost cost;
+	const time_t poll_timestamp = time(NULL);
+	const uint64_t start = rb_stats_now();
+	rb_stats_cost_start(&cost);
 	process_rb_sensor(worker_info, sensor, &messages);
+	rb_stats_histogram_since(RB_STATS_H__SENSOR_POLL, start);
+	rb_stats_counter_inc(RB_STATS_C__SENSORS_PROCESSED);
+
+	/* Sending is part of the sensor cost, and sensor lock keeps
+	rb_sensor_stats_poll single writer */
+	worker_process_sensor_send_messages(worker_info, &messages);
+	if (worker_columnar_batch) {
+		send_columnar_batch(worker_info, worker_columnar_batch);
+		rb_columnar_done(worker_columnar_batch);
+		worker_columnar_batch = NULL;
+	}
+	rb_stats_cost_end(&cost);
+	rb_sensor_stats_poll(sensor, poll_timestamp, &cost);
 	rb_sensor_unlock(sensor);
 
 	rb_sensor_put(sensor);
 
-	worker_process_sensor_send_messages(worker_info, &messages);
-
 	return 0;
 }
 
@@ -623,6 +998,435 @@ static void queue_sensors(rb_sensors_array_t *sarray, rd_fifoq_t *squeue) {
 	}
 }
 
+/** Slowest sensors first
+  @param a First sensor cost
+  @param b Second sensor cost
+  @return Comparison
+  */
+static int sensor_cost_cmp(const struct rb_stats_cost *a,
+			   const struct rb_stats_cost *b) {
+	return (a->wall_time_us < b->wall_time_us) -
+	       (a->wall_time_us > b->wall_time_us);
+}
+
+/// Slowest sensors first
+static int named_cost_cmp(const void *va, const void *vb) {
+	const struct rb_stats_named_cost *a = va, *b = vb;
+	return sensor_cost_cmp(&a->cost, &b->cost);
+}
+
+/** Emit the cost of the slowest sensors since the last call
+  @param main_info Main info, with stats config
+  @param worker_info Worker info, to send messages
+  @param sensors Current sensors
+  @param now Current timestamp
+  */
+static void emit_slow_sensors(struct _main_info *main_info,
+			      struct _worker_info *worker_info,
+			      rb_sensors_array_t *sensors,
+			      time_t now) {
+	if (0 == sensors->count) {
+		return;
+	}
+
+	struct rb_stats_named_cost *costs =
+			calloc(sensors->count, sizeof(costs[0]));
+	if (NULL == costs) {
+		rdlog(LOG_ERR, "Couldn't allocate sensors costs (OOM?)");
+		return;
+	}
+
+	for (size_t i = 0; i < sensors->count; ++i) {
+		struct rb_sensor_stats stats;
+		rb_sensor_stats_interval(sensors->elms[i], &stats);
+		costs[i].name = rb_sensor_name(sensors->elms[i]);
+		costs[i].cost = stats.total;
+	}
+
+	qsort(costs, sensors->count, sizeof(costs[0]), named_cost_cmp);
+	const size_t top = RD_MIN(sensors->count,
+				  (size_t)main_info->stats.slow_sensors_top);
+	for (size_t i = 0; i < top; ++i) {
+		rdlog(LOG_INFO,
+		      "Slow sensor #%zu %s: %" PRIu64 "us in %" PRIu64
+		      " polls (%" PRIu64 "us CPU), %" PRIu64
+		      " SNMP requests, %" PRIu64 " errors",
+		      i + 1,
+		      costs[i].name,
+		      costs[i].cost.wall_time_us,
+		      costs[i].cost.count,
+		      costs[i].cost.cpu_time_us,
+		      costs[i].cost.snmp_requests,
+		      costs[i].cost.errors);
+	}
+
+	rb_message_array_t *msgs = rb_stats_print_costs(
+			costs, top, main_info->stats.sensor_name, now);
+	if (msgs) {
+		worker_process_sensor_send_array(worker_info, msgs);
+	}
+	free(costs);
+}
+
+/** Emit rb_monitor own stats if it is time to do so
+  @param main_info Main info, with stats config and state
+  @param worker_info Worker info, to send messages
+  @param sensors Current sensors, to report the slowest ones
+  */
+static void emit_stats(struct _main_info *main_info,
+		       struct _worker_info *worker_info,
+		       rb_sensors_array_t *sensors) {
+	const time_t now = time(NULL);
+	if (0 == main_info->stats.interval || now < main_info->stats.next) {
+		return;
+	}
+
+	struct rb_stats_snapshot *snapshot = calloc(1, sizeof(*snapshot));
+	if (NULL == snapshot) {
+		rdlog(LOG_ERR, "Couldn't allocate stats snapshot (OOM?)");
+		return;
+	}
+
+	rb_stats_gauge_set(RB_STATS_G__QUEUE_DEPTH,
+			   sensor_queue_len(worker_info->queue));
+	rb_stats_snapshot(snapshot);
+
+	/* First snapshot only sets the reference */
+	if (main_info->stats.next > 0) {
+		rb_message_array_t *msgs =
+				rb_stats_print(snapshot,
+					       main_info->stats.prev,
+					       main_info->stats.sensor_name,
+					       now);
+		if (msgs) {
+			worker_process_sensor_send_array(worker_info, msgs);
+		}
+		if (main_info->stats.slow_sensors_top > 0) {
+			emit_slow_sensors(main_info, worker_info, sensors, now);
+		}
+	}
+
+	free(main_info->stats.prev);
+	main_info->stats.prev = snapshot;
+	main_info->stats.next = now + (time_t)main_info->stats.interval;
+}
+
+/** Account a new pass over all sensors
+  @param main_info Main info, with benchmark state
+  @param worker_info Worker info, to check pending sensors
+  */
+static void benchmark_cycle(struct _main_info *main_info,
+			    struct _worker_info *worker_info) {
+	const uint64_t skipped = rb_stats_counter(RB_STATS_C__SENSORS_SKIPPED);
+	const int pending = sensor_queue_len(worker_info->queue);
+
+	/* All previous cycle sensors should be polled by now */
+	if (main_info->benchmark.cycles++ > 0 &&
+	    (pending > 0 || skipped > main_info->benchmark.skipped)) {
+		main_info->benchmark.cycle_overruns++;
+	}
+	main_info->benchmark.skipped = skipped;
+	if (pending > main_info->benchmark.max_pending_sensors) {
+		main_info->benchmark.max_pending_sensors = pending;
+	}
+}
+
+/** Check if benchmark run time is over
+  @param main_info Main info, with benchmark config and state
+  @return true if rb_monitor has to keep running
+  */
+static bool benchmark_running(const struct _main_info *main_info) {
+	return 0 == main_info->benchmark.run_time ||
+	       rb_stats_now() - main_info->benchmark.start <
+			       main_info->benchmark.run_time * 1000000;
+}
+
+/** Log benchmark results, and append them as a JSON line to report file
+  @param main_info Main info, with benchmark config and state
+  @param sensors Number of sensors
+  */
+static void benchmark_report(const struct _main_info *main_info,
+			     size_t sensors) {
+	if (0 == main_info->benchmark.run_time &&
+	    NULL == main_info->benchmark.report_file) {
+		return;
+	}
+
+	struct rb_stats_snapshot *snapshot = calloc(1, sizeof(*snapshot));
+	if (NULL == snapshot) {
+		rdlog(LOG_ERR, "Couldn't allocate stats snapshot (OOM?)");
+		return;
+	}
+
+	rb_stats_snapshot(snapshot);
+	const uint64_t *counters = snapshot->counters;
+	const struct rb_stats_histogram_data *poll =
+			&snapshot->histograms[RB_STATS_H__SENSOR_POLL];
+	const double elapsed =
+			(double)(rb_stats_now() - main_info->benchmark.start) /
+			1e6;
+	const double sensors_per_second =
+			(double)counters[RB_STATS_C__SENSORS_PROCESSED] /
+			elapsed;
+	const double messages_per_second =
+			(double)counters[RB_STATS_C__MESSAGES] / elapsed;
+	const uint64_t p50 = rb_stats_histogram_quantile(poll, 0.5);
+	const uint64_t p99 = rb_stats_histogram_quantile(poll, 0.99);
+
+	rdlog(LOG_INFO,
+	      "Benchmark: %zu sensors, %" PRIu64 " threads, %.1fs: "
+	      "%.1f sensors/s, %.1f messages/s, %" PRIu64 "/%" PRIu64
+	      " cycles overrun, poll p50 %" PRIu64 "us p99 %" PRIu64 "us",
+	      sensors,
+	      main_info->threads,
+	      elapsed,
+	      sensors_per_second,
+	      messages_per_second,
+	      main_info->benchmark.cycle_overruns,
+	      main_info->benchmark.cycles,
+	      p50,
+	      p99);
+
+	const char *path = main_info->benchmark.report_file;
+	FILE *out = NULL;
+	if (NULL == path) {
+		goto done;
+	} else if (0 == strcmp(path, "-")) {
+		out = stdout;
+	} else if (NULL == (out = fopen(path, "a"))) {
+		rdlog(LOG_ERR,
+		      "Couldn't open benchmark report %s: %s",
+		      path,
+		      strerror(errno));
+		goto done;
+	}
+
+	json_object *report = json_object_new_object();
+	json_object_object_add(report,
+			       "sensors",
+			       json_object_new_int64((int64_t)sensors));
+	json_object_object_add(
+			report,
+			"threads",
+			json_object_new_int64((int64_t)main_info->threads));
+	json_object_object_add(
+			report,
+			"sleep_main",
+			json_object_new_int64((int64_t)main_info->sleep_main));
+	json_object_object_add(
+			report, "elapsed_s", json_object_new_double(elapsed));
+	json_object_object_add(report,
+			       "cycles",
+			       json_object_new_int64((int64_t)main_info
+							     ->benchmark
+							     .cycles));
+	json_object_object_add(report,
+			       "cycle_overruns",
+			       json_object_new_int64((int64_t)main_info
+							     ->benchmark
+							     .cycle_overruns));
+	json_object_object_add(report,
+			       "max_pending_sensors",
+			       json_object_new_int64(
+					       main_info->benchmark
+							       .max_pending_sensors));
+#define _X(ENUM, NAME)                                                         \
+	json_object_object_add(                                                \
+			report,                                                \
+			NAME,                                                  \
+			json_object_new_int64(                                 \
+					(int64_t)counters[RB_STATS_C__##ENUM]));
+	RB_STATS_COUNTERS_X
+#undef _X
+	json_object_object_add(report,
+			       "sensors_per_second",
+			       json_object_new_double(sensors_per_second));
+	json_object_object_add(report,
+			       "messages_per_second",
+			       json_object_new_double(messages_per_second));
+	json_object_object_add(
+			report,
+			"bytes_per_second",
+			json_object_new_double(
+					(double)counters[RB_STATS_C__BYTES] /
+					elapsed));
+	json_object_object_add(report,
+			       "poll_p50_us",
+			       json_object_new_int64((int64_t)p50));
+	json_object_object_add(report,
+			       "poll_p99_us",
+			       json_object_new_int64((int64_t)p99));
+
+	fprintf(out, "%s\n", json_object_to_json_string(report));
+	json_object_put(report);
+	if (out != stdout) {
+		fclose(out);
+	}
+
+done:
+	free(snapshot);
+}
+
+/// Admin listener status sources
+struct admin_status_ctx {
+	/// Protects sensors swap in reloads. Sensors locks are never taken
+	pthread_rwlock_t sensors_lock;
+	rb_sensors_array_t *sensors;	///< Current sensors
+	struct _worker_info *worker_info; ///< Worker info
+	time_t start;			  ///< rb_monitor start time
+};
+
+/// Sensor stats, to sort them
+struct admin_sensor_stats {
+	rb_sensor_t *sensor;
+	struct rb_sensor_stats stats;
+};
+
+/// Slowest last poll first
+static int admin_sensor_stats_cmp(const void *va, const void *vb) {
+	const struct admin_sensor_stats *a = va, *b = vb;
+	return sensor_cost_cmp(&a->stats.last_poll_cost,
+			       &b->stats.last_poll_cost);
+}
+
+/** Add process memory usage to status
+  @param status Status object
+  */
+static void admin_status_memory(json_object *status) {
+	json_object *memory = json_object_new_object();
+	struct rusage usage;
+	long pages_size = 0, pages_resident = 0;
+
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (statm) {
+		if (2 != fscanf(statm, "%ld %ld", &pages_size, &pages_resident)) {
+			pages_size = pages_resident = 0;
+		}
+		fclose(statm);
+	}
+
+	const int64_t page_kb = sysconf(_SC_PAGESIZE) / 1024;
+	json_object_object_add(memory,
+			       "vsz_kb",
+			       json_object_new_int64(pages_size * page_kb));
+	json_object_object_add(memory,
+			       "rss_kb",
+			       json_object_new_int64(pages_resident * page_kb));
+	if (0 == getrusage(RUSAGE_SELF, &usage)) {
+		json_object_object_add(memory,
+				       "max_rss_kb",
+				       json_object_new_int64(usage.ru_maxrss));
+	}
+	json_object_object_add(status, "memory", memory);
+}
+
+/** Add sensors stats to status, slowest first
+  @param status Status object
+  @param ctx Admin status context
+  */
+static void admin_status_sensors(json_object *status,
+				 struct admin_status_ctx *ctx) {
+	json_object *jsensors = json_object_new_array();
+	struct admin_sensor_stats *sensors = NULL;
+	size_t count = 0;
+
+	/* Take references, so reloads does not need to wait for printing */
+	pthread_rwlock_rdlock(&ctx->sensors_lock);
+	if (ctx->sensors->count > 0) {
+		sensors = calloc(ctx->sensors->count, sizeof(sensors[0]));
+	}
+	for (size_t i = 0; sensors && i < ctx->sensors->count; ++i) {
+		sensors[count].sensor = ctx->sensors->elms[i];
+		rb_sensor_get(sensors[count++].sensor);
+	}
+	pthread_rwlock_unlock(&ctx->sensors_lock);
+
+	for (size_t i = 0; i < count; ++i) {
+		rb_sensor_stats(sensors[i].sensor, &sensors[i].stats);
+	}
+	qsort(sensors, count, sizeof(sensors[0]), admin_sensor_stats_cmp);
+
+	for (size_t i = 0; i < count; ++i) {
+		const struct rb_sensor_stats *stats = &sensors[i].stats;
+		json_object *jsensor = json_object_new_object();
+		json_object_object_add(jsensor,
+				       "sensor_name",
+				       json_object_new_string(rb_sensor_name(
+						       sensors[i].sensor)));
+		json_object_object_add(jsensor,
+				       "last_poll",
+				       json_object_new_int64(stats->last_poll));
+		json_object_object_add(
+				jsensor,
+				"last_poll_duration_us",
+				json_object_new_int64((int64_t)stats->last_poll_cost
+								.wall_time_us));
+		const struct {
+			const char *key;
+			uint64_t val;
+		} totals[] = {
+				{"polls", stats->total.count},
+				{"errors", stats->total.errors},
+				{"wall_time_us", stats->total.wall_time_us},
+				{"cpu_time_us", stats->total.cpu_time_us},
+				{"messages", stats->total.messages},
+				{"bytes", stats->total.bytes},
+				{"snmp_requests", stats->total.snmp_requests},
+		};
+		for (size_t j = 0; j < RD_ARRAYSIZE(totals); ++j) {
+			json_object_object_add(
+					jsensor,
+					totals[j].key,
+					json_object_new_int64(
+							(int64_t)totals[j].val));
+		}
+		json_object_object_add(
+				jsensor,
+				"skipped",
+				json_object_new_int64((int64_t)stats->skipped));
+		json_object_array_add(jsensors, jsensor);
+		rb_sensor_put(sensors[i].sensor);
+	}
+
+	free(sensors);
+	json_object_object_add(status, "sensors", jsensors);
+}
+
+/** Generate admin listener status
+  @param vctx Admin status context
+  @return Status in JSON format
+  */
+static char *admin_status(void *vctx) {
+	struct admin_status_ctx *ctx = vctx;
+	const time_t now = time(NULL);
+	json_object *status = json_object_new_object();
+	if (NULL == status) {
+		return NULL;
+	}
+
+	json_object_object_add(status, "timestamp", json_object_new_int64(now));
+	json_object_object_add(status,
+			       "uptime",
+			       json_object_new_int64(now - ctx->start));
+	json_object_object_add(status,
+			       "queue_length",
+			       json_object_new_int64(sensor_queue_len(
+					       ctx->worker_info->queue)));
+	if (ctx->worker_info->rk) {
+		json_object_object_add(
+				status,
+				"kafka_outq_length",
+				json_object_new_int64(rd_kafka_outq_len(
+						ctx->worker_info->rk)));
+	}
+	admin_status_memory(status);
+	admin_status_sensors(status, ctx);
+
+	char *ret = strdup(json_object_to_json_string(status));
+	json_object_put(status);
+	return ret;
+}
+
 static void *rdkafka_delivery_reports_poll_f(void *void_worker_info) {
 	struct _worker_info *worker_info = void_worker_info;
 
@@ -633,13 +1437,248 @@ static void *rdkafka_delivery_reports_poll_f(void *void_worker_info) {
 	return NULL;
 }
 
+/** Parse monitors templates from config file
+  @param config JSON config
+  @return Monitors templates array. Empty if config has no templates
+  */
+static rb_monitors_templates_t *
+parse_monitors_templates(struct json_object *config) {
+	struct json_object *json_templates = NULL;
+	const int get_rc = json_object_object_get_ex(
+			config, CONFIG_MONITORS_TEMPLATES_KEY, &json_templates);
+	if (!get_rc) {
+		return rb_array_new(0);
+	}
+
+	return parse_rb_monitors_templates(json_templates);
+}
+
+/// Sensor of the previous config, that can be kept in a reload
+struct old_sensor {
+	uint64_t name_hash;  ///< Sensor name hash
+	rb_sensor_t *sensor; ///< Sensor. NULL if already kept
+};
+
+static int old_sensor_cmp(const void *va, const void *vb) {
+	const struct old_sensor *a = va, *b = vb;
+	return (a->name_hash > b->name_hash) - (a->name_hash < b->name_hash);
+}
+
+static uint64_t sensor_name_hash(const char *name) {
+	return rb_hash_buf(RB_HASH_INIT, name, strlen(name));
+}
+
+/** Create a name-sorted index of sensors, to search them by name
+  @param sensors Sensors to index
+  @return Index, or NULL if no memory
+  */
+static struct old_sensor *old_sensors_index(const rb_sensors_array_t *sensors) {
+	struct old_sensor *ret = calloc(sensors->count + 1, sizeof(ret[0]));
+	if (NULL == ret) {
+		rdlog(LOG_ERR, "Couldn't allocate old sensors index (OOM?)");
+		return NULL;
+	}
+
+	for (size_t i = 0; i < sensors->count; ++i) {
+		ret[i].sensor = sensors->elms[i];
+		ret[i].name_hash = sensor_name_hash(rb_sensor_name(ret[i].sensor));
+	}
+
+	qsort(ret, sensors->count, sizeof(ret[0]), old_sensor_cmp);
+	return ret;
+}
+
+/** Search for an unchanged sensor in old sensors index, and take it out of
+  the index
+  @param index Old sensors index
+  @param index_size Index length
+  @param name Sensor name
+  @param hash Sensor definition hash
+  @return Sensor with one extra reference, or NULL if not found
+  */
+static rb_sensor_t *old_sensors_take(struct old_sensor *index,
+				     size_t index_size,
+				     const char *name,
+				     uint64_t hash) {
+	const uint64_t name_hash = sensor_name_hash(name);
+	size_t low = 0, high = index_size;
+
+	/* Lower bound of name hash */
+	while (low < high) {
+		const size_t mid = low + (high - low) / 2;
+		if (index[mid].name_hash < name_hash) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	for (size_t i = low; i < index_size && index[i].name_hash == name_hash;
+	     ++i) {
+		rb_sensor_t *sensor = index[i].sensor;
+		if (sensor && rb_sensor_hash(sensor) == hash &&
+		    0 == strcmp(rb_sensor_name(sensor), name)) {
+			index[i].sensor = NULL;
+			rb_sensor_get(sensor);
+			return sensor;
+		}
+	}
+
+	return NULL;
+}
+
+/** Send the aggregation windows in progress of a sensor
+  @param worker_info Worker info
+  @param sensor Sensor
+  */
+static void sensor_flush_windows(struct _worker_info *worker_info,
+				 rb_sensor_t *sensor) {
+	rb_message_list messages;
+	rb_message_list_init(&messages);
+
+	rb_sensor_flush_windows(worker_info, sensor, &messages);
+	worker_process_sensor_send_messages(worker_info, &messages);
+}
+
+static int sensor_ptr_cmp(const void *va, const void *vb) {
+	const uintptr_t a = (uintptr_t) * (rb_sensor_t *const *)va;
+	const uintptr_t b = (uintptr_t) * (rb_sensor_t *const *)vb;
+	return (a > b) - (a < b);
+}
+
+/** Send the aggregation windows in progress of the sensors that are not kept
+  in a new sensors array, before they are released
+  @param worker_info Worker info
+  @param old_sensors Current sensors
+  @param new_sensors Sensors that replace them. NULL to flush all of them.
+  */
+static void sensors_flush_windows(struct _worker_info *worker_info,
+				  const rb_sensors_array_t *old_sensors,
+				  const rb_sensors_array_t *new_sensors) {
+	rb_sensor_t **kept = NULL;
+	const size_t kept_count = new_sensors ? new_sensors->count : 0;
+
+	if (kept_count > 0) {
+		kept = malloc(kept_count * sizeof(kept[0]));
+		if (NULL == kept) {
+			rdlog(LOG_ERR,
+			      "Couldn't allocate sensors windows flush (OOM?)");
+			return;
+		}
+		memcpy(kept, new_sensors->elms, kept_count * sizeof(kept[0]));
+		qsort(kept, kept_count, sizeof(kept[0]), sensor_ptr_cmp);
+	}
+
+	for (size_t i = 0; i < old_sensors->count; ++i) {
+		rb_sensor_t *sensor = old_sensors->elms[i];
+		if (NULL == kept || NULL == bsearch(&sensor,
+						    kept,
+						    kept_count,
+						    sizeof(kept[0]),
+						    sensor_ptr_cmp)) {
+			sensor_flush_windows(worker_info, sensor);
+		}
+	}
+
+	free(kept);
+}
+
+/** Release a sensors array and its references to the sensors
+  @param sensors Sensors array
+  */
+static void sensors_array_done(rb_sensors_array_t *sensors) {
+	for (size_t i = 0; i < sensors->count; ++i) {
+		rb_sensor_put(sensors->elms[i]);
+	}
+	rb_sensors_array_done(sensors);
+}
+
+/// Sensors parsing state, shared between parsing threads
+struct parse_sensors_ctx {
+	json_object *json_sensors;		///< Sensors JSON array
+	const struct _worker_info *worker_info; ///< Worker info
+	rb_sensor_t **sensors; ///< Sensors, in config order. Already set
+			       ///  ones are not parsed
+	size_t count;	  ///< Number of sensors
+	size_t next;	   ///< Next sensor to parse
+};
+
+static void *parse_sensors_worker(void *vctx) {
+	struct parse_sensors_ctx *ctx = vctx;
+	size_t i;
+
+	while ((i = ATOMIC_OP(fetch, add, &ctx->next, 1)) < ctx->count) {
+		if (NULL == ctx->sensors[i]) {
+			json_object *json_sensor = json_object_array_get_idx(
+					ctx->json_sensors, i);
+			ctx->sensors[i] = parse_rb_sensor(json_sensor,
+							  ctx->worker_info);
+		}
+	}
+
+	return NULL;
+}
+
+/** Parse sensors using many threads. Sensors are independent of each other,
+  and the expensive part (monitors dependencies, evaluators creation) does
+  not need to be serialized.
+  @param ctx Parsing context
+  @param threads Maximum number of threads to use
+  */
+static void parse_sensors_parallel(struct parse_sensors_ctx *ctx,
+				   size_t threads) {
+	size_t started = 0;
+	pthread_t *pool = NULL;
+
+	if (threads > ctx->count) {
+		threads = ctx->count;
+	}
+
+	if (threads > 1) {
+		pool = calloc(threads - 1, sizeof(pool[0]));
+		if (NULL == pool) {
+			rdlog(LOG_WARNING,
+			      "Couldn't allocate parsing threads, parsing "
+			      "sensors sequentially");
+		}
+	}
+
+	for (; pool && started < threads - 1; ++started) {
+		const int create_rc = pthread_create(&pool[started],
+						     NULL,
+						     parse_sensors_worker,
+						     ctx);
+		if (0 != create_rc) {
+			rdlog(LOG_WARNING,
+			      "Couldn't create parsing thread: %s",
+			      strerror(create_rc));
+			break;
+		}
+	}
+
+	/* This thread also parses */
+	parse_sensors_worker(ctx);
+
+	for (size_t i = 0; i < started; ++i) {
+		pthread_join(pool[i], NULL);
+	}
+	free(pool);
+}
+
 /** Parse sensors from config file
-  @param config Sensors list
-  @param sensor_json JSON config
+  @param worker_info Worker info
+  @param config JSON config
+  @param old_sensors Sensors of the previous config. Sensors with the same
+  name and definition are kept, instead of parsing them again. Can be NULL.
+  @param threads Number of threads to parse sensors with
   @return Sensors array
   */
-static rb_sensors_array_t *
-parse_sensors(struct _worker_info *worker_info, struct json_object *config) {
+static rb_sensors_array_t *parse_sensors(struct _worker_info *worker_info,
+					 struct json_object *config,
+					 const rb_sensors_array_t *old_sensors,
+					 size_t threads) {
+	struct old_sensor *old_index = NULL;
+	size_t kept_sensors = 0;
 	struct json_object *json_sensors = NULL;
 	const int get_rc = json_object_object_get_ex(
 			config, CONFIG_SENSORS_KEY, &json_sensors);
@@ -660,27 +1699,229 @@ parse_sensors(struct _worker_info *worker_info, struct json_object *config) {
 	const size_t sensors_length =
 			(size_t)json_object_array_length(json_sensors);
 	rb_sensors_array_t *ret = rb_sensors_array_new(sensors_length);
+	if (NULL == ret) {
+		return NULL;
+	}
 
-	for (size_t i = 0; i < sensors_length; ++i) {
-		if (rb_sensors_array_full(ret)) {
-			rdlog(LOG_CRIT,
-			      "Sensors array full at %zu, can't add "
-			      "%zu",
-			      ret->size,
-			      i);
-			break;
-		}
+	struct parse_sensors_ctx ctx = {
+			.json_sensors = json_sensors,
+			.worker_info = worker_info,
+			.sensors = calloc(sensors_length + 1,
+					  sizeof(ctx.sensors[0])),
+			.count = sensors_length,
+	};
+	if (NULL == ctx.sensors) {
+		rdlog(LOG_ERR, "Couldn't allocate sensors (OOM?)");
+		rb_sensors_array_done(ret);
+		return NULL;
+	}
+
+	if (old_sensors) {
+		old_index = old_sensors_index(old_sensors);
+	}
 
+	for (size_t i = 0; old_index && i < sensors_length; ++i) {
 		json_object *json_sensor =
 				json_object_array_get_idx(json_sensors, i);
-		rb_sensor_t *sensor = parse_rb_sensor(json_sensor, worker_info);
-		if (sensor) {
-			rb_sensor_array_add(ret, sensor);
+		const char *sensor_name = PARSE_CJSON_CHILD_STR(
+				json_sensor, "sensor_name", NULL);
+		if (sensor_name) {
+			ctx.sensors[i] = old_sensors_take(
+					old_index,
+					old_sensors->count,
+					sensor_name,
+					rb_sensor_json_hash(json_sensor,
+							    worker_info));
+		}
+
+		if (ctx.sensors[i]) {
+			kept_sensors++;
+		}
+	}
+
+	parse_sensors_parallel(&ctx, threads);
+
+	for (size_t i = 0; i < sensors_length; ++i) {
+		if (ctx.sensors[i]) {
+			rb_sensor_array_add(ret, ctx.sensors[i]);
+		}
+	}
+
+	if (old_sensors) {
+		rdlog(LOG_INFO,
+		      "Sensors reloaded: %zu kept, %zu new or changed, %zu "
+		      "removed or changed",
+		      kept_sensors,
+		      ret->count - kept_sensors,
+		      old_sensors->count - kept_sensors);
+	}
+
+	free(old_index);
+	free(ctx.sensors);
+	return ret;
+}
+
+/** Config to parse sensors from: config file sensors, plus ZooKeeper ones
+  this instance owns.
+  @param config Config file
+  @param main_info Main info, with ZooKeeper owned sensors
+  @return New reference to the config to parse sensors from
+  */
+static json_object *sensors_config(json_object *config,
+				   const struct _main_info *main_info) {
+#ifdef HAVE_ZOOKEEPER
+	json_object *config_sensors = NULL;
+	if (NULL == main_info->zk_sensors ||
+	    !json_object_object_get_ex(
+			    config, CONFIG_SENSORS_KEY, &config_sensors) ||
+	    !json_object_is_type(config_sensors, json_type_array)) {
+		return json_object_get(config);
+	}
+
+	json_object *ret = json_object_new_object();
+	json_object *sensors = json_object_new_array();
+	if (NULL == ret || NULL == sensors) {
+		rdlog(LOG_ERR, "Couldn't allocate sensors config (OOM?)");
+		json_object_put(ret);
+		json_object_put(sensors);
+		return json_object_get(config);
+	}
+
+	json_object *arrays[] = {config_sensors, main_info->zk_sensors};
+	for (size_t i = 0; i < RD_ARRAYSIZE(arrays); ++i) {
+		const size_t len = (size_t)json_object_array_length(arrays[i]);
+		for (size_t j = 0; j < len; ++j) {
+			json_object_array_add(
+					sensors,
+					json_object_get(json_object_array_get_idx(
+							arrays[i], j)));
 		}
 	}
+	json_object_object_add(ret, CONFIG_SENSORS_KEY, sensors);
+	return ret;
+#else
+	(void)main_info;
+	return json_object_get(config);
+#endif
+}
+
+/** Replace monitors templates, waiting for sensors being parsed with the
+  current ones in other threads
+  @param worker_info Worker info
+  @param templates New templates
+  @return Previous templates
+  */
+static rb_monitors_templates_t *
+swap_monitors_templates(struct _worker_info *worker_info,
+			rb_monitors_templates_t *templates) {
+	pthread_mutex_lock(&worker_info->monitors_templates_mutex);
+	rb_monitors_templates_t *ret = worker_info->monitors_templates;
+	worker_info->monitors_templates = templates;
+	pthread_mutex_unlock(&worker_info->monitors_templates_mutex);
+	return ret;
+}
+
+/** Reload sensors and monitors templates from config file. Unchanged sensors
+  keep their state; sensors being processed by workers are released when
+  workers are done with them.
+  @param config_path Config file path
+  @param worker_info Worker info
+  @param main_info Main info. Its config is replaced on success
+  @param sensors Current sensors
+  @return New sensors array, or current one if reload was not possible. Caller
+  is responsible of releasing current sensors if a new array is returned.
+  @note Only sensors and monitors templates are reloaded, not conf section
+  */
+static rb_sensors_array_t *reload_config(const char *config_path,
+					 struct _worker_info *worker_info,
+					 struct _main_info *main_info,
+					 rb_sensors_array_t *sensors) {
+	rdlog(LOG_INFO, "Reloading config file %s", config_path);
+
+	struct json_object *config = json_object_from_file(config_path);
+	if (NULL == config) {
+		rdlog(LOG_ERR,
+		      "Could not open config file %s, keeping old config",
+		      config_path);
+		return sensors;
+	}
+
+	rb_monitors_templates_t *new_templates =
+			parse_monitors_templates(config);
+	if (NULL == new_templates) {
+		rdlog(LOG_ERR, "Couldn't parse monitors templates, keeping old "
+			       "config");
+		goto err;
+	}
+
+	rb_monitors_templates_t *old_templates =
+			swap_monitors_templates(worker_info, new_templates);
+
+	json_object *config_sensors = sensors_config(config, main_info);
+	rb_sensors_array_t *new_sensors = parse_sensors(
+			worker_info, config_sensors, sensors, main_info->threads);
+	json_object_put(config_sensors);
+	if (NULL == new_sensors) {
+		rdlog(LOG_ERR, "Couldn't parse sensors, keeping old config");
+		rb_monitors_templates_done(
+				swap_monitors_templates(worker_info,
+							old_templates));
+		goto err;
+	}
+
+	rb_monitors_templates_done(old_templates);
+	json_object_put(main_info->config);
+	main_info->config = config;
+	return new_sensors;
+
+err:
+	json_object_put(config);
+	return sensors;
+}
+
+#ifdef HAVE_ZOOKEEPER
+/** Rebuild sensors if the ZooKeeper sensors this instance owns changed.
+  Sensors that stay in this instance keep their state.
+  @param worker_info Worker info
+  @param main_info Main info, with ZooKeeper handler and owned sensors
+  @param sensors Current sensors
+  @return New sensors array, or current one if nothing changed. Caller is
+  responsible of releasing current sensors if a new array is returned.
+  */
+static rb_sensors_array_t *zk_update_sensors(struct _worker_info *worker_info,
+					     struct _main_info *main_info,
+					     rb_sensors_array_t *sensors) {
+	if (NULL == main_info->zk) {
+		return sensors;
+	}
+
+	json_object *owned = rb_monitor_zk_owned_sensors(
+			main_info->zk, &main_info->zk_generation);
+	if (NULL == owned) {
+		return sensors;
+	}
+
+	rdlog(LOG_INFO,
+	      "ZooKeeper sensors changed, this instance owns %d",
+	      json_object_array_length(owned));
+	if (main_info->zk_sensors) {
+		json_object_put(main_info->zk_sensors);
+	}
+	main_info->zk_sensors = owned;
+
+	json_object *config = sensors_config(main_info->config, main_info);
+	rb_sensors_array_t *ret = parse_sensors(
+			worker_info, config, sensors, main_info->threads);
+	json_object_put(config);
+	if (NULL == ret) {
+		rdlog(LOG_ERR,
+		      "Couldn't parse ZooKeeper sensors, keeping old ones");
+		return sensors;
+	}
 
 	return ret;
 }
+#endif
 
 int main(int argc, char *argv[]) {
 	bool ret;
@@ -690,7 +1931,9 @@ int main(int argc, char *argv[]) {
 	struct json_object *default_config =
 			json_tokener_parse(str_default_config);
 	struct _worker_info worker_info;
-	struct _main_info main_info = {0};
+	struct _main_info main_info = {
+			.stats.slow_sensors_top = SLOW_SENSORS_TOP_DEFAULT,
+	};
 	int debug_severity = LOG_INFO;
 	pthread_t rdkafka_delivery_reports_poll_thread;
 
@@ -750,7 +1993,7 @@ int main(int argc, char *argv[]) {
 
 	signal(SIGINT, sigproc);
 	signal(SIGTERM, sigproc);
-	signal(SIGHUP, SIG_IGN);
+	signal(SIGHUP, sighup_proc);
 
 	if (FALSE == json_object_object_get_ex(config_file, "conf", &config)) {
 		rdlog(LOG_WARNING,
@@ -776,7 +2019,17 @@ int main(int argc, char *argv[]) {
 	snmp_sess_init(&worker_info.default_session); /* set defaults */
 	worker_info.default_session.version = SNMP_VERSION_1;
 	pthread_mutex_init(&worker_info.snmp_session_mutex, 0);
+	pthread_mutex_init(&worker_info.monitors_templates_mutex, 0);
 	main_info.syslog_indent = "rb_monitor";
+	if (NULL == main_info.stats.sensor_name) {
+		if (0 != gethostname(main_info.stats.hostname,
+				     sizeof(main_info.stats.hostname) - 1)) {
+			snprintf(main_info.stats.hostname,
+				 sizeof(main_info.stats.hostname),
+				 "rb_monitor");
+		}
+		main_info.stats.sensor_name = main_info.stats.hostname;
+	}
 	openlog(main_info.syslog_indent, 0, LOG_USER);
 
 	// rd_init();
@@ -850,8 +2103,46 @@ int main(int argc, char *argv[]) {
 	}
 #endif /* HAVE_RBHTTP */
 
+	if (worker_info.output_file_path) {
+		worker_info.output_file =
+				0 == strcmp(worker_info.output_file_path, "-")
+						? stdout
+						: fopen(worker_info.output_file_path,
+							"w");
+		if (!worker_info.output_file) {
+			rdlog(LOG_CRIT,
+			      "Couldn't open output file %s: %s",
+			      worker_info.output_file_path,
+			      strerror(errno));
+			exit(1);
+		}
+		worker_info.message_encodings |=
+				RB_MESSAGE_F(worker_info.output_file_encoding);
+	}
+
+	if (worker_info.kafka_broker) {
+		worker_info.message_encodings |=
+				RB_MESSAGE_F(worker_info.kafka_encoding);
+	}
+#ifdef HAVE_RBHTTP
+	if (worker_info.http_handler) {
+		worker_info.message_encodings |=
+				RB_MESSAGE_F(worker_info.http_encoding);
+	}
+#endif
+
+	worker_info.monitors_templates = parse_monitors_templates(config_file);
+	if (!worker_info.monitors_templates) {
+		rdlog(LOG_ERR, "Couldn't parse monitors templates");
+		exit(1);
+	}
+
+	main_info.config = json_object_get(config_file);
 	rb_sensors_array_t *sensors_array =
-			parse_sensors(&worker_info, config_file);
+			parse_sensors(&worker_info,
+				      config_file,
+				      NULL,
+				      main_info.threads);
 	if (!sensors_array) {
 		rdlog(LOG_ERR, "Couldn't create sensor array (OOM?)");
 		exit(1);
@@ -876,17 +2167,68 @@ int main(int argc, char *argv[]) {
 			       (void *)&worker_info);
 	}
 
+	struct admin_status_ctx admin_ctx = {
+			.sensors = sensors_array,
+			.worker_info = &worker_info,
+			.start = time(NULL),
+	};
+	pthread_rwlock_init(&admin_ctx.sensors_lock, NULL);
+	struct rb_admin *admin =
+			main_info.admin_socket
+					? rb_admin_new(main_info.admin_socket,
+						       admin_status,
+						       &admin_ctx)
+					: NULL;
+
+	main_info.benchmark.start = rb_stats_now();
 	while (run) {
-		for (size_t i = 0; i < sensors_array->count && run; ++i) {
+		if (!benchmark_running(&main_info)) {
+			rdlog(LOG_INFO, "Run time is over");
+			run = 0;
+			break;
+		}
+
+		rb_sensors_array_t *new_sensors = sensors_array;
+		if (reload) {
+			reload = 0;
+			new_sensors = reload_config(config_path,
+						    &worker_info,
+						    &main_info,
+						    sensors_array);
+		}
+#ifdef HAVE_ZOOKEEPER
+		else {
+			new_sensors = zk_update_sensors(
+					&worker_info, &main_info, sensors_array);
+		}
+#endif
+
+		if (new_sensors != sensors_array) {
+			pthread_rwlock_wrlock(&admin_ctx.sensors_lock);
+			admin_ctx.sensors = new_sensors;
+			pthread_rwlock_unlock(&admin_ctx.sensors_lock);
+			sensors_flush_windows(&worker_info,
+					      sensors_array,
+					      new_sensors);
+			sensors_array_done(sensors_array);
+			sensors_array = new_sensors;
+		}
+
+		benchmark_cycle(&main_info, &worker_info);
+		for (size_t i = 0; i < sensors_array->count && run && !reload &&
+				   benchmark_running(&main_info);
+		     ++i) {
 			rb_sensor_t *sensor = sensors_array->elms[i];
 			rb_sensor_get(sensor);
 			queue_sensor(worker_info.queue, sensor);
+			emit_stats(&main_info, &worker_info, sensors_array);
 			if (main_info.sleep_main > 0) {
 				usleep((useconds_t)((main_info.sleep_main * 1000000) /
 						    sensors_array->count));
 			}
 		}
 		if (sensors_array->count == 0) {
+			emit_stats(&main_info, &worker_info, sensors_array);
 			sleep((unsigned int)main_info.sleep_main);
 		}
 	}
@@ -896,8 +2238,28 @@ int main(int argc, char *argv[]) {
 		pthread_join(pd_thread[i], NULL);
 	}
 	free(pd_thread);
+	benchmark_report(&main_info, sensors_array->count);
+	sensors_flush_windows(&worker_info, sensors_array, NULL);
+
+	if (admin) {
+		rb_admin_done(admin);
+	}
+	pthread_rwlock_destroy(&admin_ctx.sensors_lock);
+
+	/* ZooKeeper cached sensors reference monitors templates */
+#ifdef HAVE_ZOOKEEPER
+	if (main_info.zk) {
+		stop_zk(main_info.zk);
+	}
+	if (main_info.zk_sensors) {
+		json_object_put(main_info.zk_sensors);
+	}
+#endif
 
-	rb_sensors_array_done(sensors_array);
+	sensors_array_done(sensors_array);
+	rb_monitors_templates_done(worker_info.monitors_templates);
+	json_object_put(main_info.config);
+	free(main_info.stats.prev);
 
 	if (worker_info.kafka_broker) {
 		int msg_left = 0;
@@ -927,10 +2289,16 @@ int main(int argc, char *argv[]) {
 	}
 #endif
 
+	if (worker_info.output_file && worker_info.output_file != stdout) {
+		fclose(worker_info.output_file);
+	}
+
 	pthread_mutex_destroy(&worker_info.snmp_session_mutex);
+	pthread_mutex_destroy(&worker_info.monitors_templates_mutex);
 	json_object_put(default_config);
 	json_object_put(config_file);
 	sensor_queue_done(&queue);
+	rb_stats_done();
 	closelog();
 
 	return ret;
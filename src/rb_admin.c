@@ -0,0 +1,204 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include "rb_admin.h"
+
+#include <librd/rdlog.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/// Time to check if listener has to stop
+#define ADMIN_POLL_TIMEOUT_MS 500
+/// Pending connections queue
+#define ADMIN_LISTEN_BACKLOG 8
+
+struct rb_admin {
+#ifndef NDEBUG
+#define RB_ADMIN_MAGIC 0xAD1AAD1AAD1AAD1AL
+	uint64_t magic;
+#endif
+	int fd;			      ///< Listening socket
+	int run;		      ///< Listener thread has to keep running
+	pthread_t thread;	     ///< Listener thread
+	rb_admin_status_cb status_cb; ///< Status callback
+	void *opaque;		      ///< Status callback opaque
+	struct sockaddr_un addr;      ///< Listening address
+};
+
+/** Write all buffer in a socket
+  @param fd Socket
+  @param buf Buffer
+  @param len Buffer length
+  */
+static void admin_write_all(int fd, const char *buf, size_t len) {
+	while (len > 0) {
+		const ssize_t rc = send(fd, buf, len, MSG_NOSIGNAL);
+		if (rc < 0 && EINTR == errno) {
+			continue;
+		} else if (rc <= 0) {
+			char errbuf[BUFSIZ];
+			rdlog(LOG_WARNING,
+			      "Couldn't send admin status: %s",
+			      strerror_r(errno, errbuf, sizeof(errbuf)));
+			return;
+		}
+
+		buf += rc;
+		len -= (size_t)rc;
+	}
+}
+
+/** Answer an admin connection
+  @param admin Admin listener
+  @param fd Connection socket
+  */
+static void admin_serve(struct rb_admin *admin, int fd) {
+	char *status = admin->status_cb(admin->opaque);
+	if (status) {
+		admin_write_all(fd, status, strlen(status));
+		admin_write_all(fd, "\n", 1);
+		free(status);
+	}
+	close(fd);
+}
+
+static void *admin_thread(void *vadmin) {
+	struct rb_admin *admin = vadmin;
+	struct pollfd pfd = {
+			.fd = admin->fd, .events = POLLIN,
+	};
+
+	while (ATOMIC_OP(add, fetch, &admin->run, 0)) {
+		const int poll_rc = poll(&pfd, 1, ADMIN_POLL_TIMEOUT_MS);
+		if (poll_rc <= 0) {
+			continue;
+		}
+
+		/* Commands launched by workers must not inherit the socket */
+		const int fd = accept4(admin->fd, NULL, NULL, SOCK_CLOEXEC);
+		if (fd < 0) {
+			char errbuf[BUFSIZ];
+			rdlog(LOG_WARNING,
+			      "Couldn't accept admin connection: %s",
+			      strerror_r(errno, errbuf, sizeof(errbuf)));
+			continue;
+		}
+
+		admin_serve(admin, fd);
+	}
+
+	return NULL;
+}
+
+struct rb_admin *
+rb_admin_new(const char *path, rb_admin_status_cb status_cb, void *opaque) {
+	char errbuf[BUFSIZ];
+	struct rb_admin *admin = calloc(1, sizeof(*admin));
+	if (NULL == admin) {
+		rdlog(LOG_ERR, "Couldn't allocate admin listener (OOM?)");
+		return NULL;
+	}
+
+#ifdef RB_ADMIN_MAGIC
+	admin->magic = RB_ADMIN_MAGIC;
+#endif
+	admin->status_cb = status_cb;
+	admin->opaque = opaque;
+	admin->run = 1;
+	admin->addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(admin->addr.sun_path)) {
+		rdlog(LOG_ERR, "Admin socket path %s is too long", path);
+		goto err_path;
+	}
+	strcpy(admin->addr.sun_path, path);
+
+	admin->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (admin->fd < 0) {
+		rdlog(LOG_ERR,
+		      "Couldn't create admin socket: %s",
+		      strerror_r(errno, errbuf, sizeof(errbuf)));
+		goto err_path;
+	}
+
+	/* Socket of a previous run. Don't remove anything else */
+	struct stat path_stat;
+	if (0 == lstat(path, &path_stat)) {
+		if (!S_ISSOCK(path_stat.st_mode)) {
+			rdlog(LOG_ERR,
+			      "Admin socket path %s exists and it is not a "
+			      "socket",
+			      path);
+			goto err_socket;
+		}
+		unlink(path);
+	}
+
+	/* Only owner can query, and nobody can connect before listen */
+	if (0 != bind(admin->fd,
+		      (struct sockaddr *)&admin->addr,
+		      sizeof(admin->addr)) ||
+	    0 != chmod(path, S_IRUSR | S_IWUSR) ||
+	    0 != listen(admin->fd, ADMIN_LISTEN_BACKLOG)) {
+		rdlog(LOG_ERR,
+		      "Couldn't listen in admin socket %s: %s",
+		      path,
+		      strerror_r(errno, errbuf, sizeof(errbuf)));
+		goto err_socket;
+	}
+
+	const int create_rc =
+			pthread_create(&admin->thread, NULL, admin_thread, admin);
+	if (0 != create_rc) {
+		rdlog(LOG_ERR,
+		      "Couldn't create admin thread: %s",
+		      strerror_r(create_rc, errbuf, sizeof(errbuf)));
+		unlink(path);
+		goto err_socket;
+	}
+
+	return admin;
+
+err_socket:
+	close(admin->fd);
+err_path:
+	free(admin);
+	return NULL;
+}
+
+void rb_admin_done(struct rb_admin *admin) {
+#ifdef RB_ADMIN_MAGIC
+	assert(RB_ADMIN_MAGIC == admin->magic);
+#endif
+
+	ATOMIC_OP(sub, fetch, &admin->run, 1);
+	pthread_join(admin->thread, NULL);
+	close(admin->fd);
+	unlink(admin->addr.sun_path);
+	free(admin);
+}
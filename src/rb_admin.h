@@ -0,0 +1,45 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/** Admin listener: a Unix domain socket, served by its own thread, that
+  answers every connection with the current rb_monitor status and closes it.
+  */
+struct rb_admin;
+
+/** Status callback
+  @param opaque Opaque given to rb_admin_new
+  @return Status to answer with, NUL terminated and allocated with malloc.
+  NULL if status couldn't be generated.
+  */
+typedef char *(*rb_admin_status_cb)(void *opaque);
+
+/** Start an admin listener
+  @param path Unix socket path. If it exists, it will be replaced
+  @param status_cb Callback to generate status
+  @param opaque Opaque to send to status_cb
+  @return New admin listener, or NULL if error
+  */
+struct rb_admin *
+rb_admin_new(const char *path, rb_admin_status_cb status_cb, void *opaque);
+
+/** Stop and release an admin listener
+  @param admin Admin listener
+  */
+void rb_admin_done(struct rb_admin *admin);
@@ -0,0 +1,577 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "config.h"
+
+#include "rb_columnar.h"
+
+#include "rb_msgpack.h"
+
+#include <librd/rd.h>
+#include <librd/rdlog.h>
+
+#include <json-c/json.h>
+#include <json-c/printbuf.h>
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct rb_columnar {
+#ifndef NDEBUG
+#define RB_COLUMNAR_MAGIC 0xC0111AC0C0111AC0L
+	uint64_t magic;
+#endif
+	json_object *rows; ///< Array of rows, in arrival order
+	/// Marker of JSON null values in columns, that json-c stores as NULL
+	json_object *null;
+};
+
+/// Columns types. See rb_columnar.h
+enum columnar_type {
+	COLUMNAR_T_DELTA,
+	COLUMNAR_T_DOUBLE,
+	COLUMNAR_T_DICT,
+	COLUMNAR_T_VALUES,
+};
+
+/// Keys that JSON messages print as strings, but are numbers
+static const char *columnar_double_keys[] = {"value", "min", "max", "sum"};
+
+/// Strings dictionary of a block
+struct columnar_dict {
+	json_object *index;   ///< String -> position in strings
+	json_object *strings; ///< Strings, in order of first appearance
+};
+
+struct rb_columnar *rb_columnar_new(void) {
+	struct rb_columnar *ret = calloc(1, sizeof(*ret));
+	if (NULL == ret) {
+		rdlog(LOG_ERR, "Couldn't allocate columnar batch (OOM?)");
+		return NULL;
+	}
+
+	ret->rows = json_object_new_array();
+	ret->null = json_object_new_object();
+	if (NULL == ret->rows || NULL == ret->null) {
+		rdlog(LOG_ERR, "Couldn't allocate columnar batch rows (OOM?)");
+		if (ret->rows) {
+			json_object_put(ret->rows);
+		}
+		if (ret->null) {
+			json_object_put(ret->null);
+		}
+		free(ret);
+		return NULL;
+	}
+
+#ifdef RB_COLUMNAR_MAGIC
+	ret->magic = RB_COLUMNAR_MAGIC;
+#endif
+	return ret;
+}
+
+static void assert_rb_columnar(const struct rb_columnar *batch) {
+#ifdef RB_COLUMNAR_MAGIC
+	assert(RB_COLUMNAR_MAGIC == batch->magic);
+#else
+	(void)batch;
+#endif
+}
+
+int rb_columnar_add_row(struct rb_columnar *batch, json_object *row) {
+	assert_rb_columnar(batch);
+
+	if (!json_object_is_type(row, json_type_object)) {
+		rdlog(LOG_ERR, "Columnar row is not a JSON object");
+		if (row) {
+			json_object_put(row);
+		}
+		return -1;
+	}
+
+	json_object_array_add(batch->rows, row);
+	return 0;
+}
+
+int rb_columnar_add_json_text(struct rb_columnar *batch, const char *text) {
+	assert_rb_columnar(batch);
+
+	json_object *row = json_tokener_parse(text);
+	if (NULL == row || !json_object_is_type(row, json_type_object)) {
+		rdlog(LOG_ERR, "Columnar row is not a JSON object: %s", text);
+		if (row) {
+			json_object_put(row);
+		}
+		return -1;
+	}
+
+	return rb_columnar_add_row(batch, row);
+}
+
+size_t rb_columnar_rows(const struct rb_columnar *batch) {
+	assert_rb_columnar(batch);
+	return (size_t)json_object_array_length(batch->rows);
+}
+
+/** Split rows in columns
+  @param batch Batch
+  @return Map from key to array of its values in every row, with NULL (or
+  shorter array) if the row does not have it, and batch->null if the value
+  is JSON null. NULL if no memory.
+  */
+static json_object *columnar_columns(const struct rb_columnar *batch) {
+	json_object *ret = json_object_new_object();
+	const int rows = json_object_array_length(batch->rows);
+
+	for (int i = 0; ret && i < rows; ++i) {
+		json_object *row = json_object_array_get_idx(batch->rows, i);
+		json_object_object_foreach(row, key, val) {
+			json_object *column = NULL;
+			if (!json_object_object_get_ex(ret, key, &column)) {
+				column = json_object_new_array();
+				if (NULL == column) {
+					json_object_put(ret);
+					ret = NULL;
+					break;
+				}
+				json_object_object_add(ret, key, column);
+			}
+
+			json_object *cval = val ? val : batch->null;
+			json_object_array_put_idx(
+					column, i, json_object_get(cval));
+		}
+	}
+
+	if (NULL == ret) {
+		rdlog(LOG_ERR, "Couldn't allocate columnar columns (OOM?)");
+	}
+
+	return ret;
+}
+
+/** Check if a key is one of columnar_double_keys
+  @param key Key
+  @return true if it is
+  */
+static bool columnar_is_double_key(const char *key) {
+	for (size_t i = 0; i < RD_ARRAYSIZE(columnar_double_keys); ++i) {
+		if (0 == strcmp(key, columnar_double_keys[i])) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/** Value of a "double" column
+  @param val JSON value
+  @param is_double_key Column is one of columnar_double_keys
+  @param d Value
+  @return true if val can be a double column value
+  */
+static bool columnar_double(json_object *val, bool is_double_key, double *d) {
+	switch (json_object_get_type(val)) {
+	case json_type_int:
+	case json_type_double:
+		*d = json_object_get_double(val);
+		return true;
+
+	case json_type_string:
+		if (is_double_key) {
+			const char *str = json_object_get_string(val);
+			char *end = NULL;
+			*d = strtod(str, &end);
+			return end != str && '\0' == *end;
+		}
+		return false;
+
+	case json_type_null:
+	case json_type_boolean:
+	case json_type_object:
+	case json_type_array:
+	default:
+		return false;
+	};
+}
+
+/** Choose the type of a column
+  @param key Column key
+  @param column Column values
+  @param rows Number of rows
+  @param null Marker of JSON null values
+  @return Column type
+  */
+static enum columnar_type columnar_column_type(const char *key,
+					       json_object *column,
+					       size_t rows,
+					       json_object *null) {
+	size_t present = 0, ints = 0, doubles = 0, numbers = 0, strings = 0;
+	const bool is_double_key = columnar_is_double_key(key);
+
+	for (size_t i = 0; i < rows; ++i) {
+		double d;
+		json_object *val = json_object_array_get_idx(column, (int)i);
+		if (NULL == val) {
+			continue;
+		} else if (null == val) {
+			/* Only "values" columns can tell null from missing */
+			return COLUMNAR_T_VALUES;
+		}
+
+		present++;
+		const json_type type = json_object_get_type(val);
+		ints += json_type_int == type;
+		doubles += json_type_double == type;
+		strings += json_type_string == type;
+		numbers += columnar_double(val, is_double_key, &d);
+	}
+
+	if (present == rows && ints == rows && !is_double_key) {
+		return COLUMNAR_T_DELTA;
+	} else if (numbers == present && (is_double_key || doubles > 0)) {
+		return COLUMNAR_T_DOUBLE;
+	} else if (strings == present) {
+		return COLUMNAR_T_DICT;
+	} else {
+		return COLUMNAR_T_VALUES;
+	}
+}
+
+/** Append a "delta" column data
+  @param buf Buffer
+  @param column Column values
+  @param rows Number of rows
+  @return 0 if success
+  */
+static int
+columnar_encode_delta(struct printbuf *buf, json_object *column, size_t rows) {
+	uint64_t prev = 0;
+
+	if (rb_msgpack_array(buf, (uint32_t)rows) < 0) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < rows; ++i) {
+		const uint64_t val = (uint64_t)json_object_get_int64(
+				json_object_array_get_idx(column, (int)i));
+		/* Two's complement difference, it can't overflow */
+		if (rb_msgpack_int(buf, (int64_t)(val - prev)) < 0) {
+			return -1;
+		}
+		prev = val;
+	}
+
+	return 0;
+}
+
+/** Append a "double" column data, and its present bitmap if needed
+  @param buf Buffer
+  @param key Column key
+  @param column Column values
+  @param rows Number of rows
+  @return 0 if success
+  */
+static int columnar_encode_double(struct printbuf *buf,
+				  const char *key,
+				  json_object *column,
+				  size_t rows) {
+	const size_t present_len = (rows + 7) / 8;
+	uint8_t *present = calloc(1, present_len);
+	bool all_present = true;
+	int rc = -1;
+
+	if (NULL == present) {
+		rdlog(LOG_ERR, "Couldn't allocate columnar bitmap (OOM?)");
+		return -1;
+	}
+
+	const bool is_double_key = columnar_is_double_key(key);
+	if (rb_msgpack_bin_header(buf, rows * sizeof(double)) < 0) {
+		goto err;
+	}
+
+	for (size_t i = 0; i < rows; ++i) {
+		char aux[sizeof(uint64_t)];
+		double d = 0;
+		uint64_t u;
+		json_object *val = json_object_array_get_idx(column, (int)i);
+		if (val && columnar_double(val, is_double_key, &d)) {
+			present[i / 8] |= (uint8_t)(1 << (i % 8));
+		} else {
+			all_present = false;
+			d = 0;
+		}
+
+		memcpy(&u, &d, sizeof(u));
+		for (size_t j = 0; j < sizeof(aux); ++j) {
+			aux[j] = (char)(u >> (8 * j));
+		}
+		if (printbuf_memappend(buf, aux, sizeof(aux)) < 0) {
+			goto err;
+		}
+	}
+
+	if (all_present) {
+		rc = 0;
+	} else if (0 == rb_msgpack_str(buf, "present", strlen("present")) &&
+		   0 == rb_msgpack_bin_header(buf, present_len) &&
+		   printbuf_memappend(buf, (char *)present, (int)present_len) >=
+				   0) {
+		rc = 0;
+	}
+
+err:
+	free(present);
+	return rc;
+}
+
+/** Position of a string in the block dictionary, adding it if needed
+  @param dict Dictionary
+  @param str String
+  @return Position, or -1 if error
+  */
+static int64_t columnar_dict_index(struct columnar_dict *dict,
+				   json_object *str) {
+	json_object *index = NULL;
+	const char *key = json_object_get_string(str);
+
+	if (json_object_object_get_ex(dict->index, key, &index)) {
+		return json_object_get_int64(index);
+	}
+
+	const int64_t ret = json_object_array_length(dict->strings);
+	index = json_object_new_int64(ret);
+	if (NULL == index) {
+		rdlog(LOG_ERR, "Couldn't allocate columnar dictionary (OOM?)");
+		return -1;
+	}
+
+	json_object_object_add(dict->index, key, index);
+	json_object_array_add(dict->strings, json_object_get(str));
+	return ret;
+}
+
+/** Append a "dict" or "values" column data
+  @param buf Buffer
+  @param type Column type
+  @param column Column values
+  @param rows Number of rows
+  @param null Marker of JSON null values
+  @param dict Block dictionary
+  @return 0 if success
+  */
+static int columnar_encode_values(struct printbuf *buf,
+				  enum columnar_type type,
+				  json_object *column,
+				  size_t rows,
+				  json_object *null,
+				  struct columnar_dict *dict) {
+	if (rb_msgpack_array(buf, (uint32_t)rows) < 0) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < rows; ++i) {
+		int rc;
+		json_object *val = json_object_array_get_idx(column, (int)i);
+		if (NULL == val || null == val) {
+			rc = rb_msgpack_nil(buf);
+		} else if (COLUMNAR_T_DICT == type) {
+			const int64_t index = columnar_dict_index(dict, val);
+			rc = index < 0 ? -1 : rb_msgpack_int(buf, index);
+		} else {
+			rc = rb_msgpack_json(buf, val);
+		}
+
+		if (rc < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/** Append a column
+  @param buf Buffer
+  @param key Column key
+  @param column Column values
+  @param rows Number of rows
+  @param null Marker of JSON null values
+  @param dict Block dictionary
+  @return 0 if success
+  */
+static int columnar_encode_column(struct printbuf *buf,
+				  const char *key,
+				  json_object *column,
+				  size_t rows,
+				  json_object *null,
+				  struct columnar_dict *dict) {
+	static const char *type_names[] = {
+			[COLUMNAR_T_DELTA] = "delta",
+			[COLUMNAR_T_DOUBLE] = "double",
+			[COLUMNAR_T_DICT] = "dict",
+			[COLUMNAR_T_VALUES] = "values",
+	};
+	const enum columnar_type type =
+			columnar_column_type(key, column, rows, null);
+	const char *type_name = type_names[type];
+	bool all_present = true;
+
+	for (size_t i = 0; all_present && i < rows; ++i) {
+		all_present = NULL != json_object_array_get_idx(column, (int)i);
+	}
+
+	/* Double columns with missing rows have a present bitmap */
+	const uint32_t pairs =
+			COLUMNAR_T_DOUBLE == type && !all_present ? 3 : 2;
+	if (rb_msgpack_map(buf, pairs) < 0 ||
+	    rb_msgpack_str(buf, "type", strlen("type")) < 0 ||
+	    rb_msgpack_str(buf, type_name, strlen(type_name)) < 0 ||
+	    rb_msgpack_str(buf, "data", strlen("data")) < 0) {
+		return -1;
+	}
+
+	switch (type) {
+	case COLUMNAR_T_DELTA:
+		return columnar_encode_delta(buf, column, rows);
+	case COLUMNAR_T_DOUBLE:
+		return columnar_encode_double(buf, key, column, rows);
+	case COLUMNAR_T_DICT:
+	case COLUMNAR_T_VALUES:
+	default:
+		return columnar_encode_values(
+				buf, type, column, rows, null, dict);
+	};
+}
+
+/** Append a string key
+  @param buf Buffer
+  @param key Key
+  @return 0 if success
+  */
+static int columnar_key(struct printbuf *buf, const char *key) {
+	return rb_msgpack_str(buf, key, strlen(key));
+}
+
+char *rb_columnar_encode(const struct rb_columnar *batch, size_t *len) {
+	char *ret = NULL;
+	uint32_t columns_count = 0;
+	const size_t rows = rb_columnar_rows(batch);
+	json_object *columns = columnar_columns(batch);
+	struct columnar_dict dict = {
+			.index = json_object_new_object(),
+			.strings = json_object_new_array(),
+	};
+	struct printbuf *columns_buf = printbuf_new();
+	struct printbuf *buf = printbuf_new();
+
+	if (NULL == columns || NULL == dict.index || NULL == dict.strings ||
+	    NULL == columns_buf || NULL == buf) {
+		rdlog(LOG_ERR, "Couldn't allocate columnar block (OOM?)");
+		goto err;
+	}
+
+	/* Columns go after strings, but they fill the dictionary */
+	json_object_object_foreach(columns, ckey, cval) {
+		(void)ckey;
+		(void)cval;
+		columns_count++;
+	}
+
+	if (rb_msgpack_map(columns_buf, columns_count) < 0) {
+		goto encode_err;
+	}
+
+	json_object_object_foreach(columns, key, column) {
+		if (columnar_key(columns_buf, key) < 0) {
+			goto encode_err;
+		}
+
+		const int rc = columnar_encode_column(columns_buf,
+						      key,
+						      column,
+						      rows,
+						      batch->null,
+						      &dict);
+		if (rc < 0) {
+			goto encode_err;
+		}
+	}
+
+	const int strings = json_object_array_length(dict.strings);
+	if (rb_msgpack_map(buf, 4) < 0 || columnar_key(buf, "schema") < 0 ||
+	    columnar_key(buf, RB_COLUMNAR_SCHEMA) < 0 ||
+	    columnar_key(buf, "rows") < 0 || rb_msgpack_uint(buf, rows) < 0 ||
+	    columnar_key(buf, "strings") < 0 ||
+	    rb_msgpack_array(buf, (uint32_t)strings) < 0) {
+		goto encode_err;
+	}
+
+	for (int i = 0; i < strings; ++i) {
+		json_object *str = json_object_array_get_idx(dict.strings, i);
+		if (rb_msgpack_str(buf,
+				   json_object_get_string(str),
+				   (size_t)json_object_get_string_len(str)) <
+		    0) {
+			goto encode_err;
+		}
+	}
+
+	if (columnar_key(buf, "columns") < 0 ||
+	    printbuf_memappend(buf, columns_buf->buf, columns_buf->bpos) < 0) {
+		goto encode_err;
+	}
+
+	ret = buf->buf;
+	*len = (size_t)buf->bpos;
+	buf->buf = NULL;
+	goto err;
+
+encode_err:
+	rdlog(LOG_ERR, "Couldn't encode columnar block");
+
+err:
+	if (buf) {
+		printbuf_free(buf);
+	}
+	if (columns_buf) {
+		printbuf_free(columns_buf);
+	}
+	if (dict.strings) {
+		json_object_put(dict.strings);
+	}
+	if (dict.index) {
+		json_object_put(dict.index);
+	}
+	if (columns) {
+		json_object_put(columns);
+	}
+	return ret;
+}
+
+void rb_columnar_done(struct rb_columnar *batch) {
+	assert_rb_columnar(batch);
+	json_object_put(batch->rows);
+	json_object_put(batch->null);
+	free(batch);
+}
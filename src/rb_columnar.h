@@ -0,0 +1,92 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <json-c/json.h>
+
+#include <stddef.h>
+
+/** Columnar batch of messages. Rows are JSON objects with the keys of
+  regular messages, and the batch is encoded as a single MessagePack block
+  with a column per message key:
+
+  - "schema": RB_COLUMNAR_SCHEMA
+  - "rows": Number of rows
+  - "strings": Array of the strings that "dict" columns refer to
+  - "columns": Map from message key to its column, in order of first
+    appearance. Every column is a map with its "type" and its "data", with
+    one element per row:
+    - "delta": Array of integers: first row value, and then the difference
+      of every row with the previous one. Used for columns of integers that
+      every row has, like timestamp.
+    - "double": Binary of little endian IEEE 754 doubles. Used for value,
+      min, max and sum (strings in JSON messages), and for columns of numbers
+      with decimals. If some rows do not have the column, "present" is a
+      binary bitmap with bit i%8 of byte i/8 set if row i has it, and missing
+      rows are 0.
+    - "dict": Array of indexes in "strings", or nil if the row does not have
+      the column. Used for columns of strings.
+    - "values": Array of values, or nil if the row does not have the
+      column. Used for the rest of columns, and for columns with JSON null
+      values, that are nil too.
+
+  Not thread safe.
+  */
+struct rb_columnar;
+
+/// Schema name and version of encoded blocks
+#define RB_COLUMNAR_SCHEMA "rb_monitor.columnar.1"
+
+/** Create a new columnar batch
+  @return New batch, or NULL if no memory
+  */
+struct rb_columnar *rb_columnar_new(void);
+
+/** Add a row to the batch
+  @param batch Batch
+  @param row JSON object of a message. Batch takes ownership of it.
+  @return 0 if success, -1 if row is not a JSON object
+  */
+int rb_columnar_add_row(struct rb_columnar *batch, json_object *row);
+
+/** Add a row to the batch from its JSON text
+  @param batch Batch
+  @param text Null terminated JSON text of a message object
+  @return 0 if success, -1 if text is not a JSON object
+  */
+int rb_columnar_add_json_text(struct rb_columnar *batch, const char *text);
+
+/** Number of rows in the batch
+  @param batch Batch
+  @return Number of rows
+  */
+size_t rb_columnar_rows(const struct rb_columnar *batch);
+
+/** Encode the batch rows as a columnar block
+  @param batch Batch
+  @param len Length of returned block
+  @return Block that needs to be freed, or NULL if error
+  */
+char *rb_columnar_encode(const struct rb_columnar *batch, size_t *len);
+
+/** Release a batch and its rows
+  @param batch Batch
+  */
+void rb_columnar_done(struct rb_columnar *batch);
@@ -0,0 +1,144 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rb_float.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/// Powers of ten that are exactly representable in a double
+static const double exact_pow10[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+		1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+		1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/// Biggest integer that a double mantissa can hold
+#define MAX_EXACT_MANTISSA (UINT64_C(1) << 53)
+
+/// Number of significant digits that can't overflow an uint64_t
+#define MAX_MANTISSA_DIGITS 19
+
+/// Exponents beyond this are always left to strtod
+#define MAX_PARSED_EXPONENT 400
+
+static inline bool is_digit(char c) {
+	return (unsigned char)(c - '0') < 10;
+}
+
+static double slow_strtod(const char *str, const char **endptr) {
+	char *end = NULL;
+	const double ret = strtod(str, &end);
+	if (endptr) {
+		*endptr = end;
+	}
+	return ret;
+}
+
+double rb_strtod(const char *str, const char **endptr) {
+	const char *cursor = str;
+	bool negative = false;
+	uint64_t mantissa = 0;
+	unsigned mantissa_digits = 0;
+	bool any_digit = false;
+	int exponent = 0;
+
+	if ('-' == *cursor || '+' == *cursor) {
+		negative = '-' == *cursor;
+		cursor++;
+	}
+
+	if ('0' == cursor[0] && ('x' == cursor[1] || 'X' == cursor[1])) {
+		/* Hexadecimal float */
+		return slow_strtod(str, endptr);
+	}
+
+	for (; is_digit(*cursor); ++cursor) {
+		any_digit = true;
+		if (0 == mantissa && '0' == *cursor) {
+			continue; /* Leading zeros are not significant */
+		}
+		if (++mantissa_digits > MAX_MANTISSA_DIGITS) {
+			return slow_strtod(str, endptr);
+		}
+		mantissa = mantissa * 10 + (uint64_t)(*cursor - '0');
+	}
+
+	if ('.' == *cursor) {
+		for (++cursor; is_digit(*cursor); ++cursor) {
+			any_digit = true;
+			exponent--;
+			if (0 == mantissa && '0' == *cursor) {
+				continue;
+			}
+			if (++mantissa_digits > MAX_MANTISSA_DIGITS) {
+				return slow_strtod(str, endptr);
+			}
+			mantissa = mantissa * 10 + (uint64_t)(*cursor - '0');
+		}
+	}
+
+	if (!any_digit) {
+		/* inf, nan, leading spaces or no conversion at all */
+		return slow_strtod(str, endptr);
+	}
+
+	if ('e' == *cursor || 'E' == *cursor) {
+		const char *exp_cursor = cursor + 1;
+		bool exp_negative = false;
+		int exp_value = 0;
+
+		if ('-' == *exp_cursor || '+' == *exp_cursor) {
+			exp_negative = '-' == *exp_cursor;
+			exp_cursor++;
+		}
+
+		if (is_digit(*exp_cursor)) {
+			for (; is_digit(*exp_cursor); ++exp_cursor) {
+				if (exp_value > MAX_PARSED_EXPONENT) {
+					return slow_strtod(str, endptr);
+				}
+				exp_value = exp_value * 10 + (*exp_cursor - '0');
+			}
+			exponent += exp_negative ? -exp_value : exp_value;
+			cursor = exp_cursor;
+		}
+	}
+
+	if (mantissa > MAX_EXACT_MANTISSA) {
+		return slow_strtod(str, endptr);
+	}
+
+	double ret = (double)mantissa;
+	if (0 == mantissa) {
+		/* Nothing to scale */
+	} else if (exponent < 0 && -exponent <= 22) {
+		ret /= exact_pow10[-exponent];
+	} else if (exponent >= 0 && exponent <= 22) {
+		ret *= exact_pow10[exponent];
+	} else {
+		return slow_strtod(str, endptr);
+	}
+
+	if (endptr) {
+		*endptr = cursor;
+	}
+
+	return negative ? -ret : ret;
+}
@@ -0,0 +1,29 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/** Converts a string to double, with the same semantics as strtod(3).
+  Plain decimal numbers that fit in a double mantissa are converted with an
+  exact fast path; everything else (hexadecimal, inf/nan, leading spaces,
+  big exponents or too many digits) falls back to strtod.
+  @param str String to convert
+  @param endptr If not NULL, first character not used in the conversion
+  @return Converted value
+  */
+double rb_strtod(const char *str, const char **endptr);
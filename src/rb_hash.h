@@ -0,0 +1,41 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// FNV-1a initial value
+#define RB_HASH_INIT UINT64_C(0xcbf29ce484222325)
+
+/** Continue a FNV-1a hash with a buffer. Not suitable against hostile
+  input, but enough to index and compare config pieces
+  @param hash Previous hash, or RB_HASH_INIT
+  @param buf Buffer to hash
+  @param len Buffer length
+  @return New hash
+  */
+static inline uint64_t rb_hash_buf(uint64_t hash, const void *buf, size_t len) {
+	const unsigned char *cursor = buf;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= cursor[i];
+		hash *= UINT64_C(0x100000001b3);
+	}
+	return hash;
+}
@@ -0,0 +1,199 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include "rb_hash_ring.h"
+
+#include "rb_hash.h"
+
+#include <librd/rdlog.h>
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Point of the ring
+struct rb_hash_ring_point {
+	uint64_t hash; ///< Position in the ring
+	size_t member; ///< Member index
+};
+
+struct rb_hash_ring {
+#ifndef NDEBUG
+#define RB_HASH_RING_MAGIC 0x4A5412C04A5412C0L
+	uint64_t magic;
+#endif
+	char **members;			   ///< Members names
+	size_t members_count;		   ///< Number of members
+	struct rb_hash_ring_point *points; ///< Points, sorted by hash
+	size_t points_count;		   ///< Number of points
+};
+
+/** Spread FNV hash bits, so similar names (like vnodes of the same member)
+  do not end in near points.
+  @param hash Hash
+  @return Mixed hash
+  */
+static uint64_t hash_ring_mix(uint64_t hash) {
+	hash ^= hash >> 30;
+	hash *= UINT64_C(0xbf58476d1ce4e5b9);
+	hash ^= hash >> 27;
+	hash *= UINT64_C(0x94d049bb133111eb);
+	hash ^= hash >> 31;
+	return hash;
+}
+
+/// Sort points by hash, and by member name to break ties
+static int hash_ring_point_cmp(const void *va, const void *vb, void *vring) {
+	const struct rb_hash_ring_point *a = va, *b = vb;
+	const struct rb_hash_ring *ring = vring;
+
+	if (a->hash != b->hash) {
+		return a->hash < b->hash ? -1 : 1;
+	}
+	return strcmp(ring->members[a->member], ring->members[b->member]);
+}
+
+/** Add a member if it is not already in the ring
+  @param ring Ring
+  @param member Member name
+  @return true if success
+  */
+static bool hash_ring_add_member(struct rb_hash_ring *ring,
+				 const char *member) {
+	for (size_t i = 0; i < ring->members_count; ++i) {
+		if (0 == strcmp(ring->members[i], member)) {
+			return true;
+		}
+	}
+
+	ring->members[ring->members_count] = strdup(member);
+	if (NULL == ring->members[ring->members_count]) {
+		return false;
+	}
+
+	ring->members_count++;
+	return true;
+}
+
+struct rb_hash_ring *rb_hash_ring_new(const char *const *members,
+				      size_t count,
+				      size_t vnodes) {
+	struct rb_hash_ring *ring = calloc(1, sizeof(*ring));
+	if (NULL == ring) {
+		goto err;
+	}
+
+#ifdef RB_HASH_RING_MAGIC
+	ring->magic = RB_HASH_RING_MAGIC;
+#endif
+
+	ring->members = calloc(count ? count : 1, sizeof(ring->members[0]));
+	ring->points = calloc(count && vnodes ? count * vnodes : 1,
+			      sizeof(ring->points[0]));
+	if (NULL == ring->members || NULL == ring->points) {
+		goto err;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		if (!hash_ring_add_member(ring, members[i])) {
+			goto err;
+		}
+	}
+
+	for (size_t i = 0; i < ring->members_count; ++i) {
+		const char *member = ring->members[i];
+		const uint64_t member_hash =
+				rb_hash_buf(RB_HASH_INIT, member, strlen(member));
+		for (uint64_t vnode = 0; vnode < vnodes; ++vnode) {
+			struct rb_hash_ring_point *point =
+					&ring->points[ring->points_count++];
+			point->hash = hash_ring_mix(rb_hash_buf(
+					member_hash, &vnode, sizeof(vnode)));
+			point->member = i;
+		}
+	}
+
+	qsort_r(ring->points,
+		ring->points_count,
+		sizeof(ring->points[0]),
+		hash_ring_point_cmp,
+		ring);
+
+	return ring;
+
+err:
+	rdlog(LOG_ERR, "Couldn't allocate hash ring (OOM?)");
+	rb_hash_ring_done(ring);
+	return NULL;
+}
+
+size_t rb_hash_ring_members(const struct rb_hash_ring *ring) {
+#ifdef RB_HASH_RING_MAGIC
+	assert(RB_HASH_RING_MAGIC == ring->magic);
+#endif
+	return ring->members_count;
+}
+
+const char *rb_hash_ring_owner(const struct rb_hash_ring *ring,
+			       const char *key,
+			       size_t key_len) {
+#ifdef RB_HASH_RING_MAGIC
+	assert(RB_HASH_RING_MAGIC == ring->magic);
+#endif
+
+	if (0 == ring->points_count) {
+		return NULL;
+	}
+
+	const uint64_t hash =
+			hash_ring_mix(rb_hash_buf(RB_HASH_INIT, key, key_len));
+
+	/* First point with hash >= key hash, wrapping around */
+	size_t lo = 0, hi = ring->points_count;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (ring->points[mid].hash < hash) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo == ring->points_count) {
+		lo = 0;
+	}
+
+	return ring->members[ring->points[lo].member];
+}
+
+void rb_hash_ring_done(struct rb_hash_ring *ring) {
+	if (NULL == ring) {
+		return;
+	}
+
+	for (size_t i = 0; ring->members && i < ring->members_count; ++i) {
+		free(ring->members[i]);
+	}
+	free(ring->members);
+	free(ring->points);
+	free(ring);
+}
@@ -0,0 +1,62 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+/** Consistent hash ring. Every member is placed in many points of the ring
+  (virtual nodes), and a key is owned by the member of the first point after
+  the key hash. Adding or removing a member only moves the keys of that
+  member, and owners do not depend on members order.
+  */
+struct rb_hash_ring;
+
+/// Default number of virtual nodes per member
+#define RB_HASH_RING_DEFAULT_VNODES 128
+
+/** Create a new hash ring
+  @param members Members names. Duplicated names are only added once.
+  @param count Number of members
+  @param vnodes Points of every member in the ring
+  @return New hash ring, or NULL in case of error
+  */
+struct rb_hash_ring *rb_hash_ring_new(const char *const *members,
+				      size_t count,
+				      size_t vnodes);
+
+/** Number of different members of the ring
+  @param ring Hash ring
+  @return Number of members
+  */
+size_t rb_hash_ring_members(const struct rb_hash_ring *ring);
+
+/** Owner of a key
+  @param ring Hash ring
+  @param key Key
+  @param key_len Key length
+  @return Owner member name, valid while ring is, or NULL if ring is empty
+  */
+const char *rb_hash_ring_owner(const struct rb_hash_ring *ring,
+			       const char *key,
+			       size_t key_len);
+
+/** Release a hash ring
+  @param ring Hash ring
+  */
+void rb_hash_ring_done(struct rb_hash_ring *ring);
@@ -0,0 +1,182 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rb_intern.h"
+
+#include "rb_hash.h"
+
+#include <librd/rdlog.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Initial number of buckets. Must be a power of two
+#define RB_INTERN_INITIAL_BUCKETS 256
+
+struct rb_intern_entry {
+#ifndef NDEBUG
+#define RB_INTERN_ENTRY_MAGIC 0x1A7E1A7E1A7E1A7EL
+	uint64_t magic;
+#endif
+	struct rb_intern_entry *next; ///< Next entry in bucket
+	uint64_t hash;		      ///< Cached string hash
+	size_t refcnt;		      ///< Reference counter
+	char str[];		      ///< Interned string
+};
+
+static struct {
+	pthread_mutex_t lock;
+	struct rb_intern_entry **buckets;
+	size_t buckets_size; ///< Always a power of two
+	size_t count;	///< Number of interned strings
+} intern_table = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static struct rb_intern_entry *rb_intern_entry(const char *str) {
+	struct rb_intern_entry *ret = (struct rb_intern_entry *)(void *)(
+			str - offsetof(struct rb_intern_entry, str));
+#ifdef RB_INTERN_ENTRY_MAGIC
+	assert(RB_INTERN_ENTRY_MAGIC == ret->magic);
+#endif
+	return ret;
+}
+
+/** Double the number of buckets. Need to hold table lock
+  @return true if OK, false if no memory (table is still usable)
+  */
+static bool rb_intern_grow(void) {
+	const size_t new_size = intern_table.buckets_size
+					? 2 * intern_table.buckets_size
+					: RB_INTERN_INITIAL_BUCKETS;
+	struct rb_intern_entry **new_buckets =
+			calloc(new_size, sizeof(new_buckets[0]));
+	if (NULL == new_buckets) {
+		return false;
+	}
+
+	for (size_t i = 0; i < intern_table.buckets_size; ++i) {
+		struct rb_intern_entry *entry = intern_table.buckets[i];
+		while (entry) {
+			struct rb_intern_entry *next = entry->next;
+			const size_t bucket = entry->hash & (new_size - 1);
+			entry->next = new_buckets[bucket];
+			new_buckets[bucket] = entry;
+			entry = next;
+		}
+	}
+
+	free(intern_table.buckets);
+	intern_table.buckets = new_buckets;
+	intern_table.buckets_size = new_size;
+	return true;
+}
+
+const char *rb_intern(const char *str) {
+	if (NULL == str) {
+		return NULL;
+	}
+
+	const char *ret = NULL;
+	const size_t len = strlen(str);
+	const uint64_t hash = rb_hash_buf(RB_HASH_INIT, str, len);
+
+	pthread_mutex_lock(&intern_table.lock);
+	if (intern_table.count >= intern_table.buckets_size &&
+	    !rb_intern_grow() && 0 == intern_table.buckets_size) {
+		rdlog(LOG_ERR, "Couldn't allocate intern table (OOM?)");
+		goto unlock;
+	}
+
+	struct rb_intern_entry **bucket =
+			&intern_table.buckets[hash &
+					      (intern_table.buckets_size - 1)];
+	for (struct rb_intern_entry *entry = *bucket; entry;
+	     entry = entry->next) {
+		if (entry->hash == hash && 0 == strcmp(entry->str, str)) {
+			entry->refcnt++;
+			ret = entry->str;
+			goto unlock;
+		}
+	}
+
+	struct rb_intern_entry *entry = malloc(sizeof(*entry) + len + 1);
+	if (NULL == entry) {
+		rdlog(LOG_ERR, "Couldn't intern string %s (OOM?)", str);
+		goto unlock;
+	}
+
+#ifdef RB_INTERN_ENTRY_MAGIC
+	entry->magic = RB_INTERN_ENTRY_MAGIC;
+#endif
+	entry->hash = hash;
+	entry->refcnt = 1;
+	memcpy(entry->str, str, len + 1);
+	entry->next = *bucket;
+	*bucket = entry;
+	intern_table.count++;
+	ret = entry->str;
+
+unlock:
+	pthread_mutex_unlock(&intern_table.lock);
+	return ret;
+}
+
+const char *rb_intern_get(const char *str) {
+	if (str) {
+		struct rb_intern_entry *entry = rb_intern_entry(str);
+		pthread_mutex_lock(&intern_table.lock);
+		entry->refcnt++;
+		pthread_mutex_unlock(&intern_table.lock);
+	}
+	return str;
+}
+
+void rb_intern_put(const char *str) {
+	if (NULL == str) {
+		return;
+	}
+
+	struct rb_intern_entry *entry = rb_intern_entry(str);
+	pthread_mutex_lock(&intern_table.lock);
+	if (0 == --entry->refcnt) {
+		struct rb_intern_entry **cursor =
+				&intern_table.buckets[entry->hash &
+						      (intern_table.buckets_size -
+						       1)];
+		while (*cursor != entry) {
+			cursor = &(*cursor)->next;
+		}
+		*cursor = entry->next;
+		intern_table.count--;
+		free(entry);
+
+		if (0 == intern_table.count) {
+			/* Leave no memory behind, valgrind friendly */
+			free(intern_table.buckets);
+			intern_table.buckets = NULL;
+			intern_table.buckets_size = 0;
+		}
+	}
+	pthread_mutex_unlock(&intern_table.lock);
+}
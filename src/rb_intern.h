@@ -0,0 +1,43 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/** Process-wide table of immutable config strings. Equal strings interned
+  through it share the same storage, so they can be compared by pointer.
+  Every interned string is reference counted, so strings of an old
+  configuration are released when nothing uses them anymore.
+  */
+
+/** Intern a string
+  @param str String to intern. Can be NULL
+  @return Interned string with one more reference, or NULL if str was NULL
+  or there was no memory
+  */
+const char *rb_intern(const char *str);
+
+/** Add a reference to an already interned string
+  @param str Interned string. Can be NULL
+  @return str
+  */
+const char *rb_intern_get(const char *str);
+
+/** Release one reference to an interned string
+  @param str Interned string. Can be NULL
+  */
+void rb_intern_put(const char *str);
@@ -41,6 +41,11 @@
 	PARSE_CJSON_CHILD0(                                                    \
 			base, child_key, json_object_get_int64, default_value)
 
+/// Convenience macro to parse a double child
+#define PARSE_CJSON_CHILD_DOUBLE(base, child_key, default_value)               \
+	PARSE_CJSON_CHILD0(                                                    \
+			base, child_key, json_object_get_double, default_value)
+
 /// Convenience function to get a string child duplicated
 static char *
 json_object_get_dup_string(json_object *json) __attribute__((unused));
@@ -20,8 +20,13 @@
 
 #include <librd/rdlog.h>
 
+#include <matheval.h>
+#include <pthread.h>
 #include <stdlib.h>
 
+/// Serializes libmatheval parser usage
+static pthread_mutex_t evaluator_create_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct libmatheval_vars *new_libmatheval_vars(size_t new_size) {
 	struct libmatheval_vars *this = NULL;
 	const size_t alloc_size = sizeof(*this) +
@@ -42,3 +47,11 @@ struct libmatheval_vars *new_libmatheval_vars(size_t new_size) {
 void delete_libmatheval_vars(struct libmatheval_vars *this) {
 	free(this);
 }
+
+void *rb_evaluator_create(const char *expression) {
+	pthread_mutex_lock(&evaluator_create_lock);
+	void *ret = evaluator_create((char *)expression);
+	pthread_mutex_unlock(&evaluator_create_lock);
+
+	return ret;
+}
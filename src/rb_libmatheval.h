@@ -38,3 +38,10 @@ struct libmatheval_vars *new_libmatheval_vars(size_t new_size);
   @param this libmatheval vars to deallocate
   */
 void delete_libmatheval_vars(struct libmatheval_vars *this);
+
+/** Thread-safe evaluator_create. Libmatheval parser is not reentrant, so
+  all evaluators must be created through this function.
+  @param expression Expression to parse
+  @return New evaluator, or NULL if expression was invalid
+  */
+void *rb_evaluator_create(const char *expression);
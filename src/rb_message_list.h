@@ -18,11 +18,65 @@
 
 #pragma once
 
-#include <librdkafka/rdkafka.h>
+#include <json-c/json.h>
+
+#include <stddef.h>
 #include <sys/queue.h>
 
-/// Message we want to send. Re-use of librdkafka at this moment
-typedef rd_kafka_message_t rb_message;
+/// Messages encodings
+enum rb_message_encoding {
+	RB_MESSAGE_ENCODING_JSON,    ///< JSON text
+	RB_MESSAGE_ENCODING_MSGPACK, ///< MessagePack
+	/// Columnar block per sensor and cycle, built from message rows. See
+	/// rb_columnar.h
+	RB_MESSAGE_ENCODING_COLUMNAR,
+	RB_MESSAGE_ENCODING__MAX,
+};
+
+/// Encoding flag, to make sets of encodings
+#define RB_MESSAGE_F(encoding) (1U << (encoding))
+#define RB_MESSAGE_F_JSON RB_MESSAGE_F(RB_MESSAGE_ENCODING_JSON)
+#define RB_MESSAGE_F_MSGPACK RB_MESSAGE_F(RB_MESSAGE_ENCODING_MSGPACK)
+#define RB_MESSAGE_F_COLUMNAR RB_MESSAGE_F(RB_MESSAGE_ENCODING_COLUMNAR)
+/// Encodings that every message is printed in
+#define RB_MESSAGE_F_PER_MESSAGE (RB_MESSAGE_F_JSON | RB_MESSAGE_F_MSGPACK)
+
+/// Message we want to send, in the encodings that sinks need
+typedef struct rb_message_s {
+	void *payload;	    ///< JSON payload, or NULL if not needed
+	size_t len;	    ///< JSON payload length
+	void *msgpack;	    ///< MessagePack payload, or NULL if not needed
+	size_t msgpack_len; ///< MessagePack payload length
+	json_object *row;   ///< Columnar block row, or NULL if not needed
+} rb_message;
+
+/** Message payload in an encoding
+  @param msg Message
+  @param encoding Encoding
+  @param len Payload length
+  @return Payload, or NULL if message is not printed in that encoding, or
+  it is not a per message encoding
+  */
+static void *rb_message_payload(const rb_message *msg,
+				enum rb_message_encoding encoding,
+				size_t *len) __attribute__((unused));
+static void *rb_message_payload(const rb_message *msg,
+				enum rb_message_encoding encoding,
+				size_t *len) {
+	switch (encoding) {
+	case RB_MESSAGE_ENCODING_JSON:
+		*len = msg->len;
+		return msg->payload;
+	case RB_MESSAGE_ENCODING_MSGPACK:
+		*len = msg->msgpack_len;
+		return msg->msgpack;
+	case RB_MESSAGE_ENCODING_COLUMNAR:
+	case RB_MESSAGE_ENCODING__MAX:
+	default:
+		*len = 0;
+		return NULL;
+	};
+}
 
 /// Message array element
 typedef struct rb_message_array_s {
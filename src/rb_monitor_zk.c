@@ -20,7 +20,10 @@
 
 #ifdef HAVE_ZOOKEEPER
 
+#include "rb_hash_ring.h"
+#include "rb_json.h"
 #include "rb_sensor.h"
+#include "rb_sensor_cache.h"
 #include "rb_sensor_queue.h"
 #include "rb_zk.h"
 
@@ -30,15 +33,29 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 
 /* Zookeeper path to save data */
 #define ZOOKEEPER_TASKS_PATH "/rb_monitor/sensors"
 #define ZOOKEEPER_TASKS_PATH_LEAF "/rb_monitor/sensors/sensor_"
-#define ZOOKEEPER_MUTEX_PATH "/rb_monitor/lock"
-#define ZOOKEEPER_MUTEX_PATH_LEAF ZOOKEEPER_MUTEX_PATH "/sensors_list_"
+/* Ephemeral claims of queue elements being popped, named like them */
+#define ZOOKEEPER_CLAIMS_PATH "/rb_monitor/claims"
 #define ZOOKEEPER_LEADER_PATH "/rb_monitor/leader"
 #define ZOOKEEPER_LEADER_LEAF_NAME ZOOKEEPER_LEADER_PATH "/leader_prop_"
+/* Hash ring members. Nodes are ephemeral and sequential, named
+<member_id>-<sequence> */
+#define ZOOKEEPER_MEMBERS_PATH "/rb_monitor/members"
+#define ZOOKEEPER_SEQUENCE_LEN (sizeof("-0000000000") - 1)
+
+/* Queue distribution pushes sensors in chunks (JSON arrays), and many chunks
+in every transaction. ZooKeeper rejects requests bigger than 1MB by default */
+#define RB_MONITOR_ZK_DEFAULT_CHUNK_SENSORS 64
+#define RB_MONITOR_ZK_CHUNK_MAX_BYTES (256 * 1024)
+#define RB_MONITOR_ZK_PUSH_MAX_BYTES (768 * 1024)
+#define RB_MONITOR_ZK_PUSH_MAX_CHUNKS 256
 
 #define RB_MONITOR_ZK_MAGIC 0xB010A1C0B010A1C0L
 
@@ -181,6 +198,7 @@ struct rb_monitor_zk {
 
 	char *zk_host;
 	time_t pop_watcher_timeout, push_timeout;
+	size_t push_chunk_sensors; ///< Max sensors per queue element
 
 	string_list pop_sensors_list;
 	string_list push_sensors_list;
@@ -189,9 +207,32 @@ struct rb_monitor_zk {
 	char *my_leader_node;
 	int i_am_leader;
 
-	rd_fifoq_t *workers_queue;
+	struct _worker_info *worker_info;
+	/// Parsed popped sensors. Only used from worker thread
+	struct rb_sensor_cache *sensors_cache;
+	/// Next time to evict sensors not popped recently
+	time_t sensors_cache_next_eviction;
 
 	struct rb_zk *zk_handler;
+
+	enum rb_monitor_zk_distribution distribution;
+	/// Hash ring distribution
+	struct {
+		char *member_id; ///< This instance name in the ring
+		size_t vnodes;   ///< Virtual nodes per member
+
+		json_object *zk_sensors; ///< Sensors to distribute
+		char **sensors_keys;     ///< Sensors ring keys
+		size_t sensors_count;    ///< Number of sensors
+
+		/// Protects pending members and owned sensors
+		pthread_mutex_t lock;
+		/// Members received from ZooKeeper, not applied yet
+		char **pending_members;
+		size_t pending_members_count;
+		bool *owned;	 ///< Sensors owned by this instance
+		uint64_t generation; ///< Incremented when owned change
+	} ring;
 };
 
 static struct rb_monitor_zk *rb_monitor_zk_casting(void *a) {
@@ -214,12 +255,30 @@ static struct rb_monitor_zk *rb_monitor_zk_const_casting(const void *a) {
 
 static void sensors_queue_poll_loop_start(struct rb_monitor_zk *rb_mzk);
 
+/** Pop error that can't be retried until we have a new ZooKeeper session
+  @param rc ZooKeeper return code
+  @return true if session is lost
+  */
+static bool pop_session_lost(int rc) {
+	return ZSESSIONEXPIRED == rc || ZINVALIDSTATE == rc;
+}
+
 void rb_zk_pop_error_cb(struct rb_zk *rb_zk,
 			struct rb_zk_queue_element *qelm,
 			const char *cause,
 			int rc,
 			void *opaque) {
 
+	if (pop_session_lost(rc)) {
+		/* Pop loop restarts when connected again */
+		rdlog(LOG_ERR,
+		      "Couldn't pop queue element [rc=%d]: %s. Waiting for a "
+		      "new session",
+		      rc,
+		      cause);
+		return;
+	}
+
 	rdlog(LOG_ERR,
 	      "Couldn't pop queue element [rc=%d]: %s. Retrying",
 	      rc,
@@ -229,11 +288,40 @@ void rb_zk_pop_error_cb(struct rb_zk *rb_zk,
 					qelm));
 }
 
+/** Queue a popped sensor in workers queue
+  @param rb_mzk rb_monitor ZooKeeper handler
+  @param sensor_info Popped sensor JSON
+  @param now Current time
+  */
+static void rb_monitor_zk_queue_sensor(struct rb_monitor_zk *rb_mzk,
+				       json_object *sensor_info,
+				       time_t now) {
+	/* Main thread could be replacing monitors templates */
+	pthread_mutex_lock(&rb_mzk->worker_info->monitors_templates_mutex);
+	rb_sensor_t *sensor = rb_sensor_cache_get(rb_mzk->sensors_cache,
+						  sensor_info,
+						  rb_mzk->worker_info,
+						  now);
+	pthread_mutex_unlock(&rb_mzk->worker_info->monitors_templates_mutex);
+	if (NULL == sensor) {
+		rdlog(LOG_ERR, "Can't parse zookeeper received sensor");
+		return;
+	}
+
+	queue_sensor(rb_mzk->worker_info->queue, sensor);
+}
+
+/** Queue all sensors of a popped queue element
+  @param str Queue element, a JSON array of sensors or a single sensor
+  @param len Length of str
+  @param opaque rb_monitor ZooKeeper handler
+  */
 static void
 rb_monitor_zk_add_sensor_to_monitor_queue(char *str, size_t len, void *opaque) {
 	struct rb_monitor_zk *rb_mzk = rb_monitor_zk_casting(opaque);
 	enum json_tokener_error jerr;
-	assert(rb_mzk->workers_queue);
+	const time_t now = time(NULL);
+	(void)len;
 
 	json_object *obj = json_tokener_parse_verbose(str, &jerr);
 	if (NULL == obj) {
@@ -243,7 +331,40 @@ rb_monitor_zk_add_sensor_to_monitor_queue(char *str, size_t len, void *opaque) {
 		return;
 	}
 
-	queue_sensor(rb_mzk->workers_queue, obj);
+	if (!json_object_is_type(obj, json_type_array)) {
+		/* Single sensor element, pushed by an old leader */
+		rb_monitor_zk_queue_sensor(rb_mzk, obj, now);
+	} else {
+		for (int i = 0; i < json_object_array_length(obj); ++i) {
+			rb_monitor_zk_queue_sensor(
+					rb_mzk,
+					json_object_array_get_idx(obj, i),
+					now);
+		}
+	}
+
+	json_object_put(obj);
+}
+
+/** Release cached sensors that the leader has not pushed for a while, so
+  sensors removed from config do not stay in memory forever
+  @param rb_mzk rb_monitor ZooKeeper handler
+  */
+static void rb_monitor_zk_evict_sensors_cache(struct rb_monitor_zk *rb_mzk) {
+	const time_t now = time(NULL);
+	if (now < rb_mzk->sensors_cache_next_eviction) {
+		return;
+	}
+
+	const size_t evicted = rb_sensor_cache_evict(
+			rb_mzk->sensors_cache, now - 3 * rb_mzk->push_timeout);
+	if (evicted > 0) {
+		rdlog(LOG_INFO,
+		      "Evicted %zu zookeeper sensors not seen in %jds",
+		      evicted,
+		      (intmax_t)(3 * rb_mzk->push_timeout));
+	}
+	rb_mzk->sensors_cache_next_eviction = now + rb_mzk->push_timeout;
 }
 
 static void rb_monitor_zk_add_popped_sensors_to_monitor_queue(
@@ -255,6 +376,7 @@ static void rb_monitor_zk_add_popped_sensors_to_monitor_queue(
 	string_list_foreach_arg_free(&laux,
 				     rb_monitor_zk_add_sensor_to_monitor_queue,
 				     rb_mzk);
+	rb_monitor_zk_evict_sensors_cache(rb_mzk);
 }
 
 void rb_zk_pop_data_cb(int rc,
@@ -287,7 +409,9 @@ void rb_zk_pop_delete_completed_cb(int rc, const void *data) {
 		rdlog(LOG_DEBUG, "Deleting sensor in zookeeper, pop completed");
 	}
 
-	sensors_queue_poll_loop_start(rbmzk);
+	if (!pop_session_lost(rc)) {
+		sensors_queue_poll_loop_start(rbmzk);
+	}
 }
 
 static void sensors_queue_poll_loop_start(struct rb_monitor_zk *rb_mzk) {
@@ -299,42 +423,92 @@ static void sensors_queue_poll_loop_start(struct rb_monitor_zk *rb_mzk) {
 					  rb_zk_pop_delete_completed_cb,
 					  rb_mzk);
 
-	rb_zk_queue_pop(rb_mzk->zk_handler,
-			qelement_config,
-			ZOOKEEPER_MUTEX_PATH_LEAF);
+	rb_zk_queue_claim(rb_mzk->zk_handler,
+			  qelement_config,
+			  ZOOKEEPER_CLAIMS_PATH);
+}
+
+/** Start popping sensors with a new session. Previous session pop loop
+  stopped when session was lost.
+  @param zk rb_zk handler
+  @param opaque rb_monitor ZooKeeper handler
+  */
+static void sensors_queue_session_start(struct rb_zk *zk, void *opaque) {
+	(void)zk;
+	sensors_queue_poll_loop_start(rb_monitor_zk_casting(opaque));
 }
 
 /*
  *  LIST PUSH
  */
 
-static void
-rb_monitor_leader_push_sensors_cb(int rc, const char *value, const void *data) {
+static void rb_monitor_leader_push_sensors_cb(int rc, const void *data) {
+	(void)data;
 	if (rc < 0) {
 		rdlog(LOG_ERR,
-		      "Error pushing element %s in the sensors queue. "
+		      "Error pushing elements in the sensors queue. "
 		      "rc=%d",
-		      value,
 		      rc);
 	}
 }
 
-static void rb_monitor_push_sensor(char *str, size_t len, void *_arg) {
-	struct rb_monitor_zk *rb_mzk = _arg;
-	rdlog(LOG_DEBUG, "uploading sensor [%s]", str);
-	rb_zk_queue_push(rb_mzk->zk_handler,
-			 ZOOKEEPER_TASKS_PATH_LEAF,
-			 str,
-			 len,
-			 rb_monitor_leader_push_sensors_cb,
-			 rb_mzk);
+/// Sensors chunks of the same push transaction
+struct push_transaction {
+	struct rb_monitor_zk *rb_mzk;
+	const char *chunks[RB_MONITOR_ZK_PUSH_MAX_CHUNKS];
+	int chunks_len[RB_MONITOR_ZK_PUSH_MAX_CHUNKS];
+	size_t count;
+	size_t bytes;
+};
+
+static void push_transaction_flush(struct push_transaction *transaction) {
+	if (0 == transaction->count) {
+		return;
+	}
+
+	rdlog(LOG_DEBUG,
+	      "uploading %zu sensors chunks (%zu bytes)",
+	      transaction->count,
+	      transaction->bytes);
+	rb_zk_queue_push_multi(transaction->rb_mzk->zk_handler,
+			       ZOOKEEPER_TASKS_PATH_LEAF,
+			       transaction->chunks,
+			       transaction->chunks_len,
+			       transaction->count,
+			       rb_monitor_leader_push_sensors_cb,
+			       transaction->rb_mzk);
+	transaction->count = transaction->bytes = 0;
+}
+
+static void rb_monitor_push_sensors_chunk(char *str, size_t len, void *_arg) {
+	struct push_transaction *transaction = _arg;
+
+	if (transaction->count == RB_MONITOR_ZK_PUSH_MAX_CHUNKS ||
+	    transaction->bytes + len > RB_MONITOR_ZK_PUSH_MAX_BYTES) {
+		push_transaction_flush(transaction);
+	}
+
+	transaction->chunks[transaction->count] = str;
+	transaction->chunks_len[transaction->count] = (int)len;
+	transaction->count++;
+	transaction->bytes += len;
 }
 
 static void rb_monitor_leader_push_sensors(void *opaque) {
 	struct rb_monitor_zk *rb_mzk = rb_monitor_zk_casting(opaque);
+	/* Too big for worker thread stack */
+	struct push_transaction *transaction = calloc(1, sizeof(*transaction));
+	if (NULL == transaction) {
+		rdlog(LOG_ERR, "Can't allocate sensors push (OOM?)");
+		return;
+	}
+
+	transaction->rb_mzk = rb_mzk;
 	string_list_foreach_arg(&rb_mzk->push_sensors_list,
-				rb_monitor_push_sensor,
-				rb_mzk);
+				rb_monitor_push_sensors_chunk,
+				transaction);
+	push_transaction_flush(transaction);
+	free(transaction);
 }
 
 /*
@@ -381,11 +555,308 @@ static void try_to_be_master(struct rb_monitor_zk *rb_mzk) {
 			 rb_mzk);
 }
 
+/*
+ *  HASH RING DISTRIBUTION
+ */
+
+static void free_members(char **members, size_t count) {
+	for (size_t i = 0; members && i < count; ++i) {
+		free(members[i]);
+	}
+	free(members);
+}
+
+/** Apply last received members: compute the new ring, and the sensors this
+  instance owns. Called in rb_monitor_zk worker thread.
+  @param rb_mzk rb_monitor ZooKeeper handler
+  */
+static void rb_monitor_zk_update_ring(struct rb_monitor_zk *rb_mzk) {
+	size_t owned_count = 0;
+	bool changed = false;
+
+	pthread_mutex_lock(&rb_mzk->ring.lock);
+	char **members = rb_mzk->ring.pending_members;
+	const size_t members_count = rb_mzk->ring.pending_members_count;
+	rb_mzk->ring.pending_members = NULL;
+	rb_mzk->ring.pending_members_count = 0;
+	pthread_mutex_unlock(&rb_mzk->ring.lock);
+
+	if (NULL == members) {
+		/* Already applied by a previous call */
+		return;
+	}
+
+	struct rb_hash_ring *ring = rb_hash_ring_new(
+			(const char *const *)members,
+			members_count,
+			rb_mzk->ring.vnodes);
+	if (NULL == ring) {
+		goto done;
+	}
+
+	pthread_mutex_lock(&rb_mzk->ring.lock);
+	for (size_t i = 0; i < rb_mzk->ring.sensors_count; ++i) {
+		const char *key = rb_mzk->ring.sensors_keys[i];
+		const char *owner = rb_hash_ring_owner(ring, key, strlen(key));
+		const bool owned = owner &&
+				   0 == strcmp(owner, rb_mzk->ring.member_id);
+		changed = changed || owned != rb_mzk->ring.owned[i];
+		rb_mzk->ring.owned[i] = owned;
+		owned_count += owned;
+	}
+	if (changed) {
+		rb_mzk->ring.generation++;
+	}
+	pthread_mutex_unlock(&rb_mzk->ring.lock);
+
+	rdlog(LOG_INFO,
+	      "ZooKeeper members changed: %zu members, this instance owns "
+	      "%zu of %zu sensors",
+	      rb_hash_ring_members(ring),
+	      owned_count,
+	      rb_mzk->ring.sensors_count);
+
+	rb_hash_ring_done(ring);
+
+done:
+	free_members(members, members_count);
+}
+
+static void rb_monitor_zk_watch_members(struct rb_monitor_zk *rb_mzk);
+
+static void members_watcher(zhandle_t *zh,
+			    int type,
+			    int state,
+			    const char *path,
+			    void *ctx) {
+	(void)zh;
+	(void)state;
+	(void)path;
+
+	/* Session events are handled by connected callback */
+	if (ZOO_CHILD_EVENT == type) {
+		rb_monitor_zk_watch_members(rb_monitor_zk_casting(ctx));
+	}
+}
+
+static void members_get_children_complete(int rc,
+					  const struct String_vector *strings,
+					  const void *data) {
+	struct rb_monitor_zk *rb_mzk = rb_monitor_zk_const_casting(data);
+
+	if (ZOK != rc) {
+		rdlog(LOG_ERR,
+		      "Can't get ZooKeeper members: %s",
+		      zerror(rc));
+		return;
+	}
+
+	char **members = calloc((size_t)strings->count + 1,
+				sizeof(members[0]));
+	if (NULL == members) {
+		rdlog(LOG_ERR, "Can't allocate ZooKeeper members (OOM?)");
+		return;
+	}
+
+	size_t same_id_members = 0;
+	for (int32_t i = 0; i < strings->count; ++i) {
+		/* Strip sequence suffix */
+		size_t len = strlen(strings->data[i]);
+		if (len > ZOOKEEPER_SEQUENCE_LEN &&
+		    '-' == strings->data[i][len - ZOOKEEPER_SEQUENCE_LEN]) {
+			len -= ZOOKEEPER_SEQUENCE_LEN;
+		}
+
+		members[i] = strndup(strings->data[i], len);
+		if (NULL == members[i]) {
+			rdlog(LOG_ERR,
+			      "Can't allocate ZooKeeper members (OOM?)");
+			free_members(members, (size_t)i);
+			return;
+		}
+
+		if (0 == strcmp(members[i], rb_mzk->ring.member_id)) {
+			same_id_members++;
+		}
+	}
+
+	if (same_id_members > 1) {
+		/* Ring can't tell them apart, so they own the same sensors */
+		rdlog(LOG_ERR,
+		      "%zu ZooKeeper members use id %s, so they poll the same "
+		      "sensors (or a previous session has not expired yet). "
+		      "Set a different member_id in every instance",
+		      same_id_members,
+		      rb_mzk->ring.member_id);
+	}
+
+	pthread_mutex_lock(&rb_mzk->ring.lock);
+	free_members(rb_mzk->ring.pending_members,
+		     rb_mzk->ring.pending_members_count);
+	rb_mzk->ring.pending_members = members;
+	rb_mzk->ring.pending_members_count = (size_t)strings->count;
+	pthread_mutex_unlock(&rb_mzk->ring.lock);
+
+	rd_thread_func_call1(rb_mzk->worker, rb_monitor_zk_update_ring, rb_mzk);
+}
+
+static void rb_monitor_zk_watch_members(struct rb_monitor_zk *rb_mzk) {
+	const int rc = rb_zk_awget_children(rb_mzk->zk_handler,
+					    ZOOKEEPER_MEMBERS_PATH,
+					    members_watcher,
+					    rb_mzk,
+					    members_get_children_complete,
+					    rb_mzk);
+	if (ZOK != rc) {
+		rdlog(LOG_ERR,
+		      "Can't watch ZooKeeper members: %s",
+		      zerror(rc));
+	}
+}
+
+/** Join the hash ring with a new session. Previous session member node and
+  watch are gone if session expired.
+  @param zk rb_zk handler
+  @param opaque rb_monitor ZooKeeper handler
+  */
+static void rb_monitor_zk_join_ring(struct rb_zk *zk, void *opaque) {
+	struct rb_monitor_zk *rb_mzk = rb_monitor_zk_casting(opaque);
+	char path[BUFSIZ];
+
+	rb_zk_create_recursive_node(zk, ZOOKEEPER_MEMBERS_PATH, 0);
+	snprintf(path,
+		 sizeof(path),
+		 ZOOKEEPER_MEMBERS_PATH "/%s-",
+		 rb_mzk->ring.member_id);
+	const int rc = rb_zk_create_node(zk,
+					 path,
+					 rb_mzk->ring.member_id,
+					 (int)strlen(rb_mzk->ring.member_id),
+					 &ZOO_OPEN_ACL_UNSAFE,
+					 ZOO_EPHEMERAL | ZOO_SEQUENCE,
+					 NULL,
+					 0);
+	if (ZOK != rc) {
+		rdlog(LOG_ERR,
+		      "Can't join ZooKeeper members as %s: %s",
+		      rb_mzk->ring.member_id,
+		      zerror(rc));
+	} else {
+		rdlog(LOG_INFO,
+		      "Joined ZooKeeper members as %s",
+		      rb_mzk->ring.member_id);
+	}
+
+	rb_monitor_zk_watch_members(rb_mzk);
+}
+
+json_object *rb_monitor_zk_owned_sensors(struct rb_monitor_zk *zk,
+					 uint64_t *generation) {
+	json_object *ret = NULL;
+
+	if (RB_MONITOR_ZK_DISTRIBUTION_HASH_RING != zk->distribution) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&zk->ring.lock);
+	if (*generation == zk->ring.generation) {
+		goto done;
+	}
+
+	ret = json_object_new_array();
+	if (NULL == ret) {
+		rdlog(LOG_ERR, "Can't allocate owned sensors (OOM?)");
+		goto done;
+	}
+
+	for (size_t i = 0; i < zk->ring.sensors_count; ++i) {
+		if (zk->ring.owned[i]) {
+			json_object_array_add(
+					ret,
+					json_object_get(json_object_array_get_idx(
+							zk->ring.zk_sensors,
+							i)));
+		}
+	}
+	*generation = zk->ring.generation;
+
+done:
+	pthread_mutex_unlock(&zk->ring.lock);
+	return ret;
+}
+
+/** Prepare hash ring distribution state
+  @param rb_mzk rb_monitor ZooKeeper handler
+  @param config rb_monitor ZooKeeper config
+  @param zk_sensors Sensors to distribute
+  @return true if success
+  */
+static bool rb_monitor_zk_ring_init(struct rb_monitor_zk *rb_mzk,
+				    const struct rb_monitor_zk_config *config,
+				    json_object *zk_sensors) {
+	char hostname[256];
+
+	pthread_mutex_init(&rb_mzk->ring.lock, NULL);
+	rb_mzk->ring.vnodes = config->ring_vnodes
+					      ? (size_t)config->ring_vnodes
+					      : RB_HASH_RING_DEFAULT_VNODES;
+	if (config->member_id) {
+		rb_mzk->ring.member_id = strdup(config->member_id);
+	} else if (0 != gethostname(hostname, sizeof(hostname) - 1)) {
+		rdlog(LOG_ERR,
+		      "Can't get hostname to use as ZooKeeper member id: %s",
+		      strerror(errno));
+		return false;
+	} else {
+		/* Many instances could run in the same host */
+		hostname[sizeof(hostname) - 1] = '\0';
+		if (asprintf(&rb_mzk->ring.member_id,
+			     "%s-%ld",
+			     hostname,
+			     (long)getpid()) < 0) {
+			rb_mzk->ring.member_id = NULL;
+		}
+	}
+
+	rb_mzk->ring.sensors_count = (size_t)json_object_array_length(zk_sensors);
+	rb_mzk->ring.sensors_keys =
+			calloc(rb_mzk->ring.sensors_count + 1,
+			       sizeof(rb_mzk->ring.sensors_keys[0]));
+	rb_mzk->ring.owned = calloc(rb_mzk->ring.sensors_count + 1,
+				    sizeof(rb_mzk->ring.owned[0]));
+	if (NULL == rb_mzk->ring.member_id ||
+	    NULL == rb_mzk->ring.sensors_keys || NULL == rb_mzk->ring.owned) {
+		rdlog(LOG_ERR, "Can't allocate ZooKeeper sensors (OOM?)");
+		return false;
+	}
+
+	rb_mzk->ring.zk_sensors = json_object_get(zk_sensors);
+	for (size_t i = 0; i < rb_mzk->ring.sensors_count; ++i) {
+		json_object *sensor = json_object_array_get_idx(zk_sensors, i);
+		/* Sensor name is the key, so changes in the sensor definition
+		do not move it to another instance */
+		const char *key = PARSE_CJSON_CHILD_STR(
+				sensor, "sensor_name", NULL);
+		if (NULL == key) {
+			key = json_object_to_json_string(sensor);
+		}
+
+		rb_mzk->ring.sensors_keys[i] = strdup(key ? key : "");
+		if (NULL == rb_mzk->ring.sensors_keys[i]) {
+			rdlog(LOG_ERR,
+			      "Can't allocate ZooKeeper sensors (OOM?)");
+			return false;
+		}
+	}
+
+	return true;
+}
+
 /* Prepare zookeeper structure */
 static int zk_prepare(struct rb_zk *zh) {
 	rdlog(LOG_DEBUG, "Preparing zookeeper structure");
 	return rb_zk_create_recursive_node(zh, ZOOKEEPER_TASKS_PATH, 0) &&
-	       rb_zk_create_recursive_node(zh, ZOOKEEPER_MUTEX_PATH, 0) &&
+	       rb_zk_create_recursive_node(zh, ZOOKEEPER_CLAIMS_PATH, 0) &&
 	       rb_zk_create_recursive_node(zh, ZOOKEEPER_LEADER_PATH, 0);
 }
 
@@ -399,10 +870,43 @@ static void *zk_mon_watcher(void *_context) {
  * RB_MONITOR ZOOKEEPER STRUCT (pt 2)
  */
 
+/** Add a sensors chunk to the push list
+  @param monitor_zk rb_monitor ZooKeeper handler
+  @param chunk Sensors JSON array. It will be emptied.
+  */
+static void rb_monitor_zk_push_sensors_chunk(struct rb_monitor_zk *monitor_zk,
+					     json_object **chunk) {
+	if (0 == json_object_array_length(*chunk)) {
+		return;
+	}
+
+	const char *chunk_str = json_object_to_json_string(*chunk);
+	if (NULL == chunk_str ||
+	    NULL == string_list_append_const(&monitor_zk->push_sensors_list,
+					     chunk_str,
+					     strlen(chunk_str),
+					     STRING_LIST_STR_F_COPY)) {
+		rdlog(LOG_ERR,
+		      "Can't append ZK sensors chunk to string list (out of "
+		      "memory?)");
+	}
+
+	json_object_put(*chunk);
+	*chunk = json_object_new_array();
+}
+
+/** Split zookeeper sensors in chunks of, at most, push_chunk_sensors sensors
+  and RB_MONITOR_ZK_CHUNK_MAX_BYTES bytes.
+  @param monitor_zk rb_monitor ZooKeeper handler
+  @param zk_sensors Sensors array
+  @return Number of sensors
+  */
 static size_t rb_monitor_zk_parse_sensors(struct rb_monitor_zk *monitor_zk,
 					  json_object *zk_sensors) {
+	size_t chunk_bytes = 0;
+	json_object *chunk = json_object_new_array();
 	int i = 0;
-	for (i = 0; i < json_object_array_length(zk_sensors); ++i) {
+	for (i = 0; chunk && i < json_object_array_length(zk_sensors); ++i) {
 		json_object *value = json_object_array_get_idx(zk_sensors, i);
 		if (NULL == value) {
 			rdlog(LOG_ERR, "ZK sensor %d couldn't be getted", i);
@@ -417,39 +921,48 @@ static size_t rb_monitor_zk_parse_sensors(struct rb_monitor_zk *monitor_zk,
 			continue;
 		}
 
-		void *rc = string_list_append_const(
-				&monitor_zk->push_sensors_list,
-				sensor_str,
-				strlen(sensor_str),
-				STRING_LIST_STR_F_COPY);
-		if (rc == NULL) {
-			rdlog(LOG_ERR,
-			      "Can't append ZK sensor %d to string "
-			      "list (out of memory?)",
-			      i);
-			continue;
+		/* Separator included */
+		const size_t sensor_bytes = strlen(sensor_str) + 1;
+		if ((size_t)json_object_array_length(chunk) ==
+				    monitor_zk->push_chunk_sensors ||
+		    chunk_bytes + sensor_bytes >
+				    RB_MONITOR_ZK_CHUNK_MAX_BYTES) {
+			rb_monitor_zk_push_sensors_chunk(monitor_zk, &chunk);
+			chunk_bytes = 0;
+		}
+
+		if (chunk) {
+			json_object_array_add(chunk, json_object_get(value));
+			chunk_bytes += sensor_bytes;
 		}
 	}
 
-	return i;
+	if (NULL == chunk) {
+		rdlog(LOG_ERR, "Can't allocate ZK sensors chunk (OOM?)");
+		return (size_t)i;
+	}
+
+	rb_monitor_zk_push_sensors_chunk(monitor_zk, &chunk);
+	json_object_put(chunk);
+	return (size_t)i;
 }
 
-struct rb_monitor_zk *init_rbmon_zk(char *host,
-				    uint64_t pop_watcher_timeout,
-				    uint64_t push_timeout,
+struct rb_monitor_zk *init_rbmon_zk(const struct rb_monitor_zk_config *config,
 				    json_object *zk_sensors,
-				    rd_fifoq_t *workers_queue) {
+				    struct _worker_info *worker_info) {
 	char strerror_buf[BUFSIZ];
 
-	assert(host);
+	assert(config);
+	assert(config->host);
 	assert(zk_sensors);
-	assert(workers_queue);
+	assert(worker_info);
 
 	struct rb_monitor_zk *_zk = calloc(1, sizeof(*_zk));
 	if (NULL == _zk) {
 		rdlog(LOG_ERR,
 		      "Can't allocate zookeeper handler (out of "
 		      "memory?)");
+		free(config->host);
 		return NULL;
 	}
 
@@ -457,22 +970,32 @@ struct rb_monitor_zk *init_rbmon_zk(char *host,
 	_zk->magic = RB_MONITOR_ZK_MAGIC;
 #endif
 
-	_zk->zk_host = host;
-	_zk->pop_watcher_timeout = pop_watcher_timeout;
-	_zk->push_timeout = push_timeout;
-	_zk->zk_handler = rb_zk_init(_zk->zk_host, pop_watcher_timeout);
-	rd_thread_create(&_zk->worker, NULL, NULL, zk_mon_watcher, _zk);
-	rd_timer_init(&_zk->timer,
-		      RD_TIMER_RECURR,
-		      _zk->worker,
-		      rb_monitor_leader_push_sensors,
-		      _zk);
-
-	_zk->workers_queue = workers_queue;
+	_zk->zk_host = config->host;
+	_zk->pop_watcher_timeout = (time_t)config->pop_watcher_timeout;
+	_zk->push_timeout = (time_t)config->push_timeout;
+	_zk->push_chunk_sensors = config->push_chunk_sensors;
+	if (0 == _zk->push_chunk_sensors) {
+		_zk->push_chunk_sensors = RB_MONITOR_ZK_DEFAULT_CHUNK_SENSORS;
+	}
+	_zk->distribution = config->distribution;
+	_zk->worker_info = worker_info;
 	string_list_init(&_zk->pop_sensors_list, STRING_LIST_F_LOCK);
 	string_list_init(&_zk->push_sensors_list, 0);
-	rb_monitor_zk_parse_sensors(_zk, zk_sensors);
 
+	if (RB_MONITOR_ZK_DISTRIBUTION_HASH_RING == _zk->distribution) {
+		if (!rb_monitor_zk_ring_init(_zk, config, zk_sensors)) {
+			goto err;
+		}
+	} else {
+		rb_monitor_zk_parse_sensors(_zk, zk_sensors);
+		_zk->sensors_cache = rb_sensor_cache_new();
+		if (NULL == _zk->sensors_cache) {
+			goto err;
+		}
+	}
+
+	_zk->zk_handler = rb_zk_init(_zk->zk_host,
+				     (int)config->pop_watcher_timeout);
 	if (NULL == _zk->zk_handler) {
 		strerror_r(errno, strerror_buf, sizeof(strerror_buf));
 		rdlog(LOG_ERR, "Can't init zookeeper: [%s].", strerror_buf);
@@ -481,14 +1004,73 @@ struct rb_monitor_zk *init_rbmon_zk(char *host,
 		rdlog(LOG_ERR, "Connected to ZooKeeper %s", _zk->zk_host);
 	}
 
+	rd_thread_create(&_zk->worker, NULL, NULL, zk_mon_watcher, _zk);
 	zk_prepare(_zk->zk_handler);
-	try_to_be_master(_zk);
-	sensors_queue_poll_loop_start(_zk);
+
+	if (RB_MONITOR_ZK_DISTRIBUTION_HASH_RING == _zk->distribution) {
+		rb_zk_set_connected_cb(
+				_zk->zk_handler, rb_monitor_zk_join_ring, _zk);
+	} else {
+		rd_timer_init(&_zk->timer,
+			      RD_TIMER_RECURR,
+			      _zk->worker,
+			      rb_monitor_leader_push_sensors,
+			      _zk);
+		try_to_be_master(_zk);
+		rb_zk_set_connected_cb(_zk->zk_handler,
+				       sensors_queue_session_start,
+				       _zk);
+	}
 
 	return _zk;
 err:
-	/// @TODO error treatment
+	stop_zk(_zk);
 	return NULL;
 }
 
+/// Just release string list nodes
+static void string_list_node_noop(char *str, size_t len, void *opaque) {
+	(void)str;
+	(void)len;
+	(void)opaque;
+}
+
+void stop_zk(struct rb_monitor_zk *zk) {
+	if (zk->zk_handler) {
+		/* Closing the session removes our member node, so other
+		instances take our sensors at once */
+		rb_zk_done(zk->zk_handler);
+	}
+
+	if (zk->worker) {
+		if (RB_MONITOR_ZK_DISTRIBUTION_QUEUE == zk->distribution) {
+			rd_timer_stop(&zk->timer);
+		}
+		rd_thread_kill_join(zk->worker, NULL);
+	}
+
+	if (RB_MONITOR_ZK_DISTRIBUTION_HASH_RING == zk->distribution) {
+		free_members(zk->ring.pending_members,
+			     zk->ring.pending_members_count);
+		free_members(zk->ring.sensors_keys, zk->ring.sensors_count);
+		free(zk->ring.owned);
+		free(zk->ring.member_id);
+		if (zk->ring.zk_sensors) {
+			json_object_put(zk->ring.zk_sensors);
+		}
+		pthread_mutex_destroy(&zk->ring.lock);
+	}
+
+	if (zk->sensors_cache) {
+		rb_sensor_cache_done(zk->sensors_cache);
+	}
+
+	string_list_foreach_arg_free(
+			&zk->pop_sensors_list, string_list_node_noop, NULL);
+	string_list_foreach_arg_free(
+			&zk->push_sensors_list, string_list_node_noop, NULL);
+	free(zk->zk_host);
+	free(zk);
+}
+
 #endif /* HAVE_ZOOKEEPER */
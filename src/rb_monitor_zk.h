@@ -25,12 +25,53 @@
 #include <json/json.h>
 #include <librd/rdqueue.h>
 
+#include <stdint.h>
+
+/// How ZooKeeper sensors are distributed between rb_monitor instances
+enum rb_monitor_zk_distribution {
+	/// Every instance owns a slice of a consistent hash ring of members
+	RB_MONITOR_ZK_DISTRIBUTION_HASH_RING,
+	/// Leader pushes sensors to a queue that followers pop
+	RB_MONITOR_ZK_DISTRIBUTION_QUEUE,
+};
+
+/// rb_monitor ZooKeeper config
+struct rb_monitor_zk_config {
+	char *host; ///< ZooKeeper hosts. rb_monitor_zk takes ownership
+	uint64_t pop_watcher_timeout; ///< ZooKeeper session timeout
+	uint64_t push_timeout; ///< Seconds between leader pushes (queue)
+	/// Max sensors per queue element (queue). 0 means default
+	uint64_t push_chunk_sensors;
+	enum rb_monitor_zk_distribution distribution; ///< Distribution
+	/// Member name in the hash ring. NULL means hostname-pid
+	const char *member_id;
+	/// Hash ring virtual nodes per member. 0 means default
+	uint64_t ring_vnodes;
+};
+
 struct rb_monitor_zk;
-struct rb_monitor_zk *init_rbmon_zk(char *host,
-				    uint64_t pop_watcher_timeout,
-				    uint64_t push_timeout,
+struct _worker_info;
+
+/** Start rb_monitor ZooKeeper handler
+  @param config ZooKeeper config
+  @param zk_sensors Sensors to distribute between instances
+  @param worker_info Worker info to parse popped sensors with, and to queue
+  them in its queue. Must outlive ZooKeeper handler.
+  @return New handler, or NULL in case of error
+  */
+struct rb_monitor_zk *init_rbmon_zk(const struct rb_monitor_zk_config *config,
 				    json_object *zk_sensors,
-				    rd_fifoq_t *workers_queue);
+				    struct _worker_info *worker_info);
+
+/** Sensors this instance owns in hash ring distribution
+  @param zk rb_monitor ZooKeeper handler
+  @param generation Ownership generation of the last returned sensors. It is
+  updated if a new array is returned.
+  @return New array with owned sensors if they changed since generation, or
+  NULL. Call it from the thread that owns zk_sensors JSON.
+  */
+json_object *rb_monitor_zk_owned_sensors(struct rb_monitor_zk *zk,
+					 uint64_t *generation);
 
 void stop_zk(struct rb_monitor_zk *zk);
 
@@ -0,0 +1,226 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include "rb_monitors_template.h"
+
+#include "rb_hash.h"
+
+#include <librd/rdlog.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct rb_monitors_template_s {
+#ifndef NDEBUG
+#define RB_MONITORS_TEMPLATE_MAGIC 0xB3A1CE3B3A1CE3L
+	uint64_t magic;
+#endif
+	char *name;			///< Template name
+	rb_monitors_array_t *monitors; ///< Monitors
+	ssize_t **op_vars; ///< Operation variables that needs each monitor
+	struct rb_monitors_schedule *schedule; ///< Evaluation order
+	uint64_t hash;     ///< Hash of the JSON template
+	int refcnt;	///< Reference counting
+};
+
+static void assert_rb_monitors_template(
+		const rb_monitors_template_t *monitors_template) {
+#ifdef RB_MONITORS_TEMPLATE_MAGIC
+	assert(RB_MONITORS_TEMPLATE_MAGIC == monitors_template->magic);
+#else
+	(void)monitors_template;
+#endif
+}
+
+rb_monitors_template_t *parse_rb_monitors_template(const char *name,
+						   json_object *monitors_json) {
+	if (!json_object_is_type(monitors_json, json_type_array)) {
+		rdlog(LOG_ERR,
+		      "Monitors of template %s are not an array",
+		      name ? name : "(sensor)");
+		return NULL;
+	}
+
+	rb_monitors_template_t *ret = calloc(1, sizeof(*ret));
+	if (NULL == ret) {
+		rdlog(LOG_ERR, "Couldn't allocate monitors template (OOM?)");
+		return NULL;
+	}
+
+#ifdef RB_MONITORS_TEMPLATE_MAGIC
+	ret->magic = RB_MONITORS_TEMPLATE_MAGIC;
+#endif
+	ret->refcnt = 1;
+
+	const char *monitors_str = json_object_to_json_string(monitors_json);
+	ret->hash = rb_hash_buf(
+			RB_HASH_INIT, monitors_str, strlen(monitors_str));
+
+	if (name) {
+		ret->name = strdup(name);
+		if (NULL == ret->name) {
+			rdlog(LOG_ERR, "Couldn't allocate template name (OOM?)");
+			goto err;
+		}
+	}
+
+	ret->monitors = parse_rb_monitors(monitors_json);
+	if (NULL == ret->monitors) {
+		goto err;
+	}
+
+	ret->op_vars = get_monitors_dependencies(ret->monitors);
+	if (NULL == ret->op_vars && ret->monitors->count > 0) {
+		goto err;
+	}
+
+	if (ret->op_vars) {
+		ret->schedule = get_monitors_schedule(ret->monitors,
+						      ret->op_vars);
+		if (NULL == ret->schedule) {
+			goto err;
+		}
+	}
+
+	return ret;
+
+err:
+	rb_monitors_template_put(ret);
+	return NULL;
+}
+
+const char *
+rb_monitors_template_name(const rb_monitors_template_t *monitors_template) {
+	assert_rb_monitors_template(monitors_template);
+	return monitors_template->name;
+}
+
+rb_monitors_array_t *
+rb_monitors_template_monitors(const rb_monitors_template_t *monitors_template) {
+	assert_rb_monitors_template(monitors_template);
+	return monitors_template->monitors;
+}
+
+ssize_t **
+rb_monitors_template_deps(const rb_monitors_template_t *monitors_template) {
+	assert_rb_monitors_template(monitors_template);
+	return monitors_template->op_vars;
+}
+
+const struct rb_monitors_schedule *rb_monitors_template_schedule(
+		const rb_monitors_template_t *monitors_template) {
+	assert_rb_monitors_template(monitors_template);
+	return monitors_template->schedule;
+}
+
+uint64_t
+rb_monitors_template_hash(const rb_monitors_template_t *monitors_template) {
+	assert_rb_monitors_template(monitors_template);
+	return monitors_template->hash;
+}
+
+void rb_monitors_template_get(rb_monitors_template_t *monitors_template) {
+	assert_rb_monitors_template(monitors_template);
+	ATOMIC_OP(add, fetch, &monitors_template->refcnt, 1);
+}
+
+/** Free template resources
+  @param monitors_template Template to free
+  */
+static void
+rb_monitors_template_done(rb_monitors_template_t *monitors_template) {
+	free_monitors_schedule(monitors_template->schedule);
+	if (monitors_template->op_vars) {
+		free_monitors_dependencies(monitors_template->op_vars,
+					   monitors_template->monitors->count);
+	}
+	if (monitors_template->monitors) {
+		rb_monitors_array_done(monitors_template->monitors);
+	}
+	free(monitors_template->name);
+	free(monitors_template);
+}
+
+void rb_monitors_template_put(rb_monitors_template_t *monitors_template) {
+	assert_rb_monitors_template(monitors_template);
+	if (0 == ATOMIC_OP(sub, fetch, &monitors_template->refcnt, 1)) {
+		rb_monitors_template_done(monitors_template);
+	}
+}
+
+rb_monitors_templates_t *
+parse_rb_monitors_templates(json_object *templates_json) {
+	if (!json_object_is_type(templates_json, json_type_object)) {
+		rdlog(LOG_ERR, "Monitors templates must be an object");
+		return NULL;
+	}
+
+	rb_monitors_templates_t *ret =
+			rb_array_new((size_t)json_object_object_length(
+					templates_json));
+	if (NULL == ret) {
+		rdlog(LOG_ERR, "Couldn't allocate templates array (OOM?)");
+		return NULL;
+	}
+
+	json_object_object_foreach(templates_json, key, val) {
+		rb_monitors_template_t *monitors_template =
+				parse_rb_monitors_template(key, val);
+		if (NULL == monitors_template) {
+			rdlog(LOG_ERR, "Couldn't parse template %s", key);
+			continue;
+		}
+
+		if (rb_array_full(ret)) {
+			rdlog(LOG_CRIT,
+			      "Templates array full at %zu, can't add %s",
+			      ret->size,
+			      key);
+			rb_monitors_template_put(monitors_template);
+			break;
+		}
+
+		rb_array_add(ret, monitors_template);
+	}
+
+	return ret;
+}
+
+rb_monitors_template_t *
+rb_monitors_templates_get(const rb_monitors_templates_t *templates,
+			  const char *name) {
+	for (size_t i = 0; templates && i < templates->count; ++i) {
+		rb_monitors_template_t *monitors_template = templates->elms[i];
+		if (0 == strcmp(monitors_template->name, name)) {
+			rb_monitors_template_get(monitors_template);
+			return monitors_template;
+		}
+	}
+
+	return NULL;
+}
+
+void rb_monitors_templates_done(rb_monitors_templates_t *templates) {
+	for (size_t i = 0; i < templates->count; ++i) {
+		rb_monitors_template_put(templates->elms[i]);
+	}
+	rb_array_done(templates);
+}
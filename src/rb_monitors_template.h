@@ -0,0 +1,112 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "rb_array.h"
+#include "rb_sensor_monitor_array.h"
+
+#include <json-c/json.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/** Immutable monitors definition, shared between all sensors that use it.
+  Sensors keep their own state (enrichment, last values) apart.
+  */
+typedef struct rb_monitors_template_s rb_monitors_template_t;
+
+/** Parse a monitors template
+  @param name Template name, or NULL if it is a sensor private monitors list
+  @param monitors_json JSON array of monitors
+  @return New monitors template, with 1 reference
+  */
+rb_monitors_template_t *parse_rb_monitors_template(const char *name,
+						   json_object *monitors_json);
+
+/** Template name
+  @param monitors_template Monitors template
+  @return Template name, or NULL if it is a sensor private template
+  */
+const char *
+rb_monitors_template_name(const rb_monitors_template_t *monitors_template);
+
+/** Template monitors
+  @param monitors_template Monitors template
+  @return Monitors array
+  */
+rb_monitors_array_t *
+rb_monitors_template_monitors(const rb_monitors_template_t *monitors_template);
+
+/** Template monitors dependencies (see get_monitors_dependencies)
+  @param monitors_template Monitors template
+  @return Monitors dependencies
+  */
+ssize_t **
+rb_monitors_template_deps(const rb_monitors_template_t *monitors_template);
+
+/** Template monitors evaluation schedule (see get_monitors_schedule)
+  @param monitors_template Monitors template
+  @return Monitors schedule
+  */
+const struct rb_monitors_schedule *rb_monitors_template_schedule(
+		const rb_monitors_template_t *monitors_template);
+
+/** Template content hash, to detect changes in config reloads
+  @param monitors_template Monitors template
+  @return Hash of the template JSON definition
+  */
+uint64_t
+rb_monitors_template_hash(const rb_monitors_template_t *monitors_template);
+
+/** Increase template reference counter
+  @param monitors_template Monitors template
+  */
+void rb_monitors_template_get(rb_monitors_template_t *monitors_template);
+
+/** Decrease template reference counter, freeing it if it reach 0
+  @param monitors_template Monitors template
+  */
+void rb_monitors_template_put(rb_monitors_template_t *monitors_template);
+
+/// Named monitors templates
+typedef struct rb_array rb_monitors_templates_t;
+
+/** Parse named templates
+  @param templates_json JSON object with template name as key and
+  monitors array as value
+  @return Templates array. Need to free with rb_monitors_templates_done
+  */
+rb_monitors_templates_t *
+parse_rb_monitors_templates(json_object *templates_json);
+
+/** Search a template by name
+  @param templates Templates array
+  @param name Template name
+  @return Template, with an extra reference, or NULL if not found
+  */
+rb_monitors_template_t *
+rb_monitors_templates_get(const rb_monitors_templates_t *templates,
+			  const char *name);
+
+/** Release templates array
+  @param templates Templates array
+  @note Templates used by sensors are kept alive until these sensors are
+  released
+  */
+void rb_monitors_templates_done(rb_monitors_templates_t *templates);
@@ -0,0 +1,259 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rb_msgpack.h"
+
+#include <librd/rdlog.h>
+
+#include <inttypes.h>
+#include <string.h>
+
+/** Append a MessagePack type byte followed by a big endian integer
+  @param buf Buffer
+  @param type Type byte
+  @param val Integer
+  @param val_len Integer bytes (0, 1, 2, 4 or 8)
+  @return 0 if success
+  */
+static int msgpack_put(struct printbuf *buf,
+		       uint8_t type,
+		       uint64_t val,
+		       size_t val_len) {
+	char aux[1 + sizeof(val)];
+
+	aux[0] = (char)type;
+	for (size_t i = 0; i < val_len; ++i) {
+		aux[val_len - i] = (char)(val >> (8 * i));
+	}
+
+	return printbuf_memappend(buf, aux, (int)(1 + val_len)) < 0 ? -1 : 0;
+}
+
+/** Append a MessagePack header of maps, arrays or strings
+  @param buf Buffer
+  @param n Number of elements
+  @param fix_type Type byte of the fix version, or 0 if there is none
+  @param fix_max Max n of the fix version
+  @param types 8, 16 and 32 bits versions type bytes, 0 if there is none
+  @return 0 if success
+  */
+static int msgpack_header(struct printbuf *buf,
+			  uint64_t n,
+			  uint8_t fix_type,
+			  uint64_t fix_max,
+			  const uint8_t types[3]) {
+	if (n <= fix_max) {
+		return msgpack_put(buf, (uint8_t)(fix_type | n), 0, 0);
+	} else if (types[0] && n <= UINT8_MAX) {
+		return msgpack_put(buf, types[0], n, 1);
+	} else if (n <= UINT16_MAX) {
+		return msgpack_put(buf, types[1], n, 2);
+	} else if (n <= UINT32_MAX) {
+		return msgpack_put(buf, types[2], n, 4);
+	}
+
+	rdlog(LOG_ERR, "Can't encode %" PRIu64 " elements in MessagePack", n);
+	return -1;
+}
+
+int rb_msgpack_nil(struct printbuf *buf) {
+	return msgpack_put(buf, 0xc0, 0, 0);
+}
+
+int rb_msgpack_bool(struct printbuf *buf, bool b) {
+	return msgpack_put(buf, b ? 0xc3 : 0xc2, 0, 0);
+}
+
+int rb_msgpack_uint(struct printbuf *buf, uint64_t u) {
+	if (u <= 0x7f) {
+		return msgpack_put(buf, (uint8_t)u, 0, 0);
+	} else if (u <= UINT8_MAX) {
+		return msgpack_put(buf, 0xcc, u, 1);
+	} else if (u <= UINT16_MAX) {
+		return msgpack_put(buf, 0xcd, u, 2);
+	} else if (u <= UINT32_MAX) {
+		return msgpack_put(buf, 0xce, u, 4);
+	} else {
+		return msgpack_put(buf, 0xcf, u, 8);
+	}
+}
+
+int rb_msgpack_int(struct printbuf *buf, int64_t i) {
+	if (i >= 0) {
+		return rb_msgpack_uint(buf, (uint64_t)i);
+	} else if (i >= -32) {
+		/* Negative fixint */
+		return msgpack_put(buf, (uint8_t)i, 0, 0);
+	} else if (i >= INT8_MIN) {
+		return msgpack_put(buf, 0xd0, (uint64_t)i, 1);
+	} else if (i >= INT16_MIN) {
+		return msgpack_put(buf, 0xd1, (uint64_t)i, 2);
+	} else if (i >= INT32_MIN) {
+		return msgpack_put(buf, 0xd2, (uint64_t)i, 4);
+	} else {
+		return msgpack_put(buf, 0xd3, (uint64_t)i, 8);
+	}
+}
+
+int rb_msgpack_double(struct printbuf *buf, double d) {
+	uint64_t u;
+	memcpy(&u, &d, sizeof(u));
+	return msgpack_put(buf, 0xcb, u, sizeof(u));
+}
+
+int rb_msgpack_str_header(struct printbuf *buf, size_t len) {
+	static const uint8_t types[] = {0xd9, 0xda, 0xdb};
+	return msgpack_header(buf, len, 0xa0, 31, types);
+}
+
+int rb_msgpack_str(struct printbuf *buf, const char *str, size_t len) {
+	if (rb_msgpack_str_header(buf, len) < 0) {
+		return -1;
+	}
+
+	return len > 0 && printbuf_memappend(buf, str, (int)len) < 0 ? -1 : 0;
+}
+
+int rb_msgpack_bin_header(struct printbuf *buf, size_t len) {
+	/* There is no fix version of binaries */
+	if (len <= UINT8_MAX) {
+		return msgpack_put(buf, 0xc4, len, 1);
+	} else if (len <= UINT16_MAX) {
+		return msgpack_put(buf, 0xc5, len, 2);
+	} else if (len <= UINT32_MAX) {
+		return msgpack_put(buf, 0xc6, len, 4);
+	}
+
+	rdlog(LOG_ERR, "Can't encode %zu bytes binary in MessagePack", len);
+	return -1;
+}
+
+int rb_msgpack_map(struct printbuf *buf, uint32_t n) {
+	static const uint8_t types[] = {0, 0xde, 0xdf};
+	return msgpack_header(buf, n, 0x80, 15, types);
+}
+
+int rb_msgpack_array(struct printbuf *buf, uint32_t n) {
+	static const uint8_t types[] = {0, 0xdc, 0xdd};
+	return msgpack_header(buf, n, 0x90, 15, types);
+}
+
+/** Append a JSON object
+  @param buf Buffer
+  @param json JSON object
+  @return 0 if success
+  */
+static int msgpack_json_object(struct printbuf *buf, json_object *json) {
+	uint32_t n = 0;
+
+	for (struct json_object_iterator i = json_object_iter_begin(json),
+					 end = json_object_iter_end(json);
+	     !json_object_iter_equal(&i, &end);
+	     json_object_iter_next(&i)) {
+		n++;
+	}
+
+	if (rb_msgpack_map(buf, n) < 0) {
+		return -1;
+	}
+
+	for (struct json_object_iterator i = json_object_iter_begin(json),
+					 end = json_object_iter_end(json);
+	     !json_object_iter_equal(&i, &end);
+	     json_object_iter_next(&i)) {
+		const char *key = json_object_iter_peek_name(&i);
+		if (rb_msgpack_str(buf, key, strlen(key)) < 0 ||
+		    rb_msgpack_json(buf, json_object_iter_peek_value(&i)) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/** Append a JSON array
+  @param buf Buffer
+  @param json JSON array
+  @return 0 if success
+  */
+static int msgpack_json_array(struct printbuf *buf, json_object *json) {
+	const int n = json_object_array_length(json);
+
+	if (rb_msgpack_array(buf, (uint32_t)n) < 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < n; ++i) {
+		if (rb_msgpack_json(buf, json_object_array_get_idx(json, i)) <
+		    0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int rb_msgpack_json(struct printbuf *buf, json_object *json) {
+	const json_type type = json_object_get_type(json);
+
+	switch (type) {
+	case json_type_null:
+		return rb_msgpack_nil(buf);
+	case json_type_boolean:
+		return rb_msgpack_bool(buf, json_object_get_boolean(json));
+	case json_type_double:
+		return rb_msgpack_double(buf, json_object_get_double(json));
+	case json_type_int:
+		return rb_msgpack_int(buf, json_object_get_int64(json));
+	case json_type_string:
+		return rb_msgpack_str(buf,
+				      json_object_get_string(json),
+				      (size_t)json_object_get_string_len(json));
+	case json_type_object:
+		return msgpack_json_object(buf, json);
+	case json_type_array:
+		return msgpack_json_array(buf, json);
+	default:
+		rdlog(LOG_ERR, "Don't know how to encode JSON type %d", type);
+		return -1;
+	};
+}
+
+char *rb_msgpack_from_json_text(const char *text, size_t *msgpack_len) {
+	char *ret = NULL;
+	json_object *json = json_tokener_parse(text);
+	if (NULL == json) {
+		rdlog(LOG_ERR, "Can't parse JSON message to encode it");
+		return NULL;
+	}
+
+	struct printbuf *buf = printbuf_new();
+	if (NULL == buf) {
+		rdlog(LOG_ERR, "Couldn't allocate MessagePack buffer (OOM?)");
+	} else {
+		if (0 == rb_msgpack_json(buf, json)) {
+			ret = buf->buf;
+			*msgpack_len = (size_t)buf->bpos;
+			buf->buf = NULL;
+		}
+		printbuf_free(buf);
+	}
+
+	json_object_put(json);
+	return ret;
+}
@@ -0,0 +1,117 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <json-c/json.h>
+#include <json-c/printbuf.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** MessagePack encoding (https://msgpack.org) over a json-c printbuf.
+  Every function appends the smallest MessagePack representation of its
+  argument, and returns 0 if success or -1 if the buffer could not grow.
+  Maps and arrays are encoded as a header with the number of elements,
+  followed by the elements (key and value in maps).
+  */
+
+/** Append a nil
+  @param buf Buffer
+  @return 0 if success
+  */
+int rb_msgpack_nil(struct printbuf *buf);
+
+/** Append a boolean
+  @param buf Buffer
+  @param b Boolean
+  @return 0 if success
+  */
+int rb_msgpack_bool(struct printbuf *buf, bool b);
+
+/** Append a signed integer
+  @param buf Buffer
+  @param i Integer
+  @return 0 if success
+  */
+int rb_msgpack_int(struct printbuf *buf, int64_t i);
+
+/** Append an unsigned integer
+  @param buf Buffer
+  @param u Integer
+  @return 0 if success
+  */
+int rb_msgpack_uint(struct printbuf *buf, uint64_t u);
+
+/** Append a 64 bits float
+  @param buf Buffer
+  @param d Float
+  @return 0 if success
+  */
+int rb_msgpack_double(struct printbuf *buf, double d);
+
+/** Append a string header. It must be followed by len bytes of string.
+  @param buf Buffer
+  @param len String length
+  @return 0 if success
+  */
+int rb_msgpack_str_header(struct printbuf *buf, size_t len);
+
+/** Append a string
+  @param buf Buffer
+  @param str String
+  @param len String length
+  @return 0 if success
+  */
+int rb_msgpack_str(struct printbuf *buf, const char *str, size_t len);
+
+/** Append a binary header. It must be followed by len raw bytes.
+  @param buf Buffer
+  @param len Binary length
+  @return 0 if success
+  */
+int rb_msgpack_bin_header(struct printbuf *buf, size_t len);
+
+/** Append a map header. It must be followed by n keys and values.
+  @param buf Buffer
+  @param n Number of map pairs
+  @return 0 if success
+  */
+int rb_msgpack_map(struct printbuf *buf, uint32_t n);
+
+/** Append an array header. It must be followed by n elements.
+  @param buf Buffer
+  @param n Number of elements
+  @return 0 if success
+  */
+int rb_msgpack_array(struct printbuf *buf, uint32_t n);
+
+/** Append a JSON value
+  @param buf Buffer
+  @param json JSON value
+  @return 0 if success
+  */
+int rb_msgpack_json(struct printbuf *buf, json_object *json);
+
+/** Encode a JSON text in MessagePack
+  @param text Null terminated JSON text
+  @param msgpack_len Length of returned buffer
+  @return MessagePack buffer that needs to be freed, or NULL if error
+  */
+char *rb_msgpack_from_json_text(const char *text, size_t *msgpack_len);
@@ -20,8 +20,10 @@
 
 #include "rb_sensor.h"
 
+#include "rb_hash.h"
 #include "rb_json.h"
 
+#include "rb_monitors_template.h"
 #include "rb_sensor_monitor_array.h"
 
 #include <librd/rd.h>
@@ -45,11 +47,15 @@ struct rb_sensor_s {
 #endif
 
 	sensor_data_t data;		     ///< Data of sensor
-	rb_monitors_array_t *monitors;       ///< Monitors to ask for
+	rb_monitors_template_t *monitors;    ///< Monitors to ask for
 	rb_monitor_value_array_t *last_vals; ///< Last values
-	ssize_t **op_vars; ///< Operation variables that needs each monitor
+	struct rb_monitor_send_state *send_states; ///< Monitors output state
+	uint64_t hash; ///< Hash of the sensor definition
 	int refcnt;	///< Reference counting
 	pthread_mutex_t lock; ///< Sensor lock
+	struct rb_sensor_stats stats; ///< Processing stats. Atomic access
+	/// Stats at previous rb_sensor_stats_interval call
+	struct rb_sensor_stats reported_stats;
 };
 
 #ifdef RB_SENSOR_MAGIC
@@ -70,6 +76,56 @@ void rb_sensor_unlock(rb_sensor_t *sensor) {
 	pthread_mutex_unlock(&sensor->lock);
 }
 
+/// Cost fields, to operate on all of them
+#define SENSOR_STATS_COST_FIELDS_X                                             \
+	_X(count) _X(wall_time_us) _X(cpu_time_us) _X(messages) _X(bytes)      \
+			_X(snmp_requests) _X(errors)
+
+void rb_sensor_stats_poll(rb_sensor_t *sensor,
+			  time_t start,
+			  const struct rb_stats_cost *cost) {
+	/* Readers load last poll values with no lock */
+	__atomic_store_n(&sensor->stats.last_poll,
+			 (int64_t)start,
+			 __ATOMIC_RELAXED);
+#define _X(field)                                                              \
+	__atomic_store_n(&sensor->stats.last_poll_cost.field,                  \
+			 cost->field,                                          \
+			 __ATOMIC_RELAXED);                                    \
+	ATOMIC_OP64(add, fetch, &sensor->stats.total.field, cost->field);
+	SENSOR_STATS_COST_FIELDS_X
+#undef _X
+}
+
+void rb_sensor_stats_skipped(rb_sensor_t *sensor) {
+	ATOMIC_OP64(add, fetch, &sensor->stats.skipped, 1);
+}
+
+void rb_sensor_stats(rb_sensor_t *sensor, struct rb_sensor_stats *stats) {
+	stats->last_poll = ATOMIC_OP64(add, fetch, &sensor->stats.last_poll, 0);
+#define _X(field)                                                              \
+	stats->last_poll_cost.field = ATOMIC_OP64(                             \
+			add, fetch, &sensor->stats.last_poll_cost.field, 0);   \
+	stats->total.field = ATOMIC_OP64(                                      \
+			add, fetch, &sensor->stats.total.field, 0);
+	SENSOR_STATS_COST_FIELDS_X
+#undef _X
+	stats->skipped = ATOMIC_OP64(add, fetch, &sensor->stats.skipped, 0);
+}
+
+void rb_sensor_stats_interval(rb_sensor_t *sensor,
+			      struct rb_sensor_stats *stats) {
+	struct rb_sensor_stats *reported = &sensor->reported_stats;
+	rb_sensor_stats(sensor, stats);
+
+	const struct rb_sensor_stats curr = *stats;
+#define _X(field) stats->total.field -= reported->total.field;
+	SENSOR_STATS_COST_FIELDS_X
+#undef _X
+	stats->skipped -= reported->skipped;
+	*reported = curr;
+}
+
 /** We assume that sensor name is only requested in config errors, so we only
   save it in enrichment json
  * @param sensor Sensor to obtain string
@@ -90,6 +146,36 @@ const char *rb_sensor_name(const rb_sensor_t *sensor) {
 	return json_object_get_string(jsensor_name);
 }
 
+const json_object *rb_sensor_enrichment(const rb_sensor_t *sensor) {
+	return sensor->data.enrichment;
+}
+
+uint64_t rb_sensor_hash(const rb_sensor_t *sensor) {
+	return sensor->hash;
+}
+
+uint64_t rb_sensor_json_hash(/* const */ json_object *sensor_info,
+			     const struct _worker_info *worker_info) {
+	const char *sensor_str = json_object_to_json_string(sensor_info);
+	uint64_t ret = rb_hash_buf(RB_HASH_INIT, sensor_str, strlen(sensor_str));
+
+	const char *template_name = PARSE_CJSON_CHILD_STR(
+			sensor_info, "monitors_template", NULL);
+	rb_monitors_template_t *monitors_template =
+			template_name ? rb_monitors_templates_get(
+						worker_info->monitors_templates,
+						template_name)
+				      : NULL;
+	if (monitors_template) {
+		const uint64_t template_hash =
+				rb_monitors_template_hash(monitors_template);
+		ret = rb_hash_buf(ret, &template_hash, sizeof(template_hash));
+		rb_monitors_template_put(monitors_template);
+	}
+
+	return ret;
+}
+
 /** Checks if a property is set. If not, it will show error message and will
   set aok to false
   @param ptr Pointer to check if a property is set.
@@ -160,14 +246,60 @@ static bool sensor_create_enrichment(const struct sensor_enrichment *data,
 	return true;
 }
 
+/** Obtain sensor monitors, from its own monitors array or from a shared
+  template
+  @param sensor_info JSON describing sensor
+  @param templates Available monitors templates
+  @param sensor_name Sensor name, for logging
+  @return Sensor monitors template
+  */
+static rb_monitors_template_t *
+sensor_monitors_parse_json(/* const */ json_object *sensor_info,
+			   const rb_monitors_templates_t *templates,
+			   const char *sensor_name) {
+	struct json_object *sensor_monitors = NULL;
+	const char *template_name = PARSE_CJSON_CHILD_STR(
+			sensor_info, "monitors_template", NULL);
+
+	if (template_name) {
+		rb_monitors_template_t *ret =
+				rb_monitors_templates_get(templates, template_name);
+		if (NULL == ret) {
+			rdlog(LOG_ERR,
+			      "Unknown monitors template %s in sensor %s",
+			      template_name,
+			      sensor_name);
+		} else if (json_object_object_get_ex(
+					   sensor_info, "monitors", NULL)) {
+			rdlog(LOG_WARNING,
+			      "Sensor %s has both monitors and "
+			      "monitors_template, ignoring monitors",
+			      sensor_name);
+		}
+		return ret;
+	}
+
+	json_object_object_get_ex(sensor_info, "monitors", &sensor_monitors);
+	if (NULL == sensor_monitors) {
+		rdlog(LOG_ERR,
+		      "Could not obtain JSON sensors monitors. "
+		      "Skipping");
+		return NULL;
+	}
+
+	return parse_rb_monitors_template(NULL, sensor_monitors);
+}
+
 /** Fill sensor information
   @param sensor Sensor to store information
   @param sensor_info JSON describing sensor
+  @param templates Available monitors templates
   */
 static bool
 sensor_common_attrs_parse_json(rb_sensor_t *sensor,
-			       /* const */ json_object *sensor_info) {
-	struct json_object *sensor_monitors = NULL;
+			       /* const */ json_object *sensor_info,
+			       const rb_monitors_templates_t *templates) {
+	json_object *enrichment = NULL;
 	// clang-format off
 	const struct sensor_enrichment sensor_enrichment = {
 		.sensor_id = PARSE_CJSON_CHILD_INT64(
@@ -182,14 +314,6 @@ sensor_common_attrs_parse_json(rb_sensor_t *sensor,
 		goto err;
 	}
 
-	json_object_object_get_ex(sensor_info, "monitors", &sensor_monitors);
-	if (NULL == sensor_monitors) {
-		rdlog(LOG_ERR,
-		      "Could not obtain JSON sensors monitors. "
-		      "Skipping");
-		goto err;
-	}
-
 	sensor->data.snmp_params.session.timeout = PARSE_CJSON_CHILD_INT64(
 			sensor_info,
 			"timeout",
@@ -206,32 +330,34 @@ sensor_common_attrs_parse_json(rb_sensor_t *sensor,
 				snmp_version, sensor_enrichment.sensor_name);
 	}
 
-	json_object_object_get_ex(
-			sensor_info, "enrichment", &sensor->data.enrichment);
+	/* Copy, so we don't modify original config */
+	json_object_object_get_ex(sensor_info, "enrichment", &enrichment);
+	sensor->data.enrichment = enrichment ? json_object_object_copy(enrichment)
+					     : json_object_new_object();
 	if (NULL == sensor->data.enrichment) {
-		sensor->data.enrichment = json_object_new_object();
-		if (NULL == sensor->data.enrichment) {
-			rdlog(LOG_CRIT,
-			      "Couldn't allocate sensor %s enrichment",
-			      sensor_enrichment.sensor_name);
-			goto err;
-		}
+		rdlog(LOG_CRIT,
+		      "Couldn't allocate sensor %s enrichment",
+		      sensor_enrichment.sensor_name);
+		goto err;
 	}
 
 	const bool create_enrichment_rc = sensor_create_enrichment(
 			&sensor_enrichment, sensor->data.enrichment);
 
-	sensor->monitors = parse_rb_monitors(sensor_monitors,
-					     sensor->data.enrichment);
 	if (!create_enrichment_rc) {
 		goto err;
 	}
 
+	sensor->monitors = sensor_monitors_parse_json(
+			sensor_info, templates, sensor_enrichment.sensor_name);
 	if (NULL != sensor->monitors) {
-		const size_t monitors_count = sensor->monitors->count;
-		sensor->op_vars = get_monitors_dependencies(sensor->monitors);
+		const size_t monitors_count =
+				rb_monitors_template_monitors(sensor->monitors)
+						->count;
 		sensor->last_vals = rb_monitor_value_array_new(monitors_count);
-		if (NULL == sensor->last_vals) {
+		sensor->send_states = calloc(monitors_count,
+					     sizeof(sensor->send_states[0]));
+		if (NULL == sensor->last_vals || NULL == sensor->send_states) {
 			rdlog(LOG_CRIT, "Couldn't allocate memory for sensor");
 			goto err;
 		} else {
@@ -276,8 +402,10 @@ static bool sensor_common_attrs_check_sensor(const rb_sensor_t *sensor) {
   @todo recorver sensor_info const (in modern cjson libraries)
   */
 static bool sensor_common_attrs(rb_sensor_t *sensor,
-				/* const */ json_object *sensor_info) {
-	const bool rc = sensor_common_attrs_parse_json(sensor, sensor_info);
+				/* const */ json_object *sensor_info,
+				const rb_monitors_templates_t *templates) {
+	const bool rc = sensor_common_attrs_parse_json(
+			sensor, sensor_info, templates);
 	return rc && sensor_common_attrs_check_sensor(sensor);
 }
 
@@ -299,10 +427,13 @@ rb_sensor_t *parse_rb_sensor(/* const */ json_object *sensor_info,
 	if (ret) {
 		sensor_set_defaults(worker_info, ret);
 		pthread_mutex_init(&ret->lock, NULL);
-		const bool sensor_ok = sensor_common_attrs(ret, sensor_info);
+		const bool sensor_ok = sensor_common_attrs(
+				ret, sensor_info, worker_info->monitors_templates);
 		if (!sensor_ok) {
 			rb_sensor_put(ret);
 			ret = NULL;
+		} else {
+			ret->hash = rb_sensor_json_hash(sensor_info, worker_info);
 		}
 	}
 
@@ -318,13 +449,32 @@ rb_sensor_t *parse_rb_sensor(/* const */ json_object *sensor_info,
 bool process_rb_sensor(struct _worker_info *worker_info,
 		       rb_sensor_t *sensor,
 		       rb_message_list *ret) {
-	return process_monitors_array(worker_info,
-				      sensor,
-				      sensor->monitors,
-				      sensor->last_vals,
-				      sensor->op_vars,
-				      &sensor->data.snmp_params,
-				      ret);
+	return process_monitors_array(
+			worker_info,
+			sensor,
+			rb_monitors_template_monitors(sensor->monitors),
+			sensor->last_vals,
+			sensor->send_states,
+			rb_monitors_template_deps(sensor->monitors),
+			rb_monitors_template_schedule(sensor->monitors),
+			&sensor->data.snmp_params,
+			ret);
+}
+
+void rb_sensor_flush_windows(const struct _worker_info *worker_info,
+			     rb_sensor_t *sensor,
+			     rb_message_list *ret) {
+	if (NULL == sensor->send_states) {
+		return;
+	}
+
+	rb_sensor_lock(sensor);
+	flush_monitors_windows(worker_info,
+			       sensor,
+			       rb_monitors_template_monitors(sensor->monitors),
+			       sensor->send_states,
+			       ret);
+	rb_sensor_unlock(sensor);
 }
 
 /// @todo find a better way
@@ -340,20 +490,20 @@ static void free_const_str(const char *str) {
 static void sensor_done(rb_sensor_t *sensor) {
 	free_const_str(sensor->data.snmp_params.peername);
 	free_const_str(sensor->data.snmp_params.session.community);
-	if (sensor->op_vars) {
-		free_monitors_dependencies(sensor->op_vars,
-					   sensor->monitors->count);
-	}
 	if (sensor->monitors) {
-		rb_monitors_array_done(sensor->monitors);
+		rb_monitors_template_put(sensor->monitors);
 	}
 	for (size_t i = 0; sensor->last_vals && i < sensor->last_vals->count;
 	     ++i) {
 		if (sensor->last_vals->elms[i]) {
 			rb_monitor_value_done(sensor->last_vals->elms[i]);
 		}
+		if (sensor->send_states) {
+			rb_monitor_send_state_done(&sensor->send_states[i]);
+		}
 	}
 	rb_monitor_value_array_done(sensor->last_vals);
+	free(sensor->send_states);
 	if (sensor->data.enrichment) {
 		json_object_put(sensor->data.enrichment);
 	}
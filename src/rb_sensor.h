@@ -21,12 +21,15 @@
 #include "rb_array.h"
 #include "rb_message_list.h"
 #include "rb_snmp.h"
+#include "rb_stats.h"
 
 #include <json-c/json.h>
 #include <librd/rdqueue.h>
 #include <librdkafka/rdkafka.h>
 
 #include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
 
 /// SHARED Info needed by threads.
 struct _worker_info {
@@ -58,6 +61,19 @@ struct _worker_info {
 	int64_t http_connttimeout;
 	int64_t http_verbose;
 	int64_t rb_http_max_messages;
+	/// Monitors templates sensors can refer to
+	struct rb_array *monitors_templates;
+	/// Protects monitors_templates replacement from sensors parsed in
+	/// other threads (ZooKeeper). Main thread does not need it to read
+	pthread_mutex_t monitors_templates_mutex;
+	/// Local file to write messages to, one per line. "-" is stdout
+	const char *output_file_path;
+	FILE *output_file;
+	/// Messages encoding of every sink
+	enum rb_message_encoding kafka_encoding, http_encoding,
+			output_file_encoding;
+	/// Encodings that configured sinks need (RB_MESSAGE_F_*)
+	unsigned message_encodings;
 };
 
 typedef struct rb_sensor_s rb_sensor_t;
@@ -70,10 +86,37 @@ void assert_rb_sensor(rb_sensor_t *sensor);
 
 rb_sensor_t *parse_rb_sensor(/* const */ json_object *sensor_info,
 			     const struct _worker_info *worker_info);
+
+/** Hash of a sensor definition, including the monitors template it uses.
+  Two sensor definitions with the same hash are considered the same sensor
+  in config reloads.
+  @param sensor_info JSON describing sensor
+  @param worker_info Worker info with monitors templates
+  @return Sensor definition hash
+  */
+uint64_t rb_sensor_json_hash(/* const */ json_object *sensor_info,
+			     const struct _worker_info *worker_info);
+
+/** Hash of the definition the sensor was created from
+  @param sensor Sensor
+  @return Hash, as rb_sensor_json_hash returned
+  */
+uint64_t rb_sensor_hash(const rb_sensor_t *sensor);
 bool process_rb_sensor(struct _worker_info *worker_info,
 		       rb_sensor_t *sensor,
 		       rb_message_list *ret);
 
+/** Close the aggregation windows in progress of a sensor monitors, so their
+  summaries are not lost when the sensor is released. It waits for any worker
+  processing the sensor.
+  @param worker_info Worker information
+  @param sensor Sensor
+  @param ret Windows summaries messages
+  */
+void rb_sensor_flush_windows(const struct _worker_info *worker_info,
+			     rb_sensor_t *sensor,
+			     rb_message_list *ret);
+
 /** Sends a message array
   @param worker_info Worker info
   @param msgs Messages to send
@@ -88,6 +131,12 @@ int worker_process_sensor_send_array(struct _worker_info *worker_info,
   */
 const char *rb_sensor_name(const rb_sensor_t *sensor);
 
+/** Obtains sensor enrichment
+  @param sensor Sensor
+  @return Sensor enrichment, to add to all monitors messages
+  */
+const json_object *rb_sensor_enrichment(const rb_sensor_t *sensor);
+
 /** Increase by 1 the reference counter for sensor
   @param sensor Sensor
   @todo this is not needed if we use proper enrichment
@@ -110,6 +159,45 @@ int rb_sensor_trylock(rb_sensor_t *sensor);
   */
 void rb_sensor_unlock(rb_sensor_t *sensor);
 
+/// Sensor processing stats
+struct rb_sensor_stats {
+	int64_t last_poll;		     ///< Last poll start timestamp
+	struct rb_stats_cost last_poll_cost; ///< Last poll cost
+	struct rb_stats_cost total; ///< Cost of all polls. total.count is the
+				    ///  number of polls
+	uint64_t skipped; ///< Polls skipped because sensor was still being
+			  ///  processed
+};
+
+/** Record a sensor poll. Only the thread that holds sensor lock can call it
+  @param sensor Sensor
+  @param start Poll start timestamp
+  @param cost Poll cost
+  */
+void rb_sensor_stats_poll(rb_sensor_t *sensor,
+			  time_t start,
+			  const struct rb_stats_cost *cost);
+
+/** Record a skipped sensor poll
+  @param sensor Sensor
+  */
+void rb_sensor_stats_skipped(rb_sensor_t *sensor);
+
+/** Get sensor stats. It does not need sensor lock, so it can be called while
+  a worker is processing the sensor.
+  @param sensor Sensor
+  @param stats Stats to fill
+  */
+void rb_sensor_stats(rb_sensor_t *sensor, struct rb_sensor_stats *stats);
+
+/** Get sensor stats since the previous call. Only one thread can call it.
+  @param sensor Sensor
+  @param stats Stats to fill. Costs and skipped polls are the ones since the
+  previous call.
+  */
+void rb_sensor_stats_interval(rb_sensor_t *sensor,
+			      struct rb_sensor_stats *stats);
+
 /** Sensors array */
 typedef struct rb_array rb_sensors_array_t;
 
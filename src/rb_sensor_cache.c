@@ -0,0 +1,192 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include "rb_sensor_cache.h"
+
+#include "rb_json.h"
+
+#include <librd/rdlog.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Cached sensor
+struct rb_sensor_cache_entry {
+	uint64_t hash;	 ///< Sensor definition hash
+	rb_sensor_t *sensor; ///< Sensor
+	time_t last_seen;    ///< Last time sensor was requested
+};
+
+struct rb_sensor_cache {
+#ifndef NDEBUG
+#define RB_SENSOR_CACHE_MAGIC 0x5E5CAC4E5E5CAC4EL
+	uint64_t magic;
+#endif
+	struct rb_sensor_cache_entry *entries; ///< Entries, sorted by hash
+	size_t count;			       ///< Number of entries
+	size_t size;			       ///< Allocated entries
+};
+
+struct rb_sensor_cache *rb_sensor_cache_new(void) {
+	struct rb_sensor_cache *ret = calloc(1, sizeof(*ret));
+	if (NULL == ret) {
+		rdlog(LOG_ERR, "Couldn't allocate sensors cache (OOM?)");
+		return NULL;
+	}
+
+#ifdef RB_SENSOR_CACHE_MAGIC
+	ret->magic = RB_SENSOR_CACHE_MAGIC;
+#endif
+	return ret;
+}
+
+static void assert_rb_sensor_cache(const struct rb_sensor_cache *cache) {
+#ifdef RB_SENSOR_CACHE_MAGIC
+	assert(RB_SENSOR_CACHE_MAGIC == cache->magic);
+#else
+	(void)cache;
+#endif
+}
+
+/** Position of the first entry with hash not less than the given one
+  @param cache Sensors cache
+  @param hash Hash to search
+  @return Position, in [0, count]
+  */
+static size_t sensor_cache_lower_bound(const struct rb_sensor_cache *cache,
+				       uint64_t hash) {
+	size_t low = 0, high = cache->count;
+	while (low < high) {
+		const size_t mid = low + (high - low) / 2;
+		if (cache->entries[mid].hash < hash) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+/** Insert a sensor in the cache
+  @param cache Sensors cache
+  @param pos Position, as sensor_cache_lower_bound returned
+  @param entry Entry to insert
+  @return true if success
+  */
+static bool sensor_cache_insert(struct rb_sensor_cache *cache,
+				size_t pos,
+				const struct rb_sensor_cache_entry *entry) {
+	if (cache->count == cache->size) {
+		const size_t new_size = cache->size ? 2 * cache->size : 16;
+		struct rb_sensor_cache_entry *entries = realloc(
+				cache->entries, new_size * sizeof(entries[0]));
+		if (NULL == entries) {
+			return false;
+		}
+		cache->entries = entries;
+		cache->size = new_size;
+	}
+
+	memmove(&cache->entries[pos + 1],
+		&cache->entries[pos],
+		(cache->count - pos) * sizeof(cache->entries[0]));
+	cache->entries[pos] = *entry;
+	cache->count++;
+	return true;
+}
+
+rb_sensor_t *rb_sensor_cache_get(struct rb_sensor_cache *cache,
+				 json_object *sensor_info,
+				 const struct _worker_info *worker_info,
+				 time_t now) {
+	assert_rb_sensor_cache(cache);
+
+	const char *name =
+			PARSE_CJSON_CHILD_STR(sensor_info, "sensor_name", NULL);
+	if (NULL == name) {
+		/* Sensors are cached by name */
+		rdlog(LOG_ERR, "Sensor without sensor_name, can't use it");
+		return NULL;
+	}
+
+	const uint64_t hash = rb_sensor_json_hash(sensor_info, worker_info);
+	const size_t pos = sensor_cache_lower_bound(cache, hash);
+
+	for (size_t i = pos; i < cache->count && cache->entries[i].hash == hash;
+	     ++i) {
+		rb_sensor_t *sensor = cache->entries[i].sensor;
+		if (0 == strcmp(rb_sensor_name(sensor), name)) {
+			cache->entries[i].last_seen = now;
+			rb_sensor_get(sensor);
+			return sensor;
+		}
+	}
+
+	const struct rb_sensor_cache_entry entry = {
+			.hash = hash,
+			.sensor = parse_rb_sensor(sensor_info, worker_info),
+			.last_seen = now,
+	};
+	if (NULL == entry.sensor) {
+		return NULL;
+	}
+
+	if (!sensor_cache_insert(cache, pos, &entry)) {
+		/* Still usable, but it will be parsed again next time */
+		rdlog(LOG_ERR, "Couldn't cache sensor %s (OOM?)", name);
+		return entry.sensor;
+	}
+
+	rb_sensor_get(entry.sensor);
+	return entry.sensor;
+}
+
+size_t rb_sensor_cache_evict(struct rb_sensor_cache *cache, time_t limit) {
+	size_t kept = 0;
+
+	assert_rb_sensor_cache(cache);
+	for (size_t i = 0; i < cache->count; ++i) {
+		if (cache->entries[i].last_seen < limit) {
+			rb_sensor_put(cache->entries[i].sensor);
+		} else {
+			cache->entries[kept++] = cache->entries[i];
+		}
+	}
+
+	const size_t evicted = cache->count - kept;
+	cache->count = kept;
+	return evicted;
+}
+
+size_t rb_sensor_cache_count(const struct rb_sensor_cache *cache) {
+	assert_rb_sensor_cache(cache);
+	return cache->count;
+}
+
+void rb_sensor_cache_done(struct rb_sensor_cache *cache) {
+	assert_rb_sensor_cache(cache);
+	for (size_t i = 0; i < cache->count; ++i) {
+		rb_sensor_put(cache->entries[i].sensor);
+	}
+	free(cache->entries);
+	free(cache);
+}
@@ -0,0 +1,72 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "rb_sensor.h"
+
+#include <json-c/json.h>
+
+#include <stddef.h>
+#include <time.h>
+
+/** Cache of parsed sensors, by definition. Sensors received many times, like
+  the ones popped from the ZooKeeper queue, are parsed once and keep their
+  state between receptions. Not thread safe.
+  */
+struct rb_sensor_cache;
+
+/** Create a new sensors cache
+  @return New cache, or NULL if no memory
+  */
+struct rb_sensor_cache *rb_sensor_cache_new(void);
+
+/** Get the sensor of a definition, parsing it if it is not cached or its
+  definition changed
+  @param cache Sensors cache
+  @param sensor_info JSON describing sensor
+  @param worker_info Worker info to parse sensor with
+  @param now Current time, to track when the sensor was seen
+  @return Sensor with one extra reference, or NULL if it could not be parsed
+  or it has no sensor_name
+  @note Reads worker_info monitors templates, so caller must hold
+  monitors_templates_mutex if templates can be replaced meanwhile
+  */
+rb_sensor_t *rb_sensor_cache_get(struct rb_sensor_cache *cache,
+				 /* const */ json_object *sensor_info,
+				 const struct _worker_info *worker_info,
+				 time_t now);
+
+/** Release cached sensors that have not been seen since limit. Workers can
+  keep using them until they release their references.
+  @param cache Sensors cache
+  @param limit Oldest last seen time to keep
+  @return Number of evicted sensors
+  */
+size_t rb_sensor_cache_evict(struct rb_sensor_cache *cache, time_t limit);
+
+/** Number of cached sensors
+  @param cache Sensors cache
+  @return Number of sensors
+  */
+size_t rb_sensor_cache_count(const struct rb_sensor_cache *cache);
+
+/** Release a sensors cache and its sensors references
+  @param cache Sensors cache
+  */
+void rb_sensor_cache_done(struct rb_sensor_cache *cache);
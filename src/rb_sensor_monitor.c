@@ -24,10 +24,15 @@
 #include "rb_snmp.h"
 #include "rb_system.h"
 
+#include "rb_float.h"
+#include "rb_intern.h"
 #include "rb_json.h"
+#include "rb_sketch.h"
 
 #include <librd/rdfloat.h>
 
+#include <ctype.h>
+#include <inttypes.h>
 #include <math.h>
 #include <matheval.h>
 
@@ -53,6 +58,61 @@ static const char DEFAULT_TIMESTAMP_SEP[] = ":";
 	/* Will operate over previous results */                               \
 	_X(RB_MONITOR_T__OP, "op", "op", rb_monitor_get_op_result)
 
+/// X-macro to define op functions over previous monitor values. They are
+/// rewritten as plain libmatheval variables, fn(x) -> fn__x
+/// _X(menum,fn)
+#define MONITOR_OP_PREV_FNS_X                                                  \
+	/* Difference with previous value */                                   \
+	_X(RB_MONITOR_OP_FN__DELTA, "delta")                                   \
+	/* Difference with previous value, per second */                       \
+	_X(RB_MONITOR_OP_FN__RATE, "rate")                                     \
+	/* Difference with previous value of a counter, taking into account    \
+	 * SNMP Counter32 wraps. Other decreases are resets */                 \
+	_X(RB_MONITOR_OP_FN__COUNTER_DELTA, "counter_delta")                   \
+	/* Counter difference, per second */                                   \
+	_X(RB_MONITOR_OP_FN__COUNTER_RATE, "counter_rate")
+
+enum monitor_op_prev_fn {
+	RB_MONITOR_OP_FN__NONE,
+#define _X(menum, fn) menum,
+	MONITOR_OP_PREV_FNS_X
+#undef _X
+};
+
+static const char *monitor_op_prev_fns[] = {
+#define _X(menum, fn) fn,
+		MONITOR_OP_PREV_FNS_X
+#undef _X
+};
+
+/// Separator between function and operand in rewritten op variables
+static const char OP_PREV_FN_SEP[] = "__";
+
+/// X-macro to define operations over all vector elements. Percentiles
+/// (pNN) are also accepted.
+/// _X(menum,split_op)
+#define MONITOR_SPLIT_OPS_X                                                    \
+	_X(RB_MONITOR_SPLIT_OP__SUM, "sum")                                    \
+	_X(RB_MONITOR_SPLIT_OP__MEAN, "mean")                                  \
+	_X(RB_MONITOR_SPLIT_OP__MIN, "min")                                    \
+	_X(RB_MONITOR_SPLIT_OP__MAX, "max")                                    \
+	/* Population standard deviation */                                    \
+	_X(RB_MONITOR_SPLIT_OP__STDDEV, "stddev")
+
+enum monitor_split_op_type {
+#define _X(menum, split_op) menum,
+	MONITOR_SPLIT_OPS_X
+#undef _X
+	/// pNN, NN-th percentile
+	RB_MONITOR_SPLIT_OP__PERCENTILE,
+};
+
+/// Max number of split ops of a monitor
+#define MONITOR_MAX_SPLIT_OPS 8
+
+/// Relative accuracy of split ops percentiles
+#define SPLIT_OP_SKETCH_ACCURACY 0.01
+
 struct rb_monitor_s {
 #ifdef RB_MONITOR_MAGIC
 	uint64_t magic;
@@ -62,6 +122,7 @@ struct rb_monitor_s {
 		MONITOR_CMDS_X
 #undef _X
 	} type;
+	/* All strings are interned, see rb_intern.h */
 	const char *name;     ///< Name of monitor
 	const char *argument; ///< Given argument to command / oid / op
 	/// If the monitor is a vector response, how to name each sub-monitor
@@ -74,8 +135,27 @@ struct rb_monitor_s {
 	bool timestamp_given; ///< Timestamp is given in response
 	bool integer;	 ///< Response must be an integer
 	const char *splittok; ///< How to split response
-	const char *splitop;  ///< Do a final operation with tokens
+	size_t splittok_len;  ///< Cached splittok length
+	/// Final operations with all vector elements
+	struct monitor_split_op {
+		enum monitor_split_op_type type;
+		double quantile;  ///< Quantile of percentile split op
+		const char *name; ///< Split op as given in config
+	} splitops[MONITOR_MAX_SPLIT_OPS];
+	size_t splitops_count;
+	bool splitops_named;	   ///< Results are sent as <name>_<split op>
+	bool send_split_instances; ///< Send vector elements, not only split ops
 	const char *cmd_arg;  ///< Argument given to command
+	bool previous_values; ///< Op uses previous values functions (rate...)
+	time_t window;	///< Aggregation window (seconds). 0 sends every value
+	/// Change suppression. Values are not sent if they are in deadband of
+	/// last sent value, unless heartbeat seconds passed since it.
+	struct {
+		bool enabled;	///< Some of these options was given
+		double absolute; ///< Absolute deadband
+		double relative; ///< Deadband relative to last sent value (%)
+		time_t heartbeat; ///< Max silence (seconds). 0 means no limit
+	} deadband;
 	json_object *enrichment;
 };
 
@@ -132,12 +212,140 @@ bool rb_monitor_send(const rb_monitor_t *monitor) {
 	return monitor->send;
 }
 
+bool rb_monitor_need_previous_values(const rb_monitor_t *monitor) {
+	return monitor->previous_values;
+}
+
+time_t rb_monitor_window(const rb_monitor_t *monitor) {
+	return monitor->window;
+}
+
+const char *rb_monitor_split_op_name(const rb_monitor_t *monitor, size_t i) {
+	return monitor->splitops_named ? monitor->splitops[i].name : NULL;
+}
+
+bool rb_monitor_send_split_instances(const rb_monitor_t *monitor) {
+	return monitor->send_split_instances;
+}
+
+bool rb_monitor_suppress_value(const rb_monitor_t *monitor,
+			       double last_sent_value,
+			       time_t last_sent_timestamp,
+			       double value,
+			       time_t timestamp) {
+	if (!monitor->deadband.enabled) {
+		return false;
+	}
+
+	if (monitor->deadband.heartbeat > 0 &&
+	    timestamp - last_sent_timestamp >= monitor->deadband.heartbeat) {
+		return false;
+	}
+
+	const double diff = fabs(value - last_sent_value);
+	return diff <= monitor->deadband.absolute ||
+	       diff <= fabs(last_sent_value) * monitor->deadband.relative /
+				       100;
+}
+
+/** Get the previous values function of an op variable
+  @param var Op variable, as libmatheval sees it
+  @param operand Monitor the function is applied to, or var itself if it is
+  not a function
+  @return Function, or RB_MONITOR_OP_FN__NONE if var is a plain monitor
+  */
+static enum monitor_op_prev_fn op_var_prev_fn(const char *var,
+					      const char **operand) {
+	for (size_t i = 0; i < RD_ARRAYSIZE(monitor_op_prev_fns); ++i) {
+		const size_t fn_len = strlen(monitor_op_prev_fns[i]);
+		const char *fn_operand = &var[fn_len + sizeof(OP_PREV_FN_SEP) - 1];
+		if (0 == strncmp(var, monitor_op_prev_fns[i], fn_len) &&
+		    0 == strncmp(&var[fn_len],
+				 OP_PREV_FN_SEP,
+				 sizeof(OP_PREV_FN_SEP) - 1) &&
+		    '\0' != *fn_operand) {
+			*operand = fn_operand;
+			return (enum monitor_op_prev_fn)(i + 1);
+		}
+	}
+
+	*operand = var;
+	return RB_MONITOR_OP_FN__NONE;
+}
+
+static bool op_ident_char(char c) {
+	return isalnum((unsigned char)c) || '_' == c;
+}
+
+/** Rewrite previous values functions calls of an operation, so libmatheval
+  sees them as plain variables: rate(x) -> rate__x
+  @param op Operation
+  @param uses_prev_fns Set to true if op uses any of these functions
+  @return New allocated operation, or NULL if no memory
+  */
+static char *op_expand_prev_fns(const char *op, bool *uses_prev_fns) {
+	static const char blanks[] = " \t";
+	/* Rewritten call is never longer than the original one */
+	char *ret = malloc(strlen(op) + 1);
+	if (NULL == ret) {
+		return NULL;
+	}
+
+	char *cursor = ret;
+	*uses_prev_fns = false;
+	for (const char *i = op; *i;) {
+		const bool ident_start = i == op || !op_ident_char(i[-1]);
+		size_t fn_len = 0, call_len = 0, operand_len = 0;
+		const char *operand = NULL;
+
+		for (size_t f = 0; ident_start && 0 == call_len &&
+				   f < RD_ARRAYSIZE(monitor_op_prev_fns);
+		     ++f) {
+			fn_len = strlen(monitor_op_prev_fns[f]);
+			if (0 != strncmp(i, monitor_op_prev_fns[f], fn_len)) {
+				continue;
+			}
+
+			const char *c = i + fn_len;
+			c += strspn(c, blanks);
+			if ('(' != *c++) {
+				continue;
+			}
+			c += strspn(c, blanks);
+			for (operand = c; op_ident_char(*c); ++c)
+				;
+			operand_len = (size_t)(c - operand);
+			c += strspn(c, blanks);
+			if (operand_len > 0 && ')' == *c++) {
+				call_len = (size_t)(c - i);
+			}
+		}
+
+		if (call_len > 0) {
+			cursor += sprintf(cursor,
+					  "%.*s%s%.*s",
+					  (int)fn_len,
+					  i,
+					  OP_PREV_FN_SEP,
+					  (int)operand_len,
+					  operand);
+			i += call_len;
+			*uses_prev_fns = true;
+		} else {
+			*cursor++ = *i++;
+		}
+	}
+	*cursor = '\0';
+
+	return ret;
+}
+
 const char *rb_monitor_get_cmd_data(const rb_monitor_t *monitor) {
 	return monitor->argument;
 }
 
 void rb_monitor_get_op_variables(const rb_monitor_t *monitor,
-				 char ***vars,
+				 const char ***vars,
 				 size_t *vars_size) {
 	void *evaluator = NULL;
 	(*vars) = NULL;
@@ -152,7 +360,7 @@ void rb_monitor_get_op_variables(const rb_monitor_t *monitor,
 		goto no_deps;
 	}
 
-	evaluator = evaluator_create((char *)monitor->cmd_arg);
+	evaluator = rb_evaluator_create(monitor->cmd_arg);
 	if (NULL == evaluator) {
 		rdlog(LOG_ERR,
 		      "Couldn't create an evaluator from %s",
@@ -169,13 +377,16 @@ void rb_monitor_get_op_variables(const rb_monitor_t *monitor,
 		goto no_deps;
 	}
 	for (int i = 0; i < all_vars.count; ++i) {
-		(*vars)[i] = strdup(all_vars.vars[i]);
+		/* Functions of previous values depend on their operand */
+		const char *operand = NULL;
+		op_var_prev_fn(all_vars.vars[i], &operand);
+		(*vars)[i] = rb_intern(operand);
 		if (NULL == (*vars)[i]) {
 			rdlog(LOG_ERR,
-			      "Couldn't strdup %s (OOM?)",
+			      "Couldn't intern %s (OOM?)",
 			      all_vars.vars[i]);
 			for (int j = 0; j < i; ++j) {
-				free((*vars)[j]);
+				rb_intern_put((*vars)[j]);
 				(*vars)[j] = NULL;
 			}
 			goto no_deps;
@@ -197,48 +408,30 @@ no_deps:
 	}
 }
 
-void rb_monitor_free_op_variables(char **vars, size_t vars_size) {
+void rb_monitor_free_op_variables(const char **vars, size_t vars_size) {
 	for (size_t i = 0; i < vars_size; ++i) {
-		free(vars[i]);
+		rb_intern_put(vars[i]);
 	}
 	free(vars);
 }
 
-/** Free a const string.
-  @todo remove this, is ugly
-  */
-static void free_const_str(const char *str) {
-	char *aux;
-	memcpy(&aux, &str, sizeof(aux));
-	free(aux);
-}
-
 void rb_monitor_done(rb_monitor_t *monitor) {
-	free_const_str(monitor->name);
-	free_const_str(monitor->argument);
-	free_const_str(monitor->name_split_suffix);
-	free_const_str(monitor->instance_prefix);
-	free_const_str(monitor->group_id);
-	free_const_str(monitor->splittok);
-	free_const_str(monitor->splitop);
-	free_const_str(monitor->cmd_arg);
+	rb_intern_put(monitor->name);
+	rb_intern_put(monitor->argument);
+	rb_intern_put(monitor->name_split_suffix);
+	rb_intern_put(monitor->instance_prefix);
+	rb_intern_put(monitor->group_id);
+	rb_intern_put(monitor->splittok);
+	for (size_t i = 0; i < monitor->splitops_count; ++i) {
+		rb_intern_put(monitor->splitops[i].name);
+	}
+	rb_intern_put(monitor->cmd_arg);
 	if (monitor->enrichment) {
 		json_object_put(monitor->enrichment);
 	}
 	free(monitor);
 }
 
-/** strtod conversion plus set errno=EINVAL if no conversion is possible
-  @param str input string
-  @return double
-  */
-static double toDouble(const char *str) {
-	char *endPtr;
-	errno = 0;
-	double d = strtod(str, &endPtr);
-	return d;
-}
-
 /** Get monitor command
   @param monitor Monitor to save command
   @param json_monitor JSON monitor to extract command
@@ -265,20 +458,99 @@ extract_monitor_cmd(enum monitor_cmd_type *type,
 	return NULL;
 }
 
-/** Checks if a split operation is valid
-  @param split_op requested split op
+/** Parse a split operation
+  @param split_op_str requested split op
+  @param split_op Parsed split op
   @return true if valid, valse in other case
   */
-static bool valid_split_op(const char *split_op) {
-	const char *ops[] = {"sum", "mean"};
+static bool parse_split_op(const char *split_op_str,
+			   struct monitor_split_op *split_op) {
+	static const char *ops[] = {
+#define _X(menum, split_op) split_op,
+			MONITOR_SPLIT_OPS_X
+#undef _X
+	};
+
+	memset(split_op, 0, sizeof(*split_op));
 	for (size_t i = 0; i < RD_ARRAYSIZE(ops); ++i) {
-		if (0 == strcmp(ops[i], split_op)) {
+		if (0 == strcmp(ops[i], split_op_str)) {
+			split_op->type = (enum monitor_split_op_type)i;
+			return true;
+		}
+	}
+
+	if ('p' == split_op_str[0]) {
+		const char *percentile_end = NULL;
+		const double percentile =
+				rb_strtod(&split_op_str[1], &percentile_end);
+		if (percentile_end != &split_op_str[1] &&
+		    '\0' == *percentile_end && percentile >= 0 &&
+		    percentile <= 100) {
+			split_op->type = RB_MONITOR_SPLIT_OP__PERCENTILE;
+			split_op->quantile = percentile / 100;
 			return true;
 		}
 	}
+
 	return false;
 }
 
+/** Add a split operation to a monitor
+  @param monitor Monitor
+  @param split_op_str Split op, as given in config
+  */
+static void rb_monitor_add_split_op(rb_monitor_t *monitor,
+				    const char *split_op_str) {
+	struct monitor_split_op split_op;
+	if (NULL == split_op_str || !parse_split_op(split_op_str, &split_op)) {
+		rdlog(LOG_WARNING,
+		      "Invalid split op %s of monitor %s",
+		      split_op_str ? split_op_str : "(null)",
+		      monitor->name);
+		return;
+	}
+
+	if (monitor->splitops_count == RD_ARRAYSIZE(monitor->splitops)) {
+		rdlog(LOG_WARNING,
+		      "Too many split ops in monitor %s, ignoring %s",
+		      monitor->name,
+		      split_op_str);
+		return;
+	}
+
+	split_op.name = rb_intern(split_op_str);
+	if (NULL == split_op.name) {
+		rdlog(LOG_ERR, "Couldn't allocate split op (OOM?)");
+		return;
+	}
+
+	monitor->splitops[monitor->splitops_count++] = split_op;
+}
+
+/** Parse monitor split operations
+  @param monitor Monitor
+  @param json_split_op Split op, or array of split ops
+  */
+static void rb_monitor_parse_split_ops(rb_monitor_t *monitor,
+				       json_object *json_split_op) {
+	if (json_object_is_type(json_split_op, json_type_array)) {
+		monitor->splitops_named = true;
+		for (size_t i = 0;
+		     i < (size_t)json_object_array_length(json_split_op);
+		     ++i) {
+			rb_monitor_add_split_op(
+					monitor,
+					json_object_get_string(
+							json_object_array_get_idx(
+									json_split_op,
+									i)));
+		}
+	} else if (json_split_op) {
+		rb_monitor_add_split_op(monitor,
+					json_object_get_string(json_split_op));
+	}
+}
+
 /** Parse a JSON monitor
   @param type Type of monitor (oid, system, op...)
   @param cmd_arg Argument of monitor (desired oid, system command, operation...)
@@ -286,35 +558,44 @@ static bool valid_split_op(const char *split_op) {
   */
 static rb_monitor_t *parse_rb_monitor0(enum monitor_cmd_type type,
 				       const char *cmd_arg,
-				       json_object *json_monitor,
-				       json_object *sensor_enrichment) {
+				       json_object *json_monitor) {
 	assert(cmd_arg);
 	assert(json_monitor);
-	assert(sensor_enrichment);
 
-	char *aux_name = PARSE_CJSON_CHILD_DUP_STR(json_monitor, "name", NULL);
+	const char *aux_name = PARSE_CJSON_CHILD_STR(json_monitor, "name", NULL);
 	if (NULL == aux_name) {
 		rdlog(LOG_ERR, "Monitor with no name");
 		return NULL;
 	}
 
-	char *aux_split_op = PARSE_CJSON_CHILD_DUP_STR(
-			json_monitor, "split_op", NULL);
-	char *unit = PARSE_CJSON_CHILD_DUP_STR(json_monitor, "unit", NULL);
-	char *group_name = PARSE_CJSON_CHILD_DUP_STR(
-			json_monitor, "group_name", NULL);
+	const char *unit = PARSE_CJSON_CHILD_STR(json_monitor, "unit", NULL);
+	const char *group_name =
+			PARSE_CJSON_CHILD_STR(json_monitor, "group_name", NULL);
 
 	/// @todo change to true/false
 	int aux_timestamp_given = PARSE_CJSON_CHILD_INT64(
 			json_monitor, "timestamp_given", 0);
 
-	if (aux_split_op && !valid_split_op(aux_split_op)) {
+	int64_t aux_window = PARSE_CJSON_CHILD_INT64(json_monitor, "window", 0);
+	if (aux_window < 0) {
 		rdlog(LOG_WARNING,
-		      "Invalid split op %s of monitor %s",
-		      aux_split_op,
+		      "Invalid window %" PRId64 " in monitor %s, ignoring it",
+		      aux_window,
+		      aux_name);
+		aux_window = 0;
+	}
+
+	const double aux_deadband =
+			PARSE_CJSON_CHILD_DOUBLE(json_monitor, "deadband", 0);
+	const double aux_deadband_pct = PARSE_CJSON_CHILD_DOUBLE(
+			json_monitor, "deadband_pct", 0);
+	const int64_t aux_heartbeat =
+			PARSE_CJSON_CHILD_INT64(json_monitor, "heartbeat", 0);
+	if (aux_deadband < 0 || aux_deadband_pct < 0 || aux_heartbeat < 0) {
+		rdlog(LOG_WARNING,
+		      "Negative deadband or heartbeat in monitor %s, ignoring "
+		      "them",
 		      aux_name);
-		free(aux_split_op);
-		aux_split_op = NULL;
 	}
 
 	if (type == RB_MONITOR_T__OP && aux_timestamp_given) {
@@ -328,9 +609,6 @@ static rb_monitor_t *parse_rb_monitor0(enum monitor_cmd_type type,
 	rb_monitor_t *ret = calloc(1, sizeof(*ret));
 	if (NULL == ret) {
 		rdlog(LOG_ERR, "Can't alloc sensor monitor (out of memory?)");
-		free(aux_name);
-		free(aux_split_op);
-		free(unit);
 		return NULL;
 	}
 
@@ -338,22 +616,49 @@ static rb_monitor_t *parse_rb_monitor0(enum monitor_cmd_type type,
 	ret->magic = RB_MONITOR_MAGIC;
 #endif
 
-	ret->splittok = PARSE_CJSON_CHILD_DUP_STR(json_monitor, "split", NULL);
-	ret->splitop = aux_split_op;
-	ret->name = aux_name;
-	ret->name_split_suffix = PARSE_CJSON_CHILD_DUP_STR(
-			json_monitor, "name_split_suffix", NULL);
-	ret->instance_prefix = PARSE_CJSON_CHILD_DUP_STR(
-			json_monitor, "instance_prefix", NULL);
-	ret->group_id = PARSE_CJSON_CHILD_DUP_STR(
-			json_monitor, "group_id", NULL);
+	const char *splittok = PARSE_CJSON_CHILD_STR(json_monitor, "split", NULL);
+	if (splittok && '\0' == splittok[0]) {
+		rdlog(LOG_WARNING,
+		      "Empty split token in monitor %s, ignoring it",
+		      aux_name);
+		splittok = NULL;
+	}
+	ret->splittok = rb_intern(splittok);
+	ret->splittok_len = splittok ? strlen(splittok) : 0;
+	ret->name = rb_intern(aux_name);
+	json_object *json_split_op = NULL;
+	json_object_object_get_ex(json_monitor, "split_op", &json_split_op);
+	rb_monitor_parse_split_ops(ret, json_split_op);
+	ret->send_split_instances = PARSE_CJSON_CHILD_INT64(
+			json_monitor, "send_split_instances", 1);
+	ret->name_split_suffix = rb_intern(PARSE_CJSON_CHILD_STR(
+			json_monitor, "name_split_suffix", NULL));
+	ret->instance_prefix = rb_intern(PARSE_CJSON_CHILD_STR(
+			json_monitor, "instance_prefix", NULL));
+	ret->group_id = rb_intern(
+			PARSE_CJSON_CHILD_STR(json_monitor, "group_id", NULL));
 	ret->timestamp_given = aux_timestamp_given;
 	ret->send = PARSE_CJSON_CHILD_INT64(json_monitor, "send", 1);
 	ret->integer = PARSE_CJSON_CHILD_INT64(json_monitor, "integer", 0);
+	ret->window = (time_t)aux_window;
+	ret->deadband.absolute = aux_deadband > 0 ? aux_deadband : 0;
+	ret->deadband.relative = aux_deadband_pct > 0 ? aux_deadband_pct : 0;
+	ret->deadband.heartbeat = aux_heartbeat > 0 ? (time_t)aux_heartbeat : 0;
+	ret->deadband.enabled = ret->deadband.absolute > 0 ||
+				ret->deadband.relative > 0 ||
+				ret->deadband.heartbeat > 0;
 	ret->type = type;
-	ret->cmd_arg = strdup(cmd_arg);
+	if (RB_MONITOR_T__OP == type) {
+		char *op = op_expand_prev_fns(cmd_arg, &ret->previous_values);
+		if (op) {
+			ret->cmd_arg = rb_intern(op);
+			free(op);
+		}
+	} else {
+		ret->cmd_arg = rb_intern(cmd_arg);
+	}
 
-	ret->enrichment = json_object_object_copy(sensor_enrichment);
+	ret->enrichment = json_object_new_object();
 	if (NULL == ret->enrichment) {
 		rdlog(LOG_CRIT, "Couldn't allocate monitor enrichment (OOM?)");
 		rb_monitor_done(ret);
@@ -398,31 +703,25 @@ static rb_monitor_t *parse_rb_monitor0(enum monitor_cmd_type type,
 		}
 	}
 
-	if (NULL == ret->cmd_arg) {
-		rdlog(LOG_CRIT, "Couldn't allocate cmd_arg (OOM?)");
+	if (NULL == ret->name || NULL == ret->cmd_arg) {
+		rdlog(LOG_CRIT, "Couldn't allocate monitor strings (OOM?)");
 		rb_monitor_done(ret);
 		ret = NULL;
 	}
 
 err:
-	free(group_name);
-	free(unit);
 	return ret;
 }
 
-rb_monitor_t *
-parse_rb_monitor(json_object *json_monitor,
-		 /* @todo const */ json_object *sensor_enrichment) {
+rb_monitor_t *parse_rb_monitor(json_object *json_monitor) {
 	enum monitor_cmd_type cmd_type;
 	const char *cmd_arg = extract_monitor_cmd(&cmd_type, json_monitor);
 	if (NULL == cmd_arg) {
 		rdlog(LOG_ERR, "Couldn't extract monitor command");
 		return NULL;
 	} else {
-		rb_monitor_t *ret = parse_rb_monitor0(cmd_type,
-						      cmd_arg,
-						      json_monitor,
-						      sensor_enrichment);
+		rb_monitor_t *ret =
+				parse_rb_monitor0(cmd_type, cmd_arg, json_monitor);
 
 		return ret;
 	}
@@ -453,12 +752,16 @@ void destroy_process_sensor_monitor_ctx(
 }
 
 /* FW declaration */
-static struct monitor_value *
-process_novector_monitor(const char *value_buf, double number, time_t now);
-
 static struct monitor_value *process_vector_monitor(const rb_monitor_t *monitor,
 						    const char *value_buf,
+						    size_t value_buf_len,
 						    time_t now);
+static struct monitor_value *
+rb_monitor_value_from_response(const rb_monitor_t *monitor,
+			       char *value_buf,
+			       size_t value_buf_size,
+			       double number,
+			       enum monitor_value_counter counter);
 
 /** Base function to obtain an external value, and to manage it as a vector or
   as an integer
@@ -478,23 +781,50 @@ rb_monitor_get_external_value(const rb_monitor_t *monitor,
 	double number = 0;
 	char value_buf[BUFSIZ];
 	value_buf[0] = '\0';
-	struct monitor_value *ret = NULL;
 	const bool ok = get_value_cb(value_buf,
 				     sizeof(value_buf),
 				     &number,
 				     get_value_cb_ctx,
 				     monitor->cmd_arg);
 
-	if (0 == strlen(value_buf)) {
+	return rb_monitor_value_from_response(monitor,
+					      value_buf,
+					      sizeof(value_buf),
+					      number,
+					      MONITOR_VALUE_COUNTER__UNKNOWN);
+}
+
+/** Creates a monitor value from an external response
+  @param monitor Monitor the response belongs to
+  @param value_buf Response in text format
+  @param value_buf_size value_buf size
+  @param number Response in double format
+  @param counter Width of the counter response was read from
+  @return Monitor value
+  */
+static struct monitor_value *
+rb_monitor_value_from_response(const rb_monitor_t *monitor,
+			       char *value_buf,
+			       size_t value_buf_size,
+			       double number,
+			       enum monitor_value_counter counter) {
+	struct monitor_value *ret = NULL;
+	size_t value_buf_len = strlen(value_buf);
+	if (0 == value_buf_len) {
 		rdlog(LOG_WARNING, "Not seeing %s value. Forcing to 0.", monitor->name);
-		snprintf(value_buf, sizeof(value_buf), "0");
+		snprintf(value_buf, value_buf_size, "0");
+		value_buf_len = strlen(value_buf);
 		number = 0;
 	}
 
 	if (!monitor->splittok) {
-		ret = process_novector_monitor(value_buf, number, time(NULL));
+		ret = new_monitor_value(number, time(NULL));
+		if (ret) {
+			ret->value.counter = counter;
+		}
 	} else /* We have a vector here */ {
-		ret = process_vector_monitor(monitor, value_buf, time(NULL));
+		ret = process_vector_monitor(
+				monitor, value_buf, value_buf_len, time(NULL));
 	}
 
 	return ret;
@@ -504,36 +834,206 @@ rb_monitor_get_external_value(const rb_monitor_t *monitor,
 static struct monitor_value *rb_monitor_get_system_external_value(
 		const rb_monitor_t *monitor,
 		struct process_sensor_monitor_ctx *process_ctx,
-		rb_monitor_value_array_t *ops_vars) {
+		rb_monitor_value_array_t *ops_vars,
+		rb_monitor_value_array_t *prev_op_vars) {
 	(void)process_ctx;
 	(void)ops_vars;
+	(void)prev_op_vars;
 	return rb_monitor_get_external_value(monitor,
 					     system_solve_response,
 					     NULL);
 }
 
-/** Convenience function */
-static bool snmp_solve_response0(char *value_buf,
-				 size_t value_buf_len,
-				 double *number,
-				 void *session,
-				 const char *oid_string) {
-	return snmp_solve_response(value_buf,
-				   value_buf_len,
-				   number,
-				   (struct monitor_snmp_session *)session,
-				   oid_string);
+/** Counter width of a SNMP response
+  @param type Response ASN type
+  @return Counter width, unknown if it is not a counter
+  */
+static enum monitor_value_counter snmp_response_counter(u_char type) {
+	switch (type) {
+	case ASN_COUNTER:
+		return MONITOR_VALUE_COUNTER__32;
+	case ASN_COUNTER64:
+		return MONITOR_VALUE_COUNTER__64;
+	default:
+		return MONITOR_VALUE_COUNTER__UNKNOWN;
+	};
 }
 
 /** Convenience function to obtain SNMP values */
 static struct monitor_value *rb_monitor_get_snmp_external_value(
 		const rb_monitor_t *monitor,
 		struct process_sensor_monitor_ctx *process_ctx,
-		rb_monitor_value_array_t *op_vars) {
+		rb_monitor_value_array_t *op_vars,
+		rb_monitor_value_array_t *prev_op_vars) {
 	(void)op_vars;
-	return rb_monitor_get_external_value(monitor,
-					     snmp_solve_response0,
-					     process_ctx->snmp_sessp);
+	(void)prev_op_vars;
+	double number = 0;
+	u_char type = ASN_NULL;
+	char value_buf[BUFSIZ];
+	value_buf[0] = '\0';
+	snmp_solve_response(value_buf,
+			    sizeof(value_buf),
+			    &number,
+			    &type,
+			    process_ctx->snmp_sessp,
+			    monitor->cmd_arg);
+
+	return rb_monitor_value_from_response(monitor,
+					      value_buf,
+					      sizeof(value_buf),
+					      number,
+					      snmp_response_counter(type));
+}
+
+/// Max number of OIDs asked in the same SNMP PDU
+#define PREFETCH_SNMP_MAX_OIDS 32
+/// Max number of system commands running at the same time
+#define PREFETCH_SYSTEM_MAX_CMDS 16
+/// Buffers needed by prefetch
+#define PREFETCH_MAX_BUFS                                                      \
+	(PREFETCH_SNMP_MAX_OIDS > PREFETCH_SYSTEM_MAX_CMDS                     \
+			 ? PREFETCH_SNMP_MAX_OIDS                              \
+			 : PREFETCH_SYSTEM_MAX_CMDS)
+
+/** Fetch a batch of SNMP monitors in the same PDU
+  @param process_ctx Process context
+  @param prefetch Prefetch entries
+  @param batch Positions of the entries to fetch in prefetch
+  @param batch_size Number of entries in batch
+  @param bufs Buffers to use
+  */
+static void rb_monitors_prefetch_snmp(
+		struct process_sensor_monitor_ctx *process_ctx,
+		struct rb_monitor_prefetch *prefetch,
+		const size_t *batch,
+		size_t batch_size,
+		char (*bufs)[BUFSIZ]) {
+	const char *oids[PREFETCH_SNMP_MAX_OIDS];
+	struct snmp_batch_response responses[PREFETCH_SNMP_MAX_OIDS];
+
+	for (size_t i = 0; i < batch_size; ++i) {
+		oids[i] = prefetch[batch[i]].monitor->cmd_arg;
+		bufs[i][0] = '\0';
+		responses[i].value_buf = bufs[i];
+		responses[i].value_buf_len = BUFSIZ;
+		responses[i].number = 0;
+		responses[i].type = ASN_NULL;
+	}
+
+	const bool solve_rc = snmp_solve_responses(
+			process_ctx->snmp_sessp, oids, responses, batch_size);
+	if (!solve_rc) {
+		/* Will be asked one by one */
+		return;
+	}
+
+	for (size_t i = 0; i < batch_size; ++i) {
+		struct rb_monitor_prefetch *entry = &prefetch[batch[i]];
+		entry->value = rb_monitor_value_from_response(
+				entry->monitor,
+				bufs[i],
+				BUFSIZ,
+				responses[i].number,
+				snmp_response_counter(responses[i].type));
+		entry->fetched = true;
+	}
+}
+
+/** Run a batch of system monitors commands at the same time
+  @param prefetch Prefetch entries
+  @param batch Positions of the entries to fetch in prefetch
+  @param batch_size Number of entries in batch
+  @param bufs Buffers to use
+  */
+static void rb_monitors_prefetch_system(struct rb_monitor_prefetch *prefetch,
+					const size_t *batch,
+					size_t batch_size,
+					char (*bufs)[BUFSIZ]) {
+	FILE *fps[PREFETCH_SYSTEM_MAX_CMDS];
+	const uint64_t start = rb_stats_now();
+
+	/* Launch all commands, so they run concurrently */
+	for (size_t i = 0; i < batch_size; ++i) {
+		fps[i] = popen(prefetch[batch[i]].monitor->cmd_arg, "r");
+	}
+
+	for (size_t i = 0; i < batch_size; ++i) {
+		struct rb_monitor_prefetch *entry = &prefetch[batch[i]];
+		double number = 0;
+		bufs[i][0] = '\0';
+		system_read_response(bufs[i],
+				     BUFSIZ,
+				     &number,
+				     fps[i],
+				     entry->monitor->cmd_arg);
+		rb_stats_histogram_since(RB_STATS_H__SYSTEM_RTT, start);
+		entry->value = rb_monitor_value_from_response(
+				entry->monitor,
+				bufs[i],
+				BUFSIZ,
+				number,
+				MONITOR_VALUE_COUNTER__UNKNOWN);
+		entry->fetched = true;
+	}
+}
+
+void rb_monitors_prefetch(struct process_sensor_monitor_ctx *process_ctx,
+			  struct rb_monitor_prefetch *prefetch,
+			  size_t count) {
+	struct {
+		enum monitor_cmd_type type;
+		size_t max_batch;
+		size_t batch[PREFETCH_MAX_BUFS];
+		size_t batch_size;
+	} batches[] = {
+			{.type = RB_MONITOR_T__OID,
+			 .max_batch = PREFETCH_SNMP_MAX_OIDS},
+			{.type = RB_MONITOR_T__SYSTEM,
+			 .max_batch = PREFETCH_SYSTEM_MAX_CMDS},
+	};
+
+	char(*bufs)[BUFSIZ] = malloc(PREFETCH_MAX_BUFS * sizeof(bufs[0]));
+	if (NULL == bufs) {
+		rdlog(LOG_WARNING,
+		      "Couldn't allocate prefetch buffers, monitors will be "
+		      "asked one by one");
+		return;
+	}
+
+	for (size_t b = 0; b < RD_ARRAYSIZE(batches); ++b) {
+		for (size_t i = 0; i <= count; ++i) {
+			const bool flush = i == count ||
+					   batches[b].batch_size ==
+							   batches[b].max_batch;
+			if (flush && batches[b].batch_size > 0) {
+				if (RB_MONITOR_T__OID == batches[b].type) {
+					if (process_ctx->snmp_sessp) {
+						rb_monitors_prefetch_snmp(
+								process_ctx,
+								prefetch,
+								batches[b].batch,
+								batches[b].batch_size,
+								bufs);
+					}
+				} else {
+					rb_monitors_prefetch_system(
+							prefetch,
+							batches[b].batch,
+							batches[b].batch_size,
+							bufs);
+				}
+				batches[b].batch_size = 0;
+			}
+
+			if (i < count && prefetch[i].monitor &&
+			    !prefetch[i].fetched &&
+			    batches[b].type == prefetch[i].monitor->type) {
+				batches[b].batch[batches[b].batch_size++] = i;
+			}
+		}
+	}
+
+	free(bufs);
 }
 
 /** Create a libmatheval vars using op_vars */
@@ -589,14 +1089,13 @@ err:
   @param f evaluator
   @param libmatheval_vars prepared libmathevals with names and values
   @param monitor Monitor operation belongs
-  @param now This time
-  @return New monitor value
+  @param result Operation result
+  @return true if the operation gave a valid result
   */
-static struct monitor_value *
-rb_monitor_op_value0(void *f,
-		     struct libmatheval_vars *libmatheval_vars,
-		     const rb_monitor_t *monitor,
-		     const time_t now) {
+static bool rb_monitor_op_value0(void *f,
+				 struct libmatheval_vars *libmatheval_vars,
+				 const rb_monitor_t *monitor,
+				 double *result) {
 
 	const char *operation = monitor->cmd_arg;
 	const double number = evaluator_evaluate(f,
@@ -609,23 +1108,74 @@ rb_monitor_op_value0(void *f,
 	      monitor->cmd_arg,
 	      number);
 
-	if (!isnormal(number)) {
+	/* An idle counter rate is a valid 0 */
+	if (!isnormal(number) && !(monitor->previous_values && 0 == number)) {
 		rdlog(LOG_ERR,
 		      "OP %s return a bad value: %lf. Skipping.",
 		      operation,
 		      number);
-		return NULL;
+		return false;
 	}
 
-	char val_buf[64];
-	sprintf(val_buf, "%lf", number);
+	*result = number;
+	return true;
+}
+
+/// Value where 32 bits counters wrap
+#define COUNTER32_WRAP 4294967296.0
+
+/** Compute a function over the previous value of a monitor
+  @param fn Function
+  @param mv Current value
+  @param prev_mv Previous iteration value
+  @param result Function result
+  @return true if it could be computed
+  @note Values are doubles, so counters above 2^53 lose precision, and
+  deltas between them are rounded.
+  */
+static bool op_prev_fn_value(enum monitor_op_prev_fn fn,
+			     const struct monitor_value *mv,
+			     const struct monitor_value *prev_mv,
+			     double *result) {
+	if (NULL == prev_mv || MONITOR_VALUE_T__VALUE != prev_mv->type) {
+		return false;
+	}
 
-	return process_novector_monitor(val_buf, number, now);
+	double delta = mv->value.value - prev_mv->value.value;
+	const bool counter = RB_MONITOR_OP_FN__COUNTER_DELTA == fn ||
+			     RB_MONITOR_OP_FN__COUNTER_RATE == fn;
+	if (counter && delta < 0) {
+		if (MONITOR_VALUE_COUNTER__32 != mv->value.counter ||
+		    MONITOR_VALUE_COUNTER__32 != prev_mv->value.counter) {
+			/* A Counter64 will not wrap in practice, and we can't
+			know the width of other counters, so it is a reset */
+			rdlog(LOG_DEBUG, "Counter decreased, dropping sample");
+			return false;
+		}
+
+		/* Counter32 wrapped */
+		delta += COUNTER32_WRAP;
+	}
+
+	if (RB_MONITOR_OP_FN__DELTA == fn ||
+	    RB_MONITOR_OP_FN__COUNTER_DELTA == fn) {
+		*result = delta;
+		return true;
+	}
+
+	const time_t elapsed = mv->value.timestamp - prev_mv->value.timestamp;
+	if (elapsed <= 0) {
+		return false;
+	}
+
+	*result = delta / (double)elapsed;
+	return true;
 }
 
 /** Do a monitor value operation, with no array involved
   @param f Evaluator
   @param op_vars Operations variables with names
+  @param prev_op_vars Operations variables values in previous iteration
   @param monitor Montior this operation belongs
   @param now This time
   @return new monitor value with operation result
@@ -633,6 +1183,7 @@ rb_monitor_op_value0(void *f,
 static struct monitor_value *
 rb_monitor_op_value(void *f,
 		    rb_monitor_value_array_t *op_vars,
+		    rb_monitor_value_array_t *prev_op_vars,
 		    struct libmatheval_vars *libmatheval_vars,
 		    const rb_monitor_t *monitor,
 		    const time_t now) {
@@ -647,51 +1198,180 @@ rb_monitor_op_value(void *f,
 		}
 
 		rdlog(LOG_DEBUG, "value operation is : %lf ", mv_v->value.value);
-		libmatheval_vars->values[v] = mv_v->value.value;
+		const char *operand = NULL;
+		const enum monitor_op_prev_fn fn = op_var_prev_fn(
+				libmatheval_vars->names[v], &operand);
+		if (RB_MONITOR_OP_FN__NONE == fn) {
+			libmatheval_vars->values[v] = mv_v->value.value;
+			continue;
+		}
+
+		const struct monitor_value *prev_mv_v =
+				prev_op_vars ? rb_monitor_value_array_at(
+						       prev_op_vars, v)
+					     : NULL;
+		if (!op_prev_fn_value(fn,
+				      mv_v,
+				      prev_mv_v,
+				      &libmatheval_vars->values[v])) {
+			/* First iteration, no time elapsed, or counter reset */
+			rdlog(LOG_DEBUG,
+			      "Not enough values of %s to compute %s",
+			      operand,
+			      libmatheval_vars->names[v]);
+			return NULL;
+		}
 	}
 
-	return rb_monitor_op_value0(f, libmatheval_vars, monitor, now);
+	double result = 0;
+	const bool ok = rb_monitor_op_value0(
+			f, libmatheval_vars, monitor, &result);
+	return ok ? new_monitor_value(result, now) : NULL;
 }
 
 /** Gets an operation result of vector position i
+  Operand vectors shorter than v_pos + 1 are treated as not present.
   @param f evaluator
   @param libmatheval_vars Libmatheval prepared variables
   @param v_pos Vector position we want to evaluate
   @param monitor Monitor this operation belongs
-  @param now Time of operation
-  @return Montior value with vector index i of the result
+  @param result Result of the operation
+  @return true if we could compute vector position i
   @todo merge with rb_monitor_op_value
   */
-static struct monitor_value *
-rb_monitor_op_vector_i(void *f,
-		       rb_monitor_value_array_t *op_vars,
-		       struct libmatheval_vars *libmatheval_vars,
-		       size_t v_pos,
-		       const rb_monitor_t *monitor,
-		       const time_t now) {
+static bool rb_monitor_op_vector_i(void *f,
+				   rb_monitor_value_array_t *op_vars,
+				   struct libmatheval_vars *libmatheval_vars,
+				   size_t v_pos,
+				   const rb_monitor_t *monitor,
+				   double *result) {
 	/* Foreach variable in operation, use element i of vector */
 	for (size_t v = 0; v < op_vars->count; ++v) {
 		const struct monitor_value *mv_v =
 				rb_monitor_value_array_at(op_vars, v);
 
-		if (NULL == mv_v || MONITOR_VALUE_T__VALUE != mv_v->type) {
-			rdlog(LOG_ERR, "Could not execute operation, missing valid parameter values");
-			return NULL;
+		if (v_pos >= mv_v->array.children_count ||
+		    !rb_monitor_value_child_present(mv_v, v_pos)) {
+			// We don't have this value, so we can't do operation
+			return false;
 		}
 
-		const struct monitor_value *mv_v_i = mv_v->array.children[v_pos];
-		if (NULL == mv_v_i) {
-			// We don't have this value, so we can't do operation
-			return NULL;
+		libmatheval_vars->values[v] = mv_v->array.values[v_pos];
+	}
+
+	return rb_monitor_op_value0(f, libmatheval_vars, monitor, result);
+}
+
+/// Vector elements accumulator, to compute all split ops in the same pass
+struct split_ops_acc {
+	size_t count;
+	double sum;
+	double mean; ///< Running mean (Welford), for stddev
+	double m2;   ///< Running sum of squared differences from mean
+	double min;
+	double max;
+	struct rb_sketch *sketch; ///< Only if some percentile is requested
+};
+
+/** Prepare split ops accumulator
+  @param acc Accumulator
+  @param monitor Monitor with split ops
+  */
+static void split_ops_acc_init(struct split_ops_acc *acc,
+			       const rb_monitor_t *monitor) {
+	memset(acc, 0, sizeof(*acc));
+	for (size_t i = 0; i < monitor->splitops_count; ++i) {
+		if (RB_MONITOR_SPLIT_OP__PERCENTILE == monitor->splitops[i].type) {
+			acc->sketch = rb_sketch_new(SPLIT_OP_SKETCH_ACCURACY);
+			if (NULL == acc->sketch) {
+				rdlog(LOG_ERR,
+				      "Couldn't allocate %s percentiles sketch "
+				      "(OOM?)",
+				      monitor->name);
+			}
+			break;
 		}
+	}
+}
 
-		assert(MONITOR_VALUE_T__VALUE == mv_v_i->type);
-		assert(0 == strcmp(mv_v_i->name, libmatheval_vars->names[v]));
+/** Add a vector element to split ops accumulator
+  @param acc Accumulator
+  @param value Element value
+  */
+static void split_ops_acc_add(struct split_ops_acc *acc, double value) {
+	acc->count++;
+	acc->sum += value;
+
+	const double delta = value - acc->mean;
+	acc->mean += delta / (double)acc->count;
+	acc->m2 += delta * (value - acc->mean);
+
+	if (1 == acc->count || value < acc->min) {
+		acc->min = value;
+	}
+	if (1 == acc->count || value > acc->max) {
+		acc->max = value;
+	}
+
+	if (acc->sketch && !rb_sketch_add(acc->sketch, value)) {
+		rdlog(LOG_ERR, "Couldn't add value to sketch (OOM?)");
+		rb_sketch_done(acc->sketch);
+		acc->sketch = NULL;
+	}
+}
+
+/** Compute split ops results and release accumulator resources
+  @param acc Accumulator
+  @param monitor Monitor with split ops
+  @param mv Vector monitor value to save results
+  @param now Results timestamp
+  */
+static void split_ops_acc_done(struct split_ops_acc *acc,
+			       const rb_monitor_t *monitor,
+			       struct monitor_value *mv,
+			       time_t now) {
+	double results[MONITOR_MAX_SPLIT_OPS];
+	bool ok = acc->count > 0 && monitor->splitops_count > 0;
+
+	for (size_t i = 0; ok && i < monitor->splitops_count; ++i) {
+		switch (monitor->splitops[i].type) {
+		case RB_MONITOR_SPLIT_OP__SUM:
+			results[i] = acc->sum;
+			break;
+		case RB_MONITOR_SPLIT_OP__MEAN:
+			results[i] = acc->sum / (double)acc->count;
+			break;
+		case RB_MONITOR_SPLIT_OP__MIN:
+			results[i] = acc->min;
+			break;
+		case RB_MONITOR_SPLIT_OP__MAX:
+			results[i] = acc->max;
+			break;
+		case RB_MONITOR_SPLIT_OP__STDDEV:
+			results[i] = sqrt(acc->m2 / (double)acc->count);
+			break;
+		case RB_MONITOR_SPLIT_OP__PERCENTILE:
+			ok = NULL != acc->sketch;
+			results[i] = ok ? rb_sketch_quantile(
+						  acc->sketch,
+						  monitor->splitops[i].quantile)
+					: 0;
+			break;
+		default:
+			ok = false;
+			break;
+		};
+	}
 
-		libmatheval_vars->values[v] = mv_v_i->value.value;
+	if (ok) {
+		/// @todo check if numbers are normal
+		rb_monitor_value_set_split_op_results(
+				mv, results, monitor->splitops_count, now);
 	}
 
-	return rb_monitor_op_value0(f, libmatheval_vars, monitor, now);
+	if (acc->sketch) {
+		rb_sketch_done(acc->sketch);
+	}
 }
 
 /** Makes a vector operation
@@ -708,14 +1388,34 @@ rb_monitor_op_vector(void *f,
 		     struct libmatheval_vars *libmatheval_vars,
 		     const rb_monitor_t *monitor,
 		     time_t now) {
-	double sum = 0;
-	size_t count = 0;
+	struct split_ops_acc split_ops_acc;
 	const struct monitor_value *mv_0 =
 			rb_monitor_value_array_at(op_vars, 0);
-	struct monitor_value *split_op = NULL;
-	struct monitor_value **children =
-			calloc(mv_0->array.children_count, sizeof(children[0]));
-	if (NULL == children) {
+
+	if (monitor->previous_values) {
+		rdlog(LOG_ERR,
+		      "Functions of previous values are not supported over "
+		      "vectors (%s)",
+		      monitor->name);
+		return NULL;
+	}
+
+	/* Foreach variable in operation, check it's a vector */
+	for (size_t v = 0; v < op_vars->count; ++v) {
+		const struct monitor_value *mv_v =
+				rb_monitor_value_array_at(op_vars, v);
+
+		if (NULL == mv_v || MONITOR_VALUE_T__ARRAY != mv_v->type) {
+			rdlog(LOG_ERR,
+			      "Could not execute operation, missing valid "
+			      "parameter values");
+			return NULL;
+		}
+	}
+
+	struct monitor_value *ret =
+			new_monitor_value_array(mv_0->array.children_count);
+	if (NULL == ret) {
 		/* @todo Error treatment */
 		rdlog(LOG_ERR,
 		      "Couldn't create monitor value %s"
@@ -724,56 +1424,43 @@ rb_monitor_op_vector(void *f,
 		return NULL;
 	}
 
+	split_ops_acc_init(&split_ops_acc, monitor);
+
 	// Foreach member of vector
 	for (size_t i = 0; i < mv_0->array.children_count; ++i) {
-		children[i] = rb_monitor_op_vector_i(f,
-						     op_vars,
-						     libmatheval_vars,
-						     i,
-						     monitor,
-						     now);
-
-		if (NULL != children[i]) {
-			sum += children[i]->value.value;
-			count++;
+		double result = 0;
+		const bool present = rb_monitor_op_vector_i(f,
+							    op_vars,
+							    libmatheval_vars,
+							    i,
+							    monitor,
+							    &result);
+
+		/* Can't fail, we reserved children_count children */
+		rb_monitor_value_children_push(ret, present, result, now);
+		if (present) {
+			split_ops_acc_add(&split_ops_acc, result);
 		}
 	} /* foreach member of vector */
 
-	if (monitor->splitop && count > 0) {
-		char string_value[64];
-
-		const double split_op_value =
-				0 == strcmp(monitor->splitop, "sum")
-						? sum
-						: sum / count;
-
-		/// @todo check if number is normal
-		/// @todo check snprintf return
-		snprintf(string_value,
-			 sizeof(string_value),
-			 "%lf",
-			 split_op_value);
+	split_ops_acc_done(&split_ops_acc, monitor, ret, now);
 
-		split_op = process_novector_monitor(string_value,
-						    split_op_value,
-						    now);
-	}
-
-	return new_monitor_value_array(mv_0->array.children_count,
-				       children,
-				       split_op);
+	return ret;
 }
 
 /** Process an operation monitor
   @param monitor Monitor this operation belongs
   @param sensor Sensor this monitor belongs
   @param process_ctx Monitor process context
+  @param op_vars Operation variables values
+  @param prev_op_vars Operation variables values in previous iteration
   @return New monitor value with operation result
   */
 static struct monitor_value *
 rb_monitor_get_op_result(const rb_monitor_t *monitor,
 			 struct process_sensor_monitor_ctx *process_ctx,
-			 rb_monitor_value_array_t *op_vars) {
+			 rb_monitor_value_array_t *op_vars,
+			 rb_monitor_value_array_t *prev_op_vars) {
 	(void)process_ctx;
 	struct monitor_value *ret = NULL;
 	const char *operation = monitor->cmd_arg;
@@ -790,7 +1477,7 @@ rb_monitor_get_op_result(const rb_monitor_t *monitor,
 		return NULL;
 	}
 
-	void *const f = evaluator_create((char *)operation);
+	void *const f = rb_evaluator_create(operation);
 	if (NULL == f) {
 		rdlog(LOG_ERR,
 		      "Couldn't create evaluator (invalid op [%s]?",
@@ -821,6 +1508,7 @@ rb_monitor_get_op_result(const rb_monitor_t *monitor,
 		case MONITOR_VALUE_T__VALUE:
 			ret = rb_monitor_op_value(f,
 						  op_vars,
+						  prev_op_vars,
 						  libmatheval_vars,
 						  monitor,
 						  now);
@@ -842,11 +1530,12 @@ libmatheval_error:
 struct monitor_value *
 process_sensor_monitor(struct process_sensor_monitor_ctx *process_ctx,
 		       const rb_monitor_t *monitor,
-		       rb_monitor_value_array_t *op_vars) {
+		       rb_monitor_value_array_t *op_vars,
+		       rb_monitor_value_array_t *prev_op_vars) {
 	switch (monitor->type) {
 #define _X(menum, cmd, type, fn)                                               \
 	case menum:                                                            \
-		return fn(monitor, process_ctx, op_vars);                      \
+		return fn(monitor, process_ctx, op_vars, prev_op_vars);        \
 		break;
 
 		MONITOR_CMDS_X
@@ -858,203 +1547,162 @@ process_sensor_monitor(struct process_sensor_monitor_ctx *process_ctx,
 	}; /* Switch monitor type */
 }
 
-/** @note our way to save a SNMP string vector in libmatheval_array is:
-    names:  [ ...  vector_name_0 ... vector_name_(N)     vector_name   ... ]
-    values: [ ...     number0    ...    number(N)      split_op_result ... ]
-*/
-
-/** Process a no-vector monitor
-  @param monitor Monitor to process
-  @param value_buf Value in text format
-  @param value Value in double format
-  @param now Time of processing
-*/
-static struct monitor_value *
-process_novector_monitor(const char *value_buf, double value, time_t now) {
-	struct monitor_value *mv = NULL;
-
-	rd_calloc_struct(&mv,
-			 sizeof(*mv),
-			 -1,
-			 value_buf,
-			 &mv->value.string_value,
-			 RD_MEM_END_TOKEN);
-
-	if (mv) {
-#ifdef MONITOR_VALUE_MAGIC
-		mv->magic = MONITOR_VALUE_MAGIC; // just sanity check
-#endif
-		mv->type = MONITOR_VALUE_T__VALUE;
-		mv->value.timestamp = now;
-		mv->value.value = value;
-	} else {
-		rdlog(LOG_ERR,
-		      "Couldn't allocate monitor value (out of "
-		      "memory?)");
-		/// @todo memory management
+/** Search for the next separator in [cursor, end)
+  @param cursor Where to start searching
+  @param end End of the string
+  @param sep Separator to search for
+  @param sep_len Separator length
+  @return Separator position, or NULL if not found
+  @note Single char separators (the common ";" and "," cases) use memchr,
+  which is vectorized in glibc.
+  */
+static const char *vector_search_sep(const char *cursor,
+				     const char *end,
+				     const char *sep,
+				     size_t sep_len) {
+	const size_t len = (size_t)(end - cursor);
+	if (1 == sep_len) {
+		return memchr(cursor, sep[0], len);
 	}
-
-	return mv;
+	return memmem(cursor, len, sep, sep_len);
 }
 
-/** Count the number of elements of a vector response
-  @param haystack String of values
-  @param splittok Token that sepparate values
-  @return Number of elements
+/** Parse a timestamp (unsigned decimal digits)
+  @param tok Token to parse
+  @param tok_end End of the token
+  @return Parsed timestamp
   */
-static size_t vector_elements(const char *haystack, const char *splittok) {
-	size_t ret = 1;
-	for (ret = 1; (haystack = strstr(haystack, splittok));
-	     haystack += strlen(splittok), ++ret)
-		;
+static time_t vector_parse_timestamp(const char *tok, const char *tok_end) {
+	time_t ret = 0;
+	for (; tok < tok_end && (unsigned char)(*tok - '0') < 10; ++tok) {
+		ret = ret * 10 + (*tok - '0');
+	}
 	return ret;
 }
 
-/** Extract value of a vector
-  @param vector_values String to extract values from
-  @param splittok Split token
-  @param str_value Value in string format
-  @param str_size str_value length
-  @param timestamp_sep Timestamp separator (if any)
-  @param timestamp If timestamp_sep is defined, extracted timestamp
-  @return Next token to iterate
+/** Extract value of a vector element
+  @param monitor Monitor the element belongs
+  @param tok Start of the element
+  @param tok_end End of the element
+  @param value Value in double format
+  @param timestamp If timestamp is given in response, extracted timestamp
+  @return true if we could extract the value
   */
-static bool extract_vector_value(const char *vector_values,
-				 const char *splittok,
-				 const char **str_value,
-				 size_t *str_size,
+static bool extract_vector_value(const rb_monitor_t *monitor,
+				 const char *tok,
+				 const char *tok_end,
 				 double *value,
-				 const char *timestamp_sep,
 				 time_t *timestamp) {
-
-	const char *end_token = strstr(vector_values, splittok);
-	if (NULL == end_token) {
-		end_token = vector_values + strlen(vector_values);
-	}
-
-	if (timestamp_sep) {
-		assert(timestamp);
-
+	if (monitor->timestamp_given) {
 		/* Search timestamp first */
-		const char *timestamp_end =
-				strstr(vector_values, timestamp_sep);
-		if (NULL == timestamp_end || timestamp_end >= end_token) {
+		const char *timestamp_end = vector_search_sep(
+				tok,
+				tok_end,
+				DEFAULT_TIMESTAMP_SEP,
+				sizeof(DEFAULT_TIMESTAMP_SEP) - 1);
+		if (NULL == timestamp_end) {
 			rdlog(LOG_ERR,
 			      "Couldn't find timestamp separator [%s] in "
-			      "[%*.s]",
-			      timestamp_sep,
-			      (int)(end_token - vector_values),
-			      vector_values);
+			      "[%.*s]",
+			      DEFAULT_TIMESTAMP_SEP,
+			      (int)(tok_end - tok),
+			      tok);
 			return false;
 		}
 
 		/// We can trust that timestamp separator token are not digits
-		sscanf(vector_values, "%tu", timestamp);
-		vector_values = timestamp_end + strlen(timestamp_sep);
+		*timestamp = vector_parse_timestamp(tok, timestamp_end);
+		tok = timestamp_end + sizeof(DEFAULT_TIMESTAMP_SEP) - 1;
+	}
+
+	if (tok == tok_end) {
+		/* Blank element */
+		*value = 0;
+		return true;
 	}
 
-	*value = toDouble(vector_values);
+	errno = 0;
+	*value = rb_strtod(tok, NULL);
 	if (errno != 0) {
 		char perrbuf[BUFSIZ];
-		const char *errbuf =
-				strerror_r(errno, perrbuf, sizeof(perrbuf));
+		const char *errbuf = strerror_r(errno, perrbuf, sizeof(perrbuf));
 		rdlog(LOG_WARNING,
 		      "Invalid double: %.*s (%s). Not counting.",
-		      (int)(end_token - vector_values),
-		      vector_values,
+		      (int)(tok_end - tok),
+		      tok,
 		      errbuf);
 		return false;
 	}
 
-	*str_value = vector_values;
-	*str_size = (size_t)(end_token - vector_values);
 	return true;
 }
 
+/// Initial capacity of a vector children array
+#define VECTOR_CHILDREN_INITIAL_SIZE 16
+
 /** Process a vector monitor
   @param monitor Monitor to process
   @param value_buf Value to process (string format)
+  @param value_buf_len Length of value_buf
   @param now This time
+  @note Single pass over value_buf: every element is parsed as soon as its
+  separator is found.
   @todo this could be joint with operation on vector
 */
 static struct monitor_value *process_vector_monitor(const rb_monitor_t *monitor,
 						    const char *value_buf,
+						    size_t value_buf_len,
 						    time_t now) {
-	const size_t n_children = vector_elements(value_buf, monitor->splittok);
-	const char *tok = NULL;
-
-	struct monitor_value **children =
-			calloc(n_children, sizeof(children[0]));
-	struct monitor_value *split_op = NULL;
-	if (NULL == children) {
+	const char *const end = value_buf + value_buf_len;
+	struct monitor_value *ret =
+			new_monitor_value_array(VECTOR_CHILDREN_INITIAL_SIZE);
+	if (NULL == ret) {
 		rdlog(LOG_ERR,
 		      "Couldn't allocate vector children (out of "
 		      "memory?)");
 		return NULL;
 	}
 
-	size_t mean_count = 0, count = 0;
-	double sum = 0;
-	for (count = 0, tok = value_buf; tok;
-	     tok = strstr(tok, monitor->splittok), count++) {
-		if (count > 0) {
-			tok += strlen(monitor->splittok);
+	struct split_ops_acc split_ops_acc;
+	split_ops_acc_init(&split_ops_acc, monitor);
+
+	for (const char *tok = value_buf; tok;) {
+		const char *tok_end = vector_search_sep(tok,
+							end,
+							monitor->splittok,
+							monitor->splittok_len);
+		const char *next_tok =
+				tok_end ? tok_end + monitor->splittok_len
+					: NULL;
+		if (NULL == tok_end) {
+			tok_end = end;
 		}
 
 		time_t i_timestamp = 0;
-		const char *i_value_str = NULL;
-		size_t i_value_str_size = 0;
 		double i_value = 0;
+		const bool present = extract_vector_value(
+				monitor, tok, tok_end, &i_value, &i_timestamp);
+		tok = next_tok;
 
-		if (0 == strcmp(tok, monitor->splittok)) {
-			rdlog(LOG_DEBUG,
-			      "Not seeing value %s(%zu)",
-			      monitor->name,
-			      count);
-			continue;
-		}
-
-		const bool get_value_rc = extract_vector_value(
-				tok,
-				monitor->splittok,
-				&i_value_str,
-				&i_value_str_size,
-				&i_value,
-				monitor->timestamp_given ? DEFAULT_TIMESTAMP_SEP
-							 : NULL,
-				&i_timestamp);
-
-		if (false == get_value_rc) {
-			continue;
-		}
-
-		children[count] = process_novector_monitor(
-				i_value_str,
+		const bool push_rc = rb_monitor_value_children_push(
+				ret,
+				present,
 				i_value,
 				i_timestamp ? i_timestamp : now);
+		if (!push_rc) {
+			rdlog(LOG_ERR,
+			      "Couldn't allocate vector children (out of "
+			      "memory?)");
+			break;
+		}
 
-		if (NULL != children[count]) {
-			sum += i_value;
-			mean_count++;
+		if (present) {
+			split_ops_acc_add(&split_ops_acc, i_value);
 		}
 	}
 
-	// Last token reached. Do we have an operation to do?
-	if (NULL != monitor->splitop && mean_count > 0) {
-		char split_op_result[1024];
-		const double result = (0 == strcmp("sum", monitor->splitop))
-						      ? sum
-						      : sum / mean_count;
-
-		/// @todo check snprint result
-		snprintf(split_op_result,
-			 sizeof(split_op_result),
-			 "%lf",
-			 result);
-		split_op = process_novector_monitor(split_op_result,
-						    result,
-						    now);
-	}
+	// Last token reached. Do we have operations to do?
+	split_ops_acc_done(&split_ops_acc, monitor, ret, now);
 
-	return new_monitor_value_array(n_children, children, split_op);
+	return ret;
 }
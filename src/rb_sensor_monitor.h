@@ -43,11 +43,11 @@ struct process_sensor_monitor_ctx;
 
 /** Parse a rb_monitor element
   @param json_monitor monitor in JSON format
-  @param sensor_enrichment enrichment given to the sensor
   @return Parsed rb_monitor.
+  @note Monitors does not hold sensor enrichment, so they can be shared
+  between sensors
   */
-rb_monitor_t *
-parse_rb_monitor(json_object *json_monitor, json_object *sensor_enrichment);
+rb_monitor_t *parse_rb_monitor(json_object *json_monitor);
 
 /** Free resources allocated by a monitor
   @param monitor Monitor to free
@@ -70,16 +70,38 @@ void destroy_process_sensor_monitor_ctx(struct process_sensor_monitor_ctx *ctx);
 /// @todo delete this FW declaration
 struct rb_sensor_s;
 
+/// Monitor to fetch before the sensor processing
+struct rb_monitor_prefetch {
+	const rb_monitor_t *monitor; ///< Monitor to fetch. NULL to skip entry
+	struct monitor_value *value; ///< Fetched value
+	bool fetched;		     ///< The monitor has been fetched
+};
+
+/** Fetch many monitors at the same time: SNMP monitors are asked in batched
+  requests, and system monitors commands run concurrently. Op monitors are
+  not fetched.
+  @param process_ctx Process context
+  @param prefetch Monitors to fetch. Entries that could not be prefetched
+  have fetched == false, and need to be processed with process_sensor_monitor
+  @param count Number of entries in prefetch
+  */
+void rb_monitors_prefetch(struct process_sensor_monitor_ctx *process_ctx,
+			  struct rb_monitor_prefetch *prefetch,
+			  size_t count);
+
 /** Process a sensor monitor
   @param process_ctx Process context
   @param monitor Monitor to process
   @param op_vars Variables that require operations
+  @param prev_op_vars Previous iteration values of op_vars, if monitor needs
+  previous values (see rb_monitor_need_previous_values)
   @param ret Returned messages
   */
 struct monitor_value *
 process_sensor_monitor(struct process_sensor_monitor_ctx *process_ctx,
 		       const rb_monitor_t *monitor,
-		       rb_monitor_value_array_t *op_vars);
+		       rb_monitor_value_array_t *op_vars,
+		       rb_monitor_value_array_t *prev_op_vars);
 
 /** Gets if monitor expect timestamp
   @param monitor Monitor to get data
@@ -123,9 +145,51 @@ bool rb_monitor_is_integer(const rb_monitor_t *monitor);
   */
 bool rb_monitor_send(const rb_monitor_t *monitor);
 
+/** Gets if monitor operation uses previous iteration values (rate, delta...)
+  @param monitor Monitor to get data
+  @return requested data
+  */
+bool rb_monitor_need_previous_values(const rb_monitor_t *monitor);
+
+/** Gets monitor aggregation window
+  @param monitor Monitor to get data
+  @return Window length in seconds, or 0 if every value is sent
+  */
+time_t rb_monitor_window(const rb_monitor_t *monitor);
+
+/** Gets the name of a monitor split op result
+  @param monitor Monitor to get data
+  @param i Split op index
+  @return Split op name, to be appended to monitor name, or NULL if the
+  result is sent with monitor name
+  */
+const char *rb_monitor_split_op_name(const rb_monitor_t *monitor, size_t i);
+
+/** Gets if monitor vector elements are sent, or only split ops results
+  @param monitor Monitor to get data
+  @return requested data
+  */
+bool rb_monitor_send_split_instances(const rb_monitor_t *monitor);
+
+/** Checks if a value should not be sent because it is in the deadband of
+  the last sent one, and heartbeat interval has not passed since it.
+  @param monitor Monitor
+  @param last_sent_value Last sent value
+  @param last_sent_timestamp Last sent value timestamp
+  @param value New value
+  @param timestamp New value timestamp
+  @return true if value should not be sent
+  */
+bool rb_monitor_suppress_value(const rb_monitor_t *monitor,
+			       double last_sent_value,
+			       time_t last_sent_timestamp,
+			       double value,
+			       time_t timestamp);
+
 /** Get monitor enrichment
  * @param monitor Monitor to get enrichment
- * @return Monitor enrichment
+ * @return Monitor enrichment. It only contains monitor's own keys, that
+ * override sensor ones.
  * @todo make const
  */
 const json_object *rb_monitor_enrichment(const rb_monitor_t *monitor);
@@ -138,16 +202,17 @@ const char *rb_monitor_get_cmd_data(const rb_monitor_t *monitor);
 
 /** Gets monitor operation needed variables
   @param monitor Monitor to get data
-  @param vars Char array to store vars
+  @param vars Char array to store vars. They are interned strings, so they
+  can be compared by pointer with monitor names (see rb_intern.h)
   @param vars_size length of store vars
   @return true if success, false in other case
   */
 void rb_monitor_get_op_variables(const rb_monitor_t *monitor,
-				 char ***vars,
+				 const char ***vars,
 				 size_t *vars_size);
 
 /** Free data returned by rb_monitor_op_variables_get
   @param vars Variables
   @param vars_size Length of vars
   */
-void rb_monitor_free_op_variables(char **vars, size_t vars_size);
+void rb_monitor_free_op_variables(const char **vars, size_t vars_size);
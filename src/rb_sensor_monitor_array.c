@@ -17,6 +17,7 @@
 */
 
 #include "rb_sensor_monitor_array.h"
+#include "rb_hash.h"
 #include "rb_sensor.h"
 
 #include <librd/rdfloat.h>
@@ -37,8 +38,7 @@ rb_monitor_t *rb_monitors_array_elm_at(rb_monitors_array_t *array, size_t i) {
 	return ret;
 }
 
-rb_monitors_array_t *parse_rb_monitors(json_object *monitors_array_json,
-				       json_object *sensor_enrichment) {
+rb_monitors_array_t *parse_rb_monitors(json_object *monitors_array_json) {
 	const size_t monitors_len =
 			(size_t)json_object_array_length(monitors_array_json);
 	rb_monitors_array_t *ret = rb_monitors_array_new(monitors_len);
@@ -54,8 +54,7 @@ rb_monitors_array_t *parse_rb_monitors(json_object *monitors_array_json,
 
 		json_object *monitor_json = json_object_array_get_idx(
 				monitors_array_json, i);
-		rb_monitor_t *monitor = parse_rb_monitor(monitor_json,
-							 sensor_enrichment);
+		rb_monitor_t *monitor = parse_rb_monitor(monitor_json);
 		if (monitor) {
 			rb_monitors_array_add(ret, monitor);
 		}
@@ -66,49 +65,42 @@ rb_monitors_array_t *parse_rb_monitors(json_object *monitors_array_json,
 
 /** Prints a monitor value taking into account timestamp of values
   @param monitor Monitor of monitor value
-  @param sensor Sensor Sensor of monitor
+  @param print_ctx Print context of monitor messages
   @param new_mv New monitor value
   @param old_mv Old monitor value
   @return Message array of this update
   */
 static rb_message_array_t *
 process_monitor_value_v_print(const rb_monitor_t *monitor,
+			      const struct monitor_value_print_ctx *print_ctx,
 			      const struct monitor_value *new_mv,
 			      const struct monitor_value *old_mv) {
 	assert(new_mv->type == MONITOR_VALUE_T__ARRAY);
 	assert(old_mv->type == MONITOR_VALUE_T__ARRAY);
 
-	struct monitor_value *print_children[new_mv->array.children_count];
-	memset(print_children,
-	       0,
-	       new_mv->array.children_count * sizeof(print_children[0]));
+	const size_t words =
+			MONITOR_VALUE_PRESENT_WORDS(new_mv->array.children_count);
+	uint64_t print_children[words ? words : 1];
 
-	/* Print all values that have changed */
-	size_t i = 0;
-	for (i = 0; i < new_mv->array.children_count &&
-		    i < old_mv->array.children_count;
+	/* Print all new variables, if any */
+	memcpy(print_children,
+	       new_mv->array.present,
+	       words * sizeof(print_children[0]));
+
+	/* Don't print values that have not changed */
+	for (size_t i = 0; i < new_mv->array.children_count &&
+			   i < old_mv->array.children_count;
 	     ++i) {
-		struct monitor_value *new_mv_i = new_mv->array.children[i];
-		const struct monitor_value *old_mv_i =
-				old_mv->array.children[i];
-
-		if (new_mv_i) {
-			const bool update = (NULL == old_mv_i ||
-					     rb_monitor_value_cmp_timestamp(
-							     old_mv_i,
-							     new_mv_i) < 0 ||
-					     rd_dne(old_mv_i->value.value,
-						    new_mv_i->value.value));
-
-			if (update) {
-				print_children[i] = new_mv_i;
-			}
-		}
-	}
+		const bool keep = rb_monitor_value_child_present(new_mv, i) &&
+				  rb_monitor_value_child_present(old_mv, i) &&
+				  old_mv->array.timestamps[i] >=
+						  new_mv->array.timestamps[i] &&
+				  !rd_dne(old_mv->array.values[i],
+					  new_mv->array.values[i]);
 
-	/* Print all new variables, if any */
-	for (; i < new_mv->array.children_count; ++i) {
-		print_children[i] = new_mv->array.children[i];
+		if (keep) {
+			print_children[i / 64] &= ~(UINT64_C(1) << (i % 64));
+		}
 	}
 
 	// clang-format off
@@ -120,14 +112,18 @@ process_monitor_value_v_print(const rb_monitor_t *monitor,
                 {
 		   .array = {
 		   	.children_count = new_mv->array.children_count,
+		   	.children_size = new_mv->array.children_size,
 		   	.split_op_result = new_mv->array.split_op_result,
-		   	.children = print_children,
+		   	.split_op_count = new_mv->array.split_op_count,
+		   	.values = new_mv->array.values,
+		   	.timestamps = new_mv->array.timestamps,
+		   	.present = print_children,
 		   }
                 }
 	};
 	// clang-format on
 
-	return print_monitor_value(&to_print, monitor);
+	return print_monitor_value(&to_print, monitor, print_ctx);
 }
 
 /// Swap two pointers
@@ -140,12 +136,14 @@ process_monitor_value_v_print(const rb_monitor_t *monitor,
 
 /** Print all elements of new array that have changed
   @param monitor Monitor of monitors values
+  @param print_ctx Print context of monitor messages
   @param new_mv New monitor value
   @param old_mv Previous monitor value we had
   @return Monitor messages to send
   */
 static rb_message_array_t *
 process_monitor_value_v(const rb_monitor_t *monitor,
+			const struct monitor_value_print_ctx *print_ctx,
 			struct monitor_value *new_mv,
 			struct monitor_value *old_mv) {
 	rb_message_array_t *ret = NULL;
@@ -154,26 +152,161 @@ process_monitor_value_v(const rb_monitor_t *monitor,
 	assert(old_mv->type == MONITOR_VALUE_T__ARRAY);
 
 	if (rb_monitor_send(monitor)) {
-		ret = process_monitor_value_v_print(monitor, new_mv, old_mv);
+		ret = process_monitor_value_v_print(
+				monitor, print_ctx, new_mv, old_mv);
 	}
 
 	SWAP(old_mv->array.children_count, new_mv->array.children_count);
-	SWAP(old_mv->array.children, new_mv->array.children);
+	SWAP(old_mv->array.children_size, new_mv->array.children_size);
+	SWAP(old_mv->array.values, new_mv->array.values);
+	SWAP(old_mv->array.timestamps, new_mv->array.timestamps);
+	SWAP(old_mv->array.present, new_mv->array.present);
 	rb_monitor_value_done(new_mv);
 	return ret;
 }
 
+/** Check if a value has not changed enough to be sent
+  @param monitor Monitor of the value
+  @param send_state Monitor output state
+  @param value Value
+  @param timestamp Value timestamp
+  @return true if value should not be sent (see rb_monitor_suppress_value)
+  */
+static bool send_state_suppress(const rb_monitor_t *monitor,
+				const struct rb_monitor_send_state *send_state,
+				double value,
+				time_t timestamp) {
+	return send_state->last_sent.valid &&
+	       rb_monitor_suppress_value(monitor,
+					 send_state->last_sent.value,
+					 send_state->last_sent.timestamp,
+					 value,
+					 timestamp);
+}
+
+/** Save the last sent value
+  @param send_state Monitor output state
+  @param value Sent value
+  @param timestamp Sent value timestamp
+  */
+static void send_state_sent(struct rb_monitor_send_state *send_state,
+			    double value,
+			    time_t timestamp) {
+	send_state->last_sent.value = value;
+	send_state->last_sent.timestamp = timestamp;
+	send_state->last_sent.valid = true;
+}
+
+/** Close the monitor aggregation window in progress
+  @param monitor Monitor
+  @param print_ctx Print context of monitor messages
+  @param send_state Monitor output state, with the window in progress
+  @return Summary message of the window, or NULL if it is empty or deadband
+  suppresses it
+  */
+static rb_message_array_t *
+send_state_window_flush(const rb_monitor_t *monitor,
+			const struct monitor_value_print_ctx *print_ctx,
+			struct rb_monitor_send_state *send_state) {
+	rb_message_array_t *ret = NULL;
+	struct monitor_value_summary *window = &send_state->window;
+
+	if (0 == window->count) {
+		return NULL;
+	}
+
+	if (!send_state_suppress(monitor,
+				 send_state,
+				 window->last,
+				 window->timestamp)) {
+		ret = print_monitor_value_summary(window, monitor, print_ctx);
+		send_state_sent(send_state, window->last, window->timestamp);
+	}
+	window->count = 0;
+
+	return ret;
+}
+
+/** Close the monitor aggregation window in progress if it is over
+  @param monitor Monitor
+  @param print_ctx Print context of monitor messages
+  @param send_state Monitor output state, with the window in progress
+  @param now Current time
+  @return Summary message of the window, or NULL if it is not over, is empty
+  or deadband suppresses it
+  */
+static rb_message_array_t *
+send_state_window_expire(const rb_monitor_t *monitor,
+			 const struct monitor_value_print_ctx *print_ctx,
+			 struct rb_monitor_send_state *send_state,
+			 time_t now) {
+	const time_t window_len = rb_monitor_window(monitor);
+	const struct monitor_value_summary *window = &send_state->window;
+
+	if (window_len > 0 && window->count > 0 &&
+	    now >= window->timestamp + window_len) {
+		return send_state_window_flush(monitor, print_ctx, send_state);
+	}
+
+	return NULL;
+}
+
+/** Add a value to the monitor aggregation window
+  @param monitor Monitor of monitor value
+  @param print_ctx Print context of monitor messages
+  @param send_state Monitor output state, with the window in progress
+  @param mv New monitor value
+  @return Summary message of the previous window if mv is out of it, or NULL
+  @note Deadband applies to summaries, comparing the last value of windows
+  */
+static rb_message_array_t *
+process_monitor_value_window(const rb_monitor_t *monitor,
+			     const struct monitor_value_print_ctx *print_ctx,
+			     struct rb_monitor_send_state *send_state,
+			     const struct monitor_value *mv) {
+	rb_message_array_t *ret = NULL;
+	struct monitor_value_summary *window = &send_state->window;
+	const time_t window_len = rb_monitor_window(monitor);
+	const double value = mv->value.value;
+	/* Windows are aligned to wall clock, so all sensors agree */
+	const time_t window_start =
+			mv->value.timestamp - mv->value.timestamp % window_len;
+
+	if (window->count > 0 && window_start != window->timestamp) {
+		ret = send_state_window_flush(monitor, print_ctx, send_state);
+	}
+
+	if (0 == window->count) {
+		window->timestamp = window_start;
+		window->min = window->max = value;
+		window->sum = 0;
+	} else {
+		window->min = value < window->min ? value : window->min;
+		window->max = value > window->max ? value : window->max;
+	}
+
+	window->sum += value;
+	window->last = value;
+	window->count++;
+
+	return ret;
+}
+
 /** Process a monitor value
   @param monitor Monitor this monitor value is related
+  @param print_ctx Print context of monitor messages
   @param monitor_value New monitor value to process
   @param old_mv Last known monitor value
+  @param send_state Monitor output state
   @param ret Message list to report
   @return New monitor value we should save
   */
 static struct monitor_value *
 process_monitor_value(const rb_monitor_t *monitor,
+		      const struct monitor_value_print_ctx *print_ctx,
 		      struct monitor_value *monitor_value,
 		      struct monitor_value *old_mv,
+		      struct rb_monitor_send_state *send_state,
 		      rb_message_list *ret) {
 	assert(monitor_value);
 
@@ -190,8 +323,29 @@ process_monitor_value(const rb_monitor_t *monitor,
 				 monitor_value->value.value)));
 
 	if (update_value) {
-		if (rb_monitor_send(monitor)) {
-			msgs = print_monitor_value(monitor_value, monitor);
+		if (!rb_monitor_send(monitor)) {
+			/* Nothing to send */
+		} else if (rb_monitor_window(monitor) > 0 &&
+			   monitor_value->type == MONITOR_VALUE_T__VALUE) {
+			msgs = process_monitor_value_window(monitor,
+							    print_ctx,
+							    send_state,
+							    monitor_value);
+		} else if (monitor_value->type == MONITOR_VALUE_T__VALUE &&
+			   send_state_suppress(
+					   monitor,
+					   send_state,
+					   monitor_value->value.value,
+					   monitor_value->value.timestamp)) {
+			/* Not changed enough */
+		} else {
+			msgs = print_monitor_value(
+					monitor_value, monitor, print_ctx);
+			if (monitor_value->type == MONITOR_VALUE_T__VALUE) {
+				send_state_sent(send_state,
+						monitor_value->value.value,
+						monitor_value->value.timestamp);
+			}
 		}
 
 		if (old_mv) {
@@ -199,7 +353,8 @@ process_monitor_value(const rb_monitor_t *monitor,
 		}
 		ret_mv = monitor_value;
 	} else if (monitor_value->type == MONITOR_VALUE_T__ARRAY) {
-		msgs = process_monitor_value_v(monitor, monitor_value, old_mv);
+		msgs = process_monitor_value_v(
+				monitor, print_ctx, monitor_value, old_mv);
 	} else {
 		// No use for the new monitor value
 		rb_monitor_value_done(monitor_value);
@@ -212,14 +367,107 @@ process_monitor_value(const rb_monitor_t *monitor,
 	return ret_mv;
 }
 
+/** Copy monitors values of the previous iteration, for operations that need
+  them (rate, delta...). Only done if any monitor needs them.
+  @param monitors Monitors
+  @param last_known_monitor_values Values of previous iteration
+  @param values Storage of copied values. Need to be freed after use.
+  @return Array of copied values, or NULL if not needed. Need to be freed
+  with rb_monitor_value_array_done
+  */
+static rb_monitor_value_array_t *
+previous_monitor_values(rb_monitors_array_t *monitors,
+			rb_monitor_value_array_t *last_known_monitor_values,
+			struct monitor_value **values) {
+	bool needed = false;
+	*values = NULL;
+
+	for (size_t i = 0; !needed && i < monitors->count; ++i) {
+		needed = rb_monitor_need_previous_values(
+				rb_monitors_array_elm_at(monitors, i));
+	}
+
+	if (!needed) {
+		return NULL;
+	}
+
+	rb_monitor_value_array_t *ret =
+			rb_monitor_value_array_new(monitors->count);
+	*values = calloc(monitors->count, sizeof((*values)[0]));
+	if (NULL == ret || NULL == *values) {
+		rdlog(LOG_ERR, "Couldn't allocate previous values (OOM?)");
+		rb_monitor_value_array_done(ret);
+		free(*values);
+		*values = NULL;
+		return NULL;
+	}
+
+	/* Values are updated in place while processing, so we need a copy */
+	ret->count = monitors->count;
+	for (size_t i = 0; i < monitors->count; ++i) {
+		const struct monitor_value *mv =
+				last_known_monitor_values->elms[i];
+		if (mv && MONITOR_VALUE_T__VALUE == mv->type) {
+			(*values)[i] = *mv;
+			ret->elms[i] = &(*values)[i];
+		}
+	}
+
+	return ret;
+}
+
+void rb_monitor_send_state_done(struct rb_monitor_send_state *send_state) {
+	monitor_value_common_keys_done(send_state->common_keys);
+}
+
+/** Encodings to print monitors messages in
+  @param worker_info Worker info
+  @return Encodings
+  */
+static unsigned
+monitors_print_encodings(const struct _worker_info *worker_info) {
+	/* No sinks configured, like in tests: messages are JSON */
+	return worker_info->message_encodings ? worker_info->message_encodings
+					      : RB_MESSAGE_F_JSON;
+}
+
+void flush_monitors_windows(const struct _worker_info *worker_info,
+			    const struct rb_sensor_s *sensor,
+			    rb_monitors_array_t *monitors,
+			    struct rb_monitor_send_state *send_states,
+			    rb_message_list *ret) {
+	const json_object *enrichment = rb_sensor_enrichment(sensor);
+	const unsigned encodings = monitors_print_encodings(worker_info);
+
+	for (size_t i = 0; i < monitors->count; ++i) {
+		const rb_monitor_t *monitor =
+				rb_monitors_array_elm_at(monitors, i);
+		const struct monitor_value_print_ctx print_ctx = {
+				.sensor_enrichment = enrichment,
+				.encodings = encodings,
+				.common_keys = send_states[i].common_keys,
+		};
+
+		rb_message_array_t *msgs = send_state_window_flush(
+				monitor, &print_ctx, &send_states[i]);
+		if (msgs) {
+			rb_message_list_push(ret, msgs);
+		}
+	}
+}
+
 bool process_monitors_array(struct _worker_info *worker_info,
 			    rb_sensor_t *sensor,
 			    rb_monitors_array_t *monitors,
 			    rb_monitor_value_array_t *last_known_monitor_values,
+			    struct rb_monitor_send_state *send_states,
 			    ssize_t **monitors_deps,
+			    const struct rb_monitors_schedule *schedule,
 			    struct snmp_params_s *snmp_params,
 			    rb_message_list *ret) {
 	bool aok = true;
+	const unsigned encodings = monitors_print_encodings(worker_info);
+	const json_object *enrichment = rb_sensor_enrichment(sensor);
 	struct monitor_snmp_session *snmp_sessp = NULL;
 	struct process_sensor_monitor_ctx *process_ctx = NULL;
 	/* @todo we only need this if we are going to use SNMP */
@@ -272,7 +520,31 @@ bool process_monitors_array(struct _worker_info *worker_info,
 		       monitors->count * sizeof(void *));
 	}
 
-	for (size_t i = 0; aok && i < monitors->count; ++i) {
+	struct monitor_value *previous_values_buf = NULL;
+	rb_monitor_value_array_t *previous_values =
+			aok ? previous_monitor_values(monitors,
+						      last_known_monitor_values,
+						      &previous_values_buf)
+			    : NULL;
+
+	/* Fetch all external values first, instead of one round trip per
+	   monitor. They don't depend on any other monitor */
+	struct rb_monitor_prefetch *prefetch = NULL;
+	if (aok && process_ctx) {
+		prefetch = calloc(monitors->count, sizeof(prefetch[0]));
+		if (prefetch) {
+			for (size_t i = 0; i < monitors->count; ++i) {
+				prefetch[i].monitor = rb_monitors_array_elm_at(
+						monitors, i);
+			}
+			rb_monitors_prefetch(process_ctx,
+					     prefetch,
+					     monitors->count);
+		}
+	}
+
+	for (size_t s = 0; aok && s < monitors->count; ++s) {
+		const size_t i = schedule ? schedule->order[s] : s;
 		rb_monitor_value_array_t *op_vars =
 				rb_monitor_value_array_select(
 						current_iteration_values,
@@ -280,9 +552,28 @@ bool process_monitors_array(struct _worker_info *worker_info,
 
 		const rb_monitor_t *monitor =
 				rb_monitors_array_elm_at(monitors, i);
-		struct monitor_value *value = process_sensor_monitor(
-				process_ctx, monitor, op_vars);
+		rb_monitor_value_array_t *prev_op_vars =
+				rb_monitor_need_previous_values(monitor)
+						? rb_monitor_value_array_select(
+								  previous_values,
+								  monitors_deps[i])
+						: NULL;
+		struct monitor_value *value = NULL;
+		if (prefetch && prefetch[i].fetched) {
+			value = prefetch[i].value;
+			prefetch[i].value = NULL;
+		} else {
+			value = process_sensor_monitor(process_ctx,
+						       monitor,
+						       op_vars,
+						       prev_op_vars);
+		}
 
+		const struct monitor_value_print_ctx print_ctx = {
+				.sensor_enrichment = enrichment,
+				.encodings = encodings,
+				.common_keys = send_states[i].common_keys,
+		};
 		if (value) {
 			struct monitor_value *last_known_monitor_value_i =
 					last_known_monitor_values->elms[i];
@@ -290,15 +581,29 @@ bool process_monitors_array(struct _worker_info *worker_info,
 			last_known_monitor_values->elms[i] =
 					process_monitor_value(
 							monitor,
+							&print_ctx,
 							value,
 							last_known_monitor_value_i,
+							&send_states[i],
 							ret);
 		}
-		
+
+		/* Windows are sent when they are over even if no value of
+		   next window arrives, like if the monitor stops answering */
+		rb_message_array_t *window_msgs =
+				send_state_window_expire(monitor,
+							 &print_ctx,
+							 &send_states[i],
+							 time(NULL));
+		if (window_msgs) {
+			rb_message_list_push(ret, window_msgs);
+		}
+
 		current_iteration_values->elms[i] =
 				last_known_monitor_values->elms[i];
 
 		rb_monitor_value_array_done(op_vars);
+		rb_monitor_value_array_done(prev_op_vars);
 
 		while (!rb_message_list_empty(ret)) {
 			rb_message_array_t *msgs = rb_message_list_first(ret);
@@ -308,6 +613,15 @@ bool process_monitors_array(struct _worker_info *worker_info,
 	}
 
 	rb_monitor_value_array_done(current_iteration_values);
+	rb_monitor_value_array_done(previous_values);
+	free(previous_values_buf);
+
+	for (size_t i = 0; prefetch && i < monitors->count; ++i) {
+		if (prefetch[i].value) {
+			rb_monitor_value_done(prefetch[i].value);
+		}
+	}
+	free(prefetch);
 
 	if (process_ctx) {
 		destroy_process_sensor_monitor_ctx(process_ctx);
@@ -329,15 +643,11 @@ bool process_monitors_array(struct _worker_info *worker_info,
 static ssize_t find_monitor_pos(const rb_monitors_array_t *monitors_array,
 				const char *name,
 				const char *group_id) {
+	/* Names and group ids are interned, so pointer comparison is enough */
 	for (size_t i = 0; i < monitors_array->count; ++i) {
-		const char *i_name = rb_monitor_name(monitors_array->elms[i]);
-		const char *i_gid =
-				rb_monitor_group_id(monitors_array->elms[i]);
-		if (0 == strcmp(name, i_name) && // If equal name
-		    ((!i_gid && !group_id)       // Both no groups
-		     // or both have group and same group
-		     ||
-		     ((i_gid && group_id) && 0 == strcmp(group_id, i_gid)))) {
+		const rb_monitor_t *i_monitor = monitors_array->elms[i];
+		if (name == rb_monitor_name(i_monitor) &&
+		    group_id == rb_monitor_group_id(i_monitor)) {
 			return (ssize_t)i;
 		}
 	}
@@ -345,16 +655,103 @@ static ssize_t find_monitor_pos(const rb_monitors_array_t *monitors_array,
 	return -1;
 }
 
+/// Open addressing index of monitors by (name, group id)
+struct monitors_index {
+	const rb_monitors_array_t *monitors_array; ///< Indexed monitors
+	size_t mask;				   ///< Slots size - 1
+	ssize_t *slots; ///< Monitor position in every slot, -1 if empty
+};
+
+static size_t monitors_index_hash(const char *name, const char *group_id) {
+	const uintptr_t key[] = {(uintptr_t)name, (uintptr_t)group_id};
+	return (size_t)rb_hash_buf(RB_HASH_INIT, key, sizeof(key));
+}
+
+/** Create monitors index
+  @param index Index to init
+  @param monitors_array Monitors to index
+  @return true if OK, false if no memory
+  */
+static bool monitors_index_init(struct monitors_index *index,
+				const rb_monitors_array_t *monitors_array) {
+	size_t slots_size = 1;
+	while (slots_size < 2 * monitors_array->count) {
+		slots_size *= 2;
+	}
+
+	index->monitors_array = monitors_array;
+	index->mask = slots_size - 1;
+	index->slots = malloc(slots_size * sizeof(index->slots[0]));
+	if (NULL == index->slots) {
+		return false;
+	}
+	memset(index->slots, 0xff, slots_size * sizeof(index->slots[0]));
+
+	for (size_t i = 0; i < monitors_array->count; ++i) {
+		const rb_monitor_t *monitor = monitors_array->elms[i];
+		const char *name = rb_monitor_name(monitor);
+		const char *group_id = rb_monitor_group_id(monitor);
+		size_t slot = monitors_index_hash(name, group_id) & index->mask;
+		for (; index->slots[slot] != -1;
+		     slot = (slot + 1) & index->mask) {
+			const rb_monitor_t *slot_monitor =
+					monitors_array->elms[index->slots[slot]];
+			if (name == rb_monitor_name(slot_monitor) &&
+			    group_id == rb_monitor_group_id(slot_monitor)) {
+				/* Keep the first one, as find_monitor_pos */
+				break;
+			}
+		}
+
+		if (-1 == index->slots[slot]) {
+			index->slots[slot] = (ssize_t)i;
+		}
+	}
+
+	return true;
+}
+
+static void monitors_index_done(struct monitors_index *index) {
+	free(index->slots);
+}
+
+/** Get a monitor position using monitors index
+  @param index Monitors index. If not initialized, a linear search is done
+  @param name Name of monitor to find (interned)
+  @param group_id Group id of monitor (interned)
+  @return position of the monitor, or -1 if it couldn't be found
+  */
+static ssize_t monitors_index_find(const struct monitors_index *index,
+				   const char *name,
+				   const char *group_id) {
+	if (NULL == index->slots) {
+		return find_monitor_pos(index->monitors_array, name, group_id);
+	}
+
+	for (size_t slot = monitors_index_hash(name, group_id) & index->mask;
+	     index->slots[slot] != -1;
+	     slot = (slot + 1) & index->mask) {
+		const rb_monitor_t *monitor =
+				index->monitors_array->elms[index->slots[slot]];
+		if (name == rb_monitor_name(monitor) &&
+		    group_id == rb_monitor_group_id(monitor)) {
+			return index->slots[slot];
+		}
+	}
+
+	return -1;
+}
+
 /** Retuns a -1 terminated array with monitor operations variables position
-  @param monitors_array Array of monitors
+  @param monitors_index Index of monitors
   @param monitor Monitor to search for
   @return requested array
   */
 static ssize_t *
-get_monitor_dependencies(const rb_monitors_array_t *monitors_array,
+get_monitor_dependencies(const struct monitors_index *monitors_index,
 			 const rb_monitor_t *monitor) {
 	ssize_t *ret = NULL;
-	char **vars;
+	const char **vars;
 	size_t vars_len;
 
 	rb_monitor_get_op_variables(monitor, &vars, &vars_len);
@@ -368,9 +765,10 @@ get_monitor_dependencies(const rb_monitors_array_t *monitors_array,
 		}
 
 		for (size_t i = 0; i < vars_len; ++i) {
-			ret[i] = find_monitor_pos(monitors_array,
-						  vars[i],
-						  rb_monitor_group_id(monitor));
+			ret[i] = monitors_index_find(
+					monitors_index,
+					vars[i],
+					rb_monitor_group_id(monitor));
 			if (-1 == ret[i]) {
 				rdlog(LOG_ERR,
 				      "Couldn't find variable [%s] in "
@@ -398,11 +796,19 @@ ssize_t **get_monitors_dependencies(const rb_monitors_array_t *monitors_array) {
 		return NULL;
 	}
 
+	struct monitors_index monitors_index;
+	if (!monitors_index_init(&monitors_index, monitors_array)) {
+		rdlog(LOG_WARNING,
+		      "Couldn't allocate monitors index, using linear search");
+		monitors_index.slots = NULL;
+	}
+
 	for (size_t i = 0; i < monitors_array->count; ++i) {
 		const rb_monitor_t *i_monitor = monitors_array->elms[i];
-		ret[i] = get_monitor_dependencies(monitors_array, i_monitor);
+		ret[i] = get_monitor_dependencies(&monitors_index, i_monitor);
 	}
 
+	monitors_index_done(&monitors_index);
 	return ret;
 }
 
@@ -413,6 +819,205 @@ void free_monitors_dependencies(ssize_t **deps, size_t count) {
 	free(deps);
 }
 
+/// Min-heap of monitors positions, to keep config order when possible
+struct monitors_heap {
+	size_t *elms;
+	size_t count;
+};
+
+static void monitors_heap_push(struct monitors_heap *heap, size_t pos) {
+	size_t i = heap->count++;
+	for (; i > 0 && heap->elms[(i - 1) / 2] > pos; i = (i - 1) / 2) {
+		heap->elms[i] = heap->elms[(i - 1) / 2];
+	}
+	heap->elms[i] = pos;
+}
+
+static size_t monitors_heap_pop(struct monitors_heap *heap) {
+	const size_t ret = heap->elms[0];
+	const size_t last = heap->elms[--heap->count];
+	size_t i = 0;
+
+	while (2 * i + 1 < heap->count) {
+		size_t child = 2 * i + 1;
+		if (child + 1 < heap->count &&
+		    heap->elms[child + 1] < heap->elms[child]) {
+			child++;
+		}
+		if (last <= heap->elms[child]) {
+			break;
+		}
+		heap->elms[i] = heap->elms[child];
+		i = child;
+	}
+	heap->elms[i] = last;
+
+	return ret;
+}
+
+/** First dependency of a monitor that is still not evaluated
+  @param deps Monitor dependencies
+  @param i Monitor position
+  @param done Evaluated flag of every monitor
+  @return Dependency position
+  @note Monitor must have a pending dependency other than itself
+  */
+static size_t monitors_schedule_pending_dep(const ssize_t *deps,
+					    size_t i,
+					    const size_t *done) {
+	size_t j = 0;
+	while ((size_t)deps[j] == i || done[deps[j]]) {
+		j++;
+	}
+	return (size_t)deps[j];
+}
+
+/** Choose the monitor to break a dependency cycle with, when all pending
+  monitors wait for another one. Following pending dependencies from any
+  pending monitor ends in a cycle, and the first monitor of that cycle in
+  config order is chosen. Monitors that only depend on the cycle are not
+  part of it, so they still wait for it.
+  @param deps Monitors dependencies
+  @param count Number of monitors
+  @param done Evaluated flag of every monitor
+  @param visited Scratch memory, count elements
+  @param stamp Value to mark visited monitors, different in every call
+  @return Monitor position
+  */
+static size_t monitors_schedule_cycle(ssize_t **deps,
+				      size_t count,
+				      const size_t *done,
+				      size_t *visited,
+				      size_t stamp) {
+	size_t i = 0;
+	while (done[i]) {
+		i++;
+	}
+	assert(i < count);
+	(void)count;
+
+	while (visited[i] != stamp) {
+		visited[i] = stamp;
+		i = monitors_schedule_pending_dep(deps[i], i, done);
+	}
+
+	/* i is in a cycle now: walk it to choose its first monitor */
+	size_t ret = i;
+	for (size_t c = monitors_schedule_pending_dep(deps[i], i, done);
+	     c != i;
+	     c = monitors_schedule_pending_dep(deps[c], c, done)) {
+		if (c < ret) {
+			ret = c;
+		}
+	}
+
+	return ret;
+}
+
+struct rb_monitors_schedule *
+get_monitors_schedule(const rb_monitors_array_t *monitors_array,
+		      ssize_t **deps) {
+	const size_t count = monitors_array->count;
+	size_t edges = 0;
+
+	for (size_t i = 0; i < count; ++i) {
+		for (size_t j = 0; deps[i] && deps[i][j] != -1; ++j) {
+			edges++;
+		}
+	}
+
+	struct rb_monitors_schedule *ret = NULL;
+	/* Scratch memory: pending dependencies of every monitor, dependents
+	   lists start (count + 1), dependents lists, heap, done flags and
+	   cycles search marks */
+	size_t *pending = calloc(5 * count + 1 + edges, sizeof(pending[0]));
+	if (NULL == pending) {
+		goto err;
+	}
+	size_t *dependents_start = &pending[count];
+	size_t *dependents = &dependents_start[count + 1];
+	struct monitors_heap heap = {.elms = &dependents[edges]};
+	size_t *done = &heap.elms[count];
+	size_t *visited = &done[count];
+
+	ret = calloc(1, sizeof(*ret) + count * sizeof(ret->order[0]));
+	if (NULL == ret) {
+		goto err;
+	}
+	ret->order = (size_t *)&ret[1];
+
+	/* Build dependents lists, so we know who to wake up. A monitor that
+	   depends on itself always uses its previous value, so it is not an
+	   ordering constraint */
+	for (size_t i = 0; i < count; ++i) {
+		for (size_t j = 0; deps[i] && deps[i][j] != -1; ++j) {
+			if ((size_t)deps[i][j] != i) {
+				pending[i]++;
+				dependents_start[deps[i][j] + 1]++;
+			}
+		}
+	}
+	for (size_t i = 0; i < count; ++i) {
+		dependents_start[i + 1] += dependents_start[i];
+	}
+	for (size_t i = 0; i < count; ++i) {
+		for (size_t j = 0; deps[i] && deps[i][j] != -1; ++j) {
+			/* done[] is still unused, so use it as cursor */
+			const size_t dep = (size_t)deps[i][j];
+			if (dep != i) {
+				dependents[dependents_start[dep] +
+					   done[dep]++] = i;
+			}
+		}
+	}
+	memset(done, 0, count * sizeof(done[0]));
+
+	for (size_t i = 0; i < count; ++i) {
+		if (0 == pending[i]) {
+			monitors_heap_push(&heap, i);
+		}
+	}
+
+	for (size_t s = 0; s < count; ++s) {
+		size_t i;
+		if (heap.count > 0) {
+			i = monitors_heap_pop(&heap);
+		} else {
+			i = monitors_schedule_cycle(
+					deps, count, done, visited, s + 1);
+			rdlog(LOG_WARNING,
+			      "Monitor %s is in a dependency cycle, it will "
+			      "use previous values",
+			      rb_monitor_name(monitors_array->elms[i]));
+		}
+
+		done[i] = 1;
+		ret->order[s] = i;
+
+		for (size_t j = dependents_start[i];
+		     j < dependents_start[i + 1];
+		     ++j) {
+			const size_t dependent = dependents[j];
+			if (!done[dependent] && 0 == --pending[dependent]) {
+				monitors_heap_push(&heap, dependent);
+			}
+		}
+	}
+
+	free(pending);
+	return ret;
+
+err:
+	rdlog(LOG_ERR, "Couldn't allocate monitors schedule (OOM?)");
+	free(pending);
+	free_monitors_schedule(ret);
+	return NULL;
+}
+
+void free_monitors_schedule(struct rb_monitors_schedule *schedule) {
+	free(schedule);
+}
+
 void rb_monitors_array_done(rb_monitors_array_t *monitors_array) {
 	for (size_t i = 0; i < monitors_array->count; ++i) {
 		rb_monitor_done(rb_monitors_array_elm_at(monitors_array, i));
@@ -36,12 +36,10 @@ typedef struct rb_array rb_monitors_array_t;
 
 /** Extract monitors array from a JSON array.
   @param monitors_array_json JSON monitors template
-  @param sensor_enrichment Sensor imposed enrichment
   @return New monitors array
   @note Need to free returned monitors with rb_monitors_array_done
   */
-rb_monitors_array_t *parse_rb_monitors(json_object *monitors_array_json,
-				       json_object *sensor_enrichment);
+rb_monitors_array_t *parse_rb_monitors(json_object *monitors_array_json);
 
 /// @todo Delete this FW declaration, we only need to use operation previous
 /// values
@@ -54,12 +52,40 @@ struct rb_sensor_s;
   */
 rb_monitor_t *rb_monitors_array_elm_at(rb_monitors_array_t *array, size_t i);
 
+/// Monitors evaluation schedule
+struct rb_monitors_schedule {
+	/// Monitors positions, in evaluation order. Every monitor is evaluated
+	/// after the monitors it depends on, and in config order if possible
+	size_t *order;
+};
+
+/// Per sensor state of a monitor output
+struct rb_monitor_send_state {
+	/// Aggregation window in progress (see rb_monitor_window)
+	struct monitor_value_summary window;
+	/// Last sent value (see rb_monitor_suppress_value)
+	struct {
+		double value;	  ///< Value
+		time_t timestamp; ///< Value timestamp
+		bool valid;	  ///< Some value has been sent
+	} last_sent;
+	/// Group id and enrichment of monitor messages, in every encoding
+	struct monitor_value_common_keys common_keys[RB_MESSAGE_ENCODING__MAX];
+};
+
+/** Release monitor output state resources
+  @param send_state Output state
+  */
+void rb_monitor_send_state_done(struct rb_monitor_send_state *send_state);
+
 /** Process all monitors in sensor, returning result in ret
   @param worker_info All workers info
   @param sensor Current sensor
   @param monitors Array of monitors to ask
   @param last_known_monitor_values Last monitor values, to be able to compare
+  @param send_states Output state of every monitor
   @param monitors_deps Monitor dependencies
+  @param schedule Monitors evaluation schedule. If NULL, config order is used
   @param snmp_params SNMP connection parameters
   @param ret Message returning function
   @warning This function assumes ALL fields of sensor_data will be populated */
@@ -67,10 +93,26 @@ bool process_monitors_array(struct _worker_info *worker_info,
 			    struct rb_sensor_s *sensor,
 			    rb_monitors_array_t *monitors,
 			    rb_monitor_value_array_t *last_known_monitor_values,
+			    struct rb_monitor_send_state *send_states,
 			    ssize_t **monitors_deps,
+			    const struct rb_monitors_schedule *schedule,
 			    struct snmp_params_s *snmp_params,
 			    rb_message_list *ret);
 
+/** Close the aggregation windows in progress of all monitors, like when the
+  sensor is released
+  @param worker_info All workers info
+  @param sensor Sensor of the monitors
+  @param monitors Monitors
+  @param send_states Output state of every monitor
+  @param ret List to append windows summaries messages to
+  */
+void flush_monitors_windows(const struct _worker_info *worker_info,
+			    const struct rb_sensor_s *sensor,
+			    rb_monitors_array_t *monitors,
+			    struct rb_monitor_send_state *send_states,
+			    rb_message_list *ret);
+
 /** Given an array of monitors, return all monitor's internal dependency.
   In the return, each element of the array contains another array:
     NULL if this monitor has no dependency
@@ -86,6 +128,25 @@ ssize_t **get_monitors_dependencies(const rb_monitors_array_t *monitors_array);
   */
 void free_monitors_dependencies(ssize_t **deps, size_t count);
 
+/** Sort monitors topologically, so operations are evaluated after their
+  operands. Monitors in a dependency cycle can't be sorted: the first one in
+  config order is evaluated using previous values of the monitors that are
+  still not evaluated, and a warning is logged. Monitors that depend on a
+  cycle are still evaluated after it.
+  @param monitors_array Array of monitors
+  @param deps Monitors dependencies (see get_monitors_dependencies)
+  @return Schedule (need to free with free_monitors_schedule), or NULL if no
+  memory
+  */
+struct rb_monitors_schedule *
+get_monitors_schedule(const rb_monitors_array_t *monitors_array,
+		      ssize_t **deps);
+
+/** Release schedule allocated with get_monitors_schedule
+  @param schedule Schedule to free
+  */
+void free_monitors_schedule(struct rb_monitors_schedule *schedule);
+
 /** Free array allocated with parse_rb_monitors
   @param array Array
   */
@@ -26,3 +26,10 @@ void sensor_queue_init(sensor_queue_t *queue) {
 void sensor_queue_done(sensor_queue_t *queue) {
 	rd_fifoq_destroy(queue);
 }
+
+int sensor_queue_len(sensor_queue_t *queue) {
+	pthread_mutex_lock(&queue->rfq_lock);
+	const int ret = queue->rfq_cnt;
+	pthread_mutex_unlock(&queue->rfq_lock);
+	return ret;
+}
@@ -37,6 +37,12 @@ void sensor_queue_init(sensor_queue_t *queue);
   */
 void sensor_queue_done(sensor_queue_t *queue);
 
+/** Number of sensors waiting in queue
+  @param queue Queue
+  @return Queue length
+  */
+int sensor_queue_len(sensor_queue_t *queue);
+
 /** Queue a sensor
   @param queue Queue
   @param sensor Sensor
@@ -0,0 +1,264 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "rb_sketch.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Values closer to 0 than this are counted as 0
+#define SKETCH_MIN_INDEXABLE 1e-9
+
+/// Initial number of buckets of a store
+#define SKETCH_STORE_INITIAL_SIZE 64
+
+/// Buckets of values of the same sign
+struct rb_sketch_store {
+	int64_t offset;	  ///< Bucket index of counts[0]
+	size_t size;	  ///< Allocated buckets
+	uint64_t *counts; ///< Bucket counts
+};
+
+struct rb_sketch {
+#ifndef NDEBUG
+#define RB_SKETCH_MAGIC 0x5E7C45E7C45E7C4L
+	uint64_t magic;
+#endif
+	double gamma;	  ///< Bucket i holds (gamma^(i-1), gamma^i] values
+	double log_gamma; ///< Cached log(gamma)
+	struct rb_sketch_store positive; ///< Positive values
+	struct rb_sketch_store negative; ///< Absolute value of negative values
+	uint64_t zero_count;		 ///< Values near 0
+	uint64_t count;			 ///< Total values
+};
+
+static void assert_rb_sketch(const struct rb_sketch *sketch) {
+#ifdef RB_SKETCH_MAGIC
+	assert(RB_SKETCH_MAGIC == sketch->magic);
+#else
+	(void)sketch;
+#endif
+}
+
+struct rb_sketch *rb_sketch_new(double relative_accuracy) {
+	assert(relative_accuracy > 0 && relative_accuracy < 1);
+
+	struct rb_sketch *ret = calloc(1, sizeof(*ret));
+	if (NULL == ret) {
+		return NULL;
+	}
+
+#ifdef RB_SKETCH_MAGIC
+	ret->magic = RB_SKETCH_MAGIC;
+#endif
+	ret->gamma = (1 + relative_accuracy) / (1 - relative_accuracy);
+	ret->log_gamma = log(ret->gamma);
+
+	return ret;
+}
+
+/** Add n values to a store bucket, growing the store if needed
+  @param store Store
+  @param index Bucket index
+  @param n Number of values
+  @return true if success, false if no memory
+  */
+static bool sketch_store_add(struct rb_sketch_store *store,
+			     int64_t index,
+			     uint64_t n) {
+	if (NULL == store->counts) {
+		store->counts = calloc(SKETCH_STORE_INITIAL_SIZE,
+				       sizeof(store->counts[0]));
+		if (NULL == store->counts) {
+			return false;
+		}
+		store->size = SKETCH_STORE_INITIAL_SIZE;
+		store->offset = index - SKETCH_STORE_INITIAL_SIZE / 2;
+	} else if (index < store->offset ||
+		   index >= store->offset + (int64_t)store->size) {
+		const int64_t last = store->offset + (int64_t)store->size - 1;
+		const int64_t min = index < store->offset ? index
+							  : store->offset;
+		const int64_t max = index > last ? index : last;
+		size_t new_size = store->size;
+		while (new_size < (size_t)(max - min + 1)) {
+			new_size *= 2;
+		}
+
+		uint64_t *counts = calloc(new_size, sizeof(counts[0]));
+		if (NULL == counts) {
+			return false;
+		}
+
+		/* Leave the free room in the direction the store is growing */
+		const int64_t new_offset = index < store->offset
+						   ? max + 1 - (int64_t)new_size
+						   : min;
+		memcpy(&counts[store->offset - new_offset],
+		       store->counts,
+		       store->size * sizeof(counts[0]));
+		free(store->counts);
+		store->counts = counts;
+		store->size = new_size;
+		store->offset = new_offset;
+	}
+
+	store->counts[index - store->offset] += n;
+	return true;
+}
+
+/** Bucket index of a value
+  @param sketch Sketch
+  @param value Value (> SKETCH_MIN_INDEXABLE)
+  @return Bucket index
+  */
+static int64_t sketch_index(const struct rb_sketch *sketch, double value) {
+	return (int64_t)ceil(log(value) / sketch->log_gamma);
+}
+
+/** Representative value of a bucket, the one with the least relative error
+  to all values it can hold
+  @param sketch Sketch
+  @param index Bucket index
+  @return Bucket value
+  */
+static double sketch_bucket_value(const struct rb_sketch *sketch,
+				  int64_t index) {
+	return 2 * pow(sketch->gamma, (double)index) / (sketch->gamma + 1);
+}
+
+bool rb_sketch_add(struct rb_sketch *sketch, double value) {
+	assert_rb_sketch(sketch);
+
+	if (!isfinite(value)) {
+		/* Can't be indexed, and would spoil all quantiles */
+		return true;
+	}
+
+	bool ok = true;
+	if (value > SKETCH_MIN_INDEXABLE) {
+		ok = sketch_store_add(&sketch->positive,
+				      sketch_index(sketch, value),
+				      1);
+	} else if (value < -SKETCH_MIN_INDEXABLE) {
+		ok = sketch_store_add(&sketch->negative,
+				      sketch_index(sketch, -value),
+				      1);
+	} else {
+		sketch->zero_count++;
+	}
+
+	if (ok) {
+		sketch->count++;
+	}
+	return ok;
+}
+
+/** Add all buckets of src store to dst store
+  @param dst Destination store
+  @param src Source store
+  @return true if success, false if no memory
+  */
+static bool sketch_store_merge(struct rb_sketch_store *dst,
+			       const struct rb_sketch_store *src) {
+	for (size_t i = 0; i < src->size; ++i) {
+		if (src->counts[i] > 0 &&
+		    !sketch_store_add(dst,
+				      src->offset + (int64_t)i,
+				      src->counts[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool rb_sketch_merge(struct rb_sketch *dst, const struct rb_sketch *src) {
+	assert_rb_sketch(dst);
+	assert_rb_sketch(src);
+
+	if (dst->gamma != src->gamma) {
+		return false;
+	}
+
+	if (!sketch_store_merge(&dst->positive, &src->positive) ||
+	    !sketch_store_merge(&dst->negative, &src->negative)) {
+		return false;
+	}
+
+	dst->zero_count += src->zero_count;
+	dst->count += src->count;
+	return true;
+}
+
+uint64_t rb_sketch_count(const struct rb_sketch *sketch) {
+	assert_rb_sketch(sketch);
+	return sketch->count;
+}
+
+double rb_sketch_quantile(const struct rb_sketch *sketch, double quantile) {
+	assert_rb_sketch(sketch);
+
+	if (0 == sketch->count) {
+		return NAN;
+	}
+
+	if (quantile < 0) {
+		quantile = 0;
+	} else if (quantile > 1) {
+		quantile = 1;
+	}
+
+	const double rank = quantile * (double)(sketch->count - 1);
+	uint64_t cumulative = 0;
+
+	/* Negative values, from the biggest absolute value to the smallest */
+	const struct rb_sketch_store *negative = &sketch->negative;
+	for (size_t i = negative->size; i-- > 0;) {
+		cumulative += negative->counts[i];
+		if ((double)cumulative > rank) {
+			return -sketch_bucket_value(sketch,
+						    negative->offset + (int64_t)i);
+		}
+	}
+
+	cumulative += sketch->zero_count;
+	if ((double)cumulative > rank) {
+		return 0;
+	}
+
+	const struct rb_sketch_store *positive = &sketch->positive;
+	for (size_t i = 0; i < positive->size; ++i) {
+		cumulative += positive->counts[i];
+		if ((double)cumulative > rank) {
+			return sketch_bucket_value(sketch,
+						   positive->offset + (int64_t)i);
+		}
+	}
+
+	/* Not reachable: rank < count */
+	return NAN;
+}
+
+void rb_sketch_done(struct rb_sketch *sketch) {
+	assert_rb_sketch(sketch);
+	free(sketch->positive.counts);
+	free(sketch->negative.counts);
+	free(sketch);
+}
@@ -0,0 +1,66 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** DDSketch quantiles sketch. Values are counted in logarithmic buckets, so
+  any quantile is returned with a bounded relative error, and two sketches
+  can be merged just adding their buckets.
+  */
+struct rb_sketch;
+
+/** Create a new sketch
+  @param relative_accuracy Max relative error of returned quantiles (0, 1)
+  @return New sketch, or NULL if no memory
+  */
+struct rb_sketch *rb_sketch_new(double relative_accuracy);
+
+/** Add a value to sketch
+  @param sketch Sketch
+  @param value Value to add
+  @return true if success, false if no memory
+  */
+bool rb_sketch_add(struct rb_sketch *sketch, double value);
+
+/** Add all src values to dst
+  @param dst Destination sketch
+  @param src Source sketch. Must have the same relative accuracy as dst
+  @return true if success, false if no memory or not compatible sketches
+  */
+bool rb_sketch_merge(struct rb_sketch *dst, const struct rb_sketch *src);
+
+/** Number of values added to sketch
+  @param sketch Sketch
+  @return Number of values
+  */
+uint64_t rb_sketch_count(const struct rb_sketch *sketch);
+
+/** Get a quantile
+  @param sketch Sketch
+  @param quantile Quantile, in [0, 1] range
+  @return Quantile value, or NAN if sketch is empty
+  */
+double rb_sketch_quantile(const struct rb_sketch *sketch, double quantile);
+
+/** Free a sketch
+  @param sketch Sketch
+  */
+void rb_sketch_done(struct rb_sketch *sketch);
@@ -17,10 +17,13 @@
 */
 
 #include "rb_snmp.h"
+#include "rb_stats.h"
 #include <assert.h>
 #include <librd/rd.h>
 #include <librd/rdlog.h>
 
+#include <inttypes.h>
+
 // #define SNMP_SESS_MAGIC 0x12345678
 
 struct monitor_snmp_session {
@@ -69,9 +72,131 @@ new_snmp_session(struct snmp_session *initial_session,
 	return session;
 }
 
+/** Extract the value of a response variable
+  @param value_buf Return buffer where the response will be saved (text format)
+  @param value_buf_len Buffer value_buf length
+  @param number Response in double format
+  @param type Response ASN type
+  @param variable Response variable
+  @param oid_string String representing oid, for logging
+  */
+static void snmp_solve_variable(char *value_buf,
+				size_t value_buf_len,
+				double *number,
+				u_char *type,
+				const struct variable_list *variable,
+				const char *oid_string) {
+	const size_t effective_len = RD_MIN(value_buf_len, variable->val_len);
+	*type = variable->type;
+
+	// See in /usr/include/net-snmp/types.h
+	switch (variable->type) {
+	case ASN_GAUGE:
+	case ASN_INTEGER:
+		snprintf(value_buf, value_buf_len, "%ld", *variable->val.integer);
+		*number = *variable->val.integer;
+		break;
+	case ASN_OCTET_STR:
+		if (effective_len == 0) {
+			snprintf(value_buf, value_buf_len, "0");
+			*number = 0;
+			break;
+		}
+
+		snprintf(value_buf,
+			 value_buf_len,
+			 "%.*s",
+			 (int)variable->val_len,
+			 variable->val.string);
+
+		*number = strtod(value_buf, NULL);
+		break;
+	case ASN_COUNTER: // counter32
+		snprintf(value_buf,
+			 value_buf_len,
+			 "%lu",
+			 (unsigned long)*variable->val.integer);
+		*number = (unsigned long)*variable->val.integer;
+		break;
+	case ASN_COUNTER64: {
+		/* high and low are 32 bits halves stored in u_long */
+		const uint64_t counter64 =
+				(uint64_t)(variable->val.counter64->high &
+					   0xffffffffUL)
+						<< 32 |
+				(variable->val.counter64->low & 0xffffffffUL);
+		snprintf(value_buf, value_buf_len, "%" PRIu64, counter64);
+		*number = (double)counter64;
+		break;
+	}
+	default:
+		rdlog(LOG_WARNING,
+		      "Unknow variable type %d in SNMP response",
+		      variable->type);
+		snprintf(value_buf, value_buf_len, "0");
+		*number = 0;
+	};
+
+	rdlog(LOG_DEBUG,
+	      "SNMP OID %s response type %d: %s\n",
+	      oid_string,
+	      variable->type,
+	      value_buf);
+}
+
+/** Log a failed SNMP request
+  @param session SNMP session
+  @param status Request status
+  */
+static void snmp_log_request_error(struct monitor_snmp_session *session,
+				   int status) {
+	rdlog(LOG_ERR,
+	      "Snmp error: %s",
+	      status != STAT_SUCCESS
+			      ? snmp_api_errstring(
+						snmp_sess_session(session->sessp)
+								->s_snmp_errno)
+			      : "No SNMP response given.");
+}
+
+/** Send a SNMP request and wait for the response, recording stats
+  @param session SNMP session
+  @param pdu Request PDU. It will be released
+  @param response Response PDU
+  @return Request status
+  */
+static int snmp_synch_request(struct monitor_snmp_session *session,
+			      struct snmp_pdu *pdu,
+			      struct snmp_pdu **response) {
+	const uint64_t start = rb_stats_now();
+	const int status = snmp_sess_synch_response(session->sessp, pdu, response);
+	rb_stats_histogram_since(RB_STATS_H__SNMP_RTT, start);
+	rb_stats_counter_inc(RB_STATS_C__SNMP_REQUESTS);
+	if (STAT_TIMEOUT == status) {
+		rb_stats_counter_inc(RB_STATS_C__SNMP_TIMEOUTS);
+	} else if (STAT_SUCCESS != status || NULL == *response ||
+		   SNMP_ERR_NOERROR != (*response)->errstat) {
+		rb_stats_counter_inc(RB_STATS_C__SNMP_ERRORS);
+	}
+
+	return status;
+}
+
+/** Add an OID to a PDU
+  @param pdu PDU
+  @param oid_string OID in text format
+  */
+static void snmp_pdu_add_oid(struct snmp_pdu *pdu, const char *oid_string) {
+	oid entry_oid[MAX_OID_LEN];
+	size_t entry_oid_len = MAX_OID_LEN;
+	read_objid(oid_string, entry_oid, &entry_oid_len);
+	snmp_add_null_var(pdu, entry_oid, entry_oid_len);
+}
+
 bool snmp_solve_response(char *value_buf,
 			 size_t value_buf_len,
 			 double *number,
+			 u_char *type,
 			 struct monitor_snmp_session *session,
 			 const char *oid_string) {
 #ifdef SNMP_SESS_MAGIC
@@ -81,88 +206,86 @@ bool snmp_solve_response(char *value_buf,
 	struct snmp_pdu *pdu = snmp_pdu_create(SNMP_MSG_GET);
 	struct snmp_pdu *response = NULL;
 
-	oid entry_oid[MAX_OID_LEN];
-	size_t entry_oid_len = MAX_OID_LEN;
-	read_objid(oid_string, entry_oid, &entry_oid_len);
-	snmp_add_null_var(pdu, entry_oid, entry_oid_len);
-	const int status = snmp_sess_synch_response(
-			session->sessp, pdu, &response);
-	/* A lot of variables. Just if we pass SNMPV3 someday.
-	struct variable_list *vars;
-	for(vars=response->variables; vars; vars=vars->next_variable)
-		print_variable(vars->name,vars->name_length,vars);
-	*/
-	int ret = 0;
+	snmp_pdu_add_oid(pdu, oid_string);
+	const int status = snmp_synch_request(session, pdu, &response);
 	assert(value_buf);
 	assert(number);
 
-	if (status != STAT_SUCCESS || NULL == response) {
-		rdlog(LOG_ERR,
-		      "Snmp error: %s",
-		      status != STAT_SUCCESS
-				      ? snmp_api_errstring(
-							snmp_sess_session(session->sessp)
-									->s_snmp_errno)
-				      : "No SNMP response given.");
+	if (status != STAT_SUCCESS || NULL == response ||
+	    NULL == response->variables) {
+		snmp_log_request_error(session, status);
 		snprintf(value_buf, value_buf_len, "0");
 		*number = 0;
-		ret = 1;
+		*type = ASN_NULL;
 	} else {
+		snmp_solve_variable(value_buf,
+				    value_buf_len,
+				    number,
+				    type,
+				    response->variables,
+				    oid_string);
+	}
+
+	if (response) {
+		snmp_free_pdu(response);
+	}
+	return true;
+}
+
+bool snmp_solve_responses(struct monitor_snmp_session *session,
+			  const char **oid_strings,
+			  struct snmp_batch_response *responses,
+			  size_t count) {
+#ifdef SNMP_SESS_MAGIC
+	assert(session->magic == SNMP_SESS_MAGIC);
+#endif
+
+	bool ret = true;
+	struct snmp_pdu *pdu = snmp_pdu_create(SNMP_MSG_GET);
+	struct snmp_pdu *response = NULL;
+
+	for (size_t i = 0; i < count; ++i) {
+		snmp_pdu_add_oid(pdu, oid_strings[i]);
+	}
+
+	const int status = snmp_synch_request(session, pdu, &response);
+
+	if (status != STAT_SUCCESS || NULL == response) {
+		/* Same as asking one by one: the agent is not answering */
+		snmp_log_request_error(session, status);
+		for (size_t i = 0; i < count; ++i) {
+			snprintf(responses[i].value_buf,
+				 responses[i].value_buf_len,
+				 "0");
+			responses[i].number = 0;
+			responses[i].type = ASN_NULL;
+		}
+	} else if (SNMP_ERR_NOERROR != response->errstat) {
+		/* SNMPv1 agents fail all the PDU if an OID does not exist,
+		   and the PDU could be too big */
 		rdlog(LOG_DEBUG,
-		      "SNMP OID %s response type %d: %s\n",
-		      oid_string,
-		      response->variables->type,
-		      value_buf);
-		const size_t effective_len = RD_MIN(
-				value_buf_len, response->variables->val_len);
-
-		// See in /usr/include/net-snmp/types.h
-		switch (response->variables->type) {
-		case ASN_GAUGE:
-		case ASN_INTEGER:
-			snprintf(value_buf,
-				 value_buf_len,
-				 "%ld",
-				 *response->variables->val.integer);
-			*number = *response->variables->val.integer;
-			ret = 1;
-			break;
-		case ASN_OCTET_STR:
-			if (effective_len == 0) {
-				snprintf(value_buf, value_buf_len, "0");
-				*number = 0;
-				ret = 1;
+		      "Batched SNMP request failed: %s",
+		      snmp_errstring(response->errstat));
+		ret = false;
+	} else {
+		const struct variable_list *variable = response->variables;
+		for (size_t i = 0; i < count; ++i) {
+			if (NULL == variable) {
+				rdlog(LOG_ERR,
+				      "SNMP response has less variables than "
+				      "requested");
+				ret = false;
 				break;
 			}
 
-			snprintf(value_buf,
-				 value_buf_len,
-				 "%.*s",
-				 (int)response->variables->val_len,
-				 response->variables->val.string);
-
-			*number = strtod(value_buf, NULL);
-			ret = 1;
-			break;
-	    case 65: //counter32 TODO: replace by ASN_COUNTER32 if exists
-			snprintf(value_buf, value_buf_len, "%ld", *response->variables->val.integer);
-			*number = *response->variables->val.integer;
-			ret = 1;
-			break;
-		case ASN_COUNTER64: //counter64
-			// TODO: Prepare this for high values also
-			snprintf(value_buf,value_buf_len,"%lu",response->variables->val.counter64->low);
-			*number = (double) response->variables->val.counter64->low;
-			ret = 1;
-			break;
-		default:
-			rdlog(LOG_WARNING,
-			      "Unknow variable type %d in SNMP response",
-			      response->variables->type);
-			snprintf(value_buf, value_buf_len, "0");
-			*number = 0;
-			ret = 1;
-		};
+			snmp_solve_variable(responses[i].value_buf,
+					    responses[i].value_buf_len,
+					    &responses[i].number,
+					    &responses[i].type,
+					    variable,
+					    oid_strings[i]);
+			variable = variable->next_variable;
+		}
 	}
 
 	if (response) {
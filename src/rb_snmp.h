@@ -43,6 +43,8 @@ new_snmp_session(struct snmp_session *ss,
   @param value_buf_len Buffer value_buf length
   @param number      If possible, the response will be saved in double format
   here
+  @param type        Response ASN type (ASN_COUNTER, ASN_COUNTER64...), or
+  ASN_NULL if no response
   @param _session    SNMP session to use
   @param _oid_string String representing oid
   @return            0 if number was not setted; non 0 otherwise.
@@ -50,9 +52,32 @@ new_snmp_session(struct snmp_session *ss,
 bool snmp_solve_response(char *value_buf,
 			 size_t value_buf_len,
 			 double *number,
+			 u_char *type,
 			 struct monitor_snmp_session *session,
 			 const char *oid_string);
 
+/// Response of an OID in a batched request
+struct snmp_batch_response {
+	char *value_buf;      ///< Response in text format
+	size_t value_buf_len; ///< value_buf length
+	double number;	///< Response in double format
+	u_char type;          ///< Response ASN type
+};
+
+/** Ask for many OIDs in the same SNMP GET PDU, saving a round trip per OID.
+  @param session SNMP session to use
+  @param oid_strings OIDs to ask for
+  @param responses Responses, in the same order as oid_strings
+  @param count Number of OIDs
+  @return true if responses are filled (with "0" if the agent did not
+  answer), false if the agent rejected the PDU and OIDs need to be asked
+  one by one
+  */
+bool snmp_solve_responses(struct monitor_snmp_session *session,
+			  const char **oid_strings,
+			  struct snmp_batch_response *responses,
+			  size_t count);
+
 void destroy_snmp_session(struct monitor_snmp_session *);
 
 int net_snmp_version(const char *string_version, const char *sensor_name);
@@ -0,0 +1,451 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include "rb_stats.h"
+
+#include <json-c/printbuf.h>
+#include <librd/rd.h>
+#include <librd/rdlog.h>
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Prefix of stats messages monitor name
+#define STATS_MONITOR_PREFIX "rb_monitor_"
+
+/// Stats of one thread. Only the owner thread writes on it
+struct rb_stats_thread {
+	struct rb_stats_thread *next; ///< Next thread in threads list
+	uint64_t counters[RB_STATS_C__MAX];
+	struct rb_stats_histogram_data histograms[RB_STATS_H__MAX];
+};
+
+/// All threads stats. Lock is only needed to register/release threads
+static struct {
+	pthread_mutex_t lock;
+	struct rb_stats_thread *threads;
+	int64_t gauges[RB_STATS_G__MAX];
+} stats = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/// Current thread stats
+static __thread struct rb_stats_thread *thread_stats;
+
+/** Current thread stats, registering them if needed
+  @return Current thread stats, or NULL if couldn't allocate them
+  */
+static struct rb_stats_thread *rb_stats_thread(void) {
+	if (likely(NULL != thread_stats)) {
+		return thread_stats;
+	}
+
+	struct rb_stats_thread *ret = calloc(1, sizeof(*ret));
+	if (NULL == ret) {
+		rdlog(LOG_ERR, "Couldn't allocate thread stats (OOM?)");
+		return NULL;
+	}
+
+	pthread_mutex_lock(&stats.lock);
+	ret->next = stats.threads;
+	stats.threads = ret;
+	pthread_mutex_unlock(&stats.lock);
+
+	thread_stats = ret;
+	return ret;
+}
+
+/** Atomic read of a value that other thread could be writing
+  @param val Value
+  @return Read value
+  */
+static uint64_t stats_load(uint64_t *val) {
+	return ATOMIC_OP64(add, fetch, val, 0);
+}
+
+uint64_t rb_stats_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void rb_stats_counter_add(enum rb_stats_counter counter, uint64_t value) {
+	struct rb_stats_thread *t = rb_stats_thread();
+	if (likely(NULL != t)) {
+		ATOMIC_OP64(add, fetch, &t->counters[counter], value);
+	}
+}
+
+uint64_t rb_stats_thread_counter(enum rb_stats_counter counter) {
+	struct rb_stats_thread *t = rb_stats_thread();
+	return likely(NULL != t) ? stats_load(&t->counters[counter]) : 0;
+}
+
+uint64_t rb_stats_counter(enum rb_stats_counter counter) {
+	uint64_t ret = 0;
+
+	pthread_mutex_lock(&stats.lock);
+	for (struct rb_stats_thread *t = stats.threads; t; t = t->next) {
+		ret += stats_load(&t->counters[counter]);
+	}
+	pthread_mutex_unlock(&stats.lock);
+
+	return ret;
+}
+
+/** Current thread CPU time
+  @return CPU time in microseconds
+  */
+static uint64_t stats_thread_cpu_time(void) {
+	struct timespec ts;
+	if (0 != clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+		return 0;
+	}
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void rb_stats_cost_start(struct rb_stats_cost *cost) {
+	cost->count = 0;
+	cost->wall_time_us = rb_stats_now();
+	cost->cpu_time_us = stats_thread_cpu_time();
+	cost->messages = rb_stats_thread_counter(RB_STATS_C__MESSAGES);
+	cost->bytes = rb_stats_thread_counter(RB_STATS_C__BYTES);
+	cost->snmp_requests = rb_stats_thread_counter(RB_STATS_C__SNMP_REQUESTS);
+	cost->errors = rb_stats_thread_counter(RB_STATS_C__SNMP_ERRORS) +
+		       rb_stats_thread_counter(RB_STATS_C__SNMP_TIMEOUTS) +
+		       rb_stats_thread_counter(RB_STATS_C__SYSTEM_ERRORS);
+}
+
+void rb_stats_cost_end(struct rb_stats_cost *cost) {
+	struct rb_stats_cost end;
+	rb_stats_cost_start(&end);
+
+	cost->count = 1;
+	cost->wall_time_us = end.wall_time_us - cost->wall_time_us;
+	cost->cpu_time_us = end.cpu_time_us - cost->cpu_time_us;
+	cost->messages = end.messages - cost->messages;
+	cost->bytes = end.bytes - cost->bytes;
+	cost->snmp_requests = end.snmp_requests - cost->snmp_requests;
+	cost->errors = end.errors - cost->errors;
+}
+
+void rb_stats_gauge_set(enum rb_stats_gauge gauge, int64_t value) {
+	/* A load and an add of the difference could lose concurrent sets */
+	__atomic_store_n(&stats.gauges[gauge], value, __ATOMIC_RELAXED);
+}
+
+/** Histogram bucket of a value. Values are grouped in powers of two, and
+  every power of two is divided in RB_STATS_HISTOGRAM_SUB_BUCKETS linear
+  buckets.
+  @param value Value
+  @return Bucket index
+  */
+static size_t histogram_bucket(uint64_t value) {
+	if (value < RB_STATS_HISTOGRAM_SUB_BUCKETS) {
+		return (size_t)value;
+	}
+
+	const unsigned msb = 63 - (unsigned)__builtin_clzll(value);
+	if (msb >= RB_STATS_HISTOGRAM_MAX_BITS) {
+		return RB_STATS_HISTOGRAM_BUCKETS - 1;
+	}
+
+	const unsigned shift = msb - RB_STATS_HISTOGRAM_SUB_BUCKETS_BITS;
+	return (shift + 1) * RB_STATS_HISTOGRAM_SUB_BUCKETS +
+	       ((value >> shift) & (RB_STATS_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/** Representative value of a histogram bucket
+  @param bucket Bucket index
+  @return Middle value of bucket
+  */
+static uint64_t histogram_bucket_value(size_t bucket) {
+	if (bucket < RB_STATS_HISTOGRAM_SUB_BUCKETS) {
+		return bucket;
+	}
+
+	const unsigned shift =
+			(unsigned)(bucket / RB_STATS_HISTOGRAM_SUB_BUCKETS) - 1;
+	const uint64_t sub_bucket = bucket % RB_STATS_HISTOGRAM_SUB_BUCKETS;
+	const uint64_t low = (RB_STATS_HISTOGRAM_SUB_BUCKETS + sub_bucket)
+			     << shift;
+	return low + ((UINT64_C(1) << shift) - 1) / 2;
+}
+
+void rb_stats_histogram_add(enum rb_stats_histogram histogram,
+			    uint64_t value_us) {
+	struct rb_stats_thread *t = rb_stats_thread();
+	if (likely(NULL != t)) {
+		struct rb_stats_histogram_data *h = &t->histograms[histogram];
+		ATOMIC_OP64(add, fetch, &h->buckets[histogram_bucket(value_us)],
+			    1);
+		ATOMIC_OP64(add, fetch, &h->sum, value_us);
+		ATOMIC_OP64(add, fetch, &h->count, 1);
+	}
+}
+
+void rb_stats_histogram_since(enum rb_stats_histogram histogram,
+			      uint64_t start) {
+	const uint64_t now = rb_stats_now();
+	rb_stats_histogram_add(histogram, now > start ? now - start : 0);
+}
+
+void rb_stats_snapshot(struct rb_stats_snapshot *snapshot) {
+	memset(snapshot, 0, sizeof(*snapshot));
+
+	pthread_mutex_lock(&stats.lock);
+	for (struct rb_stats_thread *t = stats.threads; t; t = t->next) {
+		for (size_t i = 0; i < RB_STATS_C__MAX; ++i) {
+			snapshot->counters[i] += stats_load(&t->counters[i]);
+		}
+
+		for (size_t i = 0; i < RB_STATS_H__MAX; ++i) {
+			struct rb_stats_histogram_data *src =
+					&t->histograms[i];
+			struct rb_stats_histogram_data *dst =
+					&snapshot->histograms[i];
+			dst->count += stats_load(&src->count);
+			dst->sum += stats_load(&src->sum);
+			for (size_t j = 0; j < RB_STATS_HISTOGRAM_BUCKETS;
+			     ++j) {
+				dst->buckets[j] += stats_load(&src->buckets[j]);
+			}
+		}
+	}
+	pthread_mutex_unlock(&stats.lock);
+
+	for (size_t i = 0; i < RB_STATS_G__MAX; ++i) {
+		snapshot->gauges[i] =
+				ATOMIC_OP64(add, fetch, &stats.gauges[i], 0);
+	}
+}
+
+uint64_t rb_stats_histogram_quantile(
+		const struct rb_stats_histogram_data *histogram,
+		double quantile) {
+	uint64_t count = 0;
+	for (size_t i = 0; i < RB_STATS_HISTOGRAM_BUCKETS; ++i) {
+		count += histogram->buckets[i];
+	}
+
+	if (0 == count) {
+		return 0;
+	}
+
+	if (quantile < 0) {
+		quantile = 0;
+	} else if (quantile > 1) {
+		quantile = 1;
+	}
+
+	const uint64_t rank = (uint64_t)(quantile * (double)(count - 1));
+	uint64_t accumulated = 0;
+	for (size_t i = 0; i < RB_STATS_HISTOGRAM_BUCKETS; ++i) {
+		accumulated += histogram->buckets[i];
+		if (accumulated > rank) {
+			return histogram_bucket_value(i);
+		}
+	}
+
+	return histogram_bucket_value(RB_STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+/** Print common stats message keys, and open the message
+  @param buf Buffer to print message
+  @param now Message timestamp
+  @param name Stat name
+  @param sensor_name Sensor name
+  @param unit Stat unit
+  */
+static void print_stats_message_begin(struct printbuf *buf,
+				      time_t now,
+				      const char *name,
+				      const char *sensor_name,
+				      const char *unit) {
+	sprintbuf(buf,
+		  "{\"timestamp\":%lu,\"sensor_name\":\"%s\","
+		  "\"monitor\":\"" STATS_MONITOR_PREFIX "%s\","
+		  "\"type\":\"internal\",\"unit\":\"%s\"",
+		  (unsigned long)now,
+		  sensor_name,
+		  name,
+		  unit);
+}
+
+/** Close a stats message and move it to the messages array
+  @param buf Buffer with message. It will be released
+  @param msg Message to fill
+  */
+static void print_stats_message_end(struct printbuf *buf, rb_message *msg) {
+	sprintbuf(buf, "}");
+	msg->payload = buf->buf;
+	msg->len = (size_t)buf->bpos;
+	buf->buf = NULL;
+	printbuf_free(buf);
+}
+
+rb_message_array_t *rb_stats_print(const struct rb_stats_snapshot *curr,
+				   const struct rb_stats_snapshot *prev,
+				   const char *sensor_name,
+				   time_t now) {
+	static const char *counters_names[] = {
+#define _X(ENUM, NAME) NAME,
+			RB_STATS_COUNTERS_X
+#undef _X
+	};
+	static const char *histograms_names[] = {
+#define _X(ENUM, NAME) NAME,
+			RB_STATS_HISTOGRAMS_X
+#undef _X
+	};
+	static const char *gauges_names[] = {
+#define _X(ENUM, NAME) NAME,
+			RB_STATS_GAUGES_X
+#undef _X
+	};
+
+	rb_message_array_t *ret = new_messages_array(
+			RB_STATS_C__MAX + RB_STATS_G__MAX + RB_STATS_H__MAX);
+	if (NULL == ret) {
+		rdlog(LOG_ERR, "Couldn't allocate stats messages array");
+		return NULL;
+	}
+
+	size_t i_msgs = 0;
+	for (size_t i = 0; i < RB_STATS_C__MAX; ++i) {
+		struct printbuf *buf = printbuf_new();
+		if (unlikely(NULL == buf)) {
+			continue;
+		}
+
+		const uint64_t value = curr->counters[i] -
+				       (prev ? prev->counters[i] : 0);
+		print_stats_message_begin(
+				buf, now, counters_names[i], sensor_name, "events");
+		sprintbuf(buf, ",\"value\":%" PRIu64, value);
+		print_stats_message_end(buf, &ret->msgs[i_msgs++]);
+	}
+
+	for (size_t i = 0; i < RB_STATS_G__MAX; ++i) {
+		struct printbuf *buf = printbuf_new();
+		if (unlikely(NULL == buf)) {
+			continue;
+		}
+
+		print_stats_message_begin(
+				buf, now, gauges_names[i], sensor_name, "items");
+		sprintbuf(buf, ",\"value\":%" PRId64, curr->gauges[i]);
+		print_stats_message_end(buf, &ret->msgs[i_msgs++]);
+	}
+
+	for (size_t i = 0; i < RB_STATS_H__MAX; ++i) {
+		struct rb_stats_histogram_data interval = curr->histograms[i];
+		struct printbuf *buf = printbuf_new();
+		if (unlikely(NULL == buf)) {
+			continue;
+		}
+
+		if (prev) {
+			const struct rb_stats_histogram_data *p =
+					&prev->histograms[i];
+			interval.count -= p->count;
+			interval.sum -= p->sum;
+			for (size_t j = 0; j < RB_STATS_HISTOGRAM_BUCKETS;
+			     ++j) {
+				interval.buckets[j] -= p->buckets[j];
+			}
+		}
+
+		print_stats_message_begin(
+				buf, now, histograms_names[i], sensor_name, "us");
+		sprintbuf(buf,
+			  ",\"value\":%" PRIu64 ",\"p90\":%" PRIu64
+			  ",\"p99\":%" PRIu64 ",\"max\":%" PRIu64
+			  ",\"count\":%" PRIu64,
+			  rb_stats_histogram_quantile(&interval, 0.5),
+			  rb_stats_histogram_quantile(&interval, 0.9),
+			  rb_stats_histogram_quantile(&interval, 0.99),
+			  rb_stats_histogram_quantile(&interval, 1),
+			  interval.count);
+		print_stats_message_end(buf, &ret->msgs[i_msgs++]);
+	}
+
+	ret->count = i_msgs;
+	return ret;
+}
+
+rb_message_array_t *rb_stats_print_costs(const struct rb_stats_named_cost *costs,
+					 size_t count,
+					 const char *collector,
+					 time_t now) {
+	rb_message_array_t *ret = new_messages_array(count);
+	if (NULL == ret) {
+		rdlog(LOG_ERR, "Couldn't allocate costs messages array");
+		return NULL;
+	}
+
+	size_t i_msgs = 0;
+	for (size_t i = 0; i < count; ++i) {
+		const struct rb_stats_cost *cost = &costs[i].cost;
+		struct printbuf *buf = printbuf_new();
+		if (unlikely(NULL == buf)) {
+			continue;
+		}
+
+		print_stats_message_begin(
+				buf, now, "sensor_cost", costs[i].name, "us");
+		sprintbuf(buf,
+			  ",\"value\":%" PRIu64 ",\"cpu_time_us\":%" PRIu64
+			  ",\"polls\":%" PRIu64 ",\"messages\":%" PRIu64
+			  ",\"bytes\":%" PRIu64 ",\"snmp_requests\":%" PRIu64
+			  ",\"errors\":%" PRIu64 ",\"rank\":%zu"
+			  ",\"collector\":\"%s\"",
+			  cost->wall_time_us,
+			  cost->cpu_time_us,
+			  cost->count,
+			  cost->messages,
+			  cost->bytes,
+			  cost->snmp_requests,
+			  cost->errors,
+			  i + 1,
+			  collector);
+		print_stats_message_end(buf, &ret->msgs[i_msgs++]);
+	}
+
+	ret->count = i_msgs;
+	return ret;
+}
+
+void rb_stats_done(void) {
+	pthread_mutex_lock(&stats.lock);
+	struct rb_stats_thread *t = stats.threads;
+	stats.threads = NULL;
+	pthread_mutex_unlock(&stats.lock);
+
+	while (t) {
+		struct rb_stats_thread *next = t->next;
+		free(t);
+		t = next;
+	}
+
+	thread_stats = NULL;
+}
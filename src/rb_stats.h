@@ -0,0 +1,222 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "rb_message_list.h"
+
+#include <stdint.h>
+#include <time.h>
+
+/** rb_monitor self metrics.
+
+  Every thread records in its own counters and histograms, so recording does
+  not need locks and does not bounce cache lines between workers. Readers
+  aggregate all threads values in a snapshot.
+  */
+
+// clang-format off
+/// Internal counters: enum suffix, name in messages
+#define RB_STATS_COUNTERS_X                                                    \
+	_X(SENSORS_PROCESSED, "sensors_processed")                             \
+	_X(SENSORS_SKIPPED, "sensors_skipped")                                 \
+	_X(SNMP_REQUESTS, "snmp_requests")                                     \
+	_X(SNMP_ERRORS, "snmp_errors")                                         \
+	_X(SNMP_TIMEOUTS, "snmp_timeouts")                                     \
+	_X(SYSTEM_REQUESTS, "system_requests")                                 \
+	_X(SYSTEM_ERRORS, "system_errors")                                     \
+	_X(MESSAGES, "messages")                                               \
+	_X(BYTES, "bytes")                                                     \
+	_X(PRODUCE_ERRORS, "produce_errors")
+
+/// Internal latency histograms, in microseconds: enum suffix, message name
+#define RB_STATS_HISTOGRAMS_X                                                  \
+	_X(SENSOR_POLL, "sensor_poll_time")                                    \
+	_X(SNMP_RTT, "snmp_rtt")                                               \
+	_X(SYSTEM_RTT, "system_rtt")                                           \
+	_X(PRINT, "print_time")                                                \
+	_X(PRODUCE, "produce_time")
+
+/// Internal gauges, set by the thread that emits stats
+#define RB_STATS_GAUGES_X                                                      \
+	_X(QUEUE_DEPTH, "queue_depth")
+// clang-format on
+
+enum rb_stats_counter {
+#define _X(ENUM, NAME) RB_STATS_C__##ENUM,
+	RB_STATS_COUNTERS_X
+#undef _X
+	RB_STATS_C__MAX,
+};
+
+enum rb_stats_histogram {
+#define _X(ENUM, NAME) RB_STATS_H__##ENUM,
+	RB_STATS_HISTOGRAMS_X
+#undef _X
+	RB_STATS_H__MAX,
+};
+
+enum rb_stats_gauge {
+#define _X(ENUM, NAME) RB_STATS_G__##ENUM,
+	RB_STATS_GAUGES_X
+#undef _X
+	RB_STATS_G__MAX,
+};
+
+/// Linear sub-buckets per power of two. Relative error is 1/16
+#define RB_STATS_HISTOGRAM_SUB_BUCKETS_BITS 4
+#define RB_STATS_HISTOGRAM_SUB_BUCKETS (1 << RB_STATS_HISTOGRAM_SUB_BUCKETS_BITS)
+/// Max tracked value is 2^RB_STATS_HISTOGRAM_MAX_BITS us (~12 days)
+#define RB_STATS_HISTOGRAM_MAX_BITS 40
+#define RB_STATS_HISTOGRAM_BUCKETS                                             \
+	((RB_STATS_HISTOGRAM_MAX_BITS - RB_STATS_HISTOGRAM_SUB_BUCKETS_BITS +  \
+	  1) * RB_STATS_HISTOGRAM_SUB_BUCKETS)
+
+/// Histogram values
+struct rb_stats_histogram_data {
+	uint64_t count;					///< Values recorded
+	uint64_t sum;					///< Values sum
+	uint64_t buckets[RB_STATS_HISTOGRAM_BUCKETS]; ///< Log-linear buckets
+};
+
+/// Aggregated values of all threads
+struct rb_stats_snapshot {
+	uint64_t counters[RB_STATS_C__MAX];
+	int64_t gauges[RB_STATS_G__MAX];
+	struct rb_stats_histogram_data histograms[RB_STATS_H__MAX];
+};
+
+/// Resources consumed by a task, like a sensor poll, or many of them
+struct rb_stats_cost {
+	uint64_t count;		///< Number of tasks
+	uint64_t wall_time_us;  ///< Elapsed time
+	uint64_t cpu_time_us;   ///< Thread CPU time
+	uint64_t messages;      ///< Messages produced
+	uint64_t bytes;		///< Bytes produced
+	uint64_t snmp_requests; ///< SNMP requests done
+	uint64_t errors;	///< SNMP errors and timeouts, and system errors
+};
+
+/// Named cost, to print them
+struct rb_stats_named_cost {
+	const char *name;	  ///< Name
+	struct rb_stats_cost cost; ///< Cost
+};
+
+/** Start measuring the cost of a task in the current thread
+  @param cost Cost to start
+  */
+void rb_stats_cost_start(struct rb_stats_cost *cost);
+
+/** End measuring the cost of a task in the current thread
+  @param cost Cost started with rb_stats_cost_start. It will contain the
+  task cost.
+  */
+void rb_stats_cost_end(struct rb_stats_cost *cost);
+
+/** Monotonic clock, for latency measures
+  @return Microseconds since an arbitrary point
+  */
+uint64_t rb_stats_now(void);
+
+/** Add to a counter of the current thread
+  @param counter Counter
+  @param value Value to add
+  */
+void rb_stats_counter_add(enum rb_stats_counter counter, uint64_t value);
+
+/** Increment a counter of the current thread
+  @param counter Counter
+  */
+#define rb_stats_counter_inc(counter) rb_stats_counter_add(counter, 1)
+
+/** Current thread value of a counter. Useful to know the events of a
+  thread task, like the errors of a sensor poll.
+  @param counter Counter
+  @return Counter value for the current thread
+  */
+uint64_t rb_stats_thread_counter(enum rb_stats_counter counter);
+
+/** Value of a counter, aggregated for all threads. Cheaper than a snapshot
+  if only one counter is needed.
+  @param counter Counter
+  @return Counter value
+  */
+uint64_t rb_stats_counter(enum rb_stats_counter counter);
+
+/** Set a global gauge
+  @param gauge Gauge
+  @param value New value
+  */
+void rb_stats_gauge_set(enum rb_stats_gauge gauge, int64_t value);
+
+/** Record a value in a histogram of the current thread
+  @param histogram Histogram
+  @param value_us Value, in microseconds
+  */
+void rb_stats_histogram_add(enum rb_stats_histogram histogram,
+			    uint64_t value_us);
+
+/** Record elapsed time since start in a histogram of the current thread
+  @param histogram Histogram
+  @param start Start time, as rb_stats_now returned
+  */
+void rb_stats_histogram_since(enum rb_stats_histogram histogram,
+			      uint64_t start);
+
+/** Aggregate all threads stats
+  @param snapshot Snapshot to fill
+  */
+void rb_stats_snapshot(struct rb_stats_snapshot *snapshot);
+
+/** Estimate a histogram quantile
+  @param histogram Histogram
+  @param quantile Quantile, in [0,1] range
+  @return Estimated value, or 0 if histogram is empty
+  */
+uint64_t rb_stats_histogram_quantile(
+		const struct rb_stats_histogram_data *histogram,
+		double quantile);
+
+/** Print stats recorded between two snapshots as monitor messages
+  @param curr Current snapshot
+  @param prev Previous snapshot. Counters and histograms are printed as
+  the difference between curr and prev. Can be NULL.
+  @param sensor_name Value of sensor_name key of messages
+  @param now Messages timestamp
+  @return Messages array
+  */
+rb_message_array_t *rb_stats_print(const struct rb_stats_snapshot *curr,
+				   const struct rb_stats_snapshot *prev,
+				   const char *sensor_name,
+				   time_t now);
+
+/** Print sensors costs as monitor messages
+  @param costs Sensors costs
+  @param count Number of costs
+  @param collector Name of this rb_monitor
+  @param now Messages timestamp
+  @return Messages array
+  */
+rb_message_array_t *rb_stats_print_costs(const struct rb_stats_named_cost *costs,
+					 size_t count,
+					 const char *collector,
+					 time_t now);
+
+/** Release all threads stats. No thread can record after this call. */
+void rb_stats_done(void);
@@ -16,6 +16,8 @@
   along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "rb_stats.h"
+
 #include <librd/rdlog.h>
 
 #include <ctype.h>
@@ -34,25 +36,20 @@ static inline char *trim_end(char *buf) {
 }
 
 /**
- Exec a system command and puts the output in value_buf
- @param worker_info    Worker_info struct
- @param value_buf      Buffer to store the output
- @param value_buf_len  Length of value_buf
- @param number         If possible, number conversion of value_buf
- @param unused         Just for snmp_solve_response compatibility
- @param command        Command to execute
- @todo see if we can join with snmp_solve_response somehow
- @return               1 if number. 0 ioc.
+ Read a system command output and puts it in value_buf
+ @param buff           Buffer to store the output
+ @param buff_size      Length of buff
+ @param number         If possible, number conversion of buff
+ @param fp             Command output, as popen returned. It will be closed
+ @param command        Command executed, for logging
+ @return               Always true, buff is "0" if output was not valid
  */
-static bool system_solve_response(char *buff,
-				  size_t buff_size,
-				  double *number,
-				  void *unused,
-				  const char *command) {
-	(void)unused;
-
+static bool system_read_response(char *buff,
+				 size_t buff_size,
+				 double *number,
+				 FILE *fp,
+				 const char *command) {
 	bool ret = false;
-	FILE *fp = popen(command, "r");
 	if (NULL == fp) {
 		rdlog(LOG_ERR, "Cannot get system command.");
 	} else {
@@ -73,7 +70,9 @@ static bool system_solve_response(char *buff,
 		pclose(fp);
 	}
 
+	rb_stats_counter_inc(RB_STATS_C__SYSTEM_REQUESTS);
 	if (!ret) {
+		rb_stats_counter_inc(RB_STATS_C__SYSTEM_ERRORS);
 		snprintf(buff, buff_size, "0");
 		*number = 0;
 		ret = true;
@@ -81,3 +80,27 @@ static bool system_solve_response(char *buff,
 
 	return ret;
 }
+
+/**
+ Exec a system command and puts the output in value_buf
+ @param worker_info    Worker_info struct
+ @param value_buf      Buffer to store the output
+ @param value_buf_len  Length of value_buf
+ @param number         If possible, number conversion of value_buf
+ @param unused         Just for snmp_solve_response compatibility
+ @param command        Command to execute
+ @todo see if we can join with snmp_solve_response somehow
+ @return               1 if number. 0 ioc.
+ */
+static bool system_solve_response(char *buff,
+				  size_t buff_size,
+				  double *number,
+				  void *unused,
+				  const char *command) {
+	(void)unused;
+	const uint64_t start = rb_stats_now();
+	const bool ret = system_read_response(
+			buff, buff_size, number, popen(command, "r"), command);
+	rb_stats_histogram_since(RB_STATS_H__SYSTEM_RTT, start);
+	return ret;
+}
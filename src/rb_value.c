@@ -18,28 +18,80 @@
 
 #include "rb_value.h"
 
+#include "rb_msgpack.h"
 #include "rb_sensor.h"
 #include "rb_sensor_monitor.h"
+#include "rb_stats.h"
 
 #include <json-c/printbuf.h>
 #include <librd/rdlog.h>
 #include <librd/rdmem.h>
 
-struct monitor_value *new_monitor_value_array(size_t n_children,
-					      struct monitor_value **children,
-					      struct monitor_value *split_op) {
+struct monitor_value *new_monitor_value(double value, time_t timestamp) {
 	struct monitor_value *ret = calloc(1, sizeof(*ret));
 	if (NULL == ret) {
-		if (split_op) {
-			rb_monitor_value_done(split_op);
-		}
-		for (size_t i = 0; i < n_children; ++i) {
-			if (children[i]) {
-				rb_monitor_value_done(children[i]);
-			}
-		}
-		free(children);
+		rdlog(LOG_ERR, "Couldn't allocate monitor value (out of memory?)");
+		return NULL;
+	}
+
+#ifdef MONITOR_VALUE_MAGIC
+	ret->magic = MONITOR_VALUE_MAGIC;
+#endif
+
+	ret->type = MONITOR_VALUE_T__VALUE;
+	ret->value.timestamp = timestamp;
+	ret->value.value = value;
+
+	return ret;
+}
+
+/** Reallocate monitor value array children storage
+  @param mv Monitor value array
+  @param children_size New children capacity
+  @return true if success, false in other case
+  @note values, timestamps and presence bitmap share the same allocation
+  */
+static bool rb_monitor_value_children_resize(struct monitor_value *mv,
+					     size_t children_size) {
+	const size_t words = MONITOR_VALUE_PRESENT_WORDS(children_size);
+	const size_t old_words =
+			MONITOR_VALUE_PRESENT_WORDS(mv->array.children_size);
+	char *storage = malloc(children_size * (sizeof(mv->array.values[0]) +
+						sizeof(mv->array.timestamps[0])) +
+			       words * sizeof(mv->array.present[0]));
+	if (NULL == storage) {
+		rdlog(LOG_ERR, "Couldn't allocate monitor value children");
+		return false;
+	}
 
+	double *values = (double *)storage;
+	time_t *timestamps = (time_t *)&values[children_size];
+	uint64_t *present = (uint64_t *)&timestamps[children_size];
+
+	if (mv->array.children_count > 0) {
+		memcpy(values,
+		       mv->array.values,
+		       mv->array.children_count * sizeof(values[0]));
+		memcpy(timestamps,
+		       mv->array.timestamps,
+		       mv->array.children_count * sizeof(timestamps[0]));
+	}
+	if (old_words > 0) {
+		memcpy(present, mv->array.present, old_words * sizeof(present[0]));
+	}
+	memset(&present[old_words], 0, (words - old_words) * sizeof(present[0]));
+
+	free(mv->array.values);
+	mv->array.values = values;
+	mv->array.timestamps = timestamps;
+	mv->array.present = present;
+	mv->array.children_size = children_size;
+	return true;
+}
+
+struct monitor_value *new_monitor_value_array(size_t children_size) {
+	struct monitor_value *ret = calloc(1, sizeof(*ret));
+	if (NULL == ret) {
 		rdlog(LOG_ERR, "Couldn't allocate monitor value");
 		return NULL;
 	}
@@ -49,13 +101,64 @@ struct monitor_value *new_monitor_value_array(size_t n_children,
 #endif
 
 	ret->type = MONITOR_VALUE_T__ARRAY;
-	ret->array.children_count = n_children;
-	ret->array.split_op_result = split_op;
-	ret->array.children = children;
+	if (!rb_monitor_value_children_resize(ret,
+					      children_size ? children_size
+							    : 1)) {
+		free(ret);
+		return NULL;
+	}
 
 	return ret;
 }
 
+bool rb_monitor_value_children_push(struct monitor_value *mv,
+				    bool present,
+				    double value,
+				    time_t timestamp) {
+	assert(MONITOR_VALUE_T__ARRAY == mv->type);
+
+	const size_t i = mv->array.children_count;
+	if (i == mv->array.children_size &&
+	    !rb_monitor_value_children_resize(mv, 2 * i)) {
+		return false;
+	}
+
+	mv->array.values[i] = value;
+	mv->array.timestamps[i] = timestamp;
+	if (present) {
+		mv->array.present[i / 64] |= UINT64_C(1) << (i % 64);
+	}
+	mv->array.children_count++;
+	return true;
+}
+
+bool rb_monitor_value_set_split_op_results(struct monitor_value *mv,
+					   const double *values,
+					   size_t count,
+					   time_t timestamp) {
+	assert(MONITOR_VALUE_T__ARRAY == mv->type);
+
+	struct monitor_value *results = calloc(count, sizeof(results[0]));
+	if (NULL == results) {
+		rdlog(LOG_ERR, "Couldn't allocate split ops results (OOM?)");
+		return false;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+#ifdef MONITOR_VALUE_MAGIC
+		results[i].magic = MONITOR_VALUE_MAGIC;
+#endif
+		results[i].type = MONITOR_VALUE_T__VALUE;
+		results[i].value.timestamp = timestamp;
+		results[i].value.value = values[i];
+	}
+
+	free(mv->array.split_op_result);
+	mv->array.split_op_result = results;
+	mv->array.split_op_count = count;
+	return true;
+}
+
 static void print_monitor_value_enrichment_str(struct printbuf *buf,
 					       const char *key,
 					       json_object *val) {
@@ -86,11 +189,18 @@ static void print_monitor_value_enrichment_int(struct printbuf *buf,
 	}
 }
 
-/// @TODO we should print all with this function
-static void
-print_monitor_value_enrichment(struct printbuf *buf,
-			       const json_object *const_enrichment) {
+/** Print enrichment keys
+  @param buf Buffer to print in
+  @param const_enrichment Enrichment to print
+  @param const_skip If not NULL, keys present in this object will not be
+  printed
+  @TODO we should print all with this function
+  */
+static void print_monitor_value_enrichment(struct printbuf *buf,
+					   const json_object *const_enrichment,
+					   const json_object *const_skip) {
 	json_object *enrichment = (json_object *)const_enrichment;
+	json_object *skip = (json_object *)const_skip;
 
 	for (struct json_object_iterator i = json_object_iter_begin(enrichment),
 					 end = json_object_iter_end(enrichment);
@@ -99,6 +209,10 @@ print_monitor_value_enrichment(struct printbuf *buf,
 		const char *key = json_object_iter_peek_name(&i);
 		json_object *val = json_object_iter_peek_value(&i);
 
+		if (skip && json_object_object_get_ex(skip, key, NULL)) {
+			continue;
+		}
+
 		const json_type type = json_object_get_type(val);
 		switch (type) {
 		case json_type_string:
@@ -142,27 +256,232 @@ print_monitor_value_enrichment(struct printbuf *buf,
 	}
 }
 
-#define NO_INSTANCE -1
-static void print_monitor_value0(rb_message *message,
-				 const struct monitor_value *monitor_value,
+/** Encode enrichment keys in MessagePack
+  @param buf Buffer to encode in
+  @param const_enrichment Enrichment to encode
+  @param const_skip If not NULL, keys present in this object will not be
+  encoded
+  @return Number of encoded keys
+  */
+static uint32_t
+msgpack_monitor_value_enrichment(struct printbuf *buf,
+				 const json_object *const_enrichment,
+				 const json_object *const_skip) {
+	json_object *enrichment = (json_object *)const_enrichment;
+	json_object *skip = (json_object *)const_skip;
+	uint32_t ret = 0;
+
+	for (struct json_object_iterator i = json_object_iter_begin(enrichment),
+					 end = json_object_iter_end(enrichment);
+	     !json_object_iter_equal(&i, &end);
+	     json_object_iter_next(&i)) {
+		const char *key = json_object_iter_peek_name(&i);
+		json_object *val = json_object_iter_peek_value(&i);
+
+		if (skip && json_object_object_get_ex(skip, key, NULL)) {
+			continue;
+		}
+
+		const json_type type = json_object_get_type(val);
+		if (json_type_object == type || json_type_array == type) {
+			rdlog(LOG_ERR,
+			      "Can't enrich with objects/array at this time");
+			continue;
+		}
+
+		rb_msgpack_str(buf, key, strlen(key));
+		rb_msgpack_json(buf, val);
+		ret++;
+	}
+
+	return ret;
+}
+
+/// Encode a constant string key in MessagePack
+#define MSGPACK_KEY(buf, key) rb_msgpack_str(buf, key, sizeof(key) - 1)
+
+/** Encode monitor group id in MessagePack. It is an integer if it looks like
+  one, like in JSON messages.
+  @param buf Buffer to encode in
+  @param group_id Group id
+  */
+static void msgpack_monitor_group_id(struct printbuf *buf,
+				     const char *group_id) {
+	char *end = NULL;
+	errno = 0;
+	const long long id = strtoll(group_id, &end, 10);
+	if (0 == errno && end != group_id && '\0' == *end) {
+		rb_msgpack_int(buf, id);
+	} else {
+		rb_msgpack_str(buf, group_id, strlen(group_id));
+	}
+}
+
+/** Encode the common keys of a monitor messages
+  @param keys Common keys to fill
+  @param encoding Encoding
+  @param monitor Monitor
+  @param sensor_enrichment Enrichment of monitor's sensor
+  */
+static void
+monitor_value_common_keys_encode(struct monitor_value_common_keys *keys,
+				 enum rb_message_encoding encoding,
 				 const rb_monitor_t *monitor,
-				 int instance) {
-	assert(monitor_value->type == MONITOR_VALUE_T__VALUE);
+				 const json_object *sensor_enrichment) {
+	struct printbuf *buf = printbuf_new();
+	if (unlikely(NULL == buf)) {
+		rdlog(LOG_ERR, "Couldn't allocate common keys (OOM?)");
+		return;
+	}
+
+	const char *group_id = rb_monitor_group_id(monitor);
+	const struct json_object *monitor_enrichment =
+			rb_monitor_enrichment(monitor);
+	uint32_t count = 0;
+
+	if (RB_MESSAGE_ENCODING_JSON == encoding) {
+		if (group_id) {
+			sprintbuf(buf, ",\"group_id\":%s", group_id);
+		}
+		if (monitor_enrichment) {
+			print_monitor_value_enrichment(
+					buf, monitor_enrichment, NULL);
+		}
+		if (sensor_enrichment) {
+			print_monitor_value_enrichment(
+					buf, sensor_enrichment, monitor_enrichment);
+		}
+	} else {
+		if (group_id) {
+			MSGPACK_KEY(buf, "group_id");
+			msgpack_monitor_group_id(buf, group_id);
+			count++;
+		}
+		if (monitor_enrichment) {
+			count += msgpack_monitor_value_enrichment(
+					buf, monitor_enrichment, NULL);
+		}
+		if (sensor_enrichment) {
+			count += msgpack_monitor_value_enrichment(
+					buf, sensor_enrichment, monitor_enrichment);
+		}
+	}
 
+	keys->buf = buf->buf;
+	keys->len = (size_t)buf->bpos;
+	keys->count = count;
+
+	buf->buf = NULL;
+	printbuf_free(buf);
+}
+
+void monitor_value_common_keys_done(struct monitor_value_common_keys *keys) {
+	for (size_t i = 0; i < RB_MESSAGE_ENCODING__MAX; ++i) {
+		free(keys[i].buf);
+		keys[i].buf = NULL;
+	}
+}
+
+/** Get the common keys of a monitor messages, encoding the ones that are not
+  in context cache
+  @param ctx Print context
+  @param monitor Monitor
+  @param local Storage of common keys if context has no cache, one per
+  encoding. Need to be released with monitor_value_common_keys_done after
+  print.
+  @return Common keys, one per encoding
+  */
+static const struct monitor_value_common_keys *
+print_monitor_value_common_keys(const struct monitor_value_print_ctx *ctx,
+				const rb_monitor_t *monitor,
+				struct monitor_value_common_keys *local) {
+	struct monitor_value_common_keys *ret =
+			ctx->common_keys ? ctx->common_keys : local;
+
+	for (size_t i = 0; i < RB_MESSAGE_ENCODING__MAX; ++i) {
+		const unsigned flag = RB_MESSAGE_F(i) & RB_MESSAGE_F_PER_MESSAGE;
+		if ((ctx->encodings & flag) && NULL == ret[i].buf) {
+			monitor_value_common_keys_encode(
+					&ret[i],
+					(enum rb_message_encoding)i,
+					monitor,
+					ctx->sensor_enrichment);
+		}
+	}
+
+	return ret;
+}
+
+/** Append encoded common keys to a message buffer
+  @param buf Buffer
+  @param keys Common keys
+  */
+static void print_monitor_value_append_common_keys(
+		struct printbuf *buf,
+		const struct monitor_value_common_keys *keys) {
+	if (keys->buf && keys->len > 0) {
+		printbuf_memappend(buf, keys->buf, (int)keys->len);
+	}
+}
+
+/** Print a value in the monitor format
+  @param buf Buffer to print
+  @param monitor Monitor
+  @param key Value key
+  @param value Value
+  */
+static void print_monitor_value_number(struct printbuf *buf,
+				       const rb_monitor_t *monitor,
+				       const char *key,
+				       double value) {
+	if (rb_monitor_is_integer(monitor)) {
+		sprintbuf(buf, ",\"%s\":%" PRId64, key, (int64_t)value);
+	} else {
+		sprintbuf(buf, ",\"%s\":\"%lf\"", key, value);
+	}
+}
+
+/** Encode a value in MessagePack. Unlike JSON, non integer values are sent
+  as floats instead of strings.
+  @param buf Buffer to encode in
+  @param monitor Monitor
+  @param value Value
+  */
+static void msgpack_monitor_value_number(struct printbuf *buf,
+					 const rb_monitor_t *monitor,
+					 double value) {
+	if (rb_monitor_is_integer(monitor)) {
+		rb_msgpack_int(buf, (int64_t)value);
+	} else {
+		rb_msgpack_double(buf, value);
+	}
+}
+
+#define NO_INSTANCE -1
+static void
+print_monitor_value_json(rb_message *message,
+			 double value,
+			 time_t timestamp,
+			 const rb_monitor_t *monitor,
+			 const struct monitor_value_common_keys *keys,
+			 int instance,
+			 const char *split_op_name,
+			 const struct monitor_value_summary *summary) {
 	struct printbuf *buf = printbuf_new();
 	if (likely(NULL != buf)) {
 		const char *monitor_instance_prefix =
 				rb_monitor_instance_prefix(monitor);
 		const char *monitor_name_split_suffix =
 				rb_monitor_name_split_suffix(monitor);
-		const struct json_object *monitor_enrichment =
-				rb_monitor_enrichment(monitor);
 		// @TODO use printbuf_memappend_fast instead! */
 		sprintbuf(buf, "{");
-		sprintbuf(buf,
-			  "\"timestamp\":%lu",
-			  monitor_value->value.timestamp);
-		if (NO_INSTANCE != instance && monitor_name_split_suffix) {
+		sprintbuf(buf, "\"timestamp\":%lu", timestamp);
+		if (split_op_name) {
+			sprintbuf(buf,
+				  ",\"monitor\":\"%s_%s\"",
+				  rb_monitor_name(monitor),
+				  split_op_name);
+		} else if (NO_INSTANCE != instance && monitor_name_split_suffix) {
 			sprintbuf(buf,
 				  ",\"monitor\":\"%s%s\"",
 				  rb_monitor_name(monitor),
@@ -180,25 +499,18 @@ static void print_monitor_value0(rb_message *message,
 				  instance);
 		}
 
-		if (rb_monitor_is_integer(monitor)) {
-			sprintbuf(buf,
-				  ",\"value\":%" PRId64,
-				  (int64_t)monitor_value->value.value);
-		} else {
-			sprintbuf(buf,
-				  ",\"value\":\"%lf\"",
-				  monitor_value->value.value);
-		}
-
-		if (rb_monitor_group_id(monitor)) {
-			sprintbuf(buf,
-				  ",\"group_id\":%s",
-				  rb_monitor_group_id(monitor));
+		print_monitor_value_number(buf, monitor, "value", value);
+		if (summary) {
+			print_monitor_value_number(
+					buf, monitor, "min", summary->min);
+			print_monitor_value_number(
+					buf, monitor, "max", summary->max);
+			print_monitor_value_number(
+					buf, monitor, "sum", summary->sum);
+			sprintbuf(buf, ",\"count\":%" PRIu64, summary->count);
 		}
 
-		if (monitor_enrichment) {
-			print_monitor_value_enrichment(buf, monitor_enrichment);
-		}
+		print_monitor_value_append_common_keys(buf, keys);
 		sprintbuf(buf, "}");
 
 		message->payload = buf->buf;
@@ -209,14 +521,355 @@ static void print_monitor_value0(rb_message *message,
 	}
 }
 
-rb_message_array_t *
-print_monitor_value(const struct monitor_value *monitor_value,
-		    const rb_monitor_t *monitor) {
+static void
+print_monitor_value_msgpack(rb_message *message,
+			    double value,
+			    time_t timestamp,
+			    const rb_monitor_t *monitor,
+			    const struct monitor_value_common_keys *keys,
+			    int instance,
+			    const char *split_op_name,
+			    const struct monitor_value_summary *summary) {
+	struct printbuf *buf = printbuf_new();
+	if (unlikely(NULL == buf)) {
+		return;
+	}
+
+	const char *monitor_name = rb_monitor_name(monitor);
+	const char *monitor_instance_prefix =
+			rb_monitor_instance_prefix(monitor);
+	const char *monitor_name_split_suffix =
+			rb_monitor_name_split_suffix(monitor);
+	const char *name_sep = "", *name_suffix = "";
+	if (split_op_name) {
+		name_sep = "_";
+		name_suffix = split_op_name;
+	} else if (NO_INSTANCE != instance && monitor_name_split_suffix) {
+		name_suffix = monitor_name_split_suffix;
+	}
+	const bool print_instance =
+			NO_INSTANCE != instance && monitor_instance_prefix;
+
+	/* timestamp, monitor and value are always present */
+	rb_msgpack_map(buf,
+		       3U + (print_instance ? 1U : 0U) + (summary ? 4U : 0U) +
+				       keys->count);
+	MSGPACK_KEY(buf, "timestamp");
+	rb_msgpack_int(buf, (int64_t)timestamp);
+
+	MSGPACK_KEY(buf, "monitor");
+	const size_t name_len = strlen(monitor_name);
+	const size_t name_sep_len = strlen(name_sep);
+	const size_t name_suffix_len = strlen(name_suffix);
+	rb_msgpack_str_header(buf, name_len + name_sep_len + name_suffix_len);
+	printbuf_memappend(buf, monitor_name, (int)name_len);
+	printbuf_memappend(buf, name_sep, (int)name_sep_len);
+	printbuf_memappend(buf, name_suffix, (int)name_suffix_len);
+
+	if (print_instance) {
+		char instance_str[sizeof("-2147483648")];
+		const size_t prefix_len = strlen(monitor_instance_prefix);
+		const int instance_len = snprintf(instance_str,
+						  sizeof(instance_str),
+						  "%d",
+						  instance);
+		MSGPACK_KEY(buf, "instance");
+		rb_msgpack_str_header(buf, prefix_len + (size_t)instance_len);
+		printbuf_memappend(buf,
+				   monitor_instance_prefix,
+				   (int)prefix_len);
+		printbuf_memappend(buf, instance_str, instance_len);
+	}
+
+	MSGPACK_KEY(buf, "value");
+	msgpack_monitor_value_number(buf, monitor, value);
+	if (summary) {
+		MSGPACK_KEY(buf, "min");
+		msgpack_monitor_value_number(buf, monitor, summary->min);
+		MSGPACK_KEY(buf, "max");
+		msgpack_monitor_value_number(buf, monitor, summary->max);
+		MSGPACK_KEY(buf, "sum");
+		msgpack_monitor_value_number(buf, monitor, summary->sum);
+		MSGPACK_KEY(buf, "count");
+		rb_msgpack_uint(buf, summary->count);
+	}
+
+	print_monitor_value_append_common_keys(buf, keys);
+
+	message->msgpack = buf->buf;
+	message->msgpack_len = (size_t)buf->bpos;
+
+	buf->buf = NULL;
+	printbuf_free(buf);
+}
+
+/** Add a key to a columnar row
+  @param row Row
+  @param key Key
+  @param val Value. If NULL, it could not be allocated.
+  @return true if success
+  */
+static bool row_monitor_value_add(json_object *row,
+				  const char *key,
+				  json_object *val) {
+	if (unlikely(NULL == val)) {
+		return false;
+	}
+
+	json_object_object_add(row, key, val);
+	return true;
+}
+
+/** Create a JSON string from the concatenation of three strings
+  @param s1 First string
+  @param s2 Second string
+  @param s3 Third string
+  @return New JSON string, or NULL if no memory
+  */
+static json_object *
+row_monitor_value_concat(const char *s1, const char *s2, const char *s3) {
+	const size_t s1_len = strlen(s1), s2_len = strlen(s2),
+		     s3_len = strlen(s3);
+	char *str = malloc(s1_len + s2_len + s3_len + 1);
+	if (unlikely(NULL == str)) {
+		return NULL;
+	}
+
+	memcpy(str, s1, s1_len);
+	memcpy(&str[s1_len], s2, s2_len);
+	memcpy(&str[s1_len + s2_len], s3, s3_len + 1);
+	json_object *ret = json_object_new_string(str);
+	free(str);
+	return ret;
+}
+
+/** Add a value to a columnar row
+  @param row Row
+  @param monitor Monitor
+  @param key Value key
+  @param value Value
+  @return true if success
+  */
+static bool row_monitor_value_number(json_object *row,
+				     const rb_monitor_t *monitor,
+				     const char *key,
+				     double value) {
+	json_object *val = NULL;
+	if (rb_monitor_is_integer(monitor)) {
+		val = json_object_new_int64((int64_t)value);
+	} else {
+		val = json_object_new_double(value);
+	}
+	return row_monitor_value_add(row, key, val);
+}
+
+/** Add enrichment keys to a columnar row. Values are shared with enrichment.
+  @param row Row
+  @param const_enrichment Enrichment to add
+  @param const_skip If not NULL, keys present in this object will not be
+  added
+  */
+static void row_monitor_value_enrichment(json_object *row,
+					 const json_object *const_enrichment,
+					 const json_object *const_skip) {
+	json_object *enrichment = (json_object *)const_enrichment;
+	json_object *skip = (json_object *)const_skip;
+
+	for (struct json_object_iterator i = json_object_iter_begin(enrichment),
+					 end = json_object_iter_end(enrichment);
+	     !json_object_iter_equal(&i, &end);
+	     json_object_iter_next(&i)) {
+		const char *key = json_object_iter_peek_name(&i);
+		json_object *val = json_object_iter_peek_value(&i);
+
+		if (skip && json_object_object_get_ex(skip, key, NULL)) {
+			continue;
+		}
+
+		const json_type type = json_object_get_type(val);
+		if (json_type_object == type || json_type_array == type) {
+			rdlog(LOG_ERR,
+			      "Can't enrich with objects/array at this time");
+			continue;
+		}
+
+		/* JSON null values are NULL, and they are kept as null */
+		json_object_object_add(row, key, json_object_get(val));
+	}
+}
+
+/** Add monitor group id to a columnar row. It is an integer if it looks like
+  one, like in JSON messages.
+  @param row Row
+  @param group_id Group id
+  @return true if success
+  */
+static bool row_monitor_group_id(json_object *row, const char *group_id) {
+	char *end = NULL;
+	errno = 0;
+	const long long id = strtoll(group_id, &end, 10);
+	json_object *val = NULL;
+	if (0 == errno && end != group_id && '\0' == *end) {
+		val = json_object_new_int64(id);
+	} else {
+		val = json_object_new_string(group_id);
+	}
+	return row_monitor_value_add(row, "group_id", val);
+}
+
+/** Build the columnar row of a value, with the same keys and values than
+  MessagePack messages, so columnar blocks do not need to print and parse
+  JSON messages.
+  @param message Message to store the row in
+  @param value Value
+  @param timestamp Value timestamp
+  @param monitor Monitor
+  @param sensor_enrichment Enrichment of monitor's sensor
+  @param instance Vector instance, or NO_INSTANCE
+  @param split_op_name Split operation name, or NULL
+  @param summary Window summary, or NULL
+  */
+static void
+print_monitor_value_row(rb_message *message,
+			double value,
+			time_t timestamp,
+			const rb_monitor_t *monitor,
+			const json_object *sensor_enrichment,
+			int instance,
+			const char *split_op_name,
+			const struct monitor_value_summary *summary) {
+	json_object *row = json_object_new_object();
+	if (unlikely(NULL == row)) {
+		rdlog(LOG_ERR, "Couldn't allocate columnar row (OOM?)");
+		return;
+	}
+
+	const char *monitor_instance_prefix =
+			rb_monitor_instance_prefix(monitor);
+	const char *monitor_name_split_suffix =
+			rb_monitor_name_split_suffix(monitor);
+	const char *name_sep = "", *name_suffix = "";
+	if (split_op_name) {
+		name_sep = "_";
+		name_suffix = split_op_name;
+	} else if (NO_INSTANCE != instance && monitor_name_split_suffix) {
+		name_suffix = monitor_name_split_suffix;
+	}
+
+	bool ok = row_monitor_value_add(row,
+					"timestamp",
+					json_object_new_int64(timestamp)) &&
+		  row_monitor_value_add(
+				  row,
+				  "monitor",
+				  row_monitor_value_concat(
+						  rb_monitor_name(monitor),
+						  name_sep,
+						  name_suffix));
+
+	if (ok && NO_INSTANCE != instance && monitor_instance_prefix) {
+		char instance_str[sizeof("-2147483648")];
+		snprintf(instance_str, sizeof(instance_str), "%d", instance);
+		ok = row_monitor_value_add(
+				row,
+				"instance",
+				row_monitor_value_concat(
+						monitor_instance_prefix,
+						"",
+						instance_str));
+	}
+
+	ok = ok && row_monitor_value_number(row, monitor, "value", value);
+	if (ok && summary) {
+		ok = row_monitor_value_number(
+				     row, monitor, "min", summary->min) &&
+		     row_monitor_value_number(
+				     row, monitor, "max", summary->max) &&
+		     row_monitor_value_number(
+				     row, monitor, "sum", summary->sum) &&
+		     row_monitor_value_add(
+				     row,
+				     "count",
+				     json_object_new_int64(
+						     (int64_t)summary->count));
+	}
+
+	const char *group_id = rb_monitor_group_id(monitor);
+	if (ok && group_id) {
+		ok = row_monitor_group_id(row, group_id);
+	}
+
+	if (unlikely(!ok)) {
+		rdlog(LOG_ERR, "Couldn't allocate columnar row (OOM?)");
+		json_object_put(row);
+		return;
+	}
+
+	const json_object *monitor_enrichment = rb_monitor_enrichment(monitor);
+	if (monitor_enrichment) {
+		row_monitor_value_enrichment(row, monitor_enrichment, NULL);
+	}
+	if (sensor_enrichment) {
+		row_monitor_value_enrichment(
+				row, sensor_enrichment, monitor_enrichment);
+	}
+
+	message->row = row;
+}
+
+static void print_monitor_value0(rb_message *message,
+				 double value,
+				 time_t timestamp,
+				 const rb_monitor_t *monitor,
+				 const struct monitor_value_print_ctx *ctx,
+				 const struct monitor_value_common_keys *keys,
+				 int instance,
+				 const char *split_op_name,
+				 const struct monitor_value_summary *summary) {
+	const unsigned encodings = ctx->encodings;
+	if (encodings & RB_MESSAGE_F_JSON) {
+		print_monitor_value_json(message,
+					 value,
+					 timestamp,
+					 monitor,
+					 &keys[RB_MESSAGE_ENCODING_JSON],
+					 instance,
+					 split_op_name,
+					 summary);
+	}
+
+	if (encodings & RB_MESSAGE_F_MSGPACK) {
+		print_monitor_value_msgpack(message,
+					    value,
+					    timestamp,
+					    monitor,
+					    &keys[RB_MESSAGE_ENCODING_MSGPACK],
+					    instance,
+					    split_op_name,
+					    summary);
+	}
+
+	if (encodings & RB_MESSAGE_F_COLUMNAR) {
+		print_monitor_value_row(message,
+					value,
+					timestamp,
+					monitor,
+					ctx->sensor_enrichment,
+					instance,
+					split_op_name,
+					summary);
+	}
+}
+
+static rb_message_array_t *
+print_monitor_value1(const struct monitor_value *monitor_value,
+		     const rb_monitor_t *monitor,
+		     const struct monitor_value_print_ctx *ctx,
+		     const struct monitor_value_common_keys *keys) {
 	// clang-format off
 	const size_t ret_size = monitor_value->type == MONITOR_VALUE_T__VALUE ?
 				1 : monitor_value->array.children_count +
-				    (monitor_value->array.split_op_result ? 1
-					: 0);
+				    monitor_value->array.split_op_count;
 	// clang-format on
 
 	rb_message_array_t *ret = new_messages_array(ret_size);
@@ -227,32 +880,53 @@ print_monitor_value(const struct monitor_value *monitor_value,
 
 	if (monitor_value->type == MONITOR_VALUE_T__VALUE) {
 		print_monitor_value0(&ret->msgs[0],
-				     monitor_value,
+				     monitor_value->value.value,
+				     monitor_value->value.timestamp,
 				     monitor,
-				     NO_INSTANCE);
+				     ctx,
+				     keys,
+				     NO_INSTANCE,
+				     NULL,
+				     NULL);
 	} else {
 		size_t i_msgs = 0;
 		assert(monitor_value->type == MONITOR_VALUE_T__ARRAY);
-		for (size_t i = 0; i < monitor_value->array.children_count;
-		     ++i) {
-			if (monitor_value->array.children[i]) {
+		const size_t children_count =
+				rb_monitor_send_split_instances(monitor)
+						? monitor_value->array
+								  .children_count
+						: 0;
+		for (size_t i = 0; i < children_count; ++i) {
+			if (rb_monitor_value_child_present(monitor_value, i)) {
 				print_monitor_value0(
 						&ret->msgs[i_msgs++],
+						monitor_value->array.values[i],
 						monitor_value->array
-								.children[i],
+								.timestamps[i],
 						monitor,
-						i);
+						ctx,
+						keys,
+						(int)i,
+						NULL,
+						NULL);
 			}
 		}
 
-		if (monitor_value->array.split_op_result) {
+		for (size_t i = 0; i < monitor_value->array.split_op_count;
+		     ++i) {
+			const struct monitor_value *split_op =
+					&monitor_value->array.split_op_result[i];
 			rb_message *msg = &ret->msgs[i_msgs++];
 			assert(NULL == msg->payload);
-			print_monitor_value0(
-					msg,
-					monitor_value->array.split_op_result,
-					monitor,
-					NO_INSTANCE);
+			print_monitor_value0(msg,
+					     split_op->value.value,
+					     split_op->value.timestamp,
+					     monitor,
+					     ctx,
+					     keys,
+					     NO_INSTANCE,
+					     rb_monitor_split_op_name(monitor, i),
+					     NULL);
 		}
 
 		ret->count = i_msgs;
@@ -261,6 +935,53 @@ print_monitor_value(const struct monitor_value *monitor_value,
 	return ret;
 }
 
+rb_message_array_t *
+print_monitor_value(const struct monitor_value *monitor_value,
+		    const rb_monitor_t *monitor,
+		    const struct monitor_value_print_ctx *ctx) {
+	struct monitor_value_common_keys local_keys[RB_MESSAGE_ENCODING__MAX];
+	const uint64_t start = rb_stats_now();
+
+	memset(local_keys, 0, sizeof(local_keys));
+	const struct monitor_value_common_keys *keys =
+			print_monitor_value_common_keys(
+					ctx, monitor, local_keys);
+	rb_message_array_t *ret = print_monitor_value1(
+			monitor_value, monitor, ctx, keys);
+	monitor_value_common_keys_done(local_keys);
+	rb_stats_histogram_since(RB_STATS_H__PRINT, start);
+	return ret;
+}
+
+rb_message_array_t *
+print_monitor_value_summary(const struct monitor_value_summary *summary,
+			    const rb_monitor_t *monitor,
+			    const struct monitor_value_print_ctx *ctx) {
+	struct monitor_value_common_keys local_keys[RB_MESSAGE_ENCODING__MAX];
+	rb_message_array_t *ret = new_messages_array(1);
+	if (ret == NULL) {
+		rdlog(LOG_ERR, "Couldn't allocate messages array");
+		return NULL;
+	}
+
+	memset(local_keys, 0, sizeof(local_keys));
+	const struct monitor_value_common_keys *keys =
+			print_monitor_value_common_keys(
+					ctx, monitor, local_keys);
+	print_monitor_value0(&ret->msgs[0],
+			     summary->last,
+			     summary->timestamp,
+			     monitor,
+			     ctx,
+			     keys,
+			     NO_INSTANCE,
+			     NULL,
+			     summary);
+	monitor_value_common_keys_done(local_keys);
+
+	return ret;
+}
+
 static size_t pos_array_length(ssize_t *pos) {
 	assert(pos);
 	size_t i = 0;
@@ -294,15 +1015,8 @@ rb_monitor_value_array_select(rb_monitor_value_array_t *array, ssize_t *pos) {
 
 void rb_monitor_value_done(struct monitor_value *mv) {
 	if (MONITOR_VALUE_T__ARRAY == mv->type) {
-		for (size_t i = 0; i < mv->array.children_count; ++i) {
-			if (mv->array.children[i]) {
-				rb_monitor_value_done(mv->array.children[i]);
-			}
-		}
-		if (mv->array.split_op_result) {
-			rb_monitor_value_done(mv->array.split_op_result);
-		}
-		free(mv->array.children);
+		free(mv->array.split_op_result);
+		free(mv->array.values);
 	}
 	free(mv);
 }
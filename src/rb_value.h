@@ -28,12 +28,12 @@
 #include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifndef NDEBUG
 #define MONITOR_VALUE_MAGIC 0x010AEA1C010AEA1CL
 #endif
 
-/// @todo make the vectors entry here.
 /// @note if you edit this structure, remember to edit monitor_value_copy
 struct monitor_value {
 #ifdef MONITOR_VALUE_MAGIC
@@ -54,25 +54,83 @@ struct monitor_value {
 			time_t timestamp;
 			double value;
 			bool bad_value;
-			const char *string_value;
+			/// Width of the counter value was read from
+			enum monitor_value_counter {
+				/// Not a counter, or unknown width
+				MONITOR_VALUE_COUNTER__UNKNOWN,
+				/// SNMP Counter32
+				MONITOR_VALUE_COUNTER__32,
+				/// SNMP Counter64
+				MONITOR_VALUE_COUNTER__64,
+			} counter;
 		} value;
+		/// Vector children are stored as structure of arrays, so
+		/// scans over them touch contiguous memory
 		struct {
-			size_t children_count;
+			size_t children_count; ///< Number of children
+			size_t children_size;  ///< Allocated children
+			/// Split ops results, in monitor split ops order
 			struct monitor_value *split_op_result;
-			struct monitor_value **children;
+			size_t split_op_count; ///< Number of split ops results
+			double *values;     ///< Children values
+			time_t *timestamps; ///< Children timestamps
+			uint64_t *present;  ///< Bitmap of valid children
 		} array;
 	};
 };
 
-/** Creates a new monitor value array
- * @param n_children Number of childrens
- * @param children Childrens
- * @param split_op Split operation
+/// Number of words needed for a n-children presence bitmap
+#define MONITOR_VALUE_PRESENT_WORDS(n) (((n) + 63) / 64)
+
+/** Creates a new monitor value
+ * @param value Value
+ * @param timestamp Value timestamp
+ * @return New monitor value of value type
+ */
+struct monitor_value *new_monitor_value(double value, time_t timestamp);
+
+/** Creates a new, empty, monitor value array
+ * @param children_size Expected number of children. Array will grow if
+ *        more children are pushed.
  * @return New monitor value of array type
  */
-struct monitor_value *new_monitor_value_array(size_t n_children,
-					      struct monitor_value **children,
-					      struct monitor_value *split_op);
+struct monitor_value *new_monitor_value_array(size_t children_size);
+
+/** Append a child to a monitor value array
+ * @param mv Monitor value array
+ * @param present If the child has a valid value
+ * @param value Child value
+ * @param timestamp Child timestamp
+ * @return true if success, false if we couldn't allocate memory
+ */
+bool rb_monitor_value_children_push(struct monitor_value *mv,
+				    bool present,
+				    double value,
+				    time_t timestamp);
+
+/** Set the split ops results of a monitor value array
+ * @param mv Monitor value array
+ * @param values Results values
+ * @param count Number of results
+ * @param timestamp Results timestamp
+ * @return true if success, false if we couldn't allocate memory
+ */
+bool rb_monitor_value_set_split_op_results(struct monitor_value *mv,
+					   const double *values,
+					   size_t count,
+					   time_t timestamp);
+
+/** Checks if a monitor value array child is present
+ * @param mv Monitor value array
+ * @param i Child index
+ * @return true if child has a valid value
+ */
+static bool rb_monitor_value_child_present(const struct monitor_value *mv,
+					   size_t i) __attribute__((unused));
+static bool rb_monitor_value_child_present(const struct monitor_value *mv,
+					   size_t i) {
+	return mv->array.present[i / 64] & (UINT64_C(1) << (i % 64));
+}
 
 #ifdef MONITOR_VALUE_MAGIC
 #define rb_monitor_value_assert(monitor)                                       \
@@ -135,14 +193,63 @@ rb_monitor_value_array_at(rb_monitor_value_array_t *array, size_t i) {
 struct rb_monitor_s;
 struct rb_sensor_s;
 
+/// Keys that are the same in all messages of a sensor monitor (group id and
+/// enrichment), already encoded
+struct monitor_value_common_keys {
+	char *buf;	///< Encoded keys and values, NULL if not encoded yet
+	size_t len;	///< Length of buf
+	uint32_t count; ///< Number of keys
+};
+
+/** Release encoded common keys
+  @param keys Common keys, RB_MESSAGE_ENCODING__MAX of them (one per
+  encoding)
+  */
+void monitor_value_common_keys_done(struct monitor_value_common_keys *keys);
+
+/// How to print the values of a sensor monitor
+struct monitor_value_print_ctx {
+	/// Enrichment of monitor's sensor. Monitor enrichment keys take
+	/// precedence over it.
+	const json_object *sensor_enrichment;
+	unsigned encodings; ///< Encodings to print (RB_MESSAGE_F_*)
+	/// Common keys cache, one per encoding. If NULL, they are encoded in
+	/// every print call.
+	struct monitor_value_common_keys *common_keys;
+};
+
 /** Print a sensor value
   @param monitor_value Value to print
   @param monitor Value's monitor
+  @param ctx Print context
   @return Message array with monitor value
   */
 rb_message_array_t *
 print_monitor_value(const struct monitor_value *monitor_value,
-		    const struct rb_monitor_s *monitor);
+		    const struct rb_monitor_s *monitor,
+		    const struct monitor_value_print_ctx *ctx);
+
+/// Summary of the values of a monitor in an aggregation window
+struct monitor_value_summary {
+	time_t timestamp; ///< Window start
+	double min;	  ///< Minimum value
+	double max;	  ///< Maximum value
+	double sum;	  ///< Sum of all values
+	double last;	  ///< Last value
+	uint64_t count;   ///< Number of values, 0 if window is empty
+};
+
+/** Print an aggregation window summary. Value of message is the last value
+  of window, and min/max/sum/count keys are added.
+  @param summary Summary to print
+  @param monitor Summary's monitor
+  @param ctx Print context
+  @return Message array with summary
+  */
+rb_message_array_t *
+print_monitor_value_summary(const struct monitor_value_summary *summary,
+			    const struct rb_monitor_s *monitor,
+			    const struct monitor_value_print_ctx *ctx);
 
 /** Compare monitor's timestamp
   @param m1 First monitor to compare
@@ -22,6 +22,7 @@
 
 #include "rb_zk.h"
 
+#include <librd/rd.h>
 #include <librd/rdavl.h>
 #include <librd/rdevent.h>
 #include <librd/rdlog.h>
@@ -162,6 +163,12 @@ struct rb_zk {
 	// Leaders added when ZK was down
 	pthread_mutex_t pending_leaders_lock;
 	rb_zk_mutex_list pending_leaders;
+
+	/// Called once per established session
+	rb_zk_connected_cb connected_cb;
+	void *connected_cb_opaque;
+	/// Last session connected_cb was called for
+	int64_t connected_cb_session;
 };
 
 int rb_zk_create_node(struct rb_zk *zk,
@@ -465,12 +472,31 @@ static void rb_zk_mutex_lock0(struct rb_zk *zk, struct rb_zk_mutex *mutex) {
 	}
 }
 
+int64_t rb_zk_session_id(struct rb_zk *zk) {
+	const clientid_t *client_id = zoo_client_id(zk->handler);
+	return client_id ? client_id->client_id : 0;
+}
+
+/** Notify the new session if it was not notified before
+  @param context rb_zk handler
+  */
+static void zk_watcher_do_connected_cb(struct rb_zk *context) {
+	const int64_t session = rb_zk_session_id(context);
+	if (context->connected_cb &&
+	    session != context->connected_cb_session) {
+		context->connected_cb_session = session;
+		context->connected_cb(context, context->connected_cb_opaque);
+	}
+}
+
 static void zk_watcher_do_pending_locks(struct rb_zk *context) {
 	struct rb_zk_mutex *i = NULL, *aux = NULL;
 
 	if (zoo_state(context->handler) != ZOO_CONNECTED_STATE)
 		return; // still can't do anything
 
+	zk_watcher_do_connected_cb(context);
+
 	pthread_mutex_lock(&context->pending_leaders_lock);
 	pthread_rwlock_wrlock(&context->leaders_lock);
 	rb_zk_mutex_list_foreach_safe(i, aux, &context->pending_leaders) {
@@ -495,6 +521,29 @@ struct rb_zk_mutex *rb_zk_mutex_lock(struct rb_zk *zk,
 	return _mutex;
 }
 
+void rb_zk_set_connected_cb(struct rb_zk *zk,
+			    rb_zk_connected_cb cb,
+			    void *opaque) {
+	zk->connected_cb = cb;
+	zk->connected_cb_opaque = opaque;
+	/* In case we are already connected */
+	rd_thread_func_call1(zk->zk_thread, zk_watcher_do_pending_locks, zk);
+}
+
+int rb_zk_awget_children(struct rb_zk *zk,
+			 const char *path,
+			 watcher_fn watcher,
+			 void *watcher_ctx,
+			 strings_completion_t completion,
+			 const void *data) {
+	return zoo_awget_children(zk->handler,
+				  path,
+				  watcher,
+				  watcher_ctx,
+				  completion,
+				  data);
+}
+
 static void delete_mutex_completed(int rc, const void *data) {
 	struct rb_zk_mutex *mutex = monitor_zc_mutex_const_casting(data);
 
@@ -581,15 +630,43 @@ struct rb_zk_queue_element {
 
 	struct rb_zk_mutex *queue_mutex;
 
+	/// Claim pop: directory of claim nodes
+	char *claims_path;
+	/// Claim pop: this element claim node
+	char *claim_path;
+	/// Claim pop: queue elements to try to claim, and how many we tried
+	char **candidates;
+	size_t candidates_count, candidates_tried;
+	/// Claim pop: elements claimed by others the last time we tried
+	char **busy;
+	size_t busy_count;
+	/// Claim pop: queue children watcher set and not triggered yet
+	int watcher_pending;
+	/// Claim pop: delete element and claim transaction
+	zoo_op_t claim_ops[2];
+	zoo_op_result_t claim_results[2];
+
 	uint64_t refcnt;
 };
 
+static void free_strings(char **strings, size_t count) {
+	for (size_t i = 0; strings && i < count; ++i) {
+		free(strings[i]);
+	}
+	free(strings);
+}
+
 static void rb_zk_queue_element_incref(struct rb_zk_queue_element *qelm) {
 	++qelm->refcnt;
 }
 
 static void rb_zk_queue_element_decref(struct rb_zk_queue_element *qelm) {
 	if (--qelm->refcnt == 0) {
+		free_strings(qelm->candidates, qelm->candidates_count);
+		free_strings(qelm->busy, qelm->busy_count);
+		free(qelm->claims_path);
+		free(qelm->claim_path);
+		free(qelm->queue_element_path);
 		free(qelm);
 	}
 }
@@ -882,6 +959,416 @@ void rb_zk_queue_pop(struct rb_zk *zk,
 					 qelement);
 }
 
+/*
+ *  FIFO QUEUE CLAIM
+ *
+ *  Instead of locking a global mutex, poppers claim a queue element creating
+ *  an ephemeral node with the same name in the claims directory. Only one of
+ *  them can create it, so others try the next element. The claimer gets the
+ *  element, and deletes it and its claim in the same transaction. Claims are
+ *  ephemeral, so if the claimer dies before that, its claim is released at
+ *  session expiration and the element goes back to the queue.
+ */
+
+static void rb_zk_queue_claim_list(struct rb_zk_queue_element *qelm);
+static void rb_zk_queue_claim_next(struct rb_zk_queue_element *qelm);
+
+static void rb_zk_queue_claim_error(struct rb_zk_queue_element *qelm,
+				    const char *cause,
+				    int rc) {
+	if (qelm->error_cb) {
+		qelm->error_cb(qelm->rb_zk, qelm, cause, rc, qelm->opaque);
+	}
+	rb_zk_queue_element_decref(qelm);
+}
+
+/// Ignore completion
+static void rb_zk_queue_claim_noop(int rc, const void *data) {
+	(void)rc;
+	(void)data;
+}
+
+/// Release our claim, so the element goes back to the queue
+static void rb_zk_queue_claim_release(struct rb_zk_queue_element *qelm,
+				      void_completion_t cb) {
+	static const int IGNORE_NODE_VERSION = -1;
+	const int adelete_rc = zoo_adelete(qelm->rb_zk->handler,
+					   qelm->claim_path,
+					   IGNORE_NODE_VERSION,
+					   cb,
+					   qelm);
+	if (ZOK != adelete_rc) {
+		rdlog(LOG_ERR,
+		      "Can't release queue claim %s, rc=%d",
+		      qelm->claim_path,
+		      adelete_rc);
+		if (cb != rb_zk_queue_claim_noop) {
+			cb(adelete_rc, qelm);
+		}
+	}
+}
+
+static void rb_zk_queue_claim_child_watcher(zhandle_t *zh,
+					    int type,
+					    int state,
+					    const char *path,
+					    void *watcherCtx) {
+	(void)zh;
+	(void)path;
+	struct rb_zk_queue_element *qelm =
+			rb_zk_queue_element_const_cast(watcherCtx);
+
+	if (type == ZOO_SESSION_EVENT && state == ZOO_EXPIRED_SESSION_STATE) {
+		/* Watch is lost with the session */
+		qelm->watcher_pending = 0;
+		if (!qelm->should_ignore_watcher) {
+			rb_zk_queue_claim_error(qelm,
+						"Session expired waiting for "
+						"queue elements",
+						ZSESSIONEXPIRED);
+		}
+		rb_zk_queue_element_decref(qelm);
+		return;
+	} else if (type != ZOO_CHILD_EVENT) {
+		rdlog(LOG_ERR, "Received an event != zhild event. returning.");
+		return;
+	}
+
+	qelm->watcher_pending = 0;
+	if (!qelm->should_ignore_watcher) {
+		/// Node added or removed from the queue.
+		free_strings(qelm->busy, qelm->busy_count);
+		qelm->busy = NULL;
+		qelm->busy_count = 0;
+		rb_zk_queue_claim_list(qelm);
+	}
+
+	/* Watcher reference */
+	rb_zk_queue_element_decref(qelm);
+}
+
+/// Try next candidate after releasing a claim
+static void rb_zk_queue_claim_next_cb(int rc, const void *data) {
+	(void)rc;
+	rb_zk_queue_claim_next(rb_zk_queue_element_const_cast(data));
+}
+
+static int rb_zk_queue_claim_is_busy(const struct rb_zk_queue_element *qelm,
+				     const char *element) {
+	for (size_t i = 0; i < qelm->busy_count; ++i) {
+		if (0 == strcmp(qelm->busy[i], element)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int str_ptr_cmp(const void *va, const void *vb) {
+	const char *const *a = va, *const *b = vb;
+	return strcmp(*a, *b);
+}
+
+static void rb_zk_queue_claim_children0(int rc,
+					const struct String_vector *strings,
+					const void *_data,
+					int watcher_setted);
+
+static void
+rb_zk_queue_claim_children_no_watcher(int rc,
+				      const struct String_vector *strings,
+				      const void *_data) {
+	rb_zk_queue_claim_children0(rc, strings, _data, 0);
+}
+
+static void
+rb_zk_queue_claim_children_watcher(int rc,
+				   const struct String_vector *strings,
+				   const void *_data) {
+	rb_zk_queue_claim_children0(rc, strings, _data, 1);
+}
+
+/** Wait for queue changes
+  @param qelm Queue element
+  */
+static void rb_zk_queue_claim_watch(struct rb_zk_queue_element *qelm) {
+	char buf[BUFSIZ];
+	snprintf(buf, sizeof(buf), "%s", qelm->path);
+	parent_node(buf);
+	rdlog(LOG_DEBUG, "No more sensors to claim, I will watch %s", buf);
+
+	if (!qelm->watcher_pending) {
+		qelm->watcher_pending = 1;
+		rb_zk_queue_element_incref(qelm);
+	}
+	qelm->should_ignore_watcher = 0;
+
+	const int awget_rc = zoo_awget_children(
+			qelm->rb_zk->handler,
+			buf,
+			rb_zk_queue_claim_child_watcher,
+			qelm,
+			rb_zk_queue_claim_children_watcher,
+			qelm);
+	if (ZOK != awget_rc) {
+		qelm->watcher_pending = 0;
+		rb_zk_queue_element_decref(qelm);
+		rb_zk_queue_claim_error(
+				qelm, "Can't watch queue children", awget_rc);
+	}
+}
+
+/// Save not busy elements of the queue as claim candidates
+static void rb_zk_queue_claim_children0(int rc,
+					const struct String_vector *strings,
+					const void *_data,
+					int watcher_setted) {
+	struct rb_zk_queue_element *qelm =
+			rb_zk_queue_element_const_cast(_data);
+
+	if (rc < 0) {
+		rb_zk_queue_claim_error(
+				qelm, "Error getting queue children", rc);
+		return;
+	}
+
+	free_strings(qelm->candidates, qelm->candidates_count);
+	qelm->candidates_count = qelm->candidates_tried = 0;
+	qelm->candidates = calloc(strings->count ? (size_t)strings->count : 1,
+				  sizeof(qelm->candidates[0]));
+	if (NULL == qelm->candidates) {
+		rb_zk_queue_claim_error(qelm, "Can't allocate candidates", rc);
+		return;
+	}
+
+	for (int i = 0; i < strings->count; ++i) {
+		if (NULL == strings->data[i] ||
+		    rb_zk_queue_claim_is_busy(qelm, strings->data[i])) {
+			continue;
+		}
+
+		char *candidate = strdup(strings->data[i]);
+		if (NULL == candidate) {
+			rb_zk_queue_claim_error(
+					qelm, "Can't allocate candidate", rc);
+			return;
+		}
+		qelm->candidates[qelm->candidates_count++] = candidate;
+	}
+
+	if (0 == qelm->candidates_count) {
+		if (watcher_setted) {
+			rdlog(LOG_DEBUG,
+			      "Still no sensor to claim. Waiting the watcher "
+			      "event.");
+		} else {
+			rb_zk_queue_claim_watch(qelm);
+		}
+		return;
+	}
+
+	if (watcher_setted) {
+		rdlog(LOG_DEBUG,
+		      "Watcher already setted. Marking to ignore it.");
+		qelm->should_ignore_watcher = 1;
+	}
+
+	/* Oldest first, but every popper starts in a different element, so
+	they do not race for the same claims */
+	qsort(qelm->candidates,
+	      qelm->candidates_count,
+	      sizeof(qelm->candidates[0]),
+	      str_ptr_cmp);
+	rb_zk_queue_claim_next(qelm);
+}
+
+static void rb_zk_queue_claim_deleted(int rc, const void *data) {
+	struct rb_zk_queue_element *qelm = rb_zk_queue_element_const_cast(data);
+
+	if (ZOK != rc) {
+		rdlog(LOG_ERR,
+		      "Can't delete claimed queue element %s, rc=%d",
+		      qelm->queue_element_path,
+		      rc);
+		rb_zk_queue_claim_release(qelm, rb_zk_queue_claim_noop);
+	}
+
+	if (qelm->delete_cb) {
+		qelm->delete_cb(rc, qelm->opaque);
+	}
+
+	rb_zk_queue_element_decref(qelm);
+}
+
+static void rb_zk_queue_claim_get_element(int rc,
+					  const char *value,
+					  int value_len,
+					  const struct Stat *stat,
+					  const void *data) {
+	static const int IGNORE_NODE_VERSION = -1;
+	struct rb_zk_queue_element *qelm = rb_zk_queue_element_const_cast(data);
+
+	if (ZNONODE == rc) {
+		/* Popped by the previous claimer before we claimed it */
+		rb_zk_queue_claim_release(qelm, rb_zk_queue_claim_next_cb);
+		return;
+	} else if (rc < 0) {
+		rb_zk_queue_claim_release(qelm, rb_zk_queue_claim_noop);
+		rb_zk_queue_claim_error(
+				qelm, "Error getting queue element", rc);
+		return;
+	}
+
+	if (qelm->data_cb) {
+		qelm->data_cb(rc, value, value_len, stat, qelm->opaque);
+	}
+
+	zoo_delete_op_init(&qelm->claim_ops[0],
+			   qelm->queue_element_path,
+			   IGNORE_NODE_VERSION);
+	zoo_delete_op_init(&qelm->claim_ops[1],
+			   qelm->claim_path,
+			   IGNORE_NODE_VERSION);
+	const int amulti_rc = zoo_amulti(qelm->rb_zk->handler,
+					 (int)RD_ARRAYSIZE(qelm->claim_ops),
+					 qelm->claim_ops,
+					 qelm->claim_results,
+					 rb_zk_queue_claim_deleted,
+					 qelm);
+	if (ZOK != amulti_rc) {
+		rb_zk_queue_claim_deleted(amulti_rc, qelm);
+	}
+}
+
+static void
+rb_zk_queue_claim_created(int rc, const char *value, const void *data) {
+	struct rb_zk_queue_element *qelm = rb_zk_queue_element_const_cast(data);
+	(void)value;
+
+	if (ZNODEEXISTS == rc) {
+		/* Somebody else claimed it */
+		rb_zk_queue_claim_next(qelm);
+		return;
+	} else if (rc < 0) {
+		rb_zk_queue_claim_error(qelm, "Error creating queue claim", rc);
+		return;
+	}
+
+	rdlog(LOG_DEBUG, "Claimed sensor %s", qelm->queue_element_path);
+	const int aget_rc = zoo_aget(qelm->rb_zk->handler,
+				     qelm->queue_element_path,
+				     0,
+				     rb_zk_queue_claim_get_element,
+				     qelm);
+	if (ZOK != aget_rc) {
+		rb_zk_queue_claim_release(qelm, rb_zk_queue_claim_noop);
+		rb_zk_queue_claim_error(qelm,
+					"Can't do aget over claimed element",
+					aget_rc);
+	}
+}
+
+/// Try to claim next candidate
+static void rb_zk_queue_claim_next(struct rb_zk_queue_element *qelm) {
+	char buf[BUFSIZ];
+
+	if (qelm->candidates_tried == qelm->candidates_count) {
+		/* All claimed by others. Wait until they are popped, or new
+		ones are pushed */
+		char **busy = realloc(qelm->busy,
+				      (qelm->busy_count +
+				       qelm->candidates_count) *
+					      sizeof(busy[0]));
+		if (NULL == busy) {
+			rb_zk_queue_claim_error(qelm,
+						"Can't allocate busy elements",
+						0);
+			return;
+		}
+
+		memcpy(&busy[qelm->busy_count],
+		       qelm->candidates,
+		       qelm->candidates_count * sizeof(busy[0]));
+		qelm->busy = busy;
+		qelm->busy_count += qelm->candidates_count;
+		free(qelm->candidates);
+		qelm->candidates = NULL;
+		qelm->candidates_count = qelm->candidates_tried = 0;
+		rb_zk_queue_claim_watch(qelm);
+		return;
+	}
+
+	const uint64_t session_id = (uint64_t)rb_zk_session_id(qelm->rb_zk);
+	const size_t candidate_idx =
+			(size_t)((session_id + qelm->candidates_tried++) %
+				 qelm->candidates_count);
+	const char *candidate = qelm->candidates[candidate_idx];
+
+	snprintf(buf, sizeof(buf), "%s", qelm->path);
+	parent_node(buf);
+	free(qelm->queue_element_path);
+	free(qelm->claim_path);
+	qelm->claim_path = NULL;
+	if (asprintf(&qelm->queue_element_path, "%s/%s", buf, candidate) <
+			    0 ||
+	    asprintf(&qelm->claim_path,
+		     "%s/%s",
+		     qelm->claims_path,
+		     candidate) < 0) {
+		qelm->queue_element_path = NULL;
+		rb_zk_queue_claim_error(qelm, "Can't allocate claim path", 0);
+		return;
+	}
+
+	const int acreate_rc = zoo_acreate(qelm->rb_zk->handler,
+					   qelm->claim_path,
+					   NULL,
+					   0,
+					   &ZOO_OPEN_ACL_UNSAFE,
+					   ZOO_EPHEMERAL,
+					   rb_zk_queue_claim_created,
+					   qelm);
+	if (ZOK != acreate_rc) {
+		rb_zk_queue_claim_error(qelm,
+					"Can't call acreate to claim",
+					acreate_rc);
+	}
+}
+
+static void rb_zk_queue_claim_list(struct rb_zk_queue_element *qelm) {
+	char buf[BUFSIZ];
+
+	snprintf(buf, sizeof(buf), "%s", qelm->path);
+	parent_node(buf);
+
+	const int aget_children_rc =
+			zoo_aget_children(qelm->rb_zk->handler,
+					  buf,
+					  0,
+					  rb_zk_queue_claim_children_no_watcher,
+					  qelm);
+	if (ZOK != aget_children_rc) {
+		rb_zk_queue_claim_error(
+				qelm, "Can't call aget.", aget_children_rc);
+	}
+}
+
+void rb_zk_queue_claim(struct rb_zk *zk,
+		       struct rb_zk_queue_element *qelement,
+		       const char *claims_path) {
+#ifdef PRIVATE_QELEMENT_MAGIC
+	qelement->magic = PRIVATE_QELEMENT_MAGIC;
+#endif
+	qelement->rb_zk = zk;
+	qelement->claims_path = strdup(claims_path);
+	if (NULL == qelement->claims_path) {
+		rb_zk_queue_claim_error(
+				qelement, "Can't allocate claims path", 0);
+		return;
+	}
+
+	rb_zk_queue_claim_list(qelement);
+}
+
 /// @TODO need an error callback too
 void rb_zk_queue_push(struct rb_zk *zk,
 		      const char *path,
@@ -914,6 +1401,114 @@ void rb_zk_queue_push(struct rb_zk *zk,
 	}
 }
 
+/// Queue push transaction in flight
+struct rb_zk_queue_multi {
+	void_completion_t cb;
+	void *opaque;
+	int count;
+	zoo_op_t *ops;
+	zoo_op_result_t *results;
+	char *paths; ///< Created nodes path buffers
+};
+
+static void rb_zk_queue_multi_done(struct rb_zk_queue_multi *multi) {
+	free(multi->ops);
+	free(multi->results);
+	free(multi->paths);
+	free(multi);
+}
+
+static void rb_zk_queue_push_multi_completed(int rc, const void *data) {
+	struct rb_zk_queue_multi *multi = NULL;
+	memcpy(&multi, &data, sizeof(multi));
+
+	if (ZOK != rc) {
+		/* Transaction is atomic, so first failed op is the cause */
+		for (int i = 0; i < multi->count; ++i) {
+			if (ZOK != multi->results[i].err) {
+				rdlog(LOG_ERR,
+				      "Can't push queue element %d/%d, rc=%d",
+				      i,
+				      multi->count,
+				      multi->results[i].err);
+				break;
+			}
+		}
+	}
+
+	if (multi->cb) {
+		multi->cb(rc, multi->opaque);
+	}
+	rb_zk_queue_multi_done(multi);
+}
+
+int rb_zk_queue_push_multi(struct rb_zk *zk,
+			   const char *path,
+			   const char *const *values,
+			   const int *values_len,
+			   size_t count,
+			   void_completion_t cb,
+			   void *opaque) {
+	/* Path plus sequence suffix */
+	const size_t path_size = strlen(path) + sizeof("0000000000");
+
+	struct rb_zk_queue_multi *multi = calloc(1, sizeof(*multi));
+	if (NULL == multi) {
+		goto alloc_err;
+	}
+
+	multi->cb = cb;
+	multi->opaque = opaque;
+	multi->count = (int)count;
+	multi->ops = calloc(count, sizeof(multi->ops[0]));
+	multi->results = calloc(count, sizeof(multi->results[0]));
+	multi->paths = calloc(count, path_size);
+	if (NULL == multi->ops || NULL == multi->results ||
+	    NULL == multi->paths) {
+		goto alloc_err;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		zoo_create_op_init(&multi->ops[i],
+				   path,
+				   values[i],
+				   values_len[i],
+				   &ZOO_OPEN_ACL_UNSAFE,
+				   ZOO_SEQUENCE,
+				   &multi->paths[i * path_size],
+				   (int)path_size);
+	}
+
+	const int amulti_rc = zoo_amulti(zk->handler,
+					 multi->count,
+					 multi->ops,
+					 multi->results,
+					 rb_zk_queue_push_multi_completed,
+					 multi);
+	if (ZOK != amulti_rc) {
+		rdlog(LOG_ERR,
+		      "Can't call amulti to push %zu queue %s elements, rc=%d",
+		      count,
+		      path,
+		      amulti_rc);
+		rb_zk_queue_multi_done(multi);
+	} else {
+		rdlog(LOG_DEBUG,
+		      "amulti called successfuly for %zu queue %s elements",
+		      count,
+		      path);
+	}
+
+	return amulti_rc;
+
+alloc_err:
+	rdlog(LOG_ERR, "Can't allocate queue push transaction (OOM?)");
+	if (multi) {
+		rb_zk_queue_multi_done(multi);
+	}
+	return ZSYSTEMERROR;
+}
+
 /*
  *  REDBORDER MONITOR ZOOKEEPER
  */
@@ -948,7 +1543,7 @@ static void zk_watcher(zhandle_t *zh,
 int rb_zk_create_recursive_node(struct rb_zk *context,
 				const char *node,
 				int flags) {
-	char aux_buf[strlen(node)];
+	char aux_buf[strlen(node) + 1];
 	strcpy(aux_buf, node);
 	int last_path_printed = 0;
 
@@ -1040,8 +1635,10 @@ struct rb_zk *rb_zk_init(char *host, int zk_timeout) {
 	rb_zk_mutex_list_init(&_zk->leaders_nodes_list);
 	rb_zk_mutex_list_init(&_zk->pending_leaders);
 	_zk->zk_timeout = zk_timeout;
-	reset_zk_context(_zk);
+	/* Connected event could be delivered before zookeeper_init returns,
+	and the watcher needs the thread */
 	rd_thread_create(&_zk->zk_thread, NULL, NULL, zk_ok_watcher, _zk);
+	reset_zk_context(_zk);
 
 	if (NULL == _zk->handler) {
 		strerror_r(errno, strerror_buf, sizeof(strerror_buf));
@@ -1054,11 +1651,14 @@ struct rb_zk *rb_zk_init(char *host, int zk_timeout) {
 }
 
 void rb_zk_done(struct rb_zk *_zk) {
-	rd_thread_kill_join(_zk->zk_thread, NULL);
+	/* Close before killing zk thread: watchers called while closing can
+	still send it work */
 	const int close_rc = zookeeper_close(_zk->handler);
 	if (close_rc != 0) {
 		rdlog(LOG_ERR, "Error closing ZK connection [rc=%d]", close_rc);
 	}
+	_zk->handler = NULL;
+	rd_thread_kill_join(_zk->zk_thread, NULL);
 	rb_zk_mutex_list_done(&_zk->leaders_nodes_list);
 	rb_zk_mutex_list_done(&_zk->pending_leaders);
 	rd_avl_destroy(&_zk->leaders_avl);
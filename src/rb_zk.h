@@ -21,6 +21,8 @@
 #include "config.h"
 #include <zookeeper/zookeeper.h>
 
+#include <stddef.h>
+
 /// @TODO document all callbacks localities, in what thread will be them
 /// executed
 struct rb_zk;
@@ -38,6 +40,39 @@ int rb_zk_create_node(struct rb_zk *zk,
 		      char *path_buffer,
 		      int path_buffer_len);
 
+/** Get children of a node and watch them. Just a simple wrapper
+	*/
+int rb_zk_awget_children(struct rb_zk *zk,
+			 const char *path,
+			 watcher_fn watcher,
+			 void *watcher_ctx,
+			 strings_completion_t completion,
+			 const void *data);
+
+/** Current session id
+	@param zk redBorder Zookeeper handler
+	@return Session id, or 0 if there is no session yet
+	*/
+int64_t rb_zk_session_id(struct rb_zk *zk);
+
+/** Callback called when a new session is established, so ephemeral nodes
+	and watches can be created again. It will be called in rb_zk own
+	thread, once per session.
+	@param zk     redBorder Zookeeper handler
+	@param opaque Callback opaque
+	*/
+typedef void (*rb_zk_connected_cb)(struct rb_zk *zk, void *opaque);
+
+/** Set the new session callback. It is called at once if there is already
+	a session.
+	@param zk     redBorder Zookeeper handler
+	@param cb     Callback
+	@param opaque Callback opaque
+	*/
+void rb_zk_set_connected_cb(struct rb_zk *zk,
+			    rb_zk_connected_cb cb,
+			    void *opaque);
+
 /// Zookeeper mutex.
 struct rb_zk_mutex;
 
@@ -150,6 +185,25 @@ void rb_zk_queue_push(struct rb_zk *zk,
 		      string_completion_t cb,
 		      void *opaque);
 
+/** Push many elements to a Zookeeper queue in a single transaction, so all
+    of them or none are created
+    @param zk         redBorder Zookeeper handler
+    @param path       Queue path
+    @param values     Values to push
+    @param values_len Length of values
+    @param count      Number of values
+    @param cb         Callback to execute at transaction completion.
+    @param opaque     Callback opaque.
+    @return ZOK if transaction was sent. In other case, cb is not called.
+    */
+int rb_zk_queue_push_multi(struct rb_zk *zk,
+			   const char *path,
+			   const char *const *values,
+			   const int *values_len,
+			   size_t count,
+			   void_completion_t cb,
+			   void *opaque);
+
 /** Try to obtain a mutex
     @param zk         redBorder Zookeeper handler
     @param mutex_path Path of the Zookeeper mutex you want to obtain
@@ -191,6 +245,19 @@ void rb_zk_queue_pop(struct rb_zk *zk,
 		     struct rb_zk_queue_element *qelement,
 		     const char *mutex);
 
+/** Pop an element from the queue, claiming it with an ephemeral node in
+    claims_path instead of locking a mutex. If we lose ZooKeeper session
+    before pop is completed, the claim is released and the element is
+    popped by another instance.
+	@param zk redBorder ZooKeeper handler.
+	@param qelement Queue element configuration. From this moment, qelement
+   is owned by zk.
+	@param claims_path Directory of claim nodes. It must exist.
+	*/
+void rb_zk_queue_claim(struct rb_zk *zk,
+		       struct rb_zk_queue_element *qelement,
+		       const char *claims_path);
+
 /** Release redBorder zookeeper resources
     @param zk redBorder Zookeeper handler
     */
@@ -68,7 +68,17 @@ static void prepare_test_basic_sensor_checks(check_list_t *check_list) {
 }
 
 /** Basic test */
-TEST_FN(test_basic_sensor, prepare_test_basic_sensor_checks, basic_sensor)
+TEST_FN(test_basic_sensor0, prepare_test_basic_sensor_checks, basic_sensor)
+
+/// Number of SNMP requests done
+static size_t snmp_requests;
+
+/** Basic test, all OIDs must be asked in the same request */
+static void test_basic_sensor() {
+	snmp_requests = 0;
+	test_basic_sensor0();
+	assert_true(1 == snmp_requests);
+}
 
 int main(void) {
 	const struct CMUnitTest tests[] = {
@@ -84,20 +94,20 @@ int main(void) {
  * @param oid_len oid len
  * @param val Response value
  * @param val_size Response value size
- * @return New allocated PDU
+ * @return New allocated PDU variable
  */
-static struct snmp_pdu *snmp_sess_create_response(u_char type, const oid *oid,
-			size_t oid_len, const void *val, size_t val_size) {
-	struct snmp_pdu *response = calloc(1, sizeof(*response));
-	response->variables = calloc(1, sizeof(*response->variables)
+static struct variable_list *snmp_sess_create_response_var(u_char type,
+			const oid *oid, size_t oid_len, const void *val,
+			size_t val_size) {
+	struct variable_list *variable = calloc(1, sizeof(*variable)
 								+ val_size);
-	response->variables->type = type;
+	variable->type = type;
 	// All val union members are pointers so we use one of them
-	response->variables->val.objid = (void *)(&response->variables[1]);
-	response->variables->val_len = val_size;
-	memcpy(response->variables->val.objid, val, val_size);
+	variable->val.objid = (void *)(&variable[1]);
+	variable->val_len = val_size;
+	memcpy(variable->val.objid, val, val_size);
 
-	return response;
+	return variable;
 }
 
 int snmp_sess_synch_response(void *sessp, struct snmp_pdu *pdu,
@@ -107,33 +117,55 @@ int snmp_sess_synch_response(void *sessp, struct snmp_pdu *pdu,
 	static const oid EXPECTED_OID_PREFIX[] = {1,3,6,1,4,1,39483};
 
 	(void)sessp;
-	assert_true(pdu->variables[0].name_length =
+	snmp_requests++;
+	*response = calloc(1, sizeof(**response));
+	struct variable_list **response_var = &(*response)->variables;
+
+	for (struct variable_list *variable = pdu->variables; variable;
+					variable = variable->next_variable) {
+		assert_true(variable->name_length ==
 					RD_ARRAYSIZE(EXPECTED_OID_PREFIX) + 1);
-	assert_true(0 == memcmp(EXPECTED_OID_PREFIX, pdu->variables[0].name,
+		assert_true(0 == memcmp(EXPECTED_OID_PREFIX, variable->name,
 						sizeof(EXPECTED_OID_PREFIX)));
 
-	const size_t oid_suffix_pos = RD_ARRAYSIZE(EXPECTED_OID_PREFIX);
-	const oid snmp_pdu_requested = pdu->variables[0].name[oid_suffix_pos];
+		const size_t oid_suffix_pos = RD_ARRAYSIZE(EXPECTED_OID_PREFIX);
+		const oid snmp_pdu_requested = variable->name[oid_suffix_pos];
 
 
 #define SNMP_RES_CASE(res_oid_suffix, type, res_size, res)                     \
-	case res_oid_suffix: *response = snmp_sess_create_response(type,       \
-		pdu->variables[0].name, pdu->variables[0].name_length,         \
-		res, res_size); snmp_free_pdu(pdu); return STAT_SUCCESS;
-
-
-	switch(snmp_pdu_requested) {
-		SNMP_RES_CASE(1, ASN_GAUGE,   sizeof(integers[0]), &integers[0])
-		SNMP_RES_CASE(2, ASN_INTEGER, sizeof(integers[1]), &integers[1])
-		SNMP_RES_CASE(3, ASN_OCTET_STR, strlen(OID_3_STR), OID_3_STR)
-		default:
-			snmp_free_pdu(pdu);
-			return STAT_ERROR;
-			// @todo return STAT_TIMEOUT
-	};
+	case res_oid_suffix: *response_var = snmp_sess_create_response_var(    \
+		type, variable->name, variable->name_length, res, res_size);   \
+		break;
+
+
+		switch(snmp_pdu_requested) {
+			SNMP_RES_CASE(1, ASN_GAUGE,   sizeof(integers[0]),
+								&integers[0])
+			SNMP_RES_CASE(2, ASN_INTEGER, sizeof(integers[1]),
+								&integers[1])
+			SNMP_RES_CASE(3, ASN_OCTET_STR, strlen(OID_3_STR),
+								OID_3_STR)
+			default:
+				snmp_free_pdu(pdu);
+				snmp_free_pdu(*response);
+				*response = NULL;
+				return STAT_ERROR;
+				// @todo return STAT_TIMEOUT
+		};
+
+		response_var = &(*response_var)->next_variable;
+	}
+
+	snmp_free_pdu(pdu);
+	return STAT_SUCCESS;
 }
 
 void snmp_free_pdu(struct snmp_pdu *pdu) {
-	free(pdu->variables);
+	struct variable_list *variable = pdu->variables;
+	while (variable) {
+		struct variable_list *next = variable->next_variable;
+		free(variable);
+		variable = next;
+	}
 	free(pdu);
 }
@@ -0,0 +1,117 @@
+#include "config.h"
+
+#include "json_test.h"
+#include "sensor_test.h"
+
+#include "rb_float.h"
+
+#include <librd/rd.h>
+#include <librd/rdfloat.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+// clang-format off
+
+static const char split_tokens_sensor[] =  "{"
+	"\"sensor_id\":1,"
+	"\"timeout\":2,"
+	"\"sensor_name\": \"sensor-arriba\","
+	"\"sensor_ip\": \"localhost\","
+	"\"community\" : \"public\","
+	"\"monitors\": /* this field MUST be the last! */"
+	"["
+		/* Multi-char split token, decimals and exponents */
+		"{\"name\": \"load_1\", \"system\": \"echo '1.5::2.25::4e2'\","
+				"\"name_split_suffix\":\"_per_instance\","
+				"\"split\":\"::\",\"split_op\":\"sum\","
+				"\"unit\": \"%\"},"
+		/* Single char split token, blanks and negative numbers */
+		"{\"name\": \"load_5\", \"system\": \"echo '-1,,3.5'\","
+				"\"name_split_suffix\":\"_per_instance\","
+				"\"split\":\",\",\"split_op\":\"mean\","
+				"\"unit\": \"%\"},"
+	"]"
+	"}";
+
+#define TEST_CHECKS(mmonitor,mvalue)                                           \
+	CHILD_I("sensor_id",1,                                                 \
+	CHILD_S("sensor_name","sensor-arriba",                                 \
+	CHILD_S("monitor",mmonitor,                                            \
+	CHILD_S("value",mvalue,                                                \
+	CHILD_S("type","system",                                               \
+	CHILD_S("unit","%",NULL))))))
+
+static void prepare_split_tokens_checks(check_list_t *check_list) {
+	json_key_test checks[] = {
+		JSON_KEY_TEST(TEST_CHECKS("load_1_per_instance","1.500000")),
+		JSON_KEY_TEST(TEST_CHECKS("load_1_per_instance","2.250000")),
+		JSON_KEY_TEST(TEST_CHECKS("load_1_per_instance","400.000000")),
+		JSON_KEY_TEST(TEST_CHECKS("load_1","403.750000")),
+		JSON_KEY_TEST(TEST_CHECKS("load_5_per_instance","-1.000000")),
+		JSON_KEY_TEST(TEST_CHECKS("load_5_per_instance","0.000000")),
+		JSON_KEY_TEST(TEST_CHECKS("load_5_per_instance","3.500000")),
+		JSON_KEY_TEST(TEST_CHECKS("load_5","0.833333")),
+	};
+
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+/** Split with single and multi char tokens */
+TEST_FN(test_split_tokens, prepare_split_tokens_checks, split_tokens_sensor)
+
+/** In-tree float parser must give the same results as strtod */
+static void test_strtod(void **state) {
+	(void)state;
+	static const char *inputs[] = {
+			"0",
+			"-0",
+			"12.5",
+			"-.5e2",
+			"5.",
+			"0.1",
+			"1e22",
+			"1e23",
+			"9007199254740993",
+			"123456789012345678901234",
+			"2.2250738585072014e-308",
+			"1.7976931348623157e308",
+			"1e",
+			"1e+",
+			"0x1p3",
+			" 3",
+			"inf",
+			"nan",
+			"text",
+			"12;13",
+			"20:30",
+	};
+
+	for (size_t i = 0; i < RD_ARRAYSIZE(inputs); ++i) {
+		const char *rb_end = NULL;
+		char *libc_end = NULL;
+		const double rb = rb_strtod(inputs[i], &rb_end);
+		const double libc = strtod(inputs[i], &libc_end);
+
+		assert_ptr_equal(rb_end, libc_end);
+		if (libc == libc) {
+			assert_memory_equal(&rb, &libc, sizeof(rb));
+		} else {
+			assert_false(rb == rb); /* Both NaN */
+		}
+	}
+}
+
+int main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_split_tokens),
+		cmocka_unit_test(test_strtod),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
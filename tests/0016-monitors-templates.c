@@ -0,0 +1,165 @@
+#include "config.h"
+
+#include "json_test.h"
+#include "sensor_test.h"
+
+#include "rb_monitors_template.h"
+#include "rb_sensor.h"
+
+#include <librd/rd.h>
+#include <librd/rdfloat.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#include <stdarg.h>
+#include <string.h>
+
+// clang-format off
+
+static const char monitors_templates[] = "{"
+	"\"load\": ["
+		"{\"name\": \"load_1\", \"system\": \"echo 1\","
+			"\"unit\": \"%\"},"
+		"{\"name\": \"load_5\", \"system\": \"echo 5\","
+			"\"unit\": \"%\","
+			"\"enrichment\": {\"owner\":\"monitor\"}},"
+		"{\"name\": \"load_sum\", \"op\":\"load_1+load_5\","
+			"\"unit\": \"%\"}"
+	"]"
+	"}";
+
+#define TEMPLATE_SENSOR(id, name) "{"                                          \
+	"\"sensor_id\":" #id ","                                               \
+	"\"timeout\":2,"                                                       \
+	"\"sensor_name\": \"" name "\","                                       \
+	"\"sensor_ip\": \"localhost\","                                        \
+	"\"community\" : \"public\","                                          \
+	"\"enrichment\": {\"owner\":\"sensor\", \"rack\":\"" name "\"},"       \
+	"\"monitors_template\": \"load\""                                      \
+	"}"
+
+static const char template_sensor_1[] = TEMPLATE_SENSOR(1, "sensor-1");
+static const char template_sensor_2[] = TEMPLATE_SENSOR(2, "sensor-2");
+
+static const char unknown_template_sensor[] = "{"
+	"\"sensor_id\":1,"
+	"\"timeout\":2,"
+	"\"sensor_name\": \"sensor-1\","
+	"\"sensor_ip\": \"localhost\","
+	"\"community\" : \"public\","
+	"\"monitors_template\": \"unknown\""
+	"}";
+
+#define TEST_CHECKS0(sid,sname,mmonitor,mvalue,mtype,mowner)                   \
+	CHILD_I("sensor_id",sid,                                               \
+	CHILD_S("sensor_name",sname,                                           \
+	CHILD_S("rack",sname,                                                  \
+	CHILD_S("owner",mowner,                                                \
+	CHILD_S("monitor",mmonitor,                                            \
+	CHILD_S("value",mvalue,                                                \
+	CHILD_S("type",mtype,                                                  \
+	CHILD_S("unit","%", NULL))))))))
+
+#define TEST_CHECKS(sid,sname) {                                               \
+	JSON_KEY_TEST(TEST_CHECKS0(sid,sname,"load_1","1.000000","system",     \
+								"sensor")),    \
+	JSON_KEY_TEST(TEST_CHECKS0(sid,sname,"load_5","5.000000","system",     \
+								"monitor")),   \
+	JSON_KEY_TEST(TEST_CHECKS0(sid,sname,"load_sum","6.000000","op",       \
+								"sensor")),    \
+	}
+
+// clang-format on
+
+static void prepare_template_sensor_1_checks(check_list_t *check_list) {
+	json_key_test checks[] = TEST_CHECKS(1, "sensor-1");
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+static void prepare_template_sensor_2_checks(check_list_t *check_list) {
+	json_key_test checks[] = TEST_CHECKS(2, "sensor-2");
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+static void template_test(const char *sensor,
+			  void (*prepare_checks_cb)(check_list_t *checks)) {
+	check_list_t checks;
+	TAILQ_INIT(&checks);
+	prepare_checks_cb(&checks);
+	test_sensor_templates(monitors_templates, sensor, &checks);
+}
+
+/** Sensors using a template get their own enrichment in template monitors */
+static void test_template_sensor_1() {
+	template_test(template_sensor_1, prepare_template_sensor_1_checks);
+}
+
+/** Same template, different sensor */
+static void test_template_sensor_2() {
+	template_test(template_sensor_2, prepare_template_sensor_2_checks);
+}
+
+/** Sensor referring to a template that does not exist */
+static void test_unknown_template() {
+	struct json_object *json_templates =
+			json_tokener_parse(monitors_templates);
+	struct _worker_info worker_info;
+	memset(&worker_info, 0, sizeof(worker_info));
+	worker_info.monitors_templates =
+			parse_rb_monitors_templates(json_templates);
+	json_object_put(json_templates);
+
+	struct json_object *json_sensor =
+			json_tokener_parse(unknown_template_sensor);
+	rb_sensor_t *sensor = parse_rb_sensor(json_sensor, &worker_info);
+	json_object_put(json_sensor);
+
+	assert_null(sensor);
+	rb_monitors_templates_done(worker_info.monitors_templates);
+}
+
+/** Sensor hash must change if the template it uses changes */
+static void test_template_sensor_hash() {
+	static const char other_templates[] = "{"
+		"\"load\": ["
+			"{\"name\": \"load_1\", \"system\": \"echo 2\"}"
+		"]"
+		"}";
+	const char *templates[] = {monitors_templates, other_templates};
+	uint64_t hashes[RD_ARRAYSIZE(templates)];
+
+	struct json_object *json_sensor =
+			json_tokener_parse(template_sensor_1);
+	for (size_t i = 0; i < RD_ARRAYSIZE(templates); ++i) {
+		struct json_object *json_templates =
+				json_tokener_parse(templates[i]);
+		struct _worker_info worker_info;
+		memset(&worker_info, 0, sizeof(worker_info));
+		worker_info.monitors_templates =
+				parse_rb_monitors_templates(json_templates);
+		json_object_put(json_templates);
+
+		hashes[i] = rb_sensor_json_hash(json_sensor, &worker_info);
+		rb_sensor_t *sensor = parse_rb_sensor(json_sensor, &worker_info);
+		assert_non_null(sensor);
+		assert_true(hashes[i] == rb_sensor_hash(sensor));
+		rb_sensor_put(sensor);
+		rb_monitors_templates_done(worker_info.monitors_templates);
+	}
+	json_object_put(json_sensor);
+
+	assert_true(hashes[0] != hashes[1]);
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_template_sensor_1),
+			cmocka_unit_test(test_template_sensor_2),
+			cmocka_unit_test(test_unknown_template),
+			cmocka_unit_test(test_template_sensor_hash),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,61 @@
+#include "config.h"
+
+#include "rb_intern.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+/** Equal strings must share storage */
+static void test_intern_same_pointer() {
+	char buf[] = "load_1";
+	const char *a = rb_intern("load_1");
+	const char *b = rb_intern(buf);
+	const char *c = rb_intern("load_5");
+
+	assert_non_null(a);
+	assert_ptr_equal(a, b);
+	assert_ptr_not_equal(a, c);
+	assert_string_equal(a, "load_1");
+
+	rb_intern_put(a);
+	rb_intern_put(b);
+	rb_intern_put(c);
+	assert_null(rb_intern(NULL));
+}
+
+/** Strings must survive while there is a reference, and the table has to
+  be able to grow */
+static void test_intern_refcnt() {
+	const char *strs[1024];
+	char buf[32];
+
+	for (size_t i = 0; i < sizeof(strs) / sizeof(strs[0]); ++i) {
+		snprintf(buf, sizeof(buf), "monitor_%zu", i);
+		strs[i] = rb_intern(buf);
+		rb_intern_get(strs[i]);
+	}
+
+	for (size_t i = 0; i < sizeof(strs) / sizeof(strs[0]); ++i) {
+		snprintf(buf, sizeof(buf), "monitor_%zu", i);
+		rb_intern_put(strs[i]);
+		assert_string_equal(strs[i], buf);
+		assert_ptr_equal(rb_intern(buf), strs[i]);
+		rb_intern_put(strs[i]);
+		rb_intern_put(strs[i]);
+	}
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_intern_same_pointer),
+			cmocka_unit_test(test_intern_refcnt),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,105 @@
+#include "config.h"
+
+#include "json_test.h"
+#include "sensor_test.h"
+
+#include "rb_sensor_monitor_array.h"
+
+#include <librd/rd.h>
+#include <librd/rdfloat.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#include <stdarg.h>
+#include <string.h>
+
+// clang-format off
+
+static const char ops_order_sensor[] =  "{"
+	"\"sensor_id\":1,"
+	"\"timeout\":2,"
+	"\"sensor_name\": \"sensor-arriba\","
+	"\"sensor_ip\": \"localhost\","
+	"\"community\" : \"public\","
+	"\"monitors\": /* this field MUST be the last! */"
+	"["
+		/* Operations before operands */
+		"{\"name\": \"load_sum_x2\", \"op\":\"2*load_sum\","
+			"\"unit\": \"%\"},"
+		"{\"name\": \"load_sum\", \"op\":\"load_1+load_5\","
+			"\"unit\": \"%\"},"
+		"{\"name\": \"load_1\", \"system\": \"echo 1\","
+			"\"unit\": \"%\"},"
+		"{\"name\": \"load_5\", \"system\": \"echo 5\","
+			"\"unit\": \"%\"}"
+	"]"
+	"}";
+
+#define TEST_CHECKS0(mmonitor,mvalue,mtype)                                    \
+	CHILD_I("sensor_id",1,                                                 \
+	CHILD_S("sensor_name","sensor-arriba",                                 \
+	CHILD_S("monitor",mmonitor,                                            \
+	CHILD_S("value",mvalue,                                                \
+	CHILD_S("type",mtype,                                                  \
+	CHILD_S("unit","%", NULL))))))
+
+#define TEST_CHECKS(mmonitor,mvalue,mtype)                                     \
+	JSON_KEY_TEST(TEST_CHECKS0(mmonitor,mvalue,mtype))
+
+// clang-format on
+
+static void prepare_ops_order_checks(check_list_t *check_list) {
+	json_key_test checks[] = {
+			TEST_CHECKS("load_1", "1.000000", "system"),
+			TEST_CHECKS("load_5", "5.000000", "system"),
+			TEST_CHECKS("load_sum", "6.000000", "op"),
+			TEST_CHECKS("load_sum_x2", "12.000000", "op"),
+	};
+
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+/** Operations are evaluated after their operands, whatever the config order */
+TEST_FN(test_ops_order, prepare_ops_order_checks, ops_order_sensor)
+
+/** Monitors in a dependency cycle are evaluated after their operands out of
+  the cycle, and monitors that depend on the cycle are evaluated after it,
+  even if they are before it in config */
+static void test_ops_order_cycle() {
+	static const size_t expected_order[] = {3, 1, 2, 0};
+	json_object *monitors_json = json_tokener_parse(
+			"[{\"name\":\"d\",\"op\":\"a+b\",\"unit\":\"%\"},"
+			"{\"name\":\"a\",\"op\":\"b+c\",\"unit\":\"%\"},"
+			"{\"name\":\"b\",\"op\":\"a+1\",\"unit\":\"%\"},"
+			"{\"name\":\"c\",\"system\":\"echo 1\","
+			"\"unit\":\"%\"}]");
+	rb_monitors_array_t *monitors = parse_rb_monitors(monitors_json);
+	assert_non_null(monitors);
+	assert_int_equal(RD_ARRAYSIZE(expected_order), monitors->count);
+
+	ssize_t **deps = get_monitors_dependencies(monitors);
+	assert_non_null(deps);
+	struct rb_monitors_schedule *schedule =
+			get_monitors_schedule(monitors, deps);
+	assert_non_null(schedule);
+
+	for (size_t i = 0; i < RD_ARRAYSIZE(expected_order); ++i) {
+		assert_int_equal(expected_order[i], schedule->order[i]);
+	}
+
+	free_monitors_schedule(schedule);
+	free_monitors_dependencies(deps, monitors->count);
+	rb_monitors_array_done(monitors);
+	json_object_put(monitors_json);
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_ops_order),
+			cmocka_unit_test(test_ops_order_cycle),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
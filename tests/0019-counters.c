@@ -0,0 +1,214 @@
+#include "config.h"
+
+#include "json_test.h"
+#include "sensor_test.h"
+
+#include <librd/rd.h>
+#include <librd/rdfloat.h>
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// clang-format off
+
+/* First execution returns a value near 32 bits counter wrap, the second one
+   returns it wrapped. We don't know system monitors counters width, so it is
+   a counter reset */
+static const char counters_sensor_fmt[] =  "{"
+	"\"sensor_id\":1,"
+	"\"timeout\":2,"
+	"\"sensor_name\": \"sensor-arriba\","
+	"\"sensor_ip\": \"localhost\","
+	"\"community\" : \"public\","
+	"\"monitors\": /* this field MUST be the last! */"
+	"["
+		"{\"name\": \"octets\", \"system\": \"test -f %s && echo 4 ||"
+			" (echo 4294967290; touch %s)\", \"unit\": \"%%\"},"
+		"{\"name\": \"octets_delta\", \"op\":\"delta(octets)\","
+			"\"unit\": \"%%\"},"
+		"{\"name\": \"octets_counter_delta\","
+			"\"op\":\"counter_delta( octets )\", \"unit\": \"%%\"}"
+	"]"
+	"}";
+
+/* SNMP counters, answered by snmp_sess_synch_response below */
+static const char snmp_counters_sensor[] =  "{"
+	"\"sensor_id\":1,"
+	"\"timeout\":2,"
+	"\"sensor_name\": \"sensor-arriba\","
+	"\"sensor_ip\": \"localhost\","
+	"\"community\" : \"public\","
+	"\"monitors\": /* this field MUST be the last! */"
+	"["
+		"{\"name\": \"c32\", \"oid\": \"1.3.6.1.4.1.39483.1\","
+			"\"unit\": \"%\"},"
+		"{\"name\": \"c64\", \"oid\": \"1.3.6.1.4.1.39483.2\","
+			"\"unit\": \"%\"},"
+		"{\"name\": \"c32_delta\", \"op\":\"counter_delta(c32)\","
+			"\"unit\": \"%\"},"
+		"{\"name\": \"c64_delta\", \"op\":\"counter_delta(c64)\","
+			"\"unit\": \"%\"}"
+	"]"
+	"}";
+
+#define TEST_CHECKS0(mmonitor,mvalue,mtype)                                    \
+	CHILD_I("sensor_id",1,                                                 \
+	CHILD_S("sensor_name","sensor-arriba",                                 \
+	CHILD_S("monitor",mmonitor,                                            \
+	CHILD_S("value",mvalue,                                                \
+	CHILD_S("type",mtype,                                                  \
+	CHILD_S("unit","%", NULL))))))
+
+#define TEST_CHECKS(mmonitor,mvalue,mtype)                                     \
+	JSON_KEY_TEST(TEST_CHECKS0(mmonitor,mvalue,mtype))
+
+// clang-format on
+
+static void prepare_counters_checks_0(check_list_t *check_list) {
+	/* No previous values, so no operations results */
+	json_key_test checks[] = {
+			TEST_CHECKS("octets", "4294967290.000000", "system"),
+	};
+
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+static void prepare_counters_checks_1(check_list_t *check_list) {
+	json_key_test checks[] = {
+			TEST_CHECKS("octets", "4.000000", "system"),
+			TEST_CHECKS("octets_delta", "-4294967286.000000", "op"),
+	};
+
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+static void prepare_snmp_counters_checks_0(check_list_t *check_list) {
+	json_key_test checks[] = {
+			TEST_CHECKS("c32", "4294967290.000000", "snmp"),
+			TEST_CHECKS("c64", "4294967296.000000", "snmp"),
+	};
+
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+static void prepare_snmp_counters_checks_1(check_list_t *check_list) {
+	/* Counter32 wrapped, Counter64 was reset */
+	json_key_test checks[] = {
+			TEST_CHECKS("c32", "4.000000", "snmp"),
+			TEST_CHECKS("c64", "10.000000", "snmp"),
+			TEST_CHECKS("c32_delta", "10.000000", "op"),
+	};
+
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+/** Delta and counter delta over previous iteration values */
+static void test_counters() {
+	char flag_path[] = "/tmp/rb_monitor_counters_XXXXXX";
+	const int fd = mkstemp(flag_path);
+	assert_true(fd >= 0);
+	close(fd);
+	unlink(flag_path);
+
+	char sensor[sizeof(counters_sensor_fmt) + 2 * sizeof(flag_path)];
+	snprintf(sensor,
+		 sizeof(sensor),
+		 counters_sensor_fmt,
+		 flag_path,
+		 flag_path);
+
+	void (*prepare_checks[])(check_list_t *) = {
+			prepare_counters_checks_0, prepare_counters_checks_1,
+	};
+	basic_test_checks_cb(prepare_checks, RD_ARRAYSIZE(prepare_checks),
+			     sensor);
+
+	unlink(flag_path);
+}
+
+/** Counter delta only takes into account SNMP Counter32 wraps */
+static void test_snmp_counters() {
+	void (*prepare_checks[])(check_list_t *) = {
+			prepare_snmp_counters_checks_0,
+			prepare_snmp_counters_checks_1,
+	};
+	basic_test_checks_cb(prepare_checks,
+			     RD_ARRAYSIZE(prepare_checks),
+			     snmp_counters_sensor);
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_counters),
+			cmocka_unit_test(test_snmp_counters),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+/// Number of times every OID has been asked
+static size_t snmp_oid_requests[3];
+
+int snmp_sess_synch_response(void *sessp,
+			     struct snmp_pdu *pdu,
+			     struct snmp_pdu **response) {
+	static const long counter32[] = {4294967290, 4};
+	static const struct counter64 counter64[] = {{.high = 1, .low = 0},
+						     {.high = 0, .low = 10}};
+	static const oid EXPECTED_OID_PREFIX[] = {1, 3, 6, 1, 4, 1, 39483};
+
+	(void)sessp;
+	*response = calloc(1, sizeof(**response));
+	struct variable_list **response_var = &(*response)->variables;
+
+	for (struct variable_list *variable = pdu->variables; variable;
+	     variable = variable->next_variable) {
+		assert_true(variable->name_length ==
+			    RD_ARRAYSIZE(EXPECTED_OID_PREFIX) + 1);
+		const size_t suffix_pos = RD_ARRAYSIZE(EXPECTED_OID_PREFIX);
+		const oid suffix = variable->name[suffix_pos];
+		assert_true(1 == suffix || 2 == suffix);
+		const size_t poll = snmp_oid_requests[suffix]++;
+		assert_true(poll < 2);
+
+		u_char type = ASN_COUNTER;
+		const void *val = &counter32[poll];
+		size_t val_size = sizeof(counter32[0]);
+		if (2 == suffix) {
+			type = ASN_COUNTER64;
+			val = &counter64[poll];
+			val_size = sizeof(counter64[0]);
+		}
+
+		*response_var = calloc(1, sizeof(**response_var) + val_size);
+		(*response_var)->type = type;
+		// All val union members are pointers so we use one of them
+		(*response_var)->val.objid = (void *)(&(*response_var)[1]);
+		(*response_var)->val_len = val_size;
+		memcpy((*response_var)->val.objid, val, val_size);
+
+		response_var = &(*response_var)->next_variable;
+	}
+
+	snmp_free_pdu(pdu);
+	return STAT_SUCCESS;
+}
+
+void snmp_free_pdu(struct snmp_pdu *pdu) {
+	struct variable_list *variable = pdu->variables;
+	while (variable) {
+		struct variable_list *next = variable->next_variable;
+		free(variable);
+		variable = next;
+	}
+	free(pdu);
+}
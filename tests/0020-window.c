@@ -0,0 +1,221 @@
+#include "config.h"
+
+#include "json_test.h"
+#include "sensor_test.h"
+
+#include <librd/rd.h>
+#include <librd/rdfloat.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// clang-format off
+
+/* Returns 1, 2, 3... in every execution. Third execution takes 2 seconds, so
+   it falls in the next window */
+static const char window_sensor_fmt[] =  "{"
+	"\"sensor_id\":1,"
+	"\"timeout\":2,"
+	"\"sensor_name\": \"sensor-arriba\","
+	"\"sensor_ip\": \"localhost\","
+	"\"community\" : \"public\","
+	"\"monitors\": /* this field MUST be the last! */"
+	"["
+		"{\"name\": \"load_1\", \"system\": \""
+			"n=$(cat %s 2>/dev/null || echo 0);"
+			"echo $((n+1)) > %s;"
+			"[ $n -eq 2 ] && sleep 2;"
+			"echo $((n+1))\","
+			"\"window\": 2, \"unit\": \"%%\"}"
+	"]"
+	"}";
+
+/* Always returns 5. Third and fourth executions take 2 seconds, so they fall
+   in the next windows */
+static const char window_deadband_sensor_fmt[] =  "{"
+	"\"sensor_id\":1,"
+	"\"timeout\":2,"
+	"\"sensor_name\": \"sensor-arriba\","
+	"\"sensor_ip\": \"localhost\","
+	"\"community\" : \"public\","
+	"\"monitors\": /* this field MUST be the last! */"
+	"["
+		"{\"name\": \"load_1\", \"system\": \""
+			"n=$(cat %s 2>/dev/null || echo 0);"
+			"echo $((n+1)) > %s;"
+			"[ $n -ge 2 ] && sleep 2;"
+			"echo 5\","
+			"\"window\": 2, \"deadband\": 1, \"unit\": \"%%\"}"
+	"]"
+	"}";
+
+#define TEST_CHECKS0(mmonitor,mvalue,mmin,mmax,msum,mcount)                    \
+	CHILD_I("sensor_id",1,                                                 \
+	CHILD_S("sensor_name","sensor-arriba",                                 \
+	CHILD_S("monitor",mmonitor,                                            \
+	CHILD_S("value",mvalue,                                                \
+	CHILD_S("min",mmin,                                                    \
+	CHILD_S("max",mmax,                                                    \
+	CHILD_S("sum",msum,                                                    \
+	CHILD_I("count",mcount,                                                \
+	CHILD_S("type","system",                                               \
+	CHILD_S("unit","%", NULL))))))))))
+
+// clang-format on
+
+static void prepare_window_checks_empty(check_list_t *check_list) {
+	/* Window still open */
+	(void)check_list;
+}
+
+static void prepare_window_checks(check_list_t *check_list) {
+	json_key_test checks[] = {
+			JSON_KEY_TEST(TEST_CHECKS0("load_1",
+						   "2.000000",
+						   "1.000000",
+						   "2.000000",
+						   "3.000000",
+						   2)),
+	};
+
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+static void prepare_window_deadband_checks(check_list_t *check_list) {
+	json_key_test checks[] = {
+			JSON_KEY_TEST(TEST_CHECKS0("load_1",
+						   "5.000000",
+						   "5.000000",
+						   "5.000000",
+						   "10.000000",
+						   2)),
+	};
+
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+/** Wait until the beginning of a window, so the first two executions fall in
+  it */
+static void wait_window_start(time_t window) {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	const time_t next = now.tv_sec - now.tv_sec % window + window;
+	struct timespec wait = {
+			.tv_sec = next - now.tv_sec - 1,
+			.tv_nsec = 1000000000L - now.tv_nsec + 10000000L,
+	};
+	if (wait.tv_nsec >= 1000000000L) {
+		wait.tv_sec++;
+		wait.tv_nsec -= 1000000000L;
+	}
+	nanosleep(&wait, NULL);
+}
+
+/** Values are aggregated and only the summary is sent */
+static void test_window() {
+	char counter_path[] = "/tmp/rb_monitor_window_XXXXXX";
+	const int fd = mkstemp(counter_path);
+	assert_true(fd >= 0);
+	close(fd);
+	unlink(counter_path);
+
+	char sensor[sizeof(window_sensor_fmt) + 2 * sizeof(counter_path)];
+	snprintf(sensor,
+		 sizeof(sensor),
+		 window_sensor_fmt,
+		 counter_path,
+		 counter_path);
+
+	void (*prepare_checks[])(check_list_t *) = {
+			prepare_window_checks_empty,
+			prepare_window_checks_empty,
+			prepare_window_checks,
+	};
+
+	wait_window_start(2);
+	basic_test_checks_cb(prepare_checks, RD_ARRAYSIZE(prepare_checks),
+			     sensor);
+
+	unlink(counter_path);
+}
+
+/** The window in progress is sent when the sensor is released */
+static void test_window_flush() {
+	char counter_path[] = "/tmp/rb_monitor_window_XXXXXX";
+	const int fd = mkstemp(counter_path);
+	assert_true(fd >= 0);
+	close(fd);
+	unlink(counter_path);
+
+	char sensor[sizeof(window_sensor_fmt) + 2 * sizeof(counter_path)];
+	snprintf(sensor,
+		 sizeof(sensor),
+		 window_sensor_fmt,
+		 counter_path,
+		 counter_path);
+
+	/* Both executions fall in the same window, that is still open */
+	void (*prepare_checks[])(check_list_t *) = {
+			prepare_window_checks_empty,
+			prepare_window_checks_empty,
+			prepare_window_checks,
+	};
+	check_list_t checks[RD_ARRAYSIZE(prepare_checks)];
+	for (size_t i = 0; i < RD_ARRAYSIZE(prepare_checks); ++i) {
+		TAILQ_INIT(&checks[i]);
+		prepare_checks[i](&checks[i]);
+	}
+
+	wait_window_start(2);
+	test_sensor_n_flush(sensor, checks, RD_ARRAYSIZE(checks) - 1);
+
+	unlink(counter_path);
+}
+
+/** Deadband applies to window summaries */
+static void test_window_deadband() {
+	char counter_path[] = "/tmp/rb_monitor_window_XXXXXX";
+	const int fd = mkstemp(counter_path);
+	assert_true(fd >= 0);
+	close(fd);
+	unlink(counter_path);
+
+	char sensor[sizeof(window_deadband_sensor_fmt) +
+		    2 * sizeof(counter_path)];
+	snprintf(sensor,
+		 sizeof(sensor),
+		 window_deadband_sensor_fmt,
+		 counter_path,
+		 counter_path);
+
+	/* Second summary has the same value as the first one */
+	void (*prepare_checks[])(check_list_t *) = {
+			prepare_window_checks_empty,
+			prepare_window_checks_empty,
+			prepare_window_deadband_checks,
+			prepare_window_checks_empty,
+	};
+
+	wait_window_start(2);
+	basic_test_checks_cb(prepare_checks, RD_ARRAYSIZE(prepare_checks),
+			     sensor);
+
+	unlink(counter_path);
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_window),
+			cmocka_unit_test(test_window_deadband),
+			cmocka_unit_test(test_window_flush),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,118 @@
+#include "config.h"
+
+#include "json_test.h"
+#include "sensor_test.h"
+
+#include <librd/rd.h>
+#include <librd/rdfloat.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// clang-format off
+
+/* Returns 100, 100.5 and then 102 */
+#define SEQUENCE_CMD(file)                                                     \
+	"n=$(cat " file " 2>/dev/null || echo 0);"                             \
+	"echo $((n+1)) > " file ";"                                            \
+	"case $n in 0) echo 100;; 1) echo 100.5;; *) echo 102;; esac"
+
+static const char deadband_sensor_fmt[] =  "{"
+	"\"sensor_id\":1,"
+	"\"timeout\":2,"
+	"\"sensor_name\": \"sensor-arriba\","
+	"\"sensor_ip\": \"localhost\","
+	"\"community\" : \"public\","
+	"\"monitors\": /* this field MUST be the last! */"
+	"["
+		"{\"name\": \"absolute\", \"system\": \"" SEQUENCE_CMD("%s") "\","
+			"\"deadband\": 1, \"unit\": \"%%\"},"
+		"{\"name\": \"constant\", \"system\": \"echo 5\","
+			"\"heartbeat\": 3600, \"unit\": \"%%\"},"
+		"{\"name\": \"relative\", \"system\": \"" SEQUENCE_CMD("%s") "\","
+			"\"deadband_pct\": 1, \"unit\": \"%%\"}"
+	"]"
+	"}";
+
+#define TEST_CHECKS(mmonitor,mvalue)                                           \
+	JSON_KEY_TEST(                                                         \
+	CHILD_I("sensor_id",1,                                                 \
+	CHILD_S("sensor_name","sensor-arriba",                                 \
+	CHILD_S("monitor",mmonitor,                                            \
+	CHILD_S("value",mvalue,                                                \
+	CHILD_S("type","system",                                               \
+	CHILD_S("unit","%", NULL)))))))
+
+// clang-format on
+
+static void prepare_deadband_checks_0(check_list_t *check_list) {
+	json_key_test checks[] = {
+			TEST_CHECKS("absolute", "100.000000"),
+			TEST_CHECKS("constant", "5.000000"),
+			TEST_CHECKS("relative", "100.000000"),
+	};
+
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+static void prepare_deadband_checks_1(check_list_t *check_list) {
+	/* All values are in deadband, and heartbeat has not expired */
+	(void)check_list;
+}
+
+static void prepare_deadband_checks_2(check_list_t *check_list) {
+	json_key_test checks[] = {
+			TEST_CHECKS("absolute", "102.000000"),
+			TEST_CHECKS("relative", "102.000000"),
+	};
+
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+/** Values that have not changed enough are not sent */
+static void test_deadband() {
+	char absolute_path[] = "/tmp/rb_monitor_deadband_XXXXXX";
+	char relative_path[] = "/tmp/rb_monitor_deadband_XXXXXX";
+	char *paths[] = {absolute_path, relative_path};
+	for (size_t i = 0; i < RD_ARRAYSIZE(paths); ++i) {
+		const int fd = mkstemp(paths[i]);
+		assert_true(fd >= 0);
+		close(fd);
+		unlink(paths[i]);
+	}
+
+	char sensor[sizeof(deadband_sensor_fmt) + 4 * sizeof(absolute_path)];
+	snprintf(sensor,
+		 sizeof(sensor),
+		 deadband_sensor_fmt,
+		 absolute_path,
+		 absolute_path,
+		 relative_path,
+		 relative_path);
+
+	void (*prepare_checks[])(check_list_t *) = {
+			prepare_deadband_checks_0,
+			prepare_deadband_checks_1,
+			prepare_deadband_checks_2,
+	};
+	basic_test_checks_cb(prepare_checks, RD_ARRAYSIZE(prepare_checks),
+			     sensor);
+
+	for (size_t i = 0; i < RD_ARRAYSIZE(paths); ++i) {
+		unlink(paths[i]);
+	}
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_deadband),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,106 @@
+#include "config.h"
+
+#include "json_test.h"
+#include "sensor_test.h"
+
+#include "rb_sketch.h"
+
+#include <librd/rd.h>
+#include <librd/rdfloat.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#include <math.h>
+#include <stdarg.h>
+#include <string.h>
+
+// clang-format off
+
+static const char split_ops_sensor[] =  "{"
+	"\"sensor_id\":1,"
+	"\"timeout\":2,"
+	"\"sensor_name\": \"sensor-arriba\","
+	"\"sensor_ip\": \"localhost\","
+	"\"community\" : \"public\","
+	"\"monitors\": /* this field MUST be the last! */"
+	"["
+		/* TEST many split ops, and no per-instance values */
+		"{\"name\": \"latency\", \"system\": \"echo '2;4;4;4;5;5;7;9'\","
+				"\"split\":\";\","
+				"\"split_op\":[\"min\",\"max\",\"stddev\",\"p50\"],"
+				"\"send_split_instances\":0,"
+				"\"unit\": \"ms\"},"
+		/* TEST classic single split op is not renamed */
+		"{\"name\": \"load_1\", \"system\": \"echo '3;2;1;0'\","
+				"\"split\":\";\",\"split_op\":\"max\","
+				"\"send_split_instances\":0,"
+				"\"unit\": \"ms\"}"
+	"]"
+	"}";
+
+#define TEST_CHECKS0(mmonitor,next)                                            \
+	CHILD_I("sensor_id",1,                                                 \
+	CHILD_S("sensor_name","sensor-arriba",                                 \
+	CHILD_S("monitor",mmonitor,                                            \
+	CHILD_S("type","system",                                               \
+	CHILD_S("unit","ms", next)))))
+
+#define TEST_CHECKS(mmonitor,mvalue)                                           \
+	JSON_KEY_TEST(TEST_CHECKS0(mmonitor, CHILD_S("value",mvalue,NULL)))
+
+/* Sketch does not return exact values, so we can't check it */
+#define TEST_CHECKS_NO_VALUE(mmonitor)                                         \
+	JSON_KEY_TEST(TEST_CHECKS0(mmonitor, NULL))
+
+// clang-format on
+
+static void prepare_split_ops_checks(check_list_t *check_list) {
+	json_key_test checks[] = {
+			TEST_CHECKS("latency_min", "2.000000"),
+			TEST_CHECKS("latency_max", "9.000000"),
+			TEST_CHECKS("latency_stddev", "2.000000"),
+			TEST_CHECKS_NO_VALUE("latency_p50"),
+			TEST_CHECKS("load_1", "3.000000"),
+	};
+
+	check_list_push_checks(check_list, checks, RD_ARRAYSIZE(checks));
+}
+
+TEST_FN(test_split_ops, prepare_split_ops_checks, split_ops_sensor)
+
+/** Sketch quantiles must be within sketch relative accuracy */
+static void test_sketch() {
+	static const double accuracy = 0.01;
+	struct rb_sketch *sketch = rb_sketch_new(accuracy);
+	struct rb_sketch *sketch2 = rb_sketch_new(accuracy);
+	assert_non_null(sketch);
+	assert_non_null(sketch2);
+
+	for (int i = 1; i <= 1000; ++i) {
+		rb_sketch_add(i % 2 ? sketch : sketch2, i);
+	}
+	rb_sketch_merge(sketch, sketch2);
+	rb_sketch_done(sketch2);
+
+	assert_int_equal(rb_sketch_count(sketch), 1000);
+
+	static const double quantiles[] = {0.1, 0.5, 0.9, 0.99};
+	for (size_t i = 0; i < RD_ARRAYSIZE(quantiles); ++i) {
+		const double expected = quantiles[i] * 1000;
+		const double actual = rb_sketch_quantile(sketch, quantiles[i]);
+		assert_true(fabs(actual - expected) <= 2 * accuracy * expected);
+	}
+
+	rb_sketch_done(sketch);
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_split_ops),
+			cmocka_unit_test(test_sketch),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,238 @@
+#include "config.h"
+
+#include "rb_stats.h"
+
+#include <json-c/json.h>
+#include <librd/rd.h>
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#define STATS_THREADS 4
+#define STATS_THREAD_INCREMENTS 1000
+
+static void *stats_thread(void *unused) {
+	(void)unused;
+	for (size_t i = 0; i < STATS_THREAD_INCREMENTS; ++i) {
+		rb_stats_counter_inc(RB_STATS_C__SENSORS_PROCESSED);
+	}
+	rb_stats_histogram_add(RB_STATS_H__SNMP_RTT, 100);
+	return NULL;
+}
+
+/** Counters of all threads must be aggregated */
+static void test_stats_threads() {
+	struct rb_stats_snapshot *before = calloc(1, sizeof(*before));
+	struct rb_stats_snapshot *after = calloc(1, sizeof(*after));
+	pthread_t threads[STATS_THREADS];
+	assert_non_null(before);
+	assert_non_null(after);
+
+	rb_stats_snapshot(before);
+	for (size_t i = 0; i < RD_ARRAYSIZE(threads); ++i) {
+		assert_int_equal(0,
+				 pthread_create(&threads[i],
+						NULL,
+						stats_thread,
+						NULL));
+	}
+	for (size_t i = 0; i < RD_ARRAYSIZE(threads); ++i) {
+		pthread_join(threads[i], NULL);
+	}
+	rb_stats_snapshot(after);
+
+	assert_int_equal(after->counters[RB_STATS_C__SENSORS_PROCESSED] -
+					 before->counters
+							 [RB_STATS_C__SENSORS_PROCESSED],
+			 STATS_THREADS * STATS_THREAD_INCREMENTS);
+	assert_int_equal(rb_stats_counter(RB_STATS_C__SENSORS_PROCESSED),
+			 after->counters[RB_STATS_C__SENSORS_PROCESSED]);
+	assert_int_equal(after->histograms[RB_STATS_H__SNMP_RTT].count -
+					 before->histograms[RB_STATS_H__SNMP_RTT]
+							 .count,
+			 STATS_THREADS);
+
+	free(before);
+	free(after);
+	rb_stats_done();
+}
+
+/** Histogram quantiles must be within histogram relative error */
+static void test_stats_histogram() {
+	struct rb_stats_snapshot *snapshot = calloc(1, sizeof(*snapshot));
+	assert_non_null(snapshot);
+
+	for (uint64_t i = 1; i <= 10000; ++i) {
+		rb_stats_histogram_add(RB_STATS_H__PRINT, i);
+	}
+	rb_stats_snapshot(snapshot);
+
+	const struct rb_stats_histogram_data *h =
+			&snapshot->histograms[RB_STATS_H__PRINT];
+	assert_int_equal(h->count, 10000);
+	assert_int_equal(h->sum, 10000 * 10001 / 2);
+
+	static const double quantiles[] = {0.5, 0.9, 0.99, 1};
+	for (size_t i = 0; i < RD_ARRAYSIZE(quantiles); ++i) {
+		const double expected = quantiles[i] * 10000;
+		const double actual = (double)rb_stats_histogram_quantile(
+				h, quantiles[i]);
+		assert_true(actual >= expected * (1 - 1. / 16));
+		assert_true(actual <= expected * (1 + 1. / 16));
+	}
+
+	free(snapshot);
+	rb_stats_done();
+}
+
+/** Stats messages contains the values recorded between snapshots */
+static void test_stats_print() {
+	struct rb_stats_snapshot *prev = calloc(1, sizeof(*prev));
+	struct rb_stats_snapshot *curr = calloc(1, sizeof(*curr));
+	assert_non_null(prev);
+	assert_non_null(curr);
+
+	rb_stats_counter_inc(RB_STATS_C__PRODUCE_ERRORS);
+	rb_stats_snapshot(prev);
+	rb_stats_counter_add(RB_STATS_C__PRODUCE_ERRORS, 3);
+	rb_stats_gauge_set(RB_STATS_G__QUEUE_DEPTH, 7);
+	rb_stats_histogram_add(RB_STATS_H__PRODUCE, 10);
+	rb_stats_snapshot(curr);
+
+	rb_message_array_t *msgs =
+			rb_stats_print(curr, prev, "collector-1", 1000);
+	assert_non_null(msgs);
+	assert_int_equal(msgs->count,
+			 RB_STATS_C__MAX + RB_STATS_G__MAX + RB_STATS_H__MAX);
+
+	static const struct {
+		const char *monitor;
+		int64_t value;
+	} expected[] = {
+			{"rb_monitor_produce_errors", 3},
+			{"rb_monitor_queue_depth", 7},
+			{"rb_monitor_produce_time", 10},
+	};
+	size_t found = 0;
+	for (size_t i = 0; i < msgs->count; ++i) {
+		json_object *msg = json_tokener_parse(msgs->msgs[i].payload);
+		json_object *monitor = NULL, *value = NULL, *sensor = NULL;
+		assert_non_null(msg);
+		assert_true(json_object_object_get_ex(msg, "monitor", &monitor));
+		assert_true(json_object_object_get_ex(msg, "value", &value));
+		assert_true(json_object_object_get_ex(
+				msg, "sensor_name", &sensor));
+		assert_string_equal(json_object_get_string(sensor),
+				    "collector-1");
+
+		for (size_t j = 0; j < RD_ARRAYSIZE(expected); ++j) {
+			if (0 == strcmp(json_object_get_string(monitor),
+					expected[j].monitor)) {
+				assert_int_equal(json_object_get_int64(value),
+						 expected[j].value);
+				found++;
+			}
+		}
+
+		json_object_put(msg);
+		free(msgs->msgs[i].payload);
+	}
+	assert_int_equal(found, RD_ARRAYSIZE(expected));
+
+	message_array_done(msgs);
+	free(prev);
+	free(curr);
+	rb_stats_done();
+}
+
+/** Task cost only contains the current thread activity during the task */
+static void test_stats_cost() {
+	struct rb_stats_cost cost;
+
+	rb_stats_counter_add(RB_STATS_C__MESSAGES, 5);
+	rb_stats_cost_start(&cost);
+	rb_stats_counter_add(RB_STATS_C__MESSAGES, 2);
+	rb_stats_counter_add(RB_STATS_C__BYTES, 100);
+	rb_stats_counter_add(RB_STATS_C__SNMP_REQUESTS, 3);
+	rb_stats_counter_inc(RB_STATS_C__SNMP_TIMEOUTS);
+	rb_stats_counter_inc(RB_STATS_C__SYSTEM_ERRORS);
+	rb_stats_cost_end(&cost);
+
+	assert_int_equal(cost.count, 1);
+	assert_int_equal(cost.messages, 2);
+	assert_int_equal(cost.bytes, 100);
+	assert_int_equal(cost.snmp_requests, 3);
+	assert_int_equal(cost.errors, 2);
+	assert_true(cost.cpu_time_us <= cost.wall_time_us + 1000);
+
+	rb_stats_done();
+}
+
+/** Sensors costs messages keep the given order as rank */
+static void test_stats_print_costs() {
+	const struct rb_stats_named_cost costs[] = {
+			{.name = "slow",
+			 .cost = {.count = 2,
+				  .wall_time_us = 3000,
+				  .snmp_requests = 20,
+				  .errors = 1}},
+			{.name = "fast", .cost = {.count = 2, .wall_time_us = 10}},
+	};
+
+	rb_message_array_t *msgs = rb_stats_print_costs(
+			costs, RD_ARRAYSIZE(costs), "collector-1", 1000);
+	assert_non_null(msgs);
+	assert_int_equal(msgs->count, RD_ARRAYSIZE(costs));
+
+	for (size_t i = 0; i < msgs->count; ++i) {
+		json_object *msg = json_tokener_parse(msgs->msgs[i].payload);
+		json_object *val = NULL;
+		assert_non_null(msg);
+
+		assert_true(json_object_object_get_ex(msg, "monitor", &val));
+		assert_string_equal(json_object_get_string(val),
+				    "rb_monitor_sensor_cost");
+		assert_true(json_object_object_get_ex(msg, "sensor_name", &val));
+		assert_string_equal(json_object_get_string(val),
+				    costs[i].name);
+		assert_true(json_object_object_get_ex(msg, "value", &val));
+		assert_int_equal(json_object_get_int64(val),
+				 costs[i].cost.wall_time_us);
+		assert_true(json_object_object_get_ex(msg, "polls", &val));
+		assert_int_equal(json_object_get_int64(val), 2);
+		assert_true(json_object_object_get_ex(
+				msg, "snmp_requests", &val));
+		assert_int_equal(json_object_get_int64(val),
+				 costs[i].cost.snmp_requests);
+		assert_true(json_object_object_get_ex(msg, "rank", &val));
+		assert_int_equal(json_object_get_int64(val), i + 1);
+		assert_true(json_object_object_get_ex(msg, "collector", &val));
+		assert_string_equal(json_object_get_string(val),
+				    "collector-1");
+
+		json_object_put(msg);
+		free(msgs->msgs[i].payload);
+	}
+
+	message_array_done(msgs);
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_stats_threads),
+			cmocka_unit_test(test_stats_histogram),
+			cmocka_unit_test(test_stats_print),
+			cmocka_unit_test(test_stats_cost),
+			cmocka_unit_test(test_stats_print_costs),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,111 @@
+#include "config.h"
+
+#include "rb_admin.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+static const char ADMIN_TEST_STATUS[] = "{\"sensors\":[]}";
+
+static char *admin_test_status(void *opaque) {
+	size_t *calls = opaque;
+	(*calls)++;
+	return strdup(ADMIN_TEST_STATUS);
+}
+
+/** Connect to admin socket and read all the answer
+  @param path Socket path
+  @param buf Buffer to store answer
+  @param bufsiz Buffer size
+  */
+static void admin_test_query(const char *path, char *buf, size_t bufsiz) {
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	strcpy(addr.sun_path, path);
+
+	const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	assert_true(fd >= 0);
+	assert_int_equal(0,
+			 connect(fd, (struct sockaddr *)&addr, sizeof(addr)));
+
+	size_t len = 0;
+	ssize_t rc;
+	while ((rc = read(fd, &buf[len], bufsiz - len - 1)) > 0) {
+		len += (size_t)rc;
+	}
+	buf[len] = '\0';
+	close(fd);
+}
+
+/** Every connection is answered with current status, and socket is removed
+  at the end */
+static void test_admin() {
+	char path[] = "/tmp/rb_monitor_admin_XXXXXX";
+	const int fd = mkstemp(path);
+	assert_true(fd >= 0);
+	close(fd);
+	unlink(path);
+
+	size_t calls = 0;
+	struct rb_admin *admin = rb_admin_new(path, admin_test_status, &calls);
+	assert_non_null(admin);
+
+	struct stat st;
+	assert_int_equal(0, lstat(path, &st));
+	assert_int_equal(S_IRUSR | S_IWUSR, st.st_mode & 0777);
+
+	for (size_t i = 0; i < 2; ++i) {
+		char buf[BUFSIZ];
+		admin_test_query(path, buf, sizeof(buf));
+		assert_string_equal(buf, "{\"sensors\":[]}\n");
+	}
+	assert_int_equal(calls, 2);
+
+	rb_admin_done(admin);
+
+	assert_int_not_equal(0, stat(path, &st));
+}
+
+/** Files that are not sockets are not removed */
+static void test_admin_not_socket() {
+	char path[] = "/tmp/rb_monitor_admin_XXXXXX";
+	const int fd = mkstemp(path);
+	assert_true(fd >= 0);
+	close(fd);
+
+	assert_null(rb_admin_new(path, admin_test_status, NULL));
+
+	struct stat st;
+	assert_int_equal(0, lstat(path, &st));
+	assert_true(S_ISREG(st.st_mode));
+	unlink(path);
+}
+
+/** Too long paths are rejected */
+static void test_admin_long_path() {
+	char path[sizeof(((struct sockaddr_un *)NULL)->sun_path) + 1];
+	memset(path, 'a', sizeof(path) - 1);
+	path[sizeof(path) - 1] = '\0';
+
+	assert_null(rb_admin_new(path, admin_test_status, NULL));
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_admin),
+			cmocka_unit_test(test_admin_long_path),
+			cmocka_unit_test(test_admin_not_socket),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
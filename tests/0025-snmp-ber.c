@@ -0,0 +1,132 @@
+#include "config.h"
+
+#include "tools/snmp_sim/snmp_ber.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+/// v2c GET of sysUpTime.0 and ifInOctets.1, community public, request id 42
+static const uint8_t GET_REQUEST[] = {
+		0x30, 0x37, 0x02, 0x01, 0x01, 0x04, 0x06, 'p',  'u',  'b',
+		'l',  'i',  'c',  0xa0, 0x2a, 0x02, 0x01, 0x2a, 0x02, 0x01,
+		0x00, 0x02, 0x01, 0x00, 0x30, 0x1f, 0x30, 0x0c, 0x06, 0x08,
+		0x2b, 0x06, 0x01, 0x02, 0x01, 0x01, 0x03, 0x00, 0x05, 0x00,
+		0x30, 0x0f, 0x06, 0x0b, 0x2b, 0x06, 0x01, 0x02, 0x01, 0x02,
+		0x02, 0x01, 0x0a, 0x81, 0x00, 0x05, 0x00,
+};
+
+/** Requests are decoded */
+static void test_snmp_ber_decode() {
+	struct snmp_ber_request req;
+	struct snmp_ber_oid expected;
+	char buf[BUFSIZ];
+
+	assert_true(snmp_ber_decode_request(
+			GET_REQUEST, sizeof(GET_REQUEST), &req));
+	assert_int_equal(req.version, SNMP_BER_VERSION_2c);
+	assert_int_equal(req.community_len, strlen("public"));
+	assert_memory_equal(req.community, "public", strlen("public"));
+	assert_int_equal(req.pdu_type, SNMP_BER_GET);
+	assert_int_equal(req.request_id, 42);
+	assert_int_equal(req.varbinds_count, 2);
+
+	assert_true(snmp_ber_oid_parse(".1.3.6.1.2.1.1.3.0", &expected));
+	assert_int_equal(0, snmp_ber_oid_cmp(&req.oids[0], &expected));
+	assert_string_equal(
+			snmp_ber_oid_print(&req.oids[1], buf, sizeof(buf)),
+			"1.3.6.1.2.1.2.2.1.10.128");
+}
+
+/** Truncated or invalid requests are rejected */
+static void test_snmp_ber_decode_invalid() {
+	struct snmp_ber_request req;
+	uint8_t request[sizeof(GET_REQUEST)];
+
+	for (size_t i = 0; i < sizeof(GET_REQUEST); ++i) {
+		assert_false(snmp_ber_decode_request(GET_REQUEST, i, &req));
+	}
+
+	/* SET requests are not answered */
+	memcpy(request, GET_REQUEST, sizeof(request));
+	request[13] = SNMP_BER_SET;
+	assert_false(snmp_ber_decode_request(request, sizeof(request), &req));
+}
+
+/** Responses are encoded with minimal integers, and decoded back */
+static void test_snmp_ber_encode() {
+	static const uint8_t expected[] = {
+			0x30, 0x3e, 0x02, 0x01, 0x01, 0x04, 0x06, 'p',  'u',
+			'b',  'l',  'i',  'c',  0xa2, 0x31, 0x02, 0x01, 0x2a,
+			0x02, 0x01, 0x00, 0x02, 0x01, 0x00, 0x30, 0x26, 0x30,
+			0x0f, 0x06, 0x08, 0x2b, 0x06, 0x01, 0x02, 0x01, 0x01,
+			0x03, 0x00, 0x43, 0x03, 0x00, 0x80, 0x00, 0x30, 0x13,
+			0x06, 0x0b, 0x2b, 0x06, 0x01, 0x02, 0x01, 0x02, 0x02,
+			0x01, 0x0a, 0x81, 0x00, 0x02, 0x04, 0xff, 0x00, 0x00,
+			0x00,
+	};
+	struct snmp_ber_request req;
+	uint8_t buf[BUFSIZ];
+
+	assert_true(snmp_ber_decode_request(
+			GET_REQUEST, sizeof(GET_REQUEST), &req));
+	const struct snmp_ber_oid *oids[] = {&req.oids[0], &req.oids[1]};
+	const struct snmp_ber_value values[] = {
+			{.type = SNMP_BER_TIMETICKS, .unsigned_integer = 0x8000},
+			{.type = SNMP_BER_INTEGER, .integer = -0x1000000},
+	};
+
+	const size_t len = snmp_ber_encode_response(
+			buf, sizeof(buf), &req, 0, 0, oids, values, 2);
+	assert_int_equal(len, sizeof(expected));
+	assert_memory_equal(buf, expected, sizeof(expected));
+
+	/* Not enough space */
+	assert_int_equal(0,
+			 snmp_ber_encode_response(buf,
+						  sizeof(expected) - 1,
+						  &req,
+						  0,
+						  0,
+						  oids,
+						  values,
+						  2));
+}
+
+/** OIDs are sorted lexicographically */
+static void test_snmp_ber_oid_cmp() {
+	static const char *oids[] = {
+			"1.3.6.1.2.1.1", "1.3.6.1.2.1.1.3.0", "1.3.6.1.2.1.2",
+			"1.3.6.1.2.1.10",
+	};
+	struct snmp_ber_oid a, b;
+
+	for (size_t i = 1; i < sizeof(oids) / sizeof(oids[0]); ++i) {
+		assert_true(snmp_ber_oid_parse(oids[i - 1], &a));
+		assert_true(snmp_ber_oid_parse(oids[i], &b));
+		assert_true(snmp_ber_oid_cmp(&a, &b) < 0);
+		assert_true(snmp_ber_oid_cmp(&b, &a) > 0);
+		assert_int_equal(0, snmp_ber_oid_cmp(&a, &a));
+	}
+
+	assert_false(snmp_ber_oid_parse("1", &a));
+	assert_false(snmp_ber_oid_parse("1.3.a", &a));
+	assert_false(snmp_ber_oid_parse("1..3", &a));
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_snmp_ber_decode),
+			cmocka_unit_test(test_snmp_ber_decode_invalid),
+			cmocka_unit_test(test_snmp_ber_encode),
+			cmocka_unit_test(test_snmp_ber_oid_cmp),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,131 @@
+#include "config.h"
+
+#include "rb_hash_ring.h"
+
+#include <librd/rd.h>
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#define HASH_RING_TEST_KEYS 10000
+
+static const char *HASH_RING_TEST_MEMBERS[] = {
+		"rb-monitor-1", "rb-monitor-2", "rb-monitor-3", "rb-monitor-4",
+};
+
+/** Owner of the i-th test key
+  @param ring Hash ring
+  @param i Key number
+  @return Owner
+  */
+static const char *test_key_owner(const struct rb_hash_ring *ring, size_t i) {
+	char key[64];
+	const int key_len = snprintf(key, sizeof(key), "sensor-%zu", i);
+	return rb_hash_ring_owner(ring, key, (size_t)key_len);
+}
+
+/** Owners do not depend on members order or duplicates, and keys are spread
+  among all members */
+static void test_hash_ring_owners() {
+	const char *reversed[RD_ARRAYSIZE(HASH_RING_TEST_MEMBERS) + 1];
+	size_t owned[RD_ARRAYSIZE(HASH_RING_TEST_MEMBERS)] = {0};
+
+	for (size_t i = 0; i < RD_ARRAYSIZE(HASH_RING_TEST_MEMBERS); ++i) {
+		reversed[i] = HASH_RING_TEST_MEMBERS
+				[RD_ARRAYSIZE(HASH_RING_TEST_MEMBERS) - i - 1];
+	}
+	reversed[RD_ARRAYSIZE(HASH_RING_TEST_MEMBERS)] =
+			HASH_RING_TEST_MEMBERS[0];
+
+	struct rb_hash_ring *ring = rb_hash_ring_new(
+			HASH_RING_TEST_MEMBERS,
+			RD_ARRAYSIZE(HASH_RING_TEST_MEMBERS),
+			RB_HASH_RING_DEFAULT_VNODES);
+	struct rb_hash_ring *ring2 =
+			rb_hash_ring_new(reversed,
+					 RD_ARRAYSIZE(reversed),
+					 RB_HASH_RING_DEFAULT_VNODES);
+	assert_non_null(ring);
+	assert_non_null(ring2);
+	assert_int_equal(rb_hash_ring_members(ring2),
+			 RD_ARRAYSIZE(HASH_RING_TEST_MEMBERS));
+
+	for (size_t i = 0; i < HASH_RING_TEST_KEYS; ++i) {
+		const char *owner = test_key_owner(ring, i);
+		assert_string_equal(owner, test_key_owner(ring2, i));
+		for (size_t j = 0; j < RD_ARRAYSIZE(HASH_RING_TEST_MEMBERS);
+		     ++j) {
+			if (0 == strcmp(owner, HASH_RING_TEST_MEMBERS[j])) {
+				owned[j]++;
+			}
+		}
+	}
+
+	/* Every member should own 1/4 of keys. Allow a wide margin */
+	for (size_t i = 0; i < RD_ARRAYSIZE(owned); ++i) {
+		assert_true(owned[i] > HASH_RING_TEST_KEYS / 8);
+		assert_true(owned[i] < HASH_RING_TEST_KEYS / 2);
+	}
+
+	rb_hash_ring_done(ring);
+	rb_hash_ring_done(ring2);
+}
+
+/** Adding a member only moves keys to it */
+static void test_hash_ring_add_member() {
+	const size_t members = RD_ARRAYSIZE(HASH_RING_TEST_MEMBERS);
+	struct rb_hash_ring *ring =
+			rb_hash_ring_new(HASH_RING_TEST_MEMBERS,
+					 members - 1,
+					 RB_HASH_RING_DEFAULT_VNODES);
+	struct rb_hash_ring *ring2 =
+			rb_hash_ring_new(HASH_RING_TEST_MEMBERS,
+					 members,
+					 RB_HASH_RING_DEFAULT_VNODES);
+	size_t moved = 0;
+	assert_non_null(ring);
+	assert_non_null(ring2);
+
+	for (size_t i = 0; i < HASH_RING_TEST_KEYS; ++i) {
+		const char *before = test_key_owner(ring, i);
+		const char *after = test_key_owner(ring2, i);
+		if (0 != strcmp(before, after)) {
+			assert_string_equal(after,
+					    HASH_RING_TEST_MEMBERS[members - 1]);
+			moved++;
+		}
+	}
+
+	assert_true(moved > HASH_RING_TEST_KEYS / 8);
+	assert_true(moved < HASH_RING_TEST_KEYS / 2);
+
+	rb_hash_ring_done(ring);
+	rb_hash_ring_done(ring2);
+}
+
+/** Empty rings have no owners */
+static void test_hash_ring_empty() {
+	struct rb_hash_ring *ring = rb_hash_ring_new(
+			NULL, 0, RB_HASH_RING_DEFAULT_VNODES);
+	assert_non_null(ring);
+	assert_int_equal(0, rb_hash_ring_members(ring));
+	assert_null(rb_hash_ring_owner(ring, "key", strlen("key")));
+	rb_hash_ring_done(ring);
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_hash_ring_owners),
+			cmocka_unit_test(test_hash_ring_add_member),
+			cmocka_unit_test(test_hash_ring_empty),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
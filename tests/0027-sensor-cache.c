@@ -0,0 +1,105 @@
+#include "config.h"
+
+#include "rb_sensor_cache.h"
+
+#include <librd/rd.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#include <stdarg.h>
+#include <string.h>
+
+// clang-format off
+#define SENSOR_CACHE_TEST_SENSOR(name, echo) "{"                               \
+	"\"sensor_id\":1,"                                                     \
+	"\"timeout\":2,"                                                       \
+	"\"sensor_name\": \"" name "\","                                       \
+	"\"sensor_ip\": \"localhost\","                                        \
+	"\"community\" : \"public\","                                          \
+	"\"monitors\": ["                                                      \
+		"{\"name\": \"load_1\", \"system\": \"echo " echo "\","        \
+		"\"unit\": \"%\"}"                                             \
+	"]}"
+// clang-format on
+
+/** Get a sensor from the cache
+  @param cache Sensors cache
+  @param worker_info Worker info
+  @param cjson_sensor Sensor definition
+  @param now Current time
+  @return Sensor
+  */
+static rb_sensor_t *cache_get(struct rb_sensor_cache *cache,
+			      const struct _worker_info *worker_info,
+			      const char *cjson_sensor,
+			      time_t now) {
+	json_object *json_sensor = json_tokener_parse(cjson_sensor);
+	assert_non_null(json_sensor);
+	rb_sensor_t *ret =
+			rb_sensor_cache_get(cache, json_sensor, worker_info, now);
+	json_object_put(json_sensor);
+	return ret;
+}
+
+/** Same definitions return the same sensor, changed ones a new one, and
+  unseen ones are evicted */
+static void test_sensor_cache() {
+	struct _worker_info worker_info;
+	memset(&worker_info, 0, sizeof(worker_info));
+	snmp_sess_init(&worker_info.default_session);
+
+	struct rb_sensor_cache *cache = rb_sensor_cache_new();
+	assert_non_null(cache);
+
+	rb_sensor_t *a = cache_get(cache,
+				   &worker_info,
+				   SENSOR_CACHE_TEST_SENSOR("a", "1"),
+				   1);
+	rb_sensor_t *b = cache_get(cache,
+				   &worker_info,
+				   SENSOR_CACHE_TEST_SENSOR("b", "1"),
+				   1);
+	rb_sensor_t *a2 = cache_get(cache,
+				    &worker_info,
+				    SENSOR_CACHE_TEST_SENSOR("a", "1"),
+				    2);
+	rb_sensor_t *a3 = cache_get(cache,
+				    &worker_info,
+				    SENSOR_CACHE_TEST_SENSOR("a", "2"),
+				    2);
+	assert_non_null(a);
+	assert_non_null(b);
+	assert_true(a != b);
+	assert_true(a == a2);
+	assert_true(a != a3);
+	assert_int_equal(rb_sensor_cache_count(cache), 3);
+
+	/* Invalid sensors are not cached */
+	assert_null(cache_get(cache, &worker_info, "{}", 2));
+	assert_null(cache_get(cache,
+			      &worker_info,
+			      "{\"sensor_id\":1,\"sensor_ip\":\"localhost\"}",
+			      2));
+	assert_int_equal(rb_sensor_cache_count(cache), 3);
+
+	/* b was only seen at time 1 */
+	assert_int_equal(rb_sensor_cache_evict(cache, 2), 1);
+	assert_int_equal(rb_sensor_cache_count(cache), 2);
+	assert_string_equal(rb_sensor_name(b), "b");
+
+	rb_sensor_put(a);
+	rb_sensor_put(a2);
+	rb_sensor_put(a3);
+	rb_sensor_put(b);
+	rb_sensor_cache_done(cache);
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_sensor_cache),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
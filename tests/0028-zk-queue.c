@@ -0,0 +1,612 @@
+#include "config.h"
+
+#ifdef HAVE_ZOOKEEPER
+#include "rb_zk.h"
+#include "zk_fake.h"
+#endif
+
+#include <librd/rd.h>
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#ifdef HAVE_ZOOKEEPER
+
+#define ZK_QUEUE_TEST_PATH "/rb_monitor/sensors"
+#define ZK_QUEUE_TEST_ELEMENT ZK_QUEUE_TEST_PATH "/sensor_"
+#define ZK_QUEUE_TEST_CLAIMS "/rb_monitor/claims"
+#define ZK_QUEUE_TEST_STOP "stop"
+
+#define ZK_QUEUE_TEST_POPPERS 4
+#define ZK_QUEUE_TEST_ELEMENTS 200
+#define ZK_QUEUE_TEST_BATCH 50
+/// Simulated network latency
+#define ZK_QUEUE_TEST_LATENCY_US 100
+/// Max time to wait for a condition
+#define ZK_QUEUE_TEST_TIMEOUT_MS 10000
+
+/// Queue test shared state, accessed from every rb_zk thread
+struct queue_test {
+	pthread_mutex_t lock;
+	size_t popped[ZK_QUEUE_TEST_ELEMENTS]; ///< Times every element popped
+	/// Every element push time
+	struct timespec pushed_at[ZK_QUEUE_TEST_ELEMENTS];
+	uint64_t latency_us[ZK_QUEUE_TEST_ELEMENTS]; ///< Push to pop latency
+	size_t total_popped; ///< Popped elements, without stop ones
+	size_t pushes;	     ///< Completed push transactions
+	size_t errors;	     ///< Queue errors
+};
+
+/// Queue test consumer
+struct queue_test_popper {
+	struct queue_test *test;
+	char *host;
+	struct rb_zk *zk;
+	size_t popped; ///< Popped elements
+	bool crash;    ///< Expire session at next element, without popping it
+	bool crashed;  ///< Session expired while popping an element
+	bool stopped;  ///< Popped a stop element
+	bool done;     ///< Last pop completed
+};
+
+static int64_t timespec_diff_us(const struct timespec *end,
+				const struct timespec *begin) {
+	return (int64_t)(end->tv_sec - begin->tv_sec) * 1000000 +
+	       (end->tv_nsec - begin->tv_nsec) / 1000;
+}
+
+/** Wait until a condition is true
+  @param cond Condition
+  @param opaque Condition opaque
+  @return true if condition was true before timeout
+  */
+static bool wait_for(bool (*cond)(void *opaque), void *opaque) {
+	for (int i = 0; i < ZK_QUEUE_TEST_TIMEOUT_MS; ++i) {
+		if (cond(opaque)) {
+			return true;
+		}
+		usleep(1000);
+	}
+
+	return cond(opaque);
+}
+
+static struct queue_test_popper *popper_cast(const void *opaque) {
+	struct queue_test_popper *popper = NULL;
+	memcpy(&popper, &opaque, sizeof(popper));
+	return popper;
+}
+
+static void popper_pop(struct queue_test_popper *popper);
+
+static void popper_error_cb(struct rb_zk *rb_zk,
+			    struct rb_zk_queue_element *elm,
+			    const char *cause,
+			    int rc,
+			    void *opaque) {
+	struct queue_test_popper *popper = opaque;
+	(void)rb_zk;
+	(void)elm;
+
+	print_message("Queue error: %s (rc=%d)\n", cause, rc);
+	pthread_mutex_lock(&popper->test->lock);
+	popper->test->errors++;
+	popper->done = true;
+	pthread_mutex_unlock(&popper->test->lock);
+}
+
+static void popper_data_cb(int rc,
+			   const char *value,
+			   int value_len,
+			   const struct Stat *stat,
+			   const void *opaque) {
+	struct queue_test_popper *popper = popper_cast(opaque);
+	struct queue_test *test = popper->test;
+	char buf[64];
+	struct timespec now;
+	(void)stat;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	snprintf(buf,
+		 sizeof(buf),
+		 "%.*s",
+		 value_len > 0 ? value_len : 0,
+		 value ? value : "");
+
+	pthread_mutex_lock(&test->lock);
+	if (ZOK != rc) {
+		test->errors++;
+	} else if (popper->crash) {
+		/* Lost connection before processing it */
+		popper->crash = false;
+		popper->crashed = true;
+		zk_fake_expire_session(rb_zk_session_id(popper->zk));
+	} else if (0 == strcmp(buf, ZK_QUEUE_TEST_STOP)) {
+		popper->stopped = true;
+	} else {
+		const size_t i = strtoul(buf, NULL, 10);
+		if (i < ZK_QUEUE_TEST_ELEMENTS) {
+			test->popped[i]++;
+			test->latency_us[i] = (uint64_t)timespec_diff_us(
+					&now, &test->pushed_at[i]);
+			test->total_popped++;
+			popper->popped++;
+		} else {
+			test->errors++;
+		}
+	}
+	pthread_mutex_unlock(&test->lock);
+}
+
+static void popper_delete_cb(int rc, const void *opaque) {
+	struct queue_test_popper *popper = popper_cast(opaque);
+	struct queue_test *test = popper->test;
+
+	pthread_mutex_lock(&test->lock);
+	if (ZOK != rc && !popper->crashed) {
+		test->errors++;
+	}
+	const bool restart = !popper->stopped && !popper->crashed;
+	popper->done = !restart;
+	pthread_mutex_unlock(&test->lock);
+
+	if (restart) {
+		popper_pop(popper);
+	}
+}
+
+/** Pop next queue element
+  @param popper Popper
+  */
+static void popper_pop(struct queue_test_popper *popper) {
+	struct rb_zk_queue_element *qelm =
+			new_queue_element(popper->zk,
+					  ZK_QUEUE_TEST_ELEMENT,
+					  popper_error_cb,
+					  popper_data_cb,
+					  popper_delete_cb,
+					  popper);
+	if (NULL == qelm) {
+		pthread_mutex_lock(&popper->test->lock);
+		popper->test->errors++;
+		popper->done = true;
+		pthread_mutex_unlock(&popper->test->lock);
+		return;
+	}
+
+	rb_zk_queue_claim(popper->zk, qelm, ZK_QUEUE_TEST_CLAIMS);
+}
+
+static void popper_start(struct queue_test_popper *popper,
+			 struct queue_test *test) {
+	memset(popper, 0, sizeof(*popper));
+	popper->test = test;
+	popper->host = strdup("localhost:2181");
+	assert_non_null(popper->host);
+	popper->zk = rb_zk_init(popper->host, 10000);
+	assert_non_null(popper->zk);
+}
+
+static void popper_done(struct queue_test_popper *popper) {
+	rb_zk_done(popper->zk);
+	free(popper->host);
+}
+
+static void queue_test_pushed(int rc, const void *opaque) {
+	struct queue_test *test = popper_cast(opaque)->test;
+
+	pthread_mutex_lock(&test->lock);
+	if (ZOK != rc) {
+		test->errors++;
+	}
+	test->pushes++;
+	pthread_mutex_unlock(&test->lock);
+}
+
+/** Push elements to the test queue in one transaction
+  @param producer Producer
+  @param values Elements
+  @param count Number of elements
+  */
+static void queue_test_push(struct queue_test_popper *producer,
+			    const char *const *values,
+			    size_t count) {
+	int values_len[ZK_QUEUE_TEST_BATCH];
+	assert_true(count <= ZK_QUEUE_TEST_BATCH);
+	for (size_t i = 0; i < count; ++i) {
+		values_len[i] = (int)strlen(values[i]);
+	}
+
+	const int rc = rb_zk_queue_push_multi(producer->zk,
+					      ZK_QUEUE_TEST_ELEMENT,
+					      values,
+					      values_len,
+					      count,
+					      queue_test_pushed,
+					      producer);
+	assert_int_equal(ZOK, rc);
+}
+
+/** Push stop elements, so poppers end
+  @param producer Producer
+  @param count Number of stop elements
+  */
+static void queue_test_push_stop(struct queue_test_popper *producer,
+				 size_t count) {
+	const char *values[ZK_QUEUE_TEST_POPPERS];
+	assert_true(count <= ZK_QUEUE_TEST_POPPERS);
+	for (size_t i = 0; i < count; ++i) {
+		values[i] = ZK_QUEUE_TEST_STOP;
+	}
+	queue_test_push(producer, values, count);
+}
+
+static void queue_test_init(struct queue_test *test,
+			    struct queue_test_popper *producer) {
+	zk_fake_reset();
+	memset(test, 0, sizeof(*test));
+	pthread_mutex_init(&test->lock, NULL);
+
+	popper_start(producer, test);
+	rb_zk_create_recursive_node(producer->zk, ZK_QUEUE_TEST_PATH, 0);
+	rb_zk_create_recursive_node(producer->zk, ZK_QUEUE_TEST_CLAIMS, 0);
+}
+
+/// Test all elements are popped
+static bool all_popped(void *vtest) {
+	struct queue_test *test = vtest;
+	pthread_mutex_lock(&test->lock);
+	const bool ret = test->total_popped == ZK_QUEUE_TEST_ELEMENTS;
+	pthread_mutex_unlock(&test->lock);
+	return ret;
+}
+
+/// Test first element is popped
+static bool first_popped(void *vtest) {
+	struct queue_test *test = vtest;
+	pthread_mutex_lock(&test->lock);
+	const bool ret = test->popped[0] > 0;
+	pthread_mutex_unlock(&test->lock);
+	return ret;
+}
+
+/// Test popper has completed its last pop
+static bool popper_is_done(void *vpopper) {
+	struct queue_test_popper *popper = vpopper;
+	pthread_mutex_lock(&popper->test->lock);
+	const bool ret = popper->done;
+	pthread_mutex_unlock(&popper->test->lock);
+	return ret;
+}
+
+/// Test there are no claims
+static bool no_claims(void *unused) {
+	(void)unused;
+	return 0 == zk_fake_children_count(ZK_QUEUE_TEST_CLAIMS);
+}
+
+static int uint64_cmp(const void *va, const void *vb) {
+	const uint64_t *a = va, *b = vb;
+	return *a < *b ? -1 : *a > *b;
+}
+
+/// Session watcher events
+struct fake_test_events {
+	pthread_mutex_t lock;
+	size_t child_events;   ///< Children watches triggered
+	size_t expired_events; ///< Session expired events
+};
+
+static void fake_test_watcher(zhandle_t *zh,
+			      int type,
+			      int state,
+			      const char *path,
+			      void *ctx) {
+	struct fake_test_events *events = ctx;
+	(void)zh;
+	(void)path;
+
+	pthread_mutex_lock(&events->lock);
+	if (ZOO_CHILD_EVENT == type) {
+		events->child_events++;
+	} else if (ZOO_SESSION_EVENT == type &&
+		   ZOO_EXPIRED_SESSION_STATE == state) {
+		events->expired_events++;
+	}
+	pthread_mutex_unlock(&events->lock);
+}
+
+/// Test two child events were received
+static bool fake_test_child_events(void *vevents) {
+	struct fake_test_events *events = vevents;
+	pthread_mutex_lock(&events->lock);
+	const bool ret = events->child_events == 2;
+	pthread_mutex_unlock(&events->lock);
+	return ret;
+}
+
+/// Test an expired session event was received
+static bool fake_test_expired_event(void *vevents) {
+	struct fake_test_events *events = vevents;
+	pthread_mutex_lock(&events->lock);
+	const bool ret = events->expired_events == 1;
+	pthread_mutex_unlock(&events->lock);
+	return ret;
+}
+
+/** Fake ensemble keeps sequence numbers, deletes ephemeral nodes of expired
+  sessions and fires watches once */
+static void test_zk_fake() {
+	struct fake_test_events events, events2;
+	struct String_vector children;
+	char path[64];
+
+	zk_fake_reset();
+	memset(&events, 0, sizeof(events));
+	memset(&events2, 0, sizeof(events2));
+	pthread_mutex_init(&events.lock, NULL);
+	pthread_mutex_init(&events2.lock, NULL);
+
+	zhandle_t *zh = zookeeper_init("localhost:2181",
+				       fake_test_watcher,
+				       10000,
+				       NULL,
+				       &events,
+				       0);
+	zhandle_t *zh2 = zookeeper_init("localhost:2181",
+					fake_test_watcher,
+					10000,
+					NULL,
+					&events2,
+					0);
+	assert_non_null(zh);
+	assert_non_null(zh2);
+	assert_true(zoo_client_id(zh)->client_id !=
+		    zoo_client_id(zh2)->client_id);
+
+	assert_int_equal(ZOK,
+			 zoo_create(zh,
+				    "/queue",
+				    NULL,
+				    -1,
+				    &ZOO_OPEN_ACL_UNSAFE,
+				    0,
+				    NULL,
+				    0));
+	assert_int_equal(ZNODEEXISTS,
+			 zoo_create(zh2,
+				    "/queue",
+				    NULL,
+				    -1,
+				    &ZOO_OPEN_ACL_UNSAFE,
+				    0,
+				    NULL,
+				    0));
+	assert_int_equal(ZNONODE,
+			 zoo_create(zh,
+				    "/none/child",
+				    NULL,
+				    -1,
+				    &ZOO_OPEN_ACL_UNSAFE,
+				    0,
+				    NULL,
+				    0));
+
+	/* Sequential nodes */
+	for (int i = 0; i < 2; ++i) {
+		char expected[64];
+		snprintf(expected, sizeof(expected), "/queue/e_%010d", i);
+		assert_int_equal(ZOK,
+				 zoo_create(i ? zh2 : zh,
+					    "/queue/e_",
+					    "a",
+					    1,
+					    &ZOO_OPEN_ACL_UNSAFE,
+					    ZOO_SEQUENCE,
+					    path,
+					    sizeof(path)));
+		assert_string_equal(expected, path);
+	}
+
+	/* Ephemeral nodes */
+	assert_int_equal(ZOK,
+			 zoo_create(zh2,
+				    "/queue/owner",
+				    NULL,
+				    -1,
+				    &ZOO_OPEN_ACL_UNSAFE,
+				    ZOO_EPHEMERAL,
+				    NULL,
+				    0));
+	assert_int_equal(ZOK, zoo_get_children(zh, "/queue", 1, &children));
+	assert_int_equal(3, children.count);
+	deallocate_String_vector(&children);
+
+	/* Expiration deletes them and triggers the watch. Watch is not set
+	anymore, so next delete does not trigger it */
+	assert_true(zk_fake_expire_session(zoo_client_id(zh2)->client_id));
+	assert_false(zk_fake_expire_session(zoo_client_id(zh2)->client_id));
+	assert_true(wait_for(fake_test_expired_event, &events2));
+	assert_int_equal(2, zk_fake_children_count("/queue"));
+	assert_int_equal(ZOK, zoo_delete(zh, "/queue/e_0000000000", -1));
+
+	/* Watching twice only triggers one event */
+	assert_int_equal(ZOK, zoo_get_children(zh, "/queue", 1, &children));
+	deallocate_String_vector(&children);
+	assert_int_equal(ZOK, zoo_get_children(zh, "/queue", 1, &children));
+	deallocate_String_vector(&children);
+	assert_int_equal(ZOK, zoo_delete(zh, "/queue/e_0000000001", -1));
+
+	assert_true(wait_for(fake_test_child_events, &events));
+	usleep(10000);
+	assert_int_equal(2, events.child_events);
+
+	/* Expired session can't do requests */
+	assert_int_equal(ZINVALIDSTATE,
+			 zoo_create(zh2,
+				    "/queue/e_",
+				    NULL,
+				    -1,
+				    &ZOO_OPEN_ACL_UNSAFE,
+				    ZOO_SEQUENCE,
+				    NULL,
+				    0));
+
+	zookeeper_close(zh);
+	zookeeper_close(zh2);
+	assert_int_equal(0, events.expired_events);
+	pthread_mutex_destroy(&events.lock);
+	pthread_mutex_destroy(&events2.lock);
+}
+
+/** Many instances claim queue elements. Every element is popped once, and
+  all instances pop some of them */
+static void test_zk_queue_claim() {
+	struct queue_test test;
+	struct queue_test_popper producer, poppers[ZK_QUEUE_TEST_POPPERS];
+	char values_buf[ZK_QUEUE_TEST_ELEMENTS][16];
+	const char *values[ZK_QUEUE_TEST_ELEMENTS];
+	struct timespec begin, end;
+	struct zk_fake_stats stats;
+
+	queue_test_init(&test, &producer);
+	zk_fake_set_latency(ZK_QUEUE_TEST_LATENCY_US);
+	for (size_t i = 0; i < RD_ARRAYSIZE(poppers); ++i) {
+		popper_start(&poppers[i], &test);
+		popper_pop(&poppers[i]);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (size_t i = 0; i < ZK_QUEUE_TEST_ELEMENTS; ++i) {
+		snprintf(values_buf[i], sizeof(values_buf[i]), "%zu", i);
+		values[i] = values_buf[i];
+	}
+
+	for (size_t i = 0; i < ZK_QUEUE_TEST_ELEMENTS;
+	     i += ZK_QUEUE_TEST_BATCH) {
+		pthread_mutex_lock(&test.lock);
+		for (size_t j = i; j < i + ZK_QUEUE_TEST_BATCH; ++j) {
+			clock_gettime(CLOCK_MONOTONIC, &test.pushed_at[j]);
+		}
+		pthread_mutex_unlock(&test.lock);
+		queue_test_push(&producer, &values[i], ZK_QUEUE_TEST_BATCH);
+	}
+
+	assert_true(wait_for(all_popped, &test));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	queue_test_push_stop(&producer, RD_ARRAYSIZE(poppers));
+	for (size_t i = 0; i < RD_ARRAYSIZE(poppers); ++i) {
+		assert_true(wait_for(popper_is_done, &poppers[i]));
+	}
+
+	zk_fake_get_stats(&stats);
+	size_t min_popped = SIZE_MAX, max_popped = 0;
+	for (size_t i = 0; i < RD_ARRAYSIZE(poppers); ++i) {
+		assert_true(poppers[i].stopped);
+		assert_true(poppers[i].popped > 0);
+		min_popped = RD_MIN(min_popped, poppers[i].popped);
+		max_popped = RD_MAX(max_popped, poppers[i].popped);
+		popper_done(&poppers[i]);
+	}
+
+	for (size_t i = 0; i < ZK_QUEUE_TEST_ELEMENTS; ++i) {
+		assert_int_equal(1, test.popped[i]);
+	}
+	assert_int_equal(0, test.errors);
+	assert_int_equal(0, zk_fake_children_count(ZK_QUEUE_TEST_PATH));
+	assert_int_equal(0, zk_fake_children_count(ZK_QUEUE_TEST_CLAIMS));
+
+	qsort(test.latency_us,
+	      RD_ARRAYSIZE(test.latency_us),
+	      sizeof(test.latency_us[0]),
+	      uint64_cmp);
+	print_message("%d elements, %d poppers: %" PRId64
+		      "us, popped per instance min/max %zu/%zu, latency "
+		      "p50/max %" PRIu64 "/%" PRIu64 "us\n",
+		      ZK_QUEUE_TEST_ELEMENTS,
+		      ZK_QUEUE_TEST_POPPERS,
+		      timespec_diff_us(&end, &begin),
+		      min_popped,
+		      max_popped,
+		      test.latency_us[ZK_QUEUE_TEST_ELEMENTS / 2],
+		      test.latency_us[ZK_QUEUE_TEST_ELEMENTS - 1]);
+	print_message("ZooKeeper requests %" PRIu64 ", creates %" PRIu64
+		      ", deletes %" PRIu64 ", reads %" PRIu64
+		      ", multis %" PRIu64 ", watches %" PRIu64 "\n",
+		      stats.requests,
+		      stats.creates,
+		      stats.deletes,
+		      stats.reads,
+		      stats.multis,
+		      stats.watches);
+
+	popper_done(&producer);
+	pthread_mutex_destroy(&test.lock);
+}
+
+/** An instance that loses its session while popping an element releases its
+  claim, and another instance pops the element */
+static void test_zk_queue_claim_lease() {
+	struct queue_test test;
+	struct queue_test_popper producer, crasher, popper;
+	const char *value = "0";
+
+	queue_test_init(&test, &producer);
+	popper_start(&crasher, &test);
+	crasher.crash = true;
+	popper_pop(&crasher);
+
+	queue_test_push(&producer, &value, 1);
+	assert_true(wait_for(popper_is_done, &crasher));
+	assert_true(wait_for(no_claims, NULL));
+	assert_true(crasher.crashed);
+	assert_int_equal(1, zk_fake_children_count(ZK_QUEUE_TEST_PATH));
+
+	popper_start(&popper, &test);
+	popper_pop(&popper);
+	assert_true(wait_for(first_popped, &test));
+	queue_test_push_stop(&producer, 1);
+	assert_true(wait_for(popper_is_done, &popper));
+
+	assert_true(popper.stopped);
+	assert_int_equal(1, popper.popped);
+	assert_int_equal(1, test.popped[0]);
+	assert_int_equal(0, test.errors);
+	assert_int_equal(0, zk_fake_children_count(ZK_QUEUE_TEST_PATH));
+	assert_int_equal(0, zk_fake_children_count(ZK_QUEUE_TEST_CLAIMS));
+
+	popper_done(&crasher);
+	popper_done(&popper);
+	popper_done(&producer);
+	pthread_mutex_destroy(&test.lock);
+}
+
+#endif
+
+int main() {
+#ifdef HAVE_ZOOKEEPER
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_zk_fake),
+			cmocka_unit_test(test_zk_queue_claim),
+			cmocka_unit_test(test_zk_queue_claim_lease),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+#else
+	return 0;
+#endif
+}
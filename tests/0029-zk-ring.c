@@ -0,0 +1,289 @@
+#include "config.h"
+
+#ifdef HAVE_ZOOKEEPER
+#include "rb_monitor_zk.h"
+#include "rb_sensor.h"
+#include "zk_fake.h"
+#endif
+
+#include <librd/rd.h>
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+#ifdef HAVE_ZOOKEEPER
+
+#define ZK_RING_TEST_MEMBERS_PATH "/rb_monitor/members"
+#define ZK_RING_TEST_INSTANCES 3
+#define ZK_RING_TEST_SENSORS 300
+/// Max time to wait for instances to agree
+#define ZK_RING_TEST_TIMEOUT_MS 10000
+
+/// rb_monitor instance in the hash ring
+struct ring_test_instance {
+	struct rb_monitor_zk *zk;
+	uint64_t generation; ///< Owned sensors generation
+	json_object *owned;  ///< Last owned sensors
+};
+
+/** Test sensors
+  @return Array of ZK_RING_TEST_SENSORS sensors named sensor-<n>
+  */
+static json_object *ring_test_sensors() {
+	json_object *sensors = json_object_new_array();
+	assert_non_null(sensors);
+
+	for (int i = 0; i < ZK_RING_TEST_SENSORS; ++i) {
+		char name[32];
+		json_object *sensor = json_object_new_object();
+		assert_non_null(sensor);
+		snprintf(name, sizeof(name), "sensor-%d", i);
+		json_object_object_add(sensor,
+				       "sensor_name",
+				       json_object_new_string(name));
+		json_object_array_add(sensors, sensor);
+	}
+
+	return sensors;
+}
+
+static void ring_test_instance_start(struct ring_test_instance *instance,
+				     int member,
+				     json_object *sensors,
+				     struct _worker_info *worker_info) {
+	char member_id[32];
+	snprintf(member_id, sizeof(member_id), "member-%d", member);
+	const struct rb_monitor_zk_config config = {
+			.host = strdup("localhost:2181"),
+			.pop_watcher_timeout = 10000,
+			.distribution = RB_MONITOR_ZK_DISTRIBUTION_HASH_RING,
+			.member_id = member_id,
+	};
+
+	memset(instance, 0, sizeof(*instance));
+	assert_non_null(config.host);
+	instance->zk = init_rbmon_zk(&config, sensors, worker_info);
+	assert_non_null(instance->zk);
+}
+
+static void ring_test_instance_stop(struct ring_test_instance *instance) {
+	stop_zk(instance->zk);
+	if (instance->owned) {
+		json_object_put(instance->owned);
+	}
+	memset(instance, 0, sizeof(*instance));
+}
+
+/** Check if running instances own disjoint sets of sensors that cover all
+  of them
+  @param instances Instances. Stopped ones have NULL zk.
+  @param count Number of instances
+  @return true if instances agree
+  */
+static bool ring_test_converged(struct ring_test_instance *instances,
+				size_t count) {
+	size_t owners[ZK_RING_TEST_SENSORS] = {0};
+
+	for (size_t i = 0; i < count; ++i) {
+		if (NULL == instances[i].zk) {
+			continue;
+		}
+
+		json_object *owned = rb_monitor_zk_owned_sensors(
+				instances[i].zk, &instances[i].generation);
+		if (owned) {
+			if (instances[i].owned) {
+				json_object_put(instances[i].owned);
+			}
+			instances[i].owned = owned;
+		}
+
+		if (NULL == instances[i].owned ||
+		    0 == json_object_array_length(instances[i].owned)) {
+			return false;
+		}
+
+		const int owned_count =
+				json_object_array_length(instances[i].owned);
+		for (int j = 0; j < owned_count; ++j) {
+			json_object *sensor = json_object_array_get_idx(
+					instances[i].owned, j);
+			json_object *name = NULL;
+			int n = -1;
+			json_object_object_get_ex(sensor, "sensor_name", &name);
+			sscanf(json_object_get_string(name), "sensor-%d", &n);
+			assert_in_range(n, 0, ZK_RING_TEST_SENSORS - 1);
+			owners[n]++;
+		}
+	}
+
+	for (size_t i = 0; i < RD_ARRAYSIZE(owners); ++i) {
+		if (1 != owners[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/** Wait until instances agree, and print how much it took and sensors
+  distribution
+  @param instances Instances. Stopped ones have NULL zk.
+  @param count Number of instances
+  @param what Description of the event instances react to
+  */
+static void ring_test_wait_converged(struct ring_test_instance *instances,
+				     size_t count,
+				     const char *what) {
+	struct timespec begin, end;
+	bool converged = false;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (int i = 0; !converged && i < ZK_RING_TEST_TIMEOUT_MS; ++i) {
+		converged = ring_test_converged(instances, count);
+		if (!converged) {
+			usleep(1000);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	assert_true(converged);
+
+	size_t min_owned = SIZE_MAX, max_owned = 0, running = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (NULL == instances[i].zk) {
+			continue;
+		}
+
+		const size_t owned = (size_t)json_object_array_length(
+				instances[i].owned);
+		min_owned = RD_MIN(min_owned, owned);
+		max_owned = RD_MAX(max_owned, owned);
+		running++;
+	}
+
+	/* Every instance gets a fair share of sensors */
+	assert_true(min_owned >= ZK_RING_TEST_SENSORS / running / 2);
+
+	print_message("%s: %zu instances agree after %" PRId64
+		      "us, sensors per instance min/max %zu/%zu\n",
+		      what,
+		      running,
+		      (int64_t)(end.tv_sec - begin.tv_sec) * 1000000 +
+				      (end.tv_nsec - begin.tv_nsec) / 1000,
+		      min_owned,
+		      max_owned);
+}
+
+/** Session of a ring member
+  @param zh ZooKeeper handler
+  @param member_id Member id
+  @return Session id of member node, or 0 if it has not joined
+  */
+static int64_t ring_test_member_session(zhandle_t *zh, const char *member_id) {
+	struct String_vector members;
+	int64_t ret = 0;
+
+	const int rc = zoo_get_children(
+			zh, ZK_RING_TEST_MEMBERS_PATH, 0, &members);
+	if (ZOK != rc) {
+		return 0;
+	}
+
+	for (int32_t i = 0; 0 == ret && i < members.count; ++i) {
+		char path[BUFSIZ];
+		struct Stat stat;
+		const size_t member_id_len = strlen(member_id);
+		if (0 != strncmp(members.data[i], member_id, member_id_len) ||
+		    '-' != members.data[i][member_id_len]) {
+			continue;
+		}
+
+		snprintf(path,
+			 sizeof(path),
+			 ZK_RING_TEST_MEMBERS_PATH "/%s",
+			 members.data[i]);
+		if (ZOK == zoo_exists(zh, path, 0, &stat)) {
+			ret = stat.ephemeralOwner;
+		}
+	}
+
+	deallocate_String_vector(&members);
+	return ret;
+}
+
+/** Instances split sensors between them, and agree again when an instance
+  leaves or its session expires */
+static void test_zk_ring() {
+	struct ring_test_instance instances[ZK_RING_TEST_INSTANCES];
+	struct _worker_info worker_info;
+	struct zk_fake_stats stats;
+
+	zk_fake_reset();
+	memset(&worker_info, 0, sizeof(worker_info));
+	json_object *sensors = ring_test_sensors();
+
+	for (size_t i = 0; i < RD_ARRAYSIZE(instances); ++i) {
+		ring_test_instance_start(
+				&instances[i], (int)i, sensors, &worker_info);
+	}
+	ring_test_wait_converged(instances, RD_ARRAYSIZE(instances), "Join");
+
+	ring_test_instance_stop(&instances[0]);
+	ring_test_wait_converged(instances, RD_ARRAYSIZE(instances), "Leave");
+
+	/* Member with an expired session joins again with a new one */
+	zhandle_t *zh = zookeeper_init(
+			"localhost:2181", NULL, 10000, NULL, NULL, 0);
+	assert_non_null(zh);
+	const int64_t session = ring_test_member_session(zh, "member-1");
+	assert_true(0 != session);
+	assert_true(zk_fake_expire_session(session));
+	int64_t new_session = 0;
+	for (int i = 0; i < ZK_RING_TEST_TIMEOUT_MS &&
+			(0 == new_session || session == new_session);
+	     ++i) {
+		usleep(1000);
+		new_session = ring_test_member_session(zh, "member-1");
+	}
+	assert_true(0 != new_session && session != new_session);
+	ring_test_wait_converged(instances, RD_ARRAYSIZE(instances), "Expire");
+	zookeeper_close(zh);
+
+	zk_fake_get_stats(&stats);
+	print_message("ZooKeeper requests %" PRIu64 ", reads %" PRIu64
+		      ", watches %" PRIu64 "\n",
+		      stats.requests,
+		      stats.reads,
+		      stats.watches);
+
+	for (size_t i = 1; i < RD_ARRAYSIZE(instances); ++i) {
+		ring_test_instance_stop(&instances[i]);
+	}
+	json_object_put(sensors);
+}
+
+#endif
+
+int main() {
+#ifdef HAVE_ZOOKEEPER
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_zk_ring),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,315 @@
+#include "config.h"
+
+#include "msgpack_test.h"
+#include "rb_msgpack.h"
+#include "rb_sensor_monitor.h"
+#include "rb_value.h"
+
+#include <librd/rd.h>
+
+#include <json-c/printbuf.h>
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+/** Check that a message has the same keys and values in JSON and
+  MessagePack. Non integer values are strings in JSON and floats in
+  MessagePack, and JSON doubles may be printed with other precision. Columnar
+  row, if any, must be the same as MessagePack message.
+  @param msg Message
+  */
+static void check_message_encodings(const rb_message *msg) {
+	assert_non_null(msg->payload);
+	assert_non_null(msg->msgpack);
+
+	json_object *json = json_tokener_parse(msg->payload);
+	json_object *msgpack =
+			msgpack_test_decode(msg->msgpack, msg->msgpack_len);
+	assert_non_null(json);
+	assert_non_null(msgpack);
+
+	size_t json_keys = 0, msgpack_keys = 0;
+	json_object_object_foreach(msgpack, msgpack_key, msgpack_val) {
+		(void)msgpack_key;
+		(void)msgpack_val;
+		msgpack_keys++;
+	}
+
+	json_object_object_foreach(json, key, val) {
+		json_object *mval = NULL;
+		json_keys++;
+		assert_true(json_object_object_get_ex(msgpack, key, &mval));
+		if (json_type_double == json_object_get_type(mval)) {
+			double expected = json_object_get_double(val);
+			if (json_type_string == json_object_get_type(val)) {
+				expected = atof(json_object_get_string(val));
+			}
+			assert_true(fabs(json_object_get_double(mval) -
+					 expected) < 1e-6);
+		} else {
+			assert_string_equal(json_object_to_json_string(val),
+					    json_object_to_json_string(mval));
+		}
+	}
+
+	assert_int_equal(json_keys, msgpack_keys);
+	if (msg->row) {
+		assert_string_equal(json_object_to_json_string(msgpack),
+				    json_object_to_json_string(msg->row));
+	}
+	json_object_put(json);
+	json_object_put(msgpack);
+}
+
+/** Check encoded bytes
+  @param buf Buffer with encoded value. It is reset.
+  @param expected Expected bytes
+  @param expected_len Expected length
+  */
+static void check_encoded(struct printbuf *buf,
+			  const char *expected,
+			  size_t expected_len) {
+	assert_int_equal((size_t)buf->bpos, expected_len);
+	assert_memory_equal(buf->buf, expected, expected_len);
+	printbuf_reset(buf);
+}
+
+#define CHECK_ENCODED(buf, expected)                                           \
+	check_encoded(buf, expected, sizeof(expected) - 1)
+
+/** Every value uses its smallest representation */
+static void test_msgpack_encode() {
+	char str[70000];
+	struct printbuf *buf = printbuf_new();
+	assert_non_null(buf);
+	memset(str, 'a', sizeof(str));
+
+	rb_msgpack_nil(buf);
+	rb_msgpack_bool(buf, false);
+	rb_msgpack_bool(buf, true);
+	CHECK_ENCODED(buf, "\xc0\xc2\xc3");
+
+	rb_msgpack_int(buf, 0);
+	rb_msgpack_int(buf, 127);
+	rb_msgpack_int(buf, 128);
+	rb_msgpack_int(buf, 65536);
+	CHECK_ENCODED(buf, "\x00\x7f\xcc\x80\xce\x00\x01\x00\x00");
+
+	rb_msgpack_uint(buf, UINT64_MAX);
+	CHECK_ENCODED(buf, "\xcf\xff\xff\xff\xff\xff\xff\xff\xff");
+
+	rb_msgpack_int(buf, -1);
+	rb_msgpack_int(buf, -32);
+	rb_msgpack_int(buf, -33);
+	rb_msgpack_int(buf, -129);
+	rb_msgpack_int(buf, INT64_MIN);
+	CHECK_ENCODED(buf,
+		      "\xff\xe0\xd0\xdf\xd1\xff\x7f"
+		      "\xd3\x80\x00\x00\x00\x00\x00\x00\x00");
+
+	rb_msgpack_double(buf, 1.5);
+	CHECK_ENCODED(buf, "\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00");
+
+	rb_msgpack_str(buf, "abc", 3);
+	CHECK_ENCODED(buf, "\xa3"
+			   "abc");
+	rb_msgpack_str(buf, str, 31);
+	assert_int_equal(buf->buf[0], (char)0xbf);
+	printbuf_reset(buf);
+	rb_msgpack_str(buf, str, 32);
+	CHECK_ENCODED(buf, "\xd9\x20"
+			   "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+	rb_msgpack_str(buf, str, 256);
+	assert_memory_equal(buf->buf, "\xda\x01\x00", 3);
+	printbuf_reset(buf);
+	rb_msgpack_str(buf, str, sizeof(str));
+	assert_memory_equal(buf->buf, "\xdb\x00\x01\x11\x70", 5);
+	printbuf_reset(buf);
+
+	rb_msgpack_map(buf, 15);
+	rb_msgpack_map(buf, 16);
+	rb_msgpack_array(buf, 15);
+	rb_msgpack_array(buf, 65536);
+	CHECK_ENCODED(buf, "\x8f\xde\x00\x10\x9f\xdd\x00\x01\x00\x00");
+
+	printbuf_free(buf);
+}
+
+/** JSON values and texts */
+static void test_msgpack_json() {
+	struct printbuf *buf = printbuf_new();
+	assert_non_null(buf);
+
+	json_object *json = json_tokener_parse(
+			"{\"a\":[1,-2,null],\"b\":{\"c\":true},\"d\":\"e\"}");
+	assert_non_null(json);
+	assert_int_equal(0, rb_msgpack_json(buf, json));
+	CHECK_ENCODED(buf,
+		      "\x83\xa1"
+		      "a\x93\x01\xfe\xc0\xa1"
+		      "b\x81\xa1"
+		      "c\xc3\xa1"
+		      "d\xa1"
+		      "e");
+
+	size_t len = 0;
+	char *msgpack = rb_msgpack_from_json_text(
+			json_object_to_json_string(json), &len);
+	assert_non_null(msgpack);
+	json_object *decoded = msgpack_test_decode(msgpack, len);
+	assert_string_equal(json_object_to_json_string(json),
+			    json_object_to_json_string(decoded));
+
+	assert_null(rb_msgpack_from_json_text("{\"a\":", &len));
+
+	free(msgpack);
+	json_object_put(decoded);
+	json_object_put(json);
+	printbuf_free(buf);
+}
+
+/** Free messages and check their encodings
+  @param msgs Messages
+  @param count Expected number of messages
+  */
+static void check_messages(rb_message_array_t *msgs, size_t count) {
+	assert_non_null(msgs);
+	assert_int_equal(msgs->count, count);
+	for (size_t i = 0; i < msgs->count; ++i) {
+		check_message_encodings(&msgs->msgs[i]);
+		assert_non_null(msgs->msgs[i].row);
+		free(msgs->msgs[i].payload);
+		free(msgs->msgs[i].msgpack);
+		json_object_put(msgs->msgs[i].row);
+	}
+	message_array_done(msgs);
+}
+
+/** Vector messages are the same in JSON, MessagePack and columnar rows, and
+  monitor enrichment takes precedence over sensor one */
+static void test_msgpack_print_vector() {
+	struct monitor_value_common_keys common_keys[RB_MESSAGE_ENCODING__MAX];
+	const double split_op_results[] = {4.5, 3.25};
+
+	json_object *json_monitor = json_tokener_parse(
+			"{\"name\":\"load\",\"system\":\"0\",\"split\":\";\","
+			"\"split_op\":[\"sum\",\"max\"],\"unit\":\"%\","
+			"\"instance_prefix\":\"cpu-\","
+			"\"name_split_suffix\":\"_per_instance\","
+			"\"group_id\":\"7\",\"enrichment\":{\"site\":\"a\"}}");
+	json_object *sensor_enrichment = json_tokener_parse(
+			"{\"sensor_name\":\"s1\",\"site\":\"b\",\"rack\":3,"
+			"\"virtual\":false,\"ratio\":0.5,\"owner\":null}");
+	rb_monitor_t *monitor = parse_rb_monitor(json_monitor);
+	struct monitor_value *mv = new_monitor_value_array(3);
+	assert_non_null(monitor);
+	assert_non_null(mv);
+	rb_monitor_value_children_push(mv, true, 1.25, 1000);
+	rb_monitor_value_children_push(mv, false, 0, 1000);
+	rb_monitor_value_children_push(mv, true, 3.25, 1000);
+	rb_monitor_value_set_split_op_results(
+			mv, split_op_results, RD_ARRAYSIZE(split_op_results), 1000);
+
+	memset(common_keys, 0, sizeof(common_keys));
+	const struct monitor_value_print_ctx ctx = {
+			.sensor_enrichment = sensor_enrichment,
+			.encodings = RB_MESSAGE_F_JSON | RB_MESSAGE_F_MSGPACK |
+				     RB_MESSAGE_F_COLUMNAR,
+			.common_keys = common_keys,
+	};
+
+	rb_message_array_t *msgs = print_monitor_value(mv, monitor, &ctx);
+	assert_non_null(msgs);
+	assert_int_equal(msgs->count, 4);
+	json_object *msg = msgpack_test_decode(msgs->msgs[0].msgpack,
+					       msgs->msgs[0].msgpack_len);
+	json_object *expected = json_tokener_parse(
+			"{\"timestamp\":1000,\"monitor\":\"load_per_instance\","
+			"\"instance\":\"cpu-0\",\"value\":1.25,"
+			"\"group_id\":7,\"site\":\"a\",\"type\":\"system\","
+			"\"unit\":\"%\",\"sensor_name\":\"s1\",\"rack\":3,"
+			"\"virtual\":false,\"ratio\":0.5,\"owner\":null}");
+	assert_string_equal(json_object_to_json_string(msg),
+			    json_object_to_json_string(expected));
+	json_object_put(expected);
+	json_object_put(msg);
+	check_messages(msgs, 4);
+
+	/* Second print uses cached common keys */
+	assert_non_null(common_keys[RB_MESSAGE_ENCODING_MSGPACK].buf);
+	const char *cached = common_keys[RB_MESSAGE_ENCODING_MSGPACK].buf;
+	check_messages(print_monitor_value(mv, monitor, &ctx), 4);
+	assert_ptr_equal(cached, common_keys[RB_MESSAGE_ENCODING_MSGPACK].buf);
+
+	monitor_value_common_keys_done(common_keys);
+	rb_monitor_value_done(mv);
+	rb_monitor_done(monitor);
+	json_object_put(sensor_enrichment);
+	json_object_put(json_monitor);
+}
+
+/** Integer monitors summaries, with no common keys cache and no JSON */
+static void test_msgpack_print_summary() {
+	const struct monitor_value_summary summary = {
+			.timestamp = 1200,
+			.min = 1,
+			.max = 300,
+			.sum = 301,
+			.last = 300,
+			.count = 2,
+	};
+	json_object *json_monitor = json_tokener_parse(
+			"{\"name\":\"pkts\",\"system\":\"0\",\"integer\":1}");
+	rb_monitor_t *monitor = parse_rb_monitor(json_monitor);
+	assert_non_null(monitor);
+
+	const struct monitor_value_print_ctx ctx = {
+			.sensor_enrichment = NULL,
+			.encodings = RB_MESSAGE_F_MSGPACK | RB_MESSAGE_F_COLUMNAR,
+			.common_keys = NULL,
+	};
+	rb_message_array_t *msgs =
+			print_monitor_value_summary(&summary, monitor, &ctx);
+	assert_non_null(msgs);
+	assert_int_equal(msgs->count, 1);
+	assert_null(msgs->msgs[0].payload);
+
+	json_object *msg = msgpack_test_decode(msgs->msgs[0].msgpack,
+					       msgs->msgs[0].msgpack_len);
+	json_object *expected = json_tokener_parse(
+			"{\"timestamp\":1200,\"monitor\":\"pkts\","
+			"\"value\":300,\"min\":1,\"max\":300,\"sum\":301,"
+			"\"count\":2,\"type\":\"system\"}");
+	assert_string_equal(json_object_to_json_string(msg),
+			    json_object_to_json_string(expected));
+	assert_string_equal(json_object_to_json_string(msgs->msgs[0].row),
+			    json_object_to_json_string(expected));
+
+	json_object_put(expected);
+	json_object_put(msg);
+	free(msgs->msgs[0].msgpack);
+	json_object_put(msgs->msgs[0].row);
+	message_array_done(msgs);
+	rb_monitor_done(monitor);
+	json_object_put(json_monitor);
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_msgpack_encode),
+			cmocka_unit_test(test_msgpack_json),
+			cmocka_unit_test(test_msgpack_print_vector),
+			cmocka_unit_test(test_msgpack_print_summary),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
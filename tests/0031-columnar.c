@@ -0,0 +1,327 @@
+#include "config.h"
+
+#include "msgpack_test.h"
+#include "rb_columnar.h"
+
+#include <librd/rd.h>
+
+#include <json-c/json.h>
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+/** Get a child of a JSON object, failing if it does not exist
+  @param json JSON object
+  @param key Child key
+  @return Child
+  */
+static json_object *columnar_test_child(json_object *json, const char *key) {
+	json_object *ret = NULL;
+	assert_true(json_object_object_get_ex(json, key, &ret));
+	return ret;
+}
+
+/** Value of a row in a decoded "double" column
+  @param column Decoded column
+  @param row Row
+  @return Value, or NULL if row does not have the column
+  */
+static json_object *columnar_test_double(json_object *column, size_t row) {
+	json_object *data = columnar_test_child(column, "data");
+	json_object *present = NULL;
+	const uint8_t *bytes = (const uint8_t *)json_object_get_string(data);
+	uint64_t u = 0;
+	double d;
+
+	if (json_object_object_get_ex(column, "present", &present)) {
+		const uint8_t *bitmap = (const uint8_t *)
+				json_object_get_string(present);
+		if (0 == (bitmap[row / 8] & (1 << (row % 8)))) {
+			return NULL;
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(u); ++i) {
+		u |= (uint64_t)bytes[row * sizeof(u) + i] << (8 * i);
+	}
+	memcpy(&d, &u, sizeof(d));
+	return json_object_new_double(d);
+}
+
+/** Rebuild a row from a decoded block
+  @param block Decoded block
+  @param row Row
+  @return Row as a JSON object
+  */
+static json_object *columnar_test_row(json_object *block, size_t row) {
+	json_object *ret = json_object_new_object();
+	json_object *strings = columnar_test_child(block, "strings");
+	json_object *columns = columnar_test_child(block, "columns");
+	const size_t rows = (size_t)json_object_get_int64(
+			columnar_test_child(block, "rows"));
+
+	json_object_object_foreach(columns, key, column) {
+		const char *type = json_object_get_string(
+				columnar_test_child(column, "type"));
+		json_object *data = columnar_test_child(column, "data");
+		json_object *val = NULL;
+
+		if (0 == strcmp(type, "delta")) {
+			int64_t acc = 0;
+			for (size_t i = 0; i <= row; ++i) {
+				acc += json_object_get_int64(
+						json_object_array_get_idx(
+								data, (int)i));
+			}
+			val = json_object_new_int64(acc);
+		} else if (0 == strcmp(type, "double")) {
+			assert_int_equal(json_object_get_string_len(data),
+					 sizeof(double) * rows);
+			val = columnar_test_double(column, row);
+		} else {
+			val = json_object_array_get_idx(data, (int)row);
+			if (val && 0 == strcmp(type, "dict")) {
+				const int index =
+						(int)json_object_get_int64(val);
+				val = json_object_array_get_idx(strings, index);
+				assert_non_null(val);
+			}
+			val = json_object_get(val);
+		}
+
+		if (val) {
+			json_object_object_add(ret, key, val);
+		}
+	}
+
+	return ret;
+}
+
+/** Number of a JSON value, that can be a string
+  @param val JSON value
+  @return Number
+  */
+static double columnar_test_number(json_object *val) {
+	return json_type_string == json_object_get_type(val)
+			       ? atof(json_object_get_string(val))
+			       : json_object_get_double(val);
+}
+
+/** Check that a row has the same keys and values as the original message.
+  Double columns values can be strings or integers in JSON.
+  @param expected Original message
+  @param row Rebuilt row
+  */
+static void columnar_test_check_row(json_object *expected, json_object *row) {
+	size_t expected_keys = 0, row_keys = 0;
+
+	json_object_object_foreach(row, row_key, row_val) {
+		(void)row_key;
+		(void)row_val;
+		row_keys++;
+	}
+
+	json_object_object_foreach(expected, key, val) {
+		json_object *rval = NULL;
+		if (NULL == val) {
+			/* null values are nil, like missing ones */
+			continue;
+		}
+
+		expected_keys++;
+		assert_true(json_object_object_get_ex(row, key, &rval));
+		if (json_type_double == json_object_get_type(rval)) {
+			assert_true(fabs(json_object_get_double(rval) -
+					 columnar_test_number(val)) < 1e-6);
+		} else {
+			assert_string_equal(json_object_to_json_string(val),
+					    json_object_to_json_string(rval));
+		}
+	}
+
+	assert_int_equal(expected_keys, row_keys);
+}
+
+/** Encode messages in a block, and check that rows can be rebuilt from it
+  @param messages JSON messages
+  @param count Number of messages
+  @param len Encoded block length
+  @return Decoded block
+  */
+static json_object *columnar_test_encode(const char **messages,
+					 size_t count,
+					 size_t *len) {
+	struct rb_columnar *batch = rb_columnar_new();
+	assert_non_null(batch);
+
+	for (size_t i = 0; i < count; ++i) {
+		assert_int_equal(0,
+				 rb_columnar_add_json_text(batch, messages[i]));
+	}
+	assert_int_equal(count, rb_columnar_rows(batch));
+
+	char *buf = rb_columnar_encode(batch, len);
+	assert_non_null(buf);
+	json_object *block = msgpack_test_decode(buf, *len);
+	free(buf);
+	rb_columnar_done(batch);
+
+	json_object *schema = columnar_test_child(block, "schema");
+	assert_string_equal(RB_COLUMNAR_SCHEMA, json_object_get_string(schema));
+	assert_int_equal(count,
+			 json_object_get_int64(
+					 columnar_test_child(block, "rows")));
+	for (size_t i = 0; i < count; ++i) {
+		json_object *expected = json_tokener_parse(messages[i]);
+		json_object *row = columnar_test_row(block, i);
+		columnar_test_check_row(expected, row);
+		json_object_put(expected);
+		json_object_put(row);
+	}
+
+	return block;
+}
+
+/** Type of a block column
+  @param block Decoded block
+  @param key Column key
+  @return Column type
+  */
+static const char *columnar_test_type(json_object *block, const char *key) {
+	json_object *column = columnar_test_child(
+			columnar_test_child(block, "columns"), key);
+	return json_object_get_string(columnar_test_child(column, "type"));
+}
+
+/** Every column gets the type of its values, and rows can be rebuilt */
+static void test_columnar_block() {
+	const char *messages[] = {
+			"{\"timestamp\":1000,\"sensor_name\":\"s1\","
+			"\"monitor\":\"load\",\"instance\":\"cpu-0\","
+			"\"value\":\"1.250000\",\"type\":\"system\","
+			"\"group_id\":7,\"ratio\":0.5,\"owner\":null}",
+			"{\"timestamp\":1010,\"sensor_name\":\"s1\","
+			"\"monitor\":\"load\",\"instance\":\"cpu-1\","
+			"\"value\":\"3.250000\",\"type\":\"system\","
+			"\"group_id\":7,\"ratio\":1,\"virtual\":false}",
+			"{\"timestamp\":990,\"sensor_name\":\"s1\","
+			"\"monitor\":\"pkts\",\"value\":\"300\","
+			"\"min\":\"1\",\"max\":\"300\",\"sum\":\"301\","
+			"\"count\":2,\"type\":\"system\",\"group_id\":\"g\","
+			"\"ratio\":0.25}",
+	};
+	size_t len = 0;
+
+	json_object *block = columnar_test_encode(
+			messages, RD_ARRAYSIZE(messages), &len);
+
+	assert_string_equal("delta", columnar_test_type(block, "timestamp"));
+	assert_string_equal("dict", columnar_test_type(block, "sensor_name"));
+	assert_string_equal("dict", columnar_test_type(block, "instance"));
+	assert_string_equal("double", columnar_test_type(block, "value"));
+	assert_string_equal("double", columnar_test_type(block, "min"));
+	assert_string_equal("double", columnar_test_type(block, "ratio"));
+	assert_string_equal("values", columnar_test_type(block, "group_id"));
+	assert_string_equal("values", columnar_test_type(block, "count"));
+	assert_string_equal("values", columnar_test_type(block, "virtual"));
+
+	/* null values are nil, like missing ones */
+	assert_string_equal("values", columnar_test_type(block, "owner"));
+	json_object *columns = columnar_test_child(block, "columns");
+	json_object *owner = columnar_test_child(
+			columnar_test_child(columns, "owner"), "data");
+	assert_int_equal(3, json_object_array_length(owner));
+	for (int i = 0; i < 3; ++i) {
+		assert_null(json_object_array_get_idx(owner, i));
+	}
+
+	/* Repeated strings are stored once */
+	json_object *strings = columnar_test_child(block, "strings");
+	assert_int_equal(6, json_object_array_length(strings));
+
+	json_object_put(block);
+}
+
+/** Sensor messages take much less space in a columnar block than as JSON
+  messages, even if every row has its own instance and value */
+static void test_columnar_size() {
+	enum { ROWS = 1000 };
+	const char **messages = calloc(ROWS, sizeof(messages[0]));
+	size_t json_len = 0, len = 0;
+	assert_non_null(messages);
+
+	for (size_t i = 0; i < ROWS; ++i) {
+		char *message = NULL;
+		const int rc = asprintf(
+				&message,
+				"{\"timestamp\":%zu,"
+				"\"sensor_name\":\"sensor-1\","
+				"\"monitor\":\"rx_bytes_per_instance\","
+				"\"instance\":\"eth-%zu\",\"value\":\"%lf\","
+				"\"type\":\"snmp\",\"unit\":\"bytes\","
+				"\"group_id\":\"17\",\"site\":\"madrid\","
+				"\"rack\":\"r-12\"}",
+				1469181339 + i / 100,
+				i,
+				(double)i * 1500.5);
+		assert_true(rc > 0);
+		messages[i] = message;
+		json_len += (size_t)rc;
+	}
+
+	json_object *block = columnar_test_encode(messages, ROWS, &len);
+	print_message("%d messages: %zu JSON bytes, %zu columnar bytes\n",
+		      ROWS,
+		      json_len,
+		      len);
+	assert_true(4 * len < json_len);
+
+	json_object_put(block);
+	for (size_t i = 0; i < ROWS; ++i) {
+		free((char *)messages[i]);
+	}
+	free(messages);
+}
+
+/** Only JSON objects are rows */
+static void test_columnar_invalid_row() {
+	size_t len = 0;
+	struct rb_columnar *batch = rb_columnar_new();
+	assert_non_null(batch);
+
+	assert_int_equal(-1, rb_columnar_add_json_text(batch, "[1,2]"));
+	assert_int_equal(-1, rb_columnar_add_json_text(batch, "{"));
+	assert_int_equal(0, rb_columnar_rows(batch));
+
+	char *buf = rb_columnar_encode(batch, &len);
+	assert_non_null(buf);
+	json_object *block = msgpack_test_decode(buf, len);
+	assert_int_equal(0,
+			 json_object_get_int64(
+					 columnar_test_child(block, "rows")));
+	json_object *strings = columnar_test_child(block, "strings");
+	assert_int_equal(0, json_object_array_length(strings));
+
+	json_object_put(block);
+	free(buf);
+	rb_columnar_done(batch);
+}
+
+int main() {
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(test_columnar_block),
+			cmocka_unit_test(test_columnar_size),
+			cmocka_unit_test(test_columnar_invalid_row),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,192 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "msgpack_test.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <setjmp.h> // Needs to be before of cmocka.h
+
+#include <cmocka.h>
+
+/// MessagePack reader, to check encoded messages
+struct msgpack_reader {
+	const uint8_t *buf; ///< Encoded buffer
+	size_t len;	 ///< Buffer length
+	size_t pos;	 ///< Next byte to read
+};
+
+/** Read a big endian integer
+  @param reader Reader
+  @param len Integer bytes
+  @return Integer
+  */
+static uint64_t msgpack_read_uint(struct msgpack_reader *reader, size_t len) {
+	uint64_t ret = 0;
+	assert_true(reader->pos + len <= reader->len);
+	for (size_t i = 0; i < len; ++i) {
+		ret = ret << 8 | reader->buf[reader->pos++];
+	}
+	return ret;
+}
+
+/** Read a string of known length
+  @param reader Reader
+  @param len String length
+  @return JSON string
+  */
+static json_object *msgpack_read_str(struct msgpack_reader *reader,
+				     size_t len) {
+	assert_true(reader->pos + len <= reader->len);
+	json_object *ret = json_object_new_string_len(
+			(const char *)&reader->buf[reader->pos], (int)len);
+	reader->pos += len;
+	return ret;
+}
+
+static json_object *msgpack_read(struct msgpack_reader *reader);
+
+/** Read map pairs of known length
+  @param reader Reader
+  @param n Number of pairs
+  @return JSON object
+  */
+static json_object *msgpack_read_map(struct msgpack_reader *reader,
+				     size_t n) {
+	json_object *ret = json_object_new_object();
+	for (size_t i = 0; i < n; ++i) {
+		json_object *key = msgpack_read(reader);
+		assert_int_equal(json_type_string, json_object_get_type(key));
+		/* No duplicated keys */
+		assert_false(json_object_object_get_ex(
+				ret, json_object_get_string(key), NULL));
+		json_object_object_add(ret,
+				       json_object_get_string(key),
+				       msgpack_read(reader));
+		json_object_put(key);
+	}
+	return ret;
+}
+
+/** Read array elements of known length
+  @param reader Reader
+  @param n Number of elements
+  @return JSON array
+  */
+static json_object *msgpack_read_array(struct msgpack_reader *reader,
+				       size_t n) {
+	json_object *ret = json_object_new_array();
+	for (size_t i = 0; i < n; ++i) {
+		json_object_array_add(ret, msgpack_read(reader));
+	}
+	return ret;
+}
+
+/** Read a MessagePack value, only the types rb_msgpack writes. Binaries
+  are read as strings with the raw bytes.
+  @param reader Reader
+  @return Value as JSON
+  */
+static json_object *msgpack_read(struct msgpack_reader *reader) {
+	const uint8_t type = (uint8_t)msgpack_read_uint(reader, 1);
+
+	if (type <= 0x7f) {
+		return json_object_new_int64(type);
+	} else if (type >= 0xe0) {
+		return json_object_new_int64((int8_t)type);
+	} else if ((type & 0xf0) == 0x80) {
+		return msgpack_read_map(reader, type & 0x0f);
+	} else if ((type & 0xf0) == 0x90) {
+		return msgpack_read_array(reader, type & 0x0f);
+	} else if ((type & 0xe0) == 0xa0) {
+		return msgpack_read_str(reader, type & 0x1f);
+	}
+
+	switch (type) {
+	case 0xc0:
+		return NULL;
+	case 0xc2:
+	case 0xc3:
+		return json_object_new_boolean(0xc3 == type);
+	case 0xcb: {
+		const uint64_t u = msgpack_read_uint(reader, 8);
+		double d;
+		memcpy(&d, &u, sizeof(d));
+		return json_object_new_double(d);
+	}
+	case 0xcc:
+	case 0xcd:
+	case 0xce:
+	case 0xcf:
+		return json_object_new_int64((int64_t)msgpack_read_uint(
+				reader, (size_t)1 << (type - 0xcc)));
+	case 0xd0:
+		return json_object_new_int64(
+				(int8_t)msgpack_read_uint(reader, 1));
+	case 0xd1:
+		return json_object_new_int64(
+				(int16_t)msgpack_read_uint(reader, 2));
+	case 0xd2:
+		return json_object_new_int64(
+				(int32_t)msgpack_read_uint(reader, 4));
+	case 0xd3:
+		return json_object_new_int64(
+				(int64_t)msgpack_read_uint(reader, 8));
+	case 0xd9:
+	case 0xda:
+	case 0xdb:
+		return msgpack_read_str(
+				reader,
+				msgpack_read_uint(reader,
+						  (size_t)1 << (type - 0xd9)));
+	case 0xc4:
+	case 0xc5:
+	case 0xc6:
+		return msgpack_read_str(
+				reader,
+				msgpack_read_uint(reader,
+						  (size_t)1 << (type - 0xc4)));
+	case 0xdc:
+	case 0xdd:
+		return msgpack_read_array(
+				reader,
+				msgpack_read_uint(reader,
+						  (size_t)2 << (type - 0xdc)));
+	case 0xde:
+	case 0xdf:
+		return msgpack_read_map(
+				reader,
+				msgpack_read_uint(reader,
+						  (size_t)2 << (type - 0xde)));
+	default:
+		fail_msg("Unexpected MessagePack type 0x%x", type);
+		return NULL;
+	};
+}
+
+json_object *msgpack_test_decode(const void *buf, size_t len) {
+	struct msgpack_reader reader = {
+			.buf = buf, .len = len, .pos = 0,
+	};
+	json_object *ret = msgpack_read(&reader);
+	assert_int_equal(reader.pos, len);
+	return ret;
+}
@@ -0,0 +1,31 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <json-c/json.h>
+
+#include <stddef.h>
+
+/** Decode a whole MessagePack buffer. It fails the test if the buffer has
+  types that rb_msgpack does not write, or trailing bytes.
+  @param buf Buffer
+  @param len Buffer length
+  @return Decoded value
+  */
+json_object *msgpack_test_decode(const void *buf, size_t len);
@@ -18,14 +18,17 @@
 
 #include "sensor_test.h"
 
+#include "rb_monitors_template.h"
 #include "rb_sensor.h"
 
-static void test_exec_sensor_cb(const char *cjson_sensor,
+static void test_exec_sensor_cb(const char *cjson_templates,
+				const char *cjson_sensor,
 				void (*msg_cb)(void *opaque,
 					       rb_message_list *msgs,
 					       size_t i),
 				void *opaque,
-				size_t n) {
+				size_t n,
+				bool flush_windows) {
 	const size_t aux_mem_wrap_fail_in = mem_wrap_fail_in; // Exclude this
 							      // code
 	mem_wrap_fail_in = 0;
@@ -33,6 +36,13 @@ static void test_exec_sensor_cb(const char *cjson_sensor,
 	memset(&worker_info, 0, sizeof(worker_info));
 
 	snmp_sess_init(&worker_info.default_session);
+	if (cjson_templates) {
+		struct json_object *json_templates =
+				json_tokener_parse(cjson_templates);
+		worker_info.monitors_templates =
+				parse_rb_monitors_templates(json_templates);
+		json_object_put(json_templates);
+	}
 	struct json_object *json_sensor = json_tokener_parse(cjson_sensor);
 	rb_sensor_t *sensor = parse_rb_sensor(json_sensor, &worker_info);
 	json_object_put(json_sensor);
@@ -44,7 +54,16 @@ static void test_exec_sensor_cb(const char *cjson_sensor,
 		process_rb_sensor(&worker_info, sensor, &messages);
 		msg_cb(opaque, &messages, i);
 	}
+	if (flush_windows) {
+		rb_message_list messages;
+		rb_message_list_init(&messages);
+		rb_sensor_flush_windows(&worker_info, sensor, &messages);
+		msg_cb(opaque, &messages, n);
+	}
 	rb_sensor_put(sensor);
+	if (worker_info.monitors_templates) {
+		rb_monitors_templates_done(worker_info.monitors_templates);
+	}
 }
 
 static void test_sensor_n_cb(void *vchecks, rb_message_list *msgs, size_t i) {
@@ -53,7 +72,30 @@ static void test_sensor_n_cb(void *vchecks, rb_message_list *msgs, size_t i) {
 }
 
 void test_sensor_n(const char *cjson_sensor, check_list_t *checks, size_t n) {
-	test_exec_sensor_cb(cjson_sensor, test_sensor_n_cb, checks, n);
+	test_exec_sensor_cb(NULL,
+			    cjson_sensor,
+			    test_sensor_n_cb,
+			    checks,
+			    n,
+			    false);
+}
+
+void test_sensor_n_flush(const char *cjson_sensor,
+			 check_list_t *checks,
+			 size_t n) {
+	test_exec_sensor_cb(
+			NULL, cjson_sensor, test_sensor_n_cb, checks, n, true);
+}
+
+void test_sensor_templates(const char *cjson_templates,
+			   const char *cjson_sensor,
+			   check_list_t *checks) {
+	test_exec_sensor_cb(cjson_templates,
+			    cjson_sensor,
+			    test_sensor_n_cb,
+			    checks,
+			    1,
+			    false);
 }
 
 static void test_sensor_void_cb(void *opaque, rb_message_list *msgs, size_t i) {
@@ -72,7 +114,12 @@ static void test_sensor_void_cb(void *opaque, rb_message_list *msgs, size_t i) {
 }
 
 void test_sensor_void(const char *cjson_sensor) {
-	test_exec_sensor_cb(cjson_sensor, test_sensor_void_cb, NULL, 1);
+	test_exec_sensor_cb(NULL,
+			    cjson_sensor,
+			    test_sensor_void_cb,
+			    NULL,
+			    1,
+			    false);
 }
 
 /* malloc / calloc fails tests */
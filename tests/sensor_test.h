@@ -34,6 +34,26 @@ void test_sensor_void(const char *cjson_sensor);
   */
 void test_sensor_n(const char *cjson_sensor, check_list_t *checks, size_t n);
 
+/** Checks to pass a sensor n times, and then the windows in progress sent
+  when the sensor is released
+  @param cjson_sensor Sensor in json text format
+  @param checks Checks to pass every time a sensor is processed, and the
+  flushed windows ones at checks[n]
+  @param n Number of times to pass
+  */
+void test_sensor_n_flush(const char *cjson_sensor,
+			 check_list_t *checks,
+			 size_t n);
+
+/** Checks to pass a sensor that can use monitors templates
+  @param cjson_templates Monitors templates in json text format
+  @param cjson_sensor Sensor in json text format
+  @param checks Checks to pass
+  */
+void test_sensor_templates(const char *cjson_templates,
+			   const char *cjson_sensor,
+			   check_list_t *checks);
+
 /** Convenience function to pass checks over one sensor */
 static void test_sensor(const char *cjson_sensor, check_list_t *checks)
 		__attribute__((unused));
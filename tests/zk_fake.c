@@ -0,0 +1,1491 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "zk_fake.h"
+
+#ifdef HAVE_ZOOKEEPER
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <time.h>
+
+#ifndef TAILQ_FOREACH_SAFE
+#define TAILQ_FOREACH_SAFE(var, head, field, tvar)                             \
+	for ((var) = TAILQ_FIRST(head);                                        \
+	     (var) && ((tvar) = TAILQ_NEXT(var, field), 1);                    \
+	     (var) = (tvar))
+#endif
+
+/*
+ *  ZOOKEEPER API CONSTANTS
+ */
+
+const int ZOO_EPHEMERAL = 1;
+const int ZOO_SEQUENCE = 2;
+
+const int ZOO_EXPIRED_SESSION_STATE = -112;
+const int ZOO_AUTH_FAILED_STATE = -113;
+const int ZOO_CONNECTING_STATE = 1;
+const int ZOO_ASSOCIATING_STATE = 2;
+const int ZOO_CONNECTED_STATE = 3;
+
+const int ZOO_CREATED_EVENT = 1;
+const int ZOO_DELETED_EVENT = 2;
+const int ZOO_CHANGED_EVENT = 3;
+const int ZOO_CHILD_EVENT = 4;
+const int ZOO_SESSION_EVENT = -1;
+const int ZOO_NOTWATCHING_EVENT = -2;
+
+static char zk_fake_world[] = "world", zk_fake_anyone[] = "anyone";
+static struct ACL zk_fake_open_acl = {
+		.perms = 0x1f,
+		.id = {.scheme = zk_fake_world, .id = zk_fake_anyone},
+};
+struct ACL_vector ZOO_OPEN_ACL_UNSAFE = {.count = 1,
+					 .data = &zk_fake_open_acl};
+
+/// Closed session state, internal
+#define ZK_FAKE_CLOSED_STATE 0
+/// Session establishment time. Real clients never deliver connected event
+/// before zookeeper_init returns.
+#define ZK_FAKE_CONNECT_US 1000
+
+/*
+ *  ENSEMBLE
+ */
+
+struct zk_fake_node {
+	char *path;
+	char *data;
+	int data_len; ///< -1 for NULL data
+	struct Stat stat;
+	int32_t next_sequence; ///< Next sequential child suffix
+	TAILQ_ENTRY(zk_fake_node) link;
+};
+typedef TAILQ_HEAD(, zk_fake_node) zk_fake_node_list;
+
+enum zk_fake_watch_type {
+	ZK_FAKE_WATCH_DATA,  ///< Node created, deleted or changed
+	ZK_FAKE_WATCH_CHILD, ///< Children created or deleted
+};
+
+struct zk_fake_watch {
+	zhandle_t *zh;
+	char *path;
+	enum zk_fake_watch_type type;
+	watcher_fn fn; ///< NULL means session watcher
+	void *ctx;
+	TAILQ_ENTRY(zk_fake_watch) link;
+};
+
+/// Watches to trigger if the request succeeds
+struct zk_fake_triggers {
+	struct zk_fake_trigger {
+		char *path;
+		int event;
+		enum zk_fake_watch_type watch_type;
+	} * triggers;
+	size_t count, size;
+};
+
+static struct {
+	pthread_mutex_t lock;
+	zk_fake_node_list nodes;
+	TAILQ_HEAD(, zk_fake_watch) watches;
+	TAILQ_HEAD(, _zhandle) sessions;
+	int64_t zxid;
+	int64_t last_session;
+	unsigned int latency_us;
+	struct zk_fake_stats stats;
+} ensemble = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.nodes = TAILQ_HEAD_INITIALIZER(ensemble.nodes),
+		.watches = TAILQ_HEAD_INITIALIZER(ensemble.watches),
+		.sessions = TAILQ_HEAD_INITIALIZER(ensemble.sessions),
+};
+
+/*
+ *  SESSIONS
+ */
+
+enum zk_fake_event_type {
+	ZK_FAKE_EVENT_VOID,
+	ZK_FAKE_EVENT_STRING,
+	ZK_FAKE_EVENT_DATA,
+	ZK_FAKE_EVENT_STRINGS,
+	ZK_FAKE_EVENT_STAT,
+	ZK_FAKE_EVENT_WATCH,
+};
+
+/// Completion or watch pending to deliver
+struct zk_fake_event {
+	enum zk_fake_event_type type;
+	int rc;
+	union {
+		void_completion_t void_cb;
+		string_completion_t string_cb;
+		data_completion_t data_cb;
+		strings_completion_t strings_cb;
+		stat_completion_t stat_cb;
+		watcher_fn watcher;
+	} cb;
+	const void *data; ///< Completion data or watcher context
+	char *value;      ///< String, node data, or watch path
+	int value_len;
+	struct Stat stat;
+	struct String_vector strings;
+	int watch_type, watch_state;
+	struct timespec due;
+	TAILQ_ENTRY(zk_fake_event) link;
+};
+
+struct _zhandle {
+	clientid_t client_id;
+	int state; ///< Protected by ensemble lock
+	watcher_fn watcher;
+	void *context;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	TAILQ_HEAD(, zk_fake_event) events;
+	bool closing;
+	bool free_on_exit; ///< Closed from its own thread
+	TAILQ_ENTRY(_zhandle) link;
+};
+
+/*
+ *  NODES
+ */
+
+static struct zk_fake_node *zk_fake_node_find(const char *path) {
+	struct zk_fake_node *node;
+	TAILQ_FOREACH(node, &ensemble.nodes, link) {
+		if (0 == strcmp(node->path, path)) {
+			return node;
+		}
+	}
+	return NULL;
+}
+
+/** Check if node is a direct child of path
+  @param node Node
+  @param path Parent path
+  @return Child name, or NULL if it is not a child
+  */
+static const char *zk_fake_node_child_name(const struct zk_fake_node *node,
+					   const char *path) {
+	/* Root children are "/x", not "//x" */
+	const size_t path_len = 0 == strcmp(path, "/") ? 0 : strlen(path);
+	if (0 != strncmp(node->path, path, path_len) ||
+	    '/' != node->path[path_len] || '\0' == node->path[path_len + 1]) {
+		return NULL;
+	}
+
+	const char *name = &node->path[path_len + 1];
+	return strchr(name, '/') ? NULL : name;
+}
+
+static int32_t zk_fake_children(const char *path) {
+	int32_t count = 0;
+	struct zk_fake_node *node;
+	TAILQ_FOREACH(node, &ensemble.nodes, link) {
+		count += NULL != zk_fake_node_child_name(node, path);
+	}
+	return count;
+}
+
+/** Parent path of a node
+  @param path Node path
+  @param buf Buffer to print parent path
+  @param size Buffer size
+  @return buf
+  */
+static char *zk_fake_parent(const char *path, char *buf, size_t size) {
+	snprintf(buf, size, "%s", path);
+	char *last_slash = strrchr(buf, '/');
+	if (last_slash == buf) {
+		last_slash[1] = '\0';
+	} else if (last_slash) {
+		*last_slash = '\0';
+	}
+	return buf;
+}
+
+static void zk_fake_node_done(struct zk_fake_node *node) {
+	free(node->path);
+	free(node->data);
+	free(node);
+}
+
+static struct zk_fake_node *zk_fake_node_new(const char *path,
+					     const char *value,
+					     int value_len,
+					     int64_t owner) {
+	struct zk_fake_node *node = calloc(1, sizeof(*node));
+	if (NULL == node) {
+		return NULL;
+	}
+
+	node->path = strdup(path);
+	node->data_len = value ? value_len : -1;
+	node->data = malloc(value_len > 0 ? (size_t)value_len : 1);
+	if (NULL == node->path || NULL == node->data) {
+		zk_fake_node_done(node);
+		return NULL;
+	}
+
+	if (value_len > 0) {
+		memcpy(node->data, value, (size_t)value_len);
+	}
+	node->stat.czxid = node->stat.mzxid = node->stat.pzxid =
+			++ensemble.zxid;
+	node->stat.ctime = node->stat.mtime = (int64_t)time(NULL) * 1000;
+	node->stat.ephemeralOwner = owner;
+	node->stat.dataLength = value_len > 0 ? value_len : 0;
+	return node;
+}
+
+/// Make sure root node exists
+static void zk_fake_root(void) {
+	if (NULL == zk_fake_node_find("/")) {
+		struct zk_fake_node *root = zk_fake_node_new("/", NULL, 0, 0);
+		if (root) {
+			TAILQ_INSERT_TAIL(&ensemble.nodes, root, link);
+		}
+	}
+}
+
+static void zk_fake_trigger(struct zk_fake_triggers *triggers,
+			    const char *path,
+			    int event,
+			    enum zk_fake_watch_type watch_type) {
+	if (triggers->count == triggers->size) {
+		const size_t new_size = triggers->size ? 2 * triggers->size : 8;
+		struct zk_fake_trigger *new_triggers =
+				realloc(triggers->triggers,
+					new_size * sizeof(new_triggers[0]));
+		if (NULL == new_triggers) {
+			fprintf(stderr, "zk_fake: can't allocate trigger\n");
+			return;
+		}
+		triggers->triggers = new_triggers;
+		triggers->size = new_size;
+	}
+
+	triggers->triggers[triggers->count].path = strdup(path);
+	triggers->triggers[triggers->count].event = event;
+	triggers->triggers[triggers->count].watch_type = watch_type;
+	triggers->count++;
+}
+
+static int zk_fake_create0(zhandle_t *zh,
+			   const char *path,
+			   const char *value,
+			   int value_len,
+			   int flags,
+			   char **created_path,
+			   struct zk_fake_triggers *triggers) {
+	char parent_path[BUFSIZ], node_path[BUFSIZ];
+
+	if (NULL == path || '/' != path[0]) {
+		return ZBADARGUMENTS;
+	}
+
+	struct zk_fake_node *parent = zk_fake_node_find(
+			zk_fake_parent(path, parent_path, sizeof(parent_path)));
+	if (NULL == parent) {
+		return ZNONODE;
+	} else if (parent->stat.ephemeralOwner) {
+		return ZNOCHILDRENFOREPHEMERALS;
+	}
+
+	if (flags & ZOO_SEQUENCE) {
+		snprintf(node_path,
+			 sizeof(node_path),
+			 "%s%010d",
+			 path,
+			 parent->next_sequence++);
+	} else {
+		snprintf(node_path, sizeof(node_path), "%s", path);
+	}
+
+	if (zk_fake_node_find(node_path)) {
+		return ZNODEEXISTS;
+	}
+
+	struct zk_fake_node *node = zk_fake_node_new(
+			node_path,
+			value,
+			value_len,
+			(flags & ZOO_EPHEMERAL) ? zh->client_id.client_id : 0);
+	if (NULL == node) {
+		return ZSYSTEMERROR;
+	}
+
+	TAILQ_INSERT_TAIL(&ensemble.nodes, node, link);
+	parent->stat.cversion++;
+	parent->stat.numChildren++;
+	parent->stat.pzxid = node->stat.czxid;
+	ensemble.stats.creates++;
+
+	zk_fake_trigger(triggers, node_path, ZOO_CREATED_EVENT,
+			ZK_FAKE_WATCH_DATA);
+	zk_fake_trigger(triggers, parent->path, ZOO_CHILD_EVENT,
+			ZK_FAKE_WATCH_CHILD);
+
+	if (created_path) {
+		*created_path = strdup(node_path);
+	}
+
+	return ZOK;
+}
+
+static int zk_fake_delete0(const char *path,
+			   int version,
+			   struct zk_fake_triggers *triggers) {
+	char parent_path[BUFSIZ];
+
+	struct zk_fake_node *node = path ? zk_fake_node_find(path) : NULL;
+	if (NULL == node) {
+		return ZNONODE;
+	} else if (version >= 0 && version != node->stat.version) {
+		return ZBADVERSION;
+	} else if (zk_fake_children(path) > 0) {
+		return ZNOTEMPTY;
+	}
+
+	struct zk_fake_node *parent = zk_fake_node_find(
+			zk_fake_parent(path, parent_path, sizeof(parent_path)));
+	if (parent) {
+		parent->stat.cversion++;
+		parent->stat.numChildren--;
+		parent->stat.pzxid = ++ensemble.zxid;
+		zk_fake_trigger(triggers,
+				parent->path,
+				ZOO_CHILD_EVENT,
+				ZK_FAKE_WATCH_CHILD);
+	}
+
+	zk_fake_trigger(triggers, path, ZOO_DELETED_EVENT, ZK_FAKE_WATCH_DATA);
+	zk_fake_trigger(triggers, path, ZOO_DELETED_EVENT, ZK_FAKE_WATCH_CHILD);
+
+	TAILQ_REMOVE(&ensemble.nodes, node, link);
+	zk_fake_node_done(node);
+	ensemble.stats.deletes++;
+	return ZOK;
+}
+
+static int zk_fake_get_children0(const char *path,
+				 struct String_vector *strings) {
+	struct zk_fake_node *node;
+
+	memset(strings, 0, sizeof(*strings));
+	if (NULL == zk_fake_node_find(path)) {
+		return ZNONODE;
+	}
+
+	const int32_t count = zk_fake_children(path);
+	strings->data = calloc(count ? (size_t)count : 1,
+			       sizeof(strings->data[0]));
+	if (NULL == strings->data) {
+		return ZSYSTEMERROR;
+	}
+
+	TAILQ_FOREACH(node, &ensemble.nodes, link) {
+		const char *name = zk_fake_node_child_name(node, path);
+		if (name) {
+			strings->data[strings->count++] = strdup(name);
+		}
+	}
+
+	return ZOK;
+}
+
+/*
+ *  EVENTS
+ */
+
+static void zk_fake_event_done(struct zk_fake_event *event) {
+	free(event->value);
+	deallocate_String_vector(&event->strings);
+	free(event);
+}
+
+static struct zk_fake_event *zk_fake_event_new(enum zk_fake_event_type type,
+					       int rc,
+					       const void *data) {
+	struct zk_fake_event *event = calloc(1, sizeof(*event));
+	if (NULL == event) {
+		fprintf(stderr, "zk_fake: can't allocate event\n");
+		return NULL;
+	}
+
+	event->type = type;
+	event->rc = rc;
+	event->data = data;
+	return event;
+}
+
+static void zk_fake_enqueue(zhandle_t *zh, struct zk_fake_event *event) {
+	if (NULL == event) {
+		return;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &event->due);
+	event->due.tv_nsec += (long)ensemble.latency_us * 1000;
+	event->due.tv_sec += event->due.tv_nsec / 1000000000;
+	event->due.tv_nsec %= 1000000000;
+
+	pthread_mutex_lock(&zh->lock);
+	TAILQ_INSERT_TAIL(&zh->events, event, link);
+	pthread_cond_signal(&zh->cond);
+	pthread_mutex_unlock(&zh->lock);
+}
+
+static void zk_fake_enqueue_watch(zhandle_t *zh,
+				  watcher_fn fn,
+				  void *ctx,
+				  int type,
+				  int state,
+				  const char *path) {
+	struct zk_fake_event *event =
+			zk_fake_event_new(ZK_FAKE_EVENT_WATCH, ZOK, ctx);
+	if (event) {
+		event->cb.watcher = fn;
+		event->watch_type = type;
+		event->watch_state = state;
+		event->value = strdup(path);
+	}
+	zk_fake_enqueue(zh, event);
+}
+
+/// Deliver triggered watches, and release triggers
+static void zk_fake_fire_triggers(struct zk_fake_triggers *triggers,
+				  bool fire) {
+	struct zk_fake_watch *watch, *aux;
+
+	for (size_t i = 0; i < triggers->count; ++i) {
+		TAILQ_FOREACH_SAFE(watch, &ensemble.watches, link, aux) {
+			if (!fire ||
+			    watch->type != triggers->triggers[i].watch_type ||
+			    0 != strcmp(watch->path,
+					triggers->triggers[i].path)) {
+				continue;
+			}
+
+			TAILQ_REMOVE(&ensemble.watches, watch, link);
+			zk_fake_enqueue_watch(watch->zh,
+					      watch->fn,
+					      watch->ctx,
+					      triggers->triggers[i].event,
+					      ZOO_CONNECTED_STATE,
+					      watch->path);
+			ensemble.stats.watches++;
+			free(watch->path);
+			free(watch);
+		}
+		free(triggers->triggers[i].path);
+	}
+	free(triggers->triggers);
+	triggers->triggers = NULL;
+	triggers->count = triggers->size = 0;
+}
+
+/** Add a watch, if it does not exist yet
+  @param zh Session handler
+  @param path Watched node
+  @param type Watch type
+  @param fn Watcher, or NULL for session watcher
+  @param ctx Watcher context
+  */
+static void zk_fake_watch(zhandle_t *zh,
+			  const char *path,
+			  enum zk_fake_watch_type type,
+			  watcher_fn fn,
+			  void *ctx) {
+	struct zk_fake_watch *watch;
+	TAILQ_FOREACH(watch, &ensemble.watches, link) {
+		if (watch->zh == zh && watch->type == type &&
+		    watch->fn == fn && watch->ctx == ctx &&
+		    0 == strcmp(watch->path, path)) {
+			return;
+		}
+	}
+
+	watch = calloc(1, sizeof(*watch));
+	if (watch) {
+		watch->path = strdup(path);
+	}
+	if (NULL == watch || NULL == watch->path) {
+		fprintf(stderr, "zk_fake: can't allocate watch\n");
+		free(watch);
+		return;
+	}
+
+	watch->zh = zh;
+	watch->type = type;
+	watch->fn = fn;
+	watch->ctx = ctx;
+	TAILQ_INSERT_TAIL(&ensemble.watches, watch, link);
+}
+
+static void zk_fake_deliver(zhandle_t *zh, struct zk_fake_event *event) {
+	switch (event->type) {
+	case ZK_FAKE_EVENT_VOID:
+		event->cb.void_cb(event->rc, event->data);
+		break;
+	case ZK_FAKE_EVENT_STRING:
+		event->cb.string_cb(event->rc, event->value, event->data);
+		break;
+	case ZK_FAKE_EVENT_DATA:
+		event->cb.data_cb(event->rc,
+				  event->value,
+				  event->value_len,
+				  &event->stat,
+				  event->data);
+		break;
+	case ZK_FAKE_EVENT_STRINGS:
+		event->cb.strings_cb(event->rc, &event->strings, event->data);
+		break;
+	case ZK_FAKE_EVENT_STAT:
+		event->cb.stat_cb(event->rc, &event->stat, event->data);
+		break;
+	case ZK_FAKE_EVENT_WATCH:
+		if (event->cb.watcher) {
+			event->cb.watcher(zh,
+					  event->watch_type,
+					  event->watch_state,
+					  event->value,
+					  (void *)event->data);
+		} else if (zh->watcher) {
+			zh->watcher(zh,
+				    event->watch_type,
+				    event->watch_state,
+				    event->value,
+				    zh->context);
+		}
+		break;
+	default:
+		break;
+	};
+}
+
+static void zk_fake_handle_done(zhandle_t *zh) {
+	pthread_mutex_destroy(&zh->lock);
+	pthread_cond_destroy(&zh->cond);
+	free(zh);
+}
+
+/// Session thread: deliver completions and watches in order
+static void *zk_fake_dispatcher(void *opaque) {
+	zhandle_t *zh = opaque;
+	struct timespec now;
+
+	pthread_mutex_lock(&zh->lock);
+	while (true) {
+		struct zk_fake_event *event = TAILQ_FIRST(&zh->events);
+		if (NULL == event) {
+			if (zh->closing) {
+				break;
+			}
+			pthread_cond_wait(&zh->cond, &zh->lock);
+			continue;
+		}
+
+		clock_gettime(CLOCK_REALTIME, &now);
+		if (now.tv_sec < event->due.tv_sec ||
+		    (now.tv_sec == event->due.tv_sec &&
+		     now.tv_nsec < event->due.tv_nsec)) {
+			pthread_cond_timedwait(
+					&zh->cond, &zh->lock, &event->due);
+			continue;
+		}
+
+		TAILQ_REMOVE(&zh->events, event, link);
+		pthread_mutex_unlock(&zh->lock);
+		zk_fake_deliver(zh, event);
+		zk_fake_event_done(event);
+		pthread_mutex_lock(&zh->lock);
+	}
+
+	const bool free_on_exit = zh->free_on_exit;
+	pthread_mutex_unlock(&zh->lock);
+	if (free_on_exit) {
+		zk_fake_handle_done(zh);
+	}
+	return NULL;
+}
+
+/** Delete session ephemeral nodes and watches. Call with ensemble lock
+  @param zh Session handler
+  @param state New session state. Like real clients, if session expired,
+  every watcher receives the session event once.
+  */
+static void zk_fake_end_session(zhandle_t *zh, int state) {
+	struct zk_fake_triggers triggers = {.triggers = NULL};
+	struct zk_fake_node *node, *aux_node;
+	struct zk_fake_watch *watch, *aux_watch, *notified;
+	TAILQ_HEAD(, zk_fake_watch) ended = TAILQ_HEAD_INITIALIZER(ended);
+
+	zh->state = state;
+
+	TAILQ_FOREACH_SAFE(watch, &ensemble.watches, link, aux_watch) {
+		if (watch->zh != zh) {
+			continue;
+		}
+
+		TAILQ_REMOVE(&ensemble.watches, watch, link);
+		TAILQ_FOREACH(notified, &ended, link) {
+			if (notified->fn == watch->fn &&
+			    notified->ctx == watch->ctx) {
+				break;
+			}
+		}
+
+		if (watch->fn && NULL == notified &&
+		    ZOO_EXPIRED_SESSION_STATE == state) {
+			zk_fake_enqueue_watch(zh,
+					      watch->fn,
+					      watch->ctx,
+					      ZOO_SESSION_EVENT,
+					      state,
+					      "");
+		}
+		TAILQ_INSERT_TAIL(&ended, watch, link);
+	}
+
+	TAILQ_FOREACH_SAFE(watch, &ended, link, aux_watch) {
+		free(watch->path);
+		free(watch);
+	}
+
+	/* Ephemeral nodes have no children, so they can be deleted in any
+	order */
+	TAILQ_FOREACH_SAFE(node, &ensemble.nodes, link, aux_node) {
+		if (node->stat.ephemeralOwner == zh->client_id.client_id) {
+			zk_fake_delete0(node->path, -1, &triggers);
+			zk_fake_fire_triggers(&triggers, true);
+		}
+	}
+}
+
+/*
+ *  ZOOKEEPER API
+ */
+
+zhandle_t *zookeeper_init(const char *host,
+			  watcher_fn fn,
+			  int recv_timeout,
+			  const clientid_t *clientid,
+			  void *context,
+			  int flags) {
+	(void)host;
+	(void)recv_timeout;
+	(void)clientid;
+	(void)flags;
+
+	zhandle_t *zh = calloc(1, sizeof(*zh));
+	if (NULL == zh) {
+		return NULL;
+	}
+
+	zh->watcher = fn;
+	zh->context = context;
+	TAILQ_INIT(&zh->events);
+	pthread_mutex_init(&zh->lock, NULL);
+	pthread_cond_init(&zh->cond, NULL);
+
+	pthread_mutex_lock(&ensemble.lock);
+	zk_fake_root();
+	zh->client_id.client_id = ++ensemble.last_session;
+	zh->state = ZOO_CONNECTED_STATE;
+	TAILQ_INSERT_TAIL(&ensemble.sessions, zh, link);
+	zk_fake_enqueue_watch(zh,
+			      NULL,
+			      NULL,
+			      ZOO_SESSION_EVENT,
+			      ZOO_CONNECTED_STATE,
+			      "");
+	struct zk_fake_event *connected = TAILQ_FIRST(&zh->events);
+	if (connected) {
+		connected->due.tv_nsec += ZK_FAKE_CONNECT_US * 1000;
+		connected->due.tv_sec += connected->due.tv_nsec / 1000000000;
+		connected->due.tv_nsec %= 1000000000;
+	}
+	pthread_mutex_unlock(&ensemble.lock);
+
+	if (0 != pthread_create(&zh->thread, NULL, zk_fake_dispatcher, zh)) {
+		pthread_mutex_lock(&ensemble.lock);
+		TAILQ_REMOVE(&ensemble.sessions, zh, link);
+		pthread_mutex_unlock(&ensemble.lock);
+		zk_fake_handle_done(zh);
+		return NULL;
+	}
+
+	return zh;
+}
+
+int zookeeper_close(zhandle_t *zh) {
+	if (NULL == zh) {
+		return ZBADARGUMENTS;
+	}
+
+	pthread_mutex_lock(&ensemble.lock);
+	zk_fake_end_session(zh, ZK_FAKE_CLOSED_STATE);
+	TAILQ_REMOVE(&ensemble.sessions, zh, link);
+	pthread_mutex_unlock(&ensemble.lock);
+
+	const bool own_thread = pthread_equal(pthread_self(), zh->thread);
+	pthread_mutex_lock(&zh->lock);
+	zh->closing = true;
+	zh->free_on_exit = own_thread;
+	pthread_cond_signal(&zh->cond);
+	pthread_mutex_unlock(&zh->lock);
+
+	if (own_thread) {
+		pthread_detach(zh->thread);
+	} else {
+		pthread_join(zh->thread, NULL);
+		zk_fake_handle_done(zh);
+	}
+
+	return ZOK;
+}
+
+bool zk_fake_expire_session(int64_t session_id) {
+	zhandle_t *zh;
+
+	pthread_mutex_lock(&ensemble.lock);
+	TAILQ_FOREACH(zh, &ensemble.sessions, link) {
+		if (zh->client_id.client_id == session_id &&
+		    ZOO_CONNECTED_STATE == zh->state) {
+			break;
+		}
+	}
+
+	if (zh) {
+		zk_fake_end_session(zh, ZOO_EXPIRED_SESSION_STATE);
+		zk_fake_enqueue_watch(zh,
+				      NULL,
+				      NULL,
+				      ZOO_SESSION_EVENT,
+				      ZOO_EXPIRED_SESSION_STATE,
+				      "");
+	}
+	pthread_mutex_unlock(&ensemble.lock);
+
+	return NULL != zh;
+}
+
+const clientid_t *zoo_client_id(zhandle_t *zh) {
+	return &zh->client_id;
+}
+
+int zoo_state(zhandle_t *zh) {
+	if (NULL == zh) {
+		return ZBADARGUMENTS;
+	}
+
+	pthread_mutex_lock(&ensemble.lock);
+	const int state = zh->state;
+	pthread_mutex_unlock(&ensemble.lock);
+	return state;
+}
+
+const void *zoo_get_context(zhandle_t *zh) {
+	return zh->context;
+}
+
+watcher_fn zoo_set_watcher(zhandle_t *zh, watcher_fn newFn) {
+	pthread_mutex_lock(&zh->lock);
+	const watcher_fn ret = zh->watcher;
+	zh->watcher = newFn;
+	pthread_mutex_unlock(&zh->lock);
+	return ret;
+}
+
+const char *zerror(int c) {
+	switch (c) {
+	case ZOK:
+		return "ok";
+	case ZSYSTEMERROR:
+		return "system error";
+	case ZRUNTIMEINCONSISTENCY:
+		return "run time inconsistency";
+	case ZBADARGUMENTS:
+		return "bad arguments";
+	case ZINVALIDSTATE:
+		return "invalid zhandle state";
+	case ZNONODE:
+		return "no node";
+	case ZBADVERSION:
+		return "bad version";
+	case ZNOCHILDRENFOREPHEMERALS:
+		return "no children for ephemerals";
+	case ZNODEEXISTS:
+		return "node exists";
+	case ZNOTEMPTY:
+		return "not empty";
+	case ZSESSIONEXPIRED:
+		return "session expired";
+	default:
+		return "unknown error";
+	};
+}
+
+int deallocate_String_vector(struct String_vector *v) {
+	for (int32_t i = 0; v->data && i < v->count; ++i) {
+		free(v->data[i]);
+	}
+	free(v->data);
+	v->data = NULL;
+	v->count = 0;
+	return 0;
+}
+
+/** Start a request
+  @param zh Session handler
+  @return ZOK if session can send requests. Ensemble lock is held in that
+  case.
+  */
+static int zk_fake_request_begin(zhandle_t *zh) {
+	pthread_mutex_lock(&ensemble.lock);
+	if (ZOO_CONNECTED_STATE != zh->state) {
+		pthread_mutex_unlock(&ensemble.lock);
+		return ZINVALIDSTATE;
+	}
+	ensemble.stats.requests++;
+	return ZOK;
+}
+
+int zoo_create(zhandle_t *zh,
+	       const char *path,
+	       const char *value,
+	       int valuelen,
+	       const struct ACL_vector *acl,
+	       int flags,
+	       char *path_buffer,
+	       int path_buffer_len) {
+	struct zk_fake_triggers triggers = {.triggers = NULL};
+	char *created_path = NULL;
+	(void)acl;
+
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	const int rc = zk_fake_create0(zh,
+				       path,
+				       value,
+				       valuelen,
+				       flags,
+				       &created_path,
+				       &triggers);
+	zk_fake_fire_triggers(&triggers, true);
+	pthread_mutex_unlock(&ensemble.lock);
+
+	if (ZOK == rc && path_buffer && path_buffer_len > 0) {
+		snprintf(path_buffer,
+			 (size_t)path_buffer_len,
+			 "%s",
+			 created_path);
+	}
+	free(created_path);
+	return rc;
+}
+
+int zoo_acreate(zhandle_t *zh,
+		const char *path,
+		const char *value,
+		int valuelen,
+		const struct ACL_vector *acl,
+		int flags,
+		string_completion_t completion,
+		const void *data) {
+	struct zk_fake_triggers triggers = {.triggers = NULL};
+	char *created_path = NULL;
+	(void)acl;
+
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	const int rc = zk_fake_create0(zh,
+				       path,
+				       value,
+				       valuelen,
+				       flags,
+				       &created_path,
+				       &triggers);
+	zk_fake_fire_triggers(&triggers, true);
+	if (completion) {
+		struct zk_fake_event *event = zk_fake_event_new(
+				ZK_FAKE_EVENT_STRING, rc, data);
+		if (event) {
+			event->cb.string_cb = completion;
+			event->value = created_path;
+			created_path = NULL;
+		}
+		zk_fake_enqueue(zh, event);
+	}
+	pthread_mutex_unlock(&ensemble.lock);
+
+	free(created_path);
+	return ZOK;
+}
+
+int zoo_delete(zhandle_t *zh, const char *path, int version) {
+	struct zk_fake_triggers triggers = {.triggers = NULL};
+
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	const int rc = zk_fake_delete0(path, version, &triggers);
+	zk_fake_fire_triggers(&triggers, true);
+	pthread_mutex_unlock(&ensemble.lock);
+	return rc;
+}
+
+int zoo_adelete(zhandle_t *zh,
+		const char *path,
+		int version,
+		void_completion_t completion,
+		const void *data) {
+	struct zk_fake_triggers triggers = {.triggers = NULL};
+
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	const int rc = zk_fake_delete0(path, version, &triggers);
+	zk_fake_fire_triggers(&triggers, true);
+	if (completion) {
+		struct zk_fake_event *event =
+				zk_fake_event_new(ZK_FAKE_EVENT_VOID, rc, data);
+		if (event) {
+			event->cb.void_cb = completion;
+		}
+		zk_fake_enqueue(zh, event);
+	}
+	pthread_mutex_unlock(&ensemble.lock);
+	return ZOK;
+}
+
+/** Get node stat, and watch it
+  @param zh Session handler
+  @param path Node path
+  @param watch Watch node
+  @param watcher Watcher, NULL for session watcher
+  @param watcher_ctx Watcher context
+  @param stat Node stat
+  @return Node, or NULL if it does not exist
+  */
+static struct zk_fake_node *zk_fake_exists0(zhandle_t *zh,
+					    const char *path,
+					    bool watch,
+					    watcher_fn watcher,
+					    void *watcher_ctx,
+					    struct Stat *stat) {
+	struct zk_fake_node *node = zk_fake_node_find(path);
+	ensemble.stats.reads++;
+	if (watch) {
+		zk_fake_watch(zh,
+			      path,
+			      ZK_FAKE_WATCH_DATA,
+			      watcher,
+			      watcher_ctx);
+	}
+	if (node && stat) {
+		*stat = node->stat;
+		stat->numChildren = zk_fake_children(path);
+	}
+	return node;
+}
+
+int zoo_aexists(zhandle_t *zh,
+		const char *path,
+		int watch,
+		stat_completion_t completion,
+		const void *data) {
+	struct Stat stat;
+
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	const struct zk_fake_node *node =
+			zk_fake_exists0(zh, path, watch, NULL, NULL, &stat);
+	struct zk_fake_event *event = zk_fake_event_new(
+			ZK_FAKE_EVENT_STAT, node ? ZOK : ZNONODE, data);
+	if (event) {
+		event->cb.stat_cb = completion;
+		event->stat = stat;
+	}
+	zk_fake_enqueue(zh, event);
+	pthread_mutex_unlock(&ensemble.lock);
+	return ZOK;
+}
+
+int zoo_exists(zhandle_t *zh, const char *path, int watch, struct Stat *stat) {
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	const struct zk_fake_node *node =
+			zk_fake_exists0(zh, path, watch, NULL, NULL, stat);
+	pthread_mutex_unlock(&ensemble.lock);
+	return node ? ZOK : ZNONODE;
+}
+
+int zoo_wexists(zhandle_t *zh,
+		const char *path,
+		watcher_fn watcher,
+		void *watcherCtx,
+		struct Stat *stat) {
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	const struct zk_fake_node *node = zk_fake_exists0(
+			zh, path, NULL != watcher, watcher, watcherCtx, stat);
+	pthread_mutex_unlock(&ensemble.lock);
+	return node ? ZOK : ZNONODE;
+}
+
+/// Get node data, and watch it
+static int zk_fake_aget0(zhandle_t *zh,
+			 const char *path,
+			 bool watch,
+			 watcher_fn watcher,
+			 void *watcher_ctx,
+			 data_completion_t completion,
+			 const void *data) {
+	struct Stat stat;
+
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	const struct zk_fake_node *node =
+			zk_fake_exists0(zh, path, false, NULL, NULL, &stat);
+	if (node && watch) {
+		/* Get only watches existent nodes */
+		zk_fake_watch(zh,
+			      path,
+			      ZK_FAKE_WATCH_DATA,
+			      watcher,
+			      watcher_ctx);
+	}
+
+	struct zk_fake_event *event = zk_fake_event_new(
+			ZK_FAKE_EVENT_DATA, node ? ZOK : ZNONODE, data);
+	if (event) {
+		event->cb.data_cb = completion;
+		event->stat = stat;
+		event->value_len = -1;
+		if (node && node->data_len >= 0) {
+			event->value = malloc((size_t)node->data_len + 1);
+			if (event->value) {
+				memcpy(event->value,
+				       node->data,
+				       (size_t)node->data_len);
+				event->value[node->data_len] = '\0';
+				event->value_len = node->data_len;
+			}
+		}
+	}
+	zk_fake_enqueue(zh, event);
+	pthread_mutex_unlock(&ensemble.lock);
+	return ZOK;
+}
+
+int zoo_aget(zhandle_t *zh,
+	     const char *path,
+	     int watch,
+	     data_completion_t completion,
+	     const void *data) {
+	return zk_fake_aget0(zh, path, watch, NULL, NULL, completion, data);
+}
+
+int zoo_awget(zhandle_t *zh,
+	      const char *path,
+	      watcher_fn watcher,
+	      void *watcherCtx,
+	      data_completion_t completion,
+	      const void *data) {
+	return zk_fake_aget0(zh,
+			     path,
+			     NULL != watcher,
+			     watcher,
+			     watcherCtx,
+			     completion,
+			     data);
+}
+
+int zoo_aset(zhandle_t *zh,
+	     const char *path,
+	     const char *buffer,
+	     int buflen,
+	     int version,
+	     stat_completion_t completion,
+	     const void *data) {
+	struct zk_fake_triggers triggers = {.triggers = NULL};
+	struct Stat stat;
+	int rc = ZOK;
+
+	memset(&stat, 0, sizeof(stat));
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	struct zk_fake_node *node = zk_fake_node_find(path);
+	char *new_data = malloc(buflen > 0 ? (size_t)buflen : 1);
+	if (NULL == node) {
+		rc = ZNONODE;
+	} else if (version >= 0 && version != node->stat.version) {
+		rc = ZBADVERSION;
+	} else if (NULL == new_data) {
+		rc = ZSYSTEMERROR;
+	} else {
+		if (buflen > 0) {
+			memcpy(new_data, buffer, (size_t)buflen);
+		}
+		free(node->data);
+		node->data = new_data;
+		new_data = NULL;
+		node->data_len = buffer ? buflen : -1;
+		node->stat.dataLength = buflen > 0 ? buflen : 0;
+		node->stat.version++;
+		node->stat.mzxid = ++ensemble.zxid;
+		node->stat.mtime = (int64_t)time(NULL) * 1000;
+		stat = node->stat;
+		zk_fake_trigger(&triggers,
+				path,
+				ZOO_CHANGED_EVENT,
+				ZK_FAKE_WATCH_DATA);
+	}
+	free(new_data);
+
+	zk_fake_fire_triggers(&triggers, true);
+	if (completion) {
+		struct zk_fake_event *event =
+				zk_fake_event_new(ZK_FAKE_EVENT_STAT, rc, data);
+		if (event) {
+			event->cb.stat_cb = completion;
+			event->stat = stat;
+		}
+		zk_fake_enqueue(zh, event);
+	}
+	pthread_mutex_unlock(&ensemble.lock);
+	return ZOK;
+}
+
+/// Get node children, and watch them
+static int zk_fake_get_children_request(zhandle_t *zh,
+					const char *path,
+					bool watch,
+					watcher_fn watcher,
+					void *watcher_ctx,
+					struct String_vector *strings) {
+	ensemble.stats.reads++;
+	const int rc = zk_fake_get_children0(path, strings);
+	if (ZOK == rc && watch) {
+		zk_fake_watch(zh,
+			      path,
+			      ZK_FAKE_WATCH_CHILD,
+			      watcher,
+			      watcher_ctx);
+	}
+	return rc;
+}
+
+static int zk_fake_aget_children0(zhandle_t *zh,
+				  const char *path,
+				  bool watch,
+				  watcher_fn watcher,
+				  void *watcher_ctx,
+				  strings_completion_t completion,
+				  const void *data) {
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	struct zk_fake_event *event =
+			zk_fake_event_new(ZK_FAKE_EVENT_STRINGS, ZOK, data);
+	if (event) {
+		event->cb.strings_cb = completion;
+		event->rc = zk_fake_get_children_request(zh,
+							 path,
+							 watch,
+							 watcher,
+							 watcher_ctx,
+							 &event->strings);
+	}
+	zk_fake_enqueue(zh, event);
+	pthread_mutex_unlock(&ensemble.lock);
+	return ZOK;
+}
+
+int zoo_aget_children(zhandle_t *zh,
+		      const char *path,
+		      int watch,
+		      strings_completion_t completion,
+		      const void *data) {
+	return zk_fake_aget_children0(
+			zh, path, watch, NULL, NULL, completion, data);
+}
+
+int zoo_awget_children(zhandle_t *zh,
+		       const char *path,
+		       watcher_fn watcher,
+		       void *watcherCtx,
+		       strings_completion_t completion,
+		       const void *data) {
+	return zk_fake_aget_children0(zh,
+				      path,
+				      NULL != watcher,
+				      watcher,
+				      watcherCtx,
+				      completion,
+				      data);
+}
+
+int zoo_get_children(zhandle_t *zh,
+		     const char *path,
+		     int watch,
+		     struct String_vector *strings) {
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	const int rc = zk_fake_get_children_request(
+			zh, path, watch, NULL, NULL, strings);
+	pthread_mutex_unlock(&ensemble.lock);
+	return rc;
+}
+
+/*
+ *  MULTI
+ */
+
+void zoo_create_op_init(zoo_op_t *op,
+			const char *path,
+			const char *value,
+			int valuelen,
+			const struct ACL_vector *acl,
+			int flags,
+			char *path_buffer,
+			int path_buffer_len) {
+	memset(op, 0, sizeof(*op));
+	op->type = ZOO_CREATE_OP;
+	op->create_op.path = path;
+	op->create_op.data = value;
+	op->create_op.datalen = valuelen;
+	op->create_op.acl = acl;
+	op->create_op.flags = flags;
+	op->create_op.buf = path_buffer;
+	op->create_op.buflen = path_buffer_len;
+}
+
+void zoo_delete_op_init(zoo_op_t *op, const char *path, int version) {
+	memset(op, 0, sizeof(*op));
+	op->type = ZOO_DELETE_OP;
+	op->delete_op.path = path;
+	op->delete_op.version = version;
+}
+
+/// Copy of all nodes, to rollback a failed transaction
+static int zk_fake_snapshot(zk_fake_node_list *snapshot) {
+	struct zk_fake_node *node;
+	TAILQ_INIT(snapshot);
+	TAILQ_FOREACH(node, &ensemble.nodes, link) {
+		struct zk_fake_node *copy = zk_fake_node_new(
+				node->path,
+				node->data_len >= 0 ? node->data : NULL,
+				node->data_len,
+				node->stat.ephemeralOwner);
+		if (NULL == copy) {
+			return ZSYSTEMERROR;
+		}
+		copy->stat = node->stat;
+		copy->next_sequence = node->next_sequence;
+		TAILQ_INSERT_TAIL(snapshot, copy, link);
+	}
+	return ZOK;
+}
+
+static void zk_fake_nodes_done(zk_fake_node_list *nodes) {
+	struct zk_fake_node *node;
+	while ((node = TAILQ_FIRST(nodes))) {
+		TAILQ_REMOVE(nodes, node, link);
+		zk_fake_node_done(node);
+	}
+}
+
+/// Apply transaction. Call with ensemble lock.
+static int zk_fake_multi0(zhandle_t *zh,
+			  int count,
+			  const zoo_op_t *ops,
+			  zoo_op_result_t *results) {
+	struct zk_fake_triggers triggers = {.triggers = NULL};
+	zk_fake_node_list snapshot;
+	int rc = zk_fake_snapshot(&snapshot);
+	int i;
+
+	ensemble.stats.multis++;
+	for (i = 0; ZOK == rc && i < count; ++i) {
+		char *created_path = NULL;
+		memset(&results[i], 0, sizeof(results[i]));
+		if (ZOO_CREATE_OP == ops[i].type) {
+			rc = zk_fake_create0(zh,
+					     ops[i].create_op.path,
+					     ops[i].create_op.data,
+					     ops[i].create_op.datalen,
+					     ops[i].create_op.flags,
+					     &created_path,
+					     &triggers);
+			if (ZOK == rc && ops[i].create_op.buf &&
+			    ops[i].create_op.buflen > 0) {
+				snprintf(ops[i].create_op.buf,
+					 (size_t)ops[i].create_op.buflen,
+					 "%s",
+					 created_path);
+				results[i].value = ops[i].create_op.buf;
+				results[i].valuelen =
+						(int)strlen(created_path);
+			}
+			free(created_path);
+		} else if (ZOO_DELETE_OP == ops[i].type) {
+			rc = zk_fake_delete0(ops[i].delete_op.path,
+					     ops[i].delete_op.version,
+					     &triggers);
+		} else {
+			rc = ZBADARGUMENTS;
+		}
+		results[i].err = rc;
+	}
+
+	for (; i < count; ++i) {
+		memset(&results[i], 0, sizeof(results[i]));
+		results[i].err = ZRUNTIMEINCONSISTENCY;
+	}
+
+	if (ZOK == rc) {
+		zk_fake_nodes_done(&snapshot);
+	} else {
+		/* Rollback */
+		zk_fake_nodes_done(&ensemble.nodes);
+		TAILQ_CONCAT(&ensemble.nodes, &snapshot, link);
+		for (i = 0; i < count; ++i) {
+			if (ZOK == results[i].err) {
+				results[i].value = NULL;
+				results[i].valuelen = 0;
+			}
+		}
+	}
+	zk_fake_fire_triggers(&triggers, ZOK == rc);
+	return rc;
+}
+
+int zoo_multi(zhandle_t *zh,
+	      int count,
+	      const zoo_op_t *ops,
+	      zoo_op_result_t *results) {
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	const int rc = zk_fake_multi0(zh, count, ops, results);
+	pthread_mutex_unlock(&ensemble.lock);
+	return rc;
+}
+
+int zoo_amulti(zhandle_t *zh,
+	       int count,
+	       const zoo_op_t *ops,
+	       zoo_op_result_t *results,
+	       void_completion_t completion,
+	       const void *data) {
+	const int begin_rc = zk_fake_request_begin(zh);
+	if (ZOK != begin_rc) {
+		return begin_rc;
+	}
+
+	const int rc = zk_fake_multi0(zh, count, ops, results);
+	struct zk_fake_event *event =
+			zk_fake_event_new(ZK_FAKE_EVENT_VOID, rc, data);
+	if (event) {
+		event->cb.void_cb = completion;
+	}
+	zk_fake_enqueue(zh, event);
+	pthread_mutex_unlock(&ensemble.lock);
+	return ZOK;
+}
+
+/*
+ *  TEST HELPERS
+ */
+
+void zk_fake_set_latency(unsigned int latency_us) {
+	pthread_mutex_lock(&ensemble.lock);
+	ensemble.latency_us = latency_us;
+	pthread_mutex_unlock(&ensemble.lock);
+}
+
+void zk_fake_get_stats(struct zk_fake_stats *stats) {
+	pthread_mutex_lock(&ensemble.lock);
+	*stats = ensemble.stats;
+	pthread_mutex_unlock(&ensemble.lock);
+}
+
+size_t zk_fake_children_count(const char *path) {
+	pthread_mutex_lock(&ensemble.lock);
+	const int32_t ret = zk_fake_node_find(path) ? zk_fake_children(path)
+						    : 0;
+	pthread_mutex_unlock(&ensemble.lock);
+	return (size_t)ret;
+}
+
+void zk_fake_reset(void) {
+	pthread_mutex_lock(&ensemble.lock);
+	zk_fake_nodes_done(&ensemble.nodes);
+	memset(&ensemble.stats, 0, sizeof(ensemble.stats));
+	ensemble.latency_us = 0;
+	zk_fake_root();
+	pthread_mutex_unlock(&ensemble.lock);
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "config.h"
+
+#ifdef HAVE_ZOOKEEPER
+
+#include <zookeeper/zookeeper.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** In-process ZooKeeper stand-in. Linking zk_fake.o replaces the subset of
+  the zookeeper C API that rb_zk uses, so many rb_zk handlers can share a
+  single fake ensemble in a test:
+
+  - Persistent, ephemeral and sequential nodes, with versions
+  - Sync and async create, delete, get, exists and get children, and multi
+  transactions of creates and deletes
+  - One shot data and children watches
+  - Sessions: every zookeeper_init is a new session, and its ephemeral nodes
+  are deleted at close or expiration
+
+  Like the real client, every handler has its own thread that calls
+  completions and watchers in order. Requests are applied as soon as they
+  are sent, so the fake behaves like an ensemble with a single server.
+  */
+
+/// Fake ensemble counters
+struct zk_fake_stats {
+	uint64_t requests; ///< Requests received, multi counts as one
+	uint64_t creates;  ///< Created nodes
+	uint64_t deletes;  ///< Deleted nodes
+	uint64_t reads;    ///< get, exists and get children requests
+	uint64_t multis;   ///< Multi transactions
+	uint64_t watches;  ///< Triggered watches
+};
+
+/** Expire a session: its ephemeral nodes are deleted, and its pending
+  watchers and global watcher receive a session event with
+  ZOO_EXPIRED_SESSION_STATE instead. Requests over it fail from this moment.
+  @param session_id Session id, as zoo_client_id returns
+  @return true if session was connected
+  */
+bool zk_fake_expire_session(int64_t session_id);
+
+/** Delay completions and watches delivery, to simulate network latency
+  @param latency_us Microseconds
+  */
+void zk_fake_set_latency(unsigned int latency_us);
+
+/** Get fake ensemble counters
+  @param stats Counters
+  */
+void zk_fake_get_stats(struct zk_fake_stats *stats);
+
+/** Number of children of a node
+  @param path Node path
+  @return Number of children, or 0 if node does not exist
+  */
+size_t zk_fake_children_count(const char *path);
+
+/** Delete all nodes and reset counters. There must be no open session.
+  */
+void zk_fake_reset(void);
+
+#endif
@@ -0,0 +1,1186 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* SNMP agents simulator, for load testing.
+
+  Emulates many SNMPv1/v2c agents from one process, every one listening in
+  its own UDP port, and all of them serving the same OID tree. It can also
+  generate a rb_monitor config that polls all the simulated agents.
+  */
+
+#include "snmp_ber.h"
+
+#include "rb_json.h"
+
+#include <json-c/json.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Max UDP datagram we can answer
+#define SIM_MAX_DATAGRAM 65507
+/// Max responses waiting for its latency to expire
+#define SIM_MAX_PENDING (1 << 16)
+/// Events to process in each epoll_wait
+#define SIM_MAX_EVENTS 256
+
+#define SIM_DEFAULT_ADDRESS "127.0.0.1"
+#define SIM_DEFAULT_BASE_PORT 16100
+#define SIM_DEFAULT_COMMUNITY "public"
+
+/*
+ * OID TREE
+ */
+
+/// How an OID value is generated
+enum sim_value_kind {
+	SIM_VALUE_STATIC,  ///< Always the same value
+	SIM_VALUE_COUNTER, ///< Increases at a given rate
+	SIM_VALUE_RANDOM,  ///< Random value between min and max
+	SIM_VALUE_UPTIME,  ///< Simulator uptime, in hundredths of second
+};
+
+/// Served OID
+struct sim_oid {
+	struct snmp_ber_oid oid;     ///< OID
+	char *name;		     ///< rb_monitor monitor name. Can be NULL
+	char *unit;		     ///< rb_monitor monitor unit. Can be NULL
+	enum snmp_ber_type type;     ///< Value type
+	enum sim_value_kind kind;    ///< How the value is generated
+	double value;		     ///< Static value, or counter start
+	double rate;		     ///< Counter increase per second
+	double min, max;	     ///< Random values range
+	char *str;		     ///< OCTET STRING value
+	size_t str_len;		     ///< str length
+};
+
+/// Simulator config and state
+struct sim {
+	struct sim_oid *oids; ///< Served OIDs, sorted
+	size_t oids_count;    ///< Number of OIDs
+	size_t oids_size;     ///< oids allocated size
+
+	const char *address;   ///< Listening address
+	uint16_t base_port;    ///< First agent port
+	size_t agents;	       ///< Number of agents
+	const char *community; ///< Agents community
+	double latency_min_ms; ///< Minimum response latency
+	double latency_max_ms; ///< Maximum response latency
+	double loss;	       ///< Probability of dropping a request
+	double timeout_agents; ///< Fraction of agents that never answer
+
+	int *fds;	 ///< Agents sockets
+	int epoll_fd;	 ///< epoll of all agents sockets
+	uint64_t start;	 ///< Start time, in ns
+	unsigned seed;	 ///< Random seed
+
+	/// Responses waiting for its latency to expire, as a min-heap
+	struct sim_pending {
+		uint64_t due;		     ///< Send time, in ns
+		int fd;			     ///< Agent socket
+		struct sockaddr_in addr;     ///< Manager address
+		size_t len;		     ///< Response length
+		uint8_t *data;		     ///< Response
+	} * pending;
+	size_t pending_count; ///< Number of pending responses
+
+	/// Counters
+	struct sim_stats {
+		uint64_t requests;  ///< Received requests
+		uint64_t responses; ///< Sent responses
+		uint64_t dropped;   ///< Requests dropped by loss or timeouts
+		uint64_t errors;    ///< Invalid requests or send errors
+	} stats;
+};
+
+static volatile sig_atomic_t run = 1;
+
+static void sig_handler(int sig) {
+	(void)sig;
+	run = 0;
+}
+
+static uint64_t sim_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/** Uniform random value in [0, 1)
+  @param sim Simulator
+  @return Random value
+  */
+static double sim_random(struct sim *sim) {
+	return (double)rand_r(&sim->seed) / ((double)RAND_MAX + 1);
+}
+
+static int sim_oid_cmp(const void *va, const void *vb) {
+	const struct sim_oid *a = va, *b = vb;
+	return snmp_ber_oid_cmp(&a->oid, &b->oid);
+}
+
+/** Add an OID to the simulator tree
+  @param sim Simulator
+  @return New OID, or NULL if error
+  */
+static struct sim_oid *sim_oid_new(struct sim *sim) {
+	if (sim->oids_count == sim->oids_size) {
+		const size_t new_size = sim->oids_size ? 2 * sim->oids_size : 64;
+		struct sim_oid *oids =
+				realloc(sim->oids, new_size * sizeof(oids[0]));
+		if (NULL == oids) {
+			fprintf(stderr, "Couldn't allocate OIDs (OOM?)\n");
+			return NULL;
+		}
+		sim->oids = oids;
+		sim->oids_size = new_size;
+	}
+
+	struct sim_oid *ret = &sim->oids[sim->oids_count++];
+	memset(ret, 0, sizeof(*ret));
+	return ret;
+}
+
+/// Simulator types names, as in config and snmpwalk output
+static const struct {
+	const char *name;
+	enum snmp_ber_type type;
+} sim_types[] = {
+		{"integer", SNMP_BER_INTEGER},
+		{"integer32", SNMP_BER_INTEGER},
+		{"string", SNMP_BER_OCTET_STRING},
+		{"hex-string", SNMP_BER_OCTET_STRING},
+		{"counter32", SNMP_BER_COUNTER32},
+		{"counter", SNMP_BER_COUNTER32},
+		{"gauge32", SNMP_BER_GAUGE32},
+		{"gauge", SNMP_BER_GAUGE32},
+		{"unsigned32", SNMP_BER_GAUGE32},
+		{"timeticks", SNMP_BER_TIMETICKS},
+		{"counter64", SNMP_BER_COUNTER64},
+};
+
+/** Search a type by name, case insensitive
+  @param name Type name
+  @param type Found type
+  @return true if found
+  */
+static bool sim_type_parse(const char *name, enum snmp_ber_type *type) {
+	for (size_t i = 0; i < sizeof(sim_types) / sizeof(sim_types[0]); ++i) {
+		if (0 == strcasecmp(name, sim_types[i].name)) {
+			*type = sim_types[i].type;
+			return true;
+		}
+	}
+	return false;
+}
+
+/** Set an OID string value
+  @param oid OID
+  @param str String value
+  @return true if success
+  */
+static bool sim_oid_set_str(struct sim_oid *oid, const char *str) {
+	oid->str = strdup(str);
+	oid->str_len = oid->str ? strlen(str) : 0;
+	return NULL != oid->str;
+}
+
+/** Parse a config OID entry. A "rows" entry is a table column, and it is
+  expanded to one OID per row.
+  @param sim Simulator
+  @param json_oid OID in JSON format
+  @return true if success
+  */
+static bool sim_parse_oid(struct sim *sim, json_object *json_oid) {
+	const char *oid_str = PARSE_CJSON_CHILD_STR(json_oid, "oid", NULL);
+	const char *type_str =
+			PARSE_CJSON_CHILD_STR(json_oid, "type", "integer");
+	const char *name = PARSE_CJSON_CHILD_STR(json_oid, "name", NULL);
+	const int64_t rows = PARSE_CJSON_CHILD_INT64(json_oid, "rows", 0);
+	json_object *json_value = NULL, *counter = NULL, *random = NULL;
+	struct sim_oid proto;
+
+	memset(&proto, 0, sizeof(proto));
+	if (NULL == oid_str || !snmp_ber_oid_parse(oid_str, &proto.oid) ||
+	    (rows > 0 && proto.oid.len == SNMP_BER_MAX_OID_LEN)) {
+		fprintf(stderr, "Invalid oid %s\n", oid_str ? oid_str : "(null)");
+		return false;
+	} else if (!sim_type_parse(type_str, &proto.type)) {
+		fprintf(stderr, "Invalid type %s in oid %s\n", type_str, oid_str);
+		return false;
+	}
+
+	json_object_object_get_ex(json_oid, "value", &json_value);
+	json_object_object_get_ex(json_oid, "counter", &counter);
+	json_object_object_get_ex(json_oid, "random", &random);
+	if (counter) {
+		proto.kind = SIM_VALUE_COUNTER;
+		proto.value = PARSE_CJSON_CHILD_DOUBLE(counter, "start", 0);
+		proto.rate = PARSE_CJSON_CHILD_DOUBLE(counter, "rate", 1);
+	} else if (random) {
+		proto.kind = SIM_VALUE_RANDOM;
+		proto.min = PARSE_CJSON_CHILD_DOUBLE(random, "min", 0);
+		proto.max = PARSE_CJSON_CHILD_DOUBLE(random, "max", 100);
+	} else if (json_value &&
+		   json_type_string == json_object_get_type(json_value) &&
+		   0 == strcmp(json_object_get_string(json_value), "uptime")) {
+		proto.kind = SIM_VALUE_UPTIME;
+	} else if (SNMP_BER_OCTET_STRING != proto.type) {
+		proto.value = json_value ? json_object_get_double(json_value)
+					 : 0;
+	}
+
+	const int64_t oids_to_add = rows > 0 ? rows : 1;
+	for (int64_t i = 0; i < oids_to_add; ++i) {
+		struct sim_oid *oid = sim_oid_new(sim);
+		if (NULL == oid) {
+			return false;
+		}
+		*oid = proto;
+		if (rows > 0) {
+			oid->oid.ids[oid->oid.len++] = (uint32_t)(i + 1);
+		}
+
+		if (SNMP_BER_OCTET_STRING == oid->type &&
+		    !sim_oid_set_str(oid,
+				     json_value ? json_object_get_string(
+							          json_value)
+						: "")) {
+			return false;
+		}
+
+		if (name) {
+			char buf[BUFSIZ];
+			if (rows > 0) {
+				snprintf(buf, sizeof(buf), "%s_%" PRId64, name, i + 1);
+			} else {
+				snprintf(buf, sizeof(buf), "%s", name);
+			}
+			oid->name = strdup(buf);
+			oid->unit = PARSE_CJSON_CHILD_DUP_STR(json_oid, "unit", NULL);
+		}
+	}
+
+	return true;
+}
+
+/** Parse a snmpwalk -On output line, like
+  .1.3.6.1.2.1.1.3.0 = Timeticks: (1234) 0:00:12.34
+  @param sim Simulator
+  @param line Line
+  @return true if the line has been added
+  */
+static bool sim_parse_walk_line(struct sim *sim, char *line) {
+	char *eq = strstr(line, " = ");
+	if (NULL == eq) {
+		return false;
+	}
+	*eq = '\0';
+
+	char *type_str = eq + strlen(" = ");
+	char *colon = strstr(type_str, ": ");
+	char *value = colon ? colon + strlen(": ") : type_str;
+	if (colon) {
+		*colon = '\0';
+	}
+
+	struct sim_oid *oid = sim_oid_new(sim);
+	if (NULL == oid) {
+		return false;
+	}
+
+	if (!snmp_ber_oid_parse(line, &oid->oid)) {
+		sim->oids_count--;
+		return false;
+	}
+
+	value[strcspn(value, "\r\n")] = '\0';
+	if (!colon || !sim_type_parse(type_str, &oid->type)) {
+		/* Unknown types are served as strings */
+		oid->type = SNMP_BER_OCTET_STRING;
+	}
+
+	if (SNMP_BER_OCTET_STRING == oid->type) {
+		const size_t len = strlen(value);
+		if (len >= 2 && '"' == value[0] && '"' == value[len - 1]) {
+			value[len - 1] = '\0';
+			value++;
+		}
+		if (!sim_oid_set_str(oid, value)) {
+			sim->oids_count--;
+			return false;
+		}
+	} else {
+		/* Timeticks are printed as (ticks) human readable */
+		oid->value = strtod('(' == value[0] ? value + 1 : value, NULL);
+	}
+
+	return true;
+}
+
+/** Load a snmpwalk output file
+  @param sim Simulator
+  @param path File path
+  @return true if success
+  */
+static bool sim_load_walk(struct sim *sim, const char *path) {
+	FILE *fp = fopen(path, "r");
+	if (NULL == fp) {
+		fprintf(stderr,
+			"Couldn't open walk file %s: %s\n",
+			path,
+			strerror(errno));
+		return false;
+	}
+
+	char line[BUFSIZ];
+	size_t line_no = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		line_no++;
+		if ('\n' != line[0] && !sim_parse_walk_line(sim, line)) {
+			fprintf(stderr,
+				"Ignoring %s:%zu: unknown format\n",
+				path,
+				line_no);
+		}
+	}
+
+	fclose(fp);
+	return true;
+}
+
+/** Parse simulator config
+  @param sim Simulator
+  @param path Config file path
+  @return true if success
+  */
+static bool sim_parse_config(struct sim *sim, const char *path) {
+	json_object *config = json_object_from_file(path);
+	if (NULL == config) {
+		fprintf(stderr, "Couldn't parse config file %s\n", path);
+		return false;
+	}
+
+	bool ret = true;
+	sim->address = strdup(PARSE_CJSON_CHILD_STR(
+			config, "address", SIM_DEFAULT_ADDRESS));
+	sim->community = strdup(PARSE_CJSON_CHILD_STR(
+			config, "community", SIM_DEFAULT_COMMUNITY));
+	sim->base_port = (uint16_t)PARSE_CJSON_CHILD_INT64(
+			config, "base_port", SIM_DEFAULT_BASE_PORT);
+	if (0 == sim->agents) {
+		/* Command line agents take precedence */
+		sim->agents = (size_t)PARSE_CJSON_CHILD_INT64(
+				config, "agents", 1);
+	}
+	sim->loss = PARSE_CJSON_CHILD_DOUBLE(config, "loss", 0);
+	sim->timeout_agents =
+			PARSE_CJSON_CHILD_DOUBLE(config, "timeout_agents", 0);
+
+	json_object *latency = NULL;
+	if (json_object_object_get_ex(config, "latency_ms", &latency)) {
+		sim->latency_min_ms =
+				PARSE_CJSON_CHILD_DOUBLE(latency, "min", 0);
+		sim->latency_max_ms = PARSE_CJSON_CHILD_DOUBLE(
+				latency, "max", sim->latency_min_ms);
+	}
+
+	if ((size_t)sim->base_port + sim->agents > UINT16_MAX + 1) {
+		fprintf(stderr,
+			"Can't simulate %zu agents from port %" PRIu16 "\n",
+			sim->agents,
+			sim->base_port);
+		ret = false;
+	}
+
+	json_object *oids = NULL;
+	json_object_object_get_ex(config, "oids", &oids);
+	for (size_t i = 0;
+	     ret && oids && i < (size_t)json_object_array_length(oids);
+	     ++i) {
+		ret = sim_parse_oid(sim, json_object_array_get_idx(oids, i));
+	}
+
+	const char *walk = PARSE_CJSON_CHILD_STR(config, "walk", NULL);
+	if (ret && walk) {
+		ret = sim_load_walk(sim, walk);
+	}
+
+	json_object_put(config);
+	if (!ret) {
+		return false;
+	}
+
+	qsort(sim->oids, sim->oids_count, sizeof(sim->oids[0]), sim_oid_cmp);
+	for (size_t i = 1; i < sim->oids_count; ++i) {
+		if (0 == sim_oid_cmp(&sim->oids[i - 1], &sim->oids[i])) {
+			char buf[BUFSIZ];
+			fprintf(stderr,
+				"Duplicated oid %s\n",
+				snmp_ber_oid_print(&sim->oids[i].oid,
+						   buf,
+						   sizeof(buf)));
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/** Search the first OID greater or equal than the given one
+  @param sim Simulator
+  @param oid OID to search
+  @return Position of the found OID, oids_count if there is none
+  */
+static size_t sim_oid_lower_bound(const struct sim *sim,
+				  const struct snmp_ber_oid *oid) {
+	size_t low = 0, high = sim->oids_count;
+	while (low < high) {
+		const size_t mid = low + (high - low) / 2;
+		if (snmp_ber_oid_cmp(&sim->oids[mid].oid, oid) < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+/** Generate the current value of an OID for an agent
+  @param sim Simulator
+  @param agent Agent index
+  @param oid OID
+  @param now Current time, in ns
+  @param value Value to fill
+  */
+static void sim_oid_value(struct sim *sim,
+			  size_t agent,
+			  const struct sim_oid *oid,
+			  uint64_t now,
+			  struct snmp_ber_value *value) {
+	const double elapsed_s = (double)(now - sim->start) / 1e9;
+	double number = oid->value;
+
+	value->type = oid->type;
+	switch (oid->kind) {
+	case SIM_VALUE_COUNTER:
+		/* Every agent starts its counters in a different point */
+		number += (double)(agent * 7919) + oid->rate * elapsed_s;
+		break;
+	case SIM_VALUE_RANDOM:
+		number = oid->min + sim_random(sim) * (oid->max - oid->min);
+		break;
+	case SIM_VALUE_UPTIME:
+		number = elapsed_s * 100;
+		break;
+	case SIM_VALUE_STATIC:
+	default:
+		break;
+	};
+
+	switch (oid->type) {
+	case SNMP_BER_OCTET_STRING:
+		value->string.buf = oid->str;
+		value->string.len = oid->str_len;
+		break;
+	case SNMP_BER_INTEGER:
+		value->integer = (int64_t)number;
+		break;
+	case SNMP_BER_COUNTER64:
+		value->unsigned_integer = (uint64_t)fmax(number, 0);
+		break;
+	default:
+		/* 32 bits counters wrap */
+		value->unsigned_integer =
+				(uint64_t)fmax(number, 0) & UINT32_MAX;
+		break;
+	};
+}
+
+/** Answer a request
+  @param sim Simulator
+  @param agent Agent index
+  @param req Request
+  @param buf Buffer to encode response in
+  @return Response length, 0 if error
+  */
+static size_t sim_answer(struct sim *sim,
+			 size_t agent,
+			 const struct snmp_ber_request *req,
+			 uint8_t *buf) {
+	static const struct snmp_ber_oid *oids[SNMP_BER_MAX_VARBINDS * 64];
+	static struct snmp_ber_value values[SNMP_BER_MAX_VARBINDS * 64];
+	const size_t max_vars = sizeof(oids) / sizeof(oids[0]);
+	const uint64_t now = sim_now_ns();
+	const bool v1 = SNMP_BER_VERSION_1 == req->version;
+	enum snmp_ber_error error_status = SNMP_BER_ERR_NO_ERROR;
+	size_t error_index = 0, count = 0;
+
+	size_t non_repeaters = req->varbinds_count, repetitions = 1;
+	if (SNMP_BER_GETBULK == req->pdu_type) {
+		non_repeaters = (size_t)(req->non_repeaters < 0
+						 ? 0
+						 : req->non_repeaters);
+		if (non_repeaters > req->varbinds_count) {
+			non_repeaters = req->varbinds_count;
+		}
+		repetitions = (size_t)(req->max_repetitions < 0
+					       ? 0
+					       : req->max_repetitions);
+	}
+
+	/* Position and name of the last OID returned by each variable */
+	size_t next_pos[SNMP_BER_MAX_VARBINDS];
+	const struct snmp_ber_oid *last_oid[SNMP_BER_MAX_VARBINDS];
+	bool more = true;
+	for (size_t r = 0; more && r < (r ? repetitions : 1); ++r) {
+		const size_t vars_end = r || repetitions ? req->varbinds_count
+							 : non_repeaters;
+		more = false;
+		for (size_t i = r ? non_repeaters : 0; i < vars_end; ++i) {
+			if (count == max_vars) {
+				break;
+			}
+
+			const struct snmp_ber_oid *req_oid =
+					r ? last_oid[i] : &req->oids[i];
+			size_t pos = r ? next_pos[i] + 1
+				       : sim_oid_lower_bound(sim, req_oid);
+			if (SNMP_BER_GET == req->pdu_type) {
+				if (pos == sim->oids_count ||
+				    0 != snmp_ber_oid_cmp(&sim->oids[pos].oid,
+							  req_oid)) {
+					pos = sim->oids_count;
+				}
+			} else if (0 == r && pos < sim->oids_count &&
+				   0 == snmp_ber_oid_cmp(&sim->oids[pos].oid,
+							 req_oid)) {
+				/* GETNEXT: strictly greater */
+				pos++;
+			}
+			next_pos[i] = pos < sim->oids_count ? pos
+							    : sim->oids_count;
+
+			if (pos < sim->oids_count) {
+				oids[count] = last_oid[i] = &sim->oids[pos].oid;
+				sim_oid_value(sim,
+					      agent,
+					      &sim->oids[pos],
+					      now,
+					      &values[count]);
+				more = true;
+			} else if (v1) {
+				error_status = SNMP_BER_ERR_NO_SUCH_NAME;
+				error_index = i + 1;
+				break;
+			} else {
+				/* Exceptions keep the last name */
+				oids[count] = last_oid[i] = req_oid;
+				values[count].type =
+						SNMP_BER_GET == req->pdu_type
+								? SNMP_BER_NO_SUCH_OBJECT
+								: SNMP_BER_END_OF_MIB_VIEW;
+			}
+			count++;
+		}
+
+		if (SNMP_BER_ERR_NO_ERROR != error_status) {
+			break;
+		}
+	}
+
+	if (SNMP_BER_ERR_NO_ERROR != error_status) {
+		/* v1 errors answer with the requested variables */
+		for (count = 0; count < req->varbinds_count; ++count) {
+			oids[count] = &req->oids[count];
+			values[count].type = SNMP_BER_NULL;
+		}
+	}
+
+	size_t len;
+	while (0 == (len = snmp_ber_encode_response(buf,
+						     SIM_MAX_DATAGRAM,
+						     req,
+						     error_status,
+						     error_index,
+						     oids,
+						     values,
+						     count)) &&
+	       SNMP_BER_GETBULK == req->pdu_type && count > 1) {
+		/* GETBULK answers with as many variables as fit */
+		count /= 2;
+	}
+
+	if (0 == len) {
+		len = snmp_ber_encode_response(buf,
+					       SIM_MAX_DATAGRAM,
+					       req,
+					       SNMP_BER_ERR_TOO_BIG,
+					       0,
+					       NULL,
+					       NULL,
+					       0);
+	}
+
+	return len;
+}
+
+/*
+ * NETWORK
+ */
+
+/** Push a response in the pending min-heap
+  @param sim Simulator
+  @param pending Response to push
+  @return true if pushed
+  */
+static bool sim_pending_push(struct sim *sim,
+			     const struct sim_pending *pending) {
+	if (sim->pending_count == SIM_MAX_PENDING) {
+		return false;
+	}
+
+	size_t i = sim->pending_count++;
+	while (i > 0 && sim->pending[(i - 1) / 2].due > pending->due) {
+		sim->pending[i] = sim->pending[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	sim->pending[i] = *pending;
+	return true;
+}
+
+/** Pop the first response of the pending min-heap
+  @param sim Simulator
+  @param pending Popped response
+  */
+static void sim_pending_pop(struct sim *sim, struct sim_pending *pending) {
+	*pending = sim->pending[0];
+	const struct sim_pending last = sim->pending[--sim->pending_count];
+
+	size_t i = 0;
+	for (;;) {
+		size_t child = 2 * i + 1;
+		if (child >= sim->pending_count) {
+			break;
+		}
+		if (child + 1 < sim->pending_count &&
+		    sim->pending[child + 1].due < sim->pending[child].due) {
+			child++;
+		}
+		if (last.due <= sim->pending[child].due) {
+			break;
+		}
+		sim->pending[i] = sim->pending[child];
+		i = child;
+	}
+	sim->pending[i] = last;
+}
+
+static void sim_send(struct sim *sim,
+		     int fd,
+		     const struct sockaddr_in *addr,
+		     const uint8_t *data,
+		     size_t len) {
+	const ssize_t rc = sendto(fd,
+				  data,
+				  len,
+				  0,
+				  (const struct sockaddr *)addr,
+				  sizeof(*addr));
+	if (rc < 0) {
+		sim->stats.errors++;
+	} else {
+		sim->stats.responses++;
+	}
+}
+
+/** Send responses whose latency has expired
+  @param sim Simulator
+  @param now Current time, in ns
+  */
+static void sim_send_pending(struct sim *sim, uint64_t now) {
+	while (sim->pending_count > 0 && sim->pending[0].due <= now) {
+		struct sim_pending pending;
+		sim_pending_pop(sim, &pending);
+		sim_send(sim, pending.fd, &pending.addr, pending.data, pending.len);
+		free(pending.data);
+	}
+}
+
+/** An agent never answers
+  @param sim Simulator
+  @param agent Agent index
+  @return true if the agent is in timeout
+  */
+static bool sim_agent_timeout(const struct sim *sim, size_t agent) {
+	/* Spread timeout agents along the ports range */
+	const uint64_t hash = ((uint64_t)agent * 2654435761u) & UINT32_MAX;
+	return (double)hash < sim->timeout_agents * (double)UINT32_MAX;
+}
+
+/** Read and answer all pending requests of an agent
+  @param sim Simulator
+  @param agent Agent index
+  */
+static void sim_agent_read(struct sim *sim, size_t agent) {
+	static uint8_t in[SIM_MAX_DATAGRAM], out[SIM_MAX_DATAGRAM];
+	static struct snmp_ber_request req;
+	const int fd = sim->fds[agent];
+
+	for (;;) {
+		struct sockaddr_in addr;
+		socklen_t addr_len = sizeof(addr);
+		const ssize_t rc = recvfrom(fd,
+					    in,
+					    sizeof(in),
+					    0,
+					    (struct sockaddr *)&addr,
+					    &addr_len);
+		if (rc < 0) {
+			return;
+		}
+
+		sim->stats.requests++;
+		if (!snmp_ber_decode_request(in, (size_t)rc, &req) ||
+		    req.community_len != strlen(sim->community) ||
+		    0 != memcmp(req.community,
+				sim->community,
+				req.community_len)) {
+			sim->stats.errors++;
+			continue;
+		}
+
+		if (sim_agent_timeout(sim, agent) ||
+		    sim_random(sim) < sim->loss) {
+			sim->stats.dropped++;
+			continue;
+		}
+
+		const size_t len = sim_answer(sim, agent, &req, out);
+		if (0 == len) {
+			sim->stats.errors++;
+			continue;
+		}
+
+		const double latency_ms =
+				sim->latency_min_ms +
+				sim_random(sim) * (sim->latency_max_ms -
+						   sim->latency_min_ms);
+		if (latency_ms <= 0) {
+			sim_send(sim, fd, &addr, out, len);
+			continue;
+		}
+
+		struct sim_pending pending = {
+				.due = sim_now_ns() + (uint64_t)(latency_ms * 1e6),
+				.fd = fd,
+				.addr = addr,
+				.len = len,
+				.data = malloc(len),
+		};
+		if (NULL == pending.data || !sim_pending_push(sim, &pending)) {
+			free(pending.data);
+			sim->stats.dropped++;
+			continue;
+		}
+		memcpy(pending.data, out, len);
+	}
+}
+
+/** Open all agents sockets
+  @param sim Simulator
+  @return true if success
+  */
+static bool sim_listen(struct sim *sim) {
+	/* Every agent needs a socket */
+	struct rlimit nofile;
+	if (0 == getrlimit(RLIMIT_NOFILE, &nofile) &&
+	    nofile.rlim_cur < sim->agents + 64) {
+		nofile.rlim_cur = RLIM_INFINITY == nofile.rlim_max ||
+						  nofile.rlim_max >
+								  sim->agents + 64
+					  ? sim->agents + 64
+					  : nofile.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &nofile);
+	}
+
+	sim->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	sim->fds = calloc(sim->agents, sizeof(sim->fds[0]));
+	sim->pending = calloc(SIM_MAX_PENDING, sizeof(sim->pending[0]));
+	if (sim->epoll_fd < 0 || NULL == sim->fds || NULL == sim->pending) {
+		fprintf(stderr, "Couldn't allocate agents: %s\n", strerror(errno));
+		return false;
+	}
+
+	struct sockaddr_in addr = {.sin_family = AF_INET};
+	if (1 != inet_pton(AF_INET, sim->address, &addr.sin_addr)) {
+		fprintf(stderr, "Invalid address %s\n", sim->address);
+		return false;
+	}
+
+	for (size_t i = 0; i < sim->agents; ++i) {
+		addr.sin_port = htons((uint16_t)(sim->base_port + i));
+		sim->fds[i] = socket(AF_INET,
+				     SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+				     0);
+		struct epoll_event event = {
+				.events = EPOLLIN, .data.u64 = i,
+		};
+		if (sim->fds[i] < 0 ||
+		    0 != bind(sim->fds[i],
+			      (struct sockaddr *)&addr,
+			      sizeof(addr)) ||
+		    0 != epoll_ctl(sim->epoll_fd,
+				   EPOLL_CTL_ADD,
+				   sim->fds[i],
+				   &event)) {
+			fprintf(stderr,
+				"Couldn't listen in %s:%zu: %s\n",
+				sim->address,
+				sim->base_port + i,
+				strerror(errno));
+			if (sim->fds[i] >= 0) {
+				close(sim->fds[i]);
+			}
+			sim->agents = i;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void sim_print_stats(const struct sim *sim) {
+	fprintf(stderr,
+		"requests=%" PRIu64 " responses=%" PRIu64 " dropped=%" PRIu64
+		" errors=%" PRIu64 " pending=%zu\n",
+		sim->stats.requests,
+		sim->stats.responses,
+		sim->stats.dropped,
+		sim->stats.errors,
+		sim->pending_count);
+}
+
+/** Serve requests until a signal is received
+  @param sim Simulator
+  @param stats_interval_s Seconds between stats prints, 0 to disable
+  */
+static void sim_loop(struct sim *sim, double stats_interval_s) {
+	struct epoll_event events[SIM_MAX_EVENTS];
+	const uint64_t stats_interval = (uint64_t)(stats_interval_s * 1e9);
+	uint64_t next_stats = sim_now_ns() + stats_interval;
+
+	while (run) {
+		uint64_t now = sim_now_ns();
+		int timeout_ms = 1000;
+		if (sim->pending_count > 0) {
+			const uint64_t due = sim->pending[0].due;
+			timeout_ms = due <= now ? 0
+						: (int)((due - now + 999999) /
+							1000000);
+		}
+
+		const int nevents = epoll_wait(
+				sim->epoll_fd, events, SIM_MAX_EVENTS, timeout_ms);
+		for (int i = 0; i < nevents; ++i) {
+			sim_agent_read(sim, (size_t)events[i].data.u64);
+		}
+
+		now = sim_now_ns();
+		sim_send_pending(sim, now);
+		if (stats_interval > 0 && now >= next_stats) {
+			sim_print_stats(sim);
+			next_stats = now + stats_interval;
+		}
+	}
+}
+
+/*
+ * RB_MONITOR CONFIG GENERATOR
+ */
+
+/** Print a rb_monitor config that polls all simulated agents, with a monitor
+  for every named OID
+  @param sim Simulator
+  @param conf_overrides rb_monitor conf key=value overrides. Values are
+  parsed as JSON, or used as strings if they are not valid JSON.
+  @param conf_overrides_count Number of overrides
+  @param out Output file
+  */
+static void sim_print_rb_monitor_config(const struct sim *sim,
+					char *const *conf_overrides,
+					size_t conf_overrides_count,
+					FILE *out) {
+	json_object *config = json_object_new_object();
+	json_object *conf = json_object_new_object();
+	json_object *sensors = json_object_new_array();
+
+	json_object_object_add(conf, "debug", json_object_new_int64(3));
+	json_object_object_add(conf, "stdout", json_object_new_int64(1));
+	json_object_object_add(conf, "syslog", json_object_new_int64(0));
+	json_object_object_add(conf, "threads", json_object_new_int64(10));
+	json_object_object_add(conf, "timeout", json_object_new_int64(2));
+	json_object_object_add(conf, "sleep_main", json_object_new_int64(10));
+	json_object_object_add(conf, "sleep_worker", json_object_new_int64(1));
+	json_object_object_add(conf, "stats_interval", json_object_new_int64(10));
+	for (size_t i = 0; i < conf_overrides_count; ++i) {
+		char *key = conf_overrides[i];
+		char *val = strchr(key, '=');
+		if (NULL == val) {
+			fprintf(stderr, "Invalid conf override %s\n", key);
+			continue;
+		}
+
+		*val++ = '\0';
+		json_object *jval = json_tokener_parse(val);
+		json_object_object_add(
+				conf, key, jval ? jval : json_object_new_string(val));
+	}
+	json_object_object_add(config, "conf", conf);
+
+	for (size_t i = 0; i < sim->agents; ++i) {
+		char buf[BUFSIZ];
+		json_object *sensor = json_object_new_object();
+		json_object *monitors = json_object_new_array();
+
+		snprintf(buf, sizeof(buf), "sim-%05zu", i);
+		json_object_object_add(sensor,
+				       "sensor_id",
+				       json_object_new_int64((int64_t)i + 1));
+		json_object_object_add(sensor,
+				       "sensor_name",
+				       json_object_new_string(buf));
+		snprintf(buf,
+			 sizeof(buf),
+			 "%s:%zu",
+			 sim->address,
+			 sim->base_port + i);
+		json_object_object_add(sensor,
+				       "sensor_ip",
+				       json_object_new_string(buf));
+		json_object_object_add(sensor,
+				       "community",
+				       json_object_new_string(sim->community));
+		json_object_object_add(sensor, "timeout", json_object_new_int64(2));
+
+		for (size_t j = 0; j < sim->oids_count; ++j) {
+			const struct sim_oid *oid = &sim->oids[j];
+			if (NULL == oid->name) {
+				continue;
+			}
+
+			json_object *monitor = json_object_new_object();
+			json_object_object_add(monitor,
+					       "name",
+					       json_object_new_string(oid->name));
+			json_object_object_add(
+					monitor,
+					"oid",
+					json_object_new_string(snmp_ber_oid_print(
+							&oid->oid,
+							buf,
+							sizeof(buf))));
+			if (oid->unit) {
+				json_object_object_add(
+						monitor,
+						"unit",
+						json_object_new_string(oid->unit));
+			}
+			json_object_array_add(monitors, monitor);
+
+			if (SNMP_BER_COUNTER32 != oid->type &&
+			    SNMP_BER_COUNTER64 != oid->type) {
+				continue;
+			}
+
+			/* Counters are sent as rates */
+			json_object_object_add(monitor,
+					       "send",
+					       json_object_new_int64(0));
+			monitor = json_object_new_object();
+			snprintf(buf, sizeof(buf), "%s_rate", oid->name);
+			json_object_object_add(monitor,
+					       "name",
+					       json_object_new_string(buf));
+			snprintf(buf,
+				 sizeof(buf),
+				 "counter_rate(%s)",
+				 oid->name);
+			json_object_object_add(monitor,
+					       "op",
+					       json_object_new_string(buf));
+			if (oid->unit) {
+				snprintf(buf, sizeof(buf), "%s/s", oid->unit);
+				json_object_object_add(
+						monitor,
+						"unit",
+						json_object_new_string(buf));
+			}
+			json_object_array_add(monitors, monitor);
+		}
+
+		json_object_object_add(sensor, "monitors", monitors);
+		json_object_array_add(sensors, sensor);
+	}
+	json_object_object_add(config, "sensors", sensors);
+
+	fprintf(out,
+		"%s\n",
+		json_object_to_json_string(config));
+	json_object_put(config);
+}
+
+static void sim_done(struct sim *sim) {
+	for (size_t i = 0; sim->fds && i < sim->agents; ++i) {
+		close(sim->fds[i]);
+	}
+	if (sim->epoll_fd >= 0) {
+		close(sim->epoll_fd);
+	}
+	for (size_t i = 0; i < sim->pending_count; ++i) {
+		free(sim->pending[i].data);
+	}
+	for (size_t i = 0; i < sim->oids_count; ++i) {
+		free(sim->oids[i].name);
+		free(sim->oids[i].unit);
+		free(sim->oids[i].str);
+	}
+	free(sim->pending);
+	free(sim->fds);
+	free(sim->oids);
+	free((char *)sim->address);
+	free((char *)sim->community);
+}
+
+static void usage(const char *progname) {
+	fprintf(stderr,
+		"Usage: %s -c config.json [-n agents] [-g [-o key=value]...] "
+		"[-s stats_interval]\n"
+		"  -c  Simulator config file\n"
+		"  -n  Number of agents, overriding config file one\n"
+		"  -g  Print a rb_monitor config that polls all the simulated\n"
+		"      agents and exit\n"
+		"  -o  Set key=value in generated rb_monitor conf. Value is\n"
+		"      parsed as JSON, or as a string if it is not valid JSON\n"
+		"  -s  Seconds between stats prints (default 10, 0 to "
+		"disable)\n",
+		progname);
+}
+
+int main(int argc, char *argv[]) {
+	const char *config_path = NULL;
+	bool generate = false;
+	double stats_interval_s = 10;
+	size_t agents = 0;
+	char **conf_overrides = calloc((size_t)argc, sizeof(conf_overrides[0]));
+	size_t conf_overrides_count = 0;
+	int opt;
+
+	if (NULL == conf_overrides) {
+		fprintf(stderr, "Couldn't allocate conf overrides (OOM?)\n");
+		return 1;
+	}
+
+	while ((opt = getopt(argc, argv, "c:n:go:s:h")) != -1) {
+		switch (opt) {
+		case 'c':
+			config_path = optarg;
+			break;
+		case 'n':
+			agents = (size_t)strtoull(optarg, NULL, 10);
+			break;
+		case 'g':
+			generate = true;
+			break;
+		case 'o':
+			conf_overrides[conf_overrides_count++] = optarg;
+			break;
+		case 's':
+			stats_interval_s = atof(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			free(conf_overrides);
+			return 'h' == opt ? 0 : 1;
+		};
+	}
+
+	if (NULL == config_path) {
+		usage(argv[0]);
+		free(conf_overrides);
+		return 1;
+	}
+
+	struct sim sim = {
+			.epoll_fd = -1,
+			.seed = (unsigned)time(NULL),
+			.agents = agents,
+	};
+	int rc = 1;
+	if (!sim_parse_config(&sim, config_path)) {
+		goto err;
+	}
+
+	if (generate) {
+		sim_print_rb_monitor_config(&sim,
+					    conf_overrides,
+					    conf_overrides_count,
+					    stdout);
+		rc = 0;
+		goto err;
+	}
+
+	if (!sim_listen(&sim)) {
+		goto err;
+	}
+
+	signal(SIGINT, sig_handler);
+	signal(SIGTERM, sig_handler);
+	fprintf(stderr,
+		"Simulating %zu agents in %s:%" PRIu16 "-%zu with %zu OIDs\n",
+		sim.agents,
+		sim.address,
+		sim.base_port,
+		sim.base_port + sim.agents - 1,
+		sim.oids_count);
+	sim.start = sim_now_ns();
+	sim_loop(&sim, stats_interval_s);
+	sim_print_stats(&sim);
+	rc = 0;
+
+err:
+	sim_done(&sim);
+	free(conf_overrides);
+	return rc;
+}
@@ -0,0 +1,400 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "snmp_ber.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * DECODING
+ */
+
+/// Decoding cursor
+struct ber_reader {
+	const uint8_t *buf; ///< Current position
+	const uint8_t *end; ///< End of buffer
+};
+
+/** Read a tag and a length, and check that content fits in buffer
+  @param r Reader
+  @param tag Expected tag
+  @param len Content length
+  @return true if next element has expected tag and fits in buffer
+  */
+static bool ber_read_tl(struct ber_reader *r, uint8_t tag, size_t *len) {
+	if (r->end - r->buf < 2 || *r->buf != tag) {
+		return false;
+	}
+	r->buf++;
+
+	const uint8_t first = *r->buf++;
+	if (first < 0x80) {
+		*len = first;
+	} else {
+		const size_t len_bytes = first & 0x7f;
+		if (0 == len_bytes || len_bytes > sizeof(size_t) ||
+		    (size_t)(r->end - r->buf) < len_bytes) {
+			return false;
+		}
+		*len = 0;
+		for (size_t i = 0; i < len_bytes; ++i) {
+			*len = (*len << 8) | *r->buf++;
+		}
+	}
+
+	return *len <= (size_t)(r->end - r->buf);
+}
+
+/** Read an INTEGER
+  @param r Reader
+  @param val Value
+  @return true if next element is a valid INTEGER
+  */
+static bool ber_read_integer(struct ber_reader *r, int64_t *val) {
+	size_t len;
+	if (!ber_read_tl(r, SNMP_BER_INTEGER, &len) || 0 == len ||
+	    len > sizeof(*val)) {
+		return false;
+	}
+
+	uint64_t uval = (r->buf[0] & 0x80) ? UINT64_MAX : 0;
+	for (size_t i = 0; i < len; ++i) {
+		uval = (uval << 8) | r->buf[i];
+	}
+	r->buf += len;
+	*val = (int64_t)uval;
+	return true;
+}
+
+/** Read an OID
+  @param r Reader
+  @param oid OID
+  @return true if next element is a valid OID
+  */
+static bool ber_read_oid(struct ber_reader *r, struct snmp_ber_oid *oid) {
+	size_t len;
+	if (!ber_read_tl(r, SNMP_BER_OID, &len) || 0 == len) {
+		return false;
+	}
+
+	const uint8_t *end = r->buf + len;
+	uint64_t id = 0;
+	oid->len = 0;
+	for (; r->buf < end; r->buf++) {
+		id = (id << 7) | (*r->buf & 0x7f);
+		if (id > UINT32_MAX) {
+			return false;
+		} else if (*r->buf & 0x80) {
+			continue;
+		}
+
+		if (0 == oid->len) {
+			/* First byte encodes two sub-identifiers */
+			const uint32_t first = id < 80 ? (uint32_t)id / 40 : 2;
+			oid->ids[oid->len++] = first;
+			oid->ids[oid->len++] = (uint32_t)id - 40 * first;
+		} else if (oid->len < SNMP_BER_MAX_OID_LEN) {
+			oid->ids[oid->len++] = (uint32_t)id;
+		} else {
+			return false;
+		}
+		id = 0;
+	}
+
+	/* Last sub-identifier can't have continuation bit */
+	return 0 == (end[-1] & 0x80);
+}
+
+bool snmp_ber_decode_request(const uint8_t *buf,
+			     size_t len,
+			     struct snmp_ber_request *req) {
+	struct ber_reader r = {.buf = buf, .end = buf + len};
+	size_t elm_len;
+
+	if (!ber_read_tl(&r, SNMP_BER_SEQUENCE, &elm_len)) {
+		return false;
+	}
+	r.end = r.buf + elm_len;
+
+	if (!ber_read_integer(&r, &req->version) ||
+	    !ber_read_tl(&r, SNMP_BER_OCTET_STRING, &req->community_len)) {
+		return false;
+	}
+	req->community = (const char *)r.buf;
+	r.buf += req->community_len;
+
+	if (r.buf >= r.end) {
+		return false;
+	}
+	req->pdu_type = *r.buf;
+	switch (req->pdu_type) {
+	case SNMP_BER_GET:
+	case SNMP_BER_GETNEXT:
+	case SNMP_BER_GETBULK:
+		break;
+	default:
+		return false;
+	};
+
+	int64_t error_status, error_index;
+	if (!ber_read_tl(&r, (uint8_t)req->pdu_type, &elm_len) ||
+	    !ber_read_integer(&r, &req->request_id) ||
+	    !ber_read_integer(&r, &error_status) ||
+	    !ber_read_integer(&r, &error_index) ||
+	    !ber_read_tl(&r, SNMP_BER_SEQUENCE, &elm_len)) {
+		return false;
+	}
+
+	/* In GETBULK, error fields are non-repeaters and max-repetitions */
+	req->non_repeaters = error_status;
+	req->max_repetitions = error_index;
+
+	const uint8_t *varbinds_end = r.buf + elm_len;
+	for (req->varbinds_count = 0; r.buf < varbinds_end;
+	     req->varbinds_count++) {
+		if (req->varbinds_count == SNMP_BER_MAX_VARBINDS ||
+		    !ber_read_tl(&r, SNMP_BER_SEQUENCE, &elm_len)) {
+			return false;
+		}
+
+		const uint8_t *varbind_end = r.buf + elm_len;
+		if (!ber_read_oid(&r, &req->oids[req->varbinds_count]) ||
+		    r.buf > varbind_end) {
+			return false;
+		}
+		/* Ignore requested value, it should be NULL */
+		r.buf = varbind_end;
+	}
+
+	return true;
+}
+
+/*
+ * ENCODING
+ */
+
+/** Encoding buffer. BER lengths go before the contents, so it is easier to
+  encode backwards, from the end of the buffer. */
+struct ber_writer {
+	uint8_t *buf; ///< Buffer
+	size_t pos;   ///< First used position
+	bool error;   ///< Buffer was too small
+};
+
+static void ber_push(struct ber_writer *w, const void *data, size_t len) {
+	if (w->error || len > w->pos) {
+		w->error = true;
+		return;
+	}
+	w->pos -= len;
+	memcpy(&w->buf[w->pos], data, len);
+}
+
+static void ber_push_byte(struct ber_writer *w, uint8_t byte) {
+	ber_push(w, &byte, 1);
+}
+
+/** Push tag and length of an element that has already been pushed
+  @param w Writer
+  @param tag Element tag
+  @param content_end Writer position after the element content
+  */
+static void
+ber_push_tl(struct ber_writer *w, uint8_t tag, size_t content_end) {
+	size_t len = content_end - w->pos;
+	if (len < 0x80) {
+		ber_push_byte(w, (uint8_t)len);
+	} else {
+		uint8_t len_bytes = 0;
+		for (; len > 0; len >>= 8, len_bytes++) {
+			ber_push_byte(w, (uint8_t)(len & 0xff));
+		}
+		ber_push_byte(w, 0x80 | len_bytes);
+	}
+	ber_push_byte(w, tag);
+}
+
+static void ber_push_integer(struct ber_writer *w, uint8_t tag, int64_t val) {
+	const size_t end = w->pos;
+	/* Minimal two's complement: stop when the rest is sign extension */
+	do {
+		ber_push_byte(w, (uint8_t)(val & 0xff));
+		val >>= 8;
+	} while (!((0 == val && !(w->buf[w->pos] & 0x80)) ||
+		   (-1 == val && (w->buf[w->pos] & 0x80))) &&
+		 !w->error);
+	ber_push_tl(w, tag, end);
+}
+
+static void
+ber_push_unsigned(struct ber_writer *w, uint8_t tag, uint64_t val) {
+	const size_t end = w->pos;
+	do {
+		ber_push_byte(w, (uint8_t)(val & 0xff));
+		val >>= 8;
+	} while (val > 0 && !w->error);
+
+	if (!w->error && (w->buf[w->pos] & 0x80)) {
+		ber_push_byte(w, 0);
+	}
+	ber_push_tl(w, tag, end);
+}
+
+static void ber_push_oid(struct ber_writer *w, const struct snmp_ber_oid *oid) {
+	const size_t end = w->pos;
+	for (size_t i = oid->len; i > 2; --i) {
+		uint32_t id = oid->ids[i - 1];
+		ber_push_byte(w, id & 0x7f);
+		for (id >>= 7; id > 0; id >>= 7) {
+			ber_push_byte(w, 0x80 | (id & 0x7f));
+		}
+	}
+
+	const uint32_t first =
+			oid->len >= 2 ? oid->ids[0] * 40 + oid->ids[1] : 0;
+	ber_push_byte(w, (uint8_t)first);
+	ber_push_tl(w, SNMP_BER_OID, end);
+}
+
+static void ber_push_value(struct ber_writer *w,
+			   const struct snmp_ber_value *value) {
+	const size_t end = w->pos;
+	switch (value->type) {
+	case SNMP_BER_INTEGER:
+		ber_push_integer(w, SNMP_BER_INTEGER, value->integer);
+		break;
+	case SNMP_BER_COUNTER32:
+	case SNMP_BER_GAUGE32:
+	case SNMP_BER_TIMETICKS:
+	case SNMP_BER_COUNTER64:
+		ber_push_unsigned(w,
+				  (uint8_t)value->type,
+				  value->unsigned_integer);
+		break;
+	case SNMP_BER_OCTET_STRING:
+	case SNMP_BER_IPADDRESS:
+		ber_push(w, value->string.buf, value->string.len);
+		ber_push_tl(w, (uint8_t)value->type, end);
+		break;
+	default:
+		/* NULL and exceptions have no content */
+		ber_push_tl(w, (uint8_t)value->type, end);
+		break;
+	};
+}
+
+size_t snmp_ber_encode_response(uint8_t *buf,
+				size_t bufsiz,
+				const struct snmp_ber_request *req,
+				enum snmp_ber_error error_status,
+				size_t error_index,
+				const struct snmp_ber_oid *const *oids,
+				const struct snmp_ber_value *values,
+				size_t count) {
+	struct ber_writer w = {.buf = buf, .pos = bufsiz};
+	const size_t end = w.pos;
+
+	for (size_t i = count; i > 0; --i) {
+		const size_t varbind_end = w.pos;
+		ber_push_value(&w, &values[i - 1]);
+		ber_push_oid(&w, oids[i - 1]);
+		ber_push_tl(&w, SNMP_BER_SEQUENCE, varbind_end);
+	}
+	ber_push_tl(&w, SNMP_BER_SEQUENCE, end);
+
+	ber_push_integer(&w, SNMP_BER_INTEGER, (int64_t)error_index);
+	ber_push_integer(&w, SNMP_BER_INTEGER, error_status);
+	ber_push_integer(&w, SNMP_BER_INTEGER, req->request_id);
+	ber_push_tl(&w, SNMP_BER_RESPONSE, end);
+
+	const size_t community_end = w.pos;
+	ber_push(&w, req->community, req->community_len);
+	ber_push_tl(&w, SNMP_BER_OCTET_STRING, community_end);
+	ber_push_integer(&w, SNMP_BER_INTEGER, req->version);
+	ber_push_tl(&w, SNMP_BER_SEQUENCE, end);
+
+	if (w.error) {
+		return 0;
+	}
+
+	const size_t len = bufsiz - w.pos;
+	memmove(buf, &buf[w.pos], len);
+	return len;
+}
+
+/*
+ * OID UTILITIES
+ */
+
+bool snmp_ber_oid_parse(const char *str, struct snmp_ber_oid *oid) {
+	oid->len = 0;
+	if ('.' == *str) {
+		str++;
+	}
+
+	while (*str) {
+		char *endptr;
+		const unsigned long id = strtoul(str, &endptr, 10);
+		if (endptr == str || id > UINT32_MAX ||
+		    oid->len == SNMP_BER_MAX_OID_LEN ||
+		    ('.' != *endptr && '\0' != *endptr)) {
+			return false;
+		}
+
+		oid->ids[oid->len++] = (uint32_t)id;
+		str = '.' == *endptr ? endptr + 1 : endptr;
+	}
+
+	/* First sub-identifiers go in one byte */
+	return oid->len >= 2 && oid->ids[0] <= 2 && oid->ids[1] < 40;
+}
+
+char *snmp_ber_oid_print(const struct snmp_ber_oid *oid,
+			 char *buf,
+			 size_t bufsiz) {
+	size_t pos = 0;
+	buf[0] = '\0';
+	for (size_t i = 0; i < oid->len && pos < bufsiz; ++i) {
+		const int rc = snprintf(&buf[pos],
+					bufsiz - pos,
+					"%s%" PRIu32,
+					i ? "." : "",
+					oid->ids[i]);
+		if (rc < 0) {
+			break;
+		}
+		pos += (size_t)rc;
+	}
+
+	return buf;
+}
+
+int snmp_ber_oid_cmp(const struct snmp_ber_oid *a,
+		     const struct snmp_ber_oid *b) {
+	const size_t len = a->len < b->len ? a->len : b->len;
+	for (size_t i = 0; i < len; ++i) {
+		if (a->ids[i] != b->ids[i]) {
+			return a->ids[i] < b->ids[i] ? -1 : 1;
+		}
+	}
+
+	return (a->len > b->len) - (a->len < b->len);
+}
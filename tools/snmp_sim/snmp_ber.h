@@ -0,0 +1,163 @@
+/*
+  Copyright (C) 2016 Eneo Tecnologia S.L.
+  Author: Eugenio Perez <eupm90@gmail.com>
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU Affero General Public License as
+  published by the Free Software Foundation, either version 3 of the
+  License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License
+  along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/** Minimal SNMPv1/v2c messages BER codec, enough to act as an agent:
+  decodes GET, GETNEXT and GETBULK requests and encodes their responses.
+  */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// Max number of sub-identifiers of an OID
+#define SNMP_BER_MAX_OID_LEN 128
+/// Max number of variables of a request
+#define SNMP_BER_MAX_VARBINDS 64
+
+// clang-format off
+/// BER types: enum suffix, tag
+#define SNMP_BER_TYPES_X                                                       \
+	_X(INTEGER,          0x02)                                         \
+	_X(OCTET_STRING,     0x04)                                         \
+	_X(NULL,             0x05)                                         \
+	_X(OID,              0x06)                                         \
+	_X(SEQUENCE,         0x30)                                         \
+	_X(IPADDRESS,        0x40)                                         \
+	_X(COUNTER32,        0x41)                                         \
+	_X(GAUGE32,          0x42)                                         \
+	_X(TIMETICKS,        0x43)                                         \
+	_X(COUNTER64,        0x46)                                         \
+	_X(NO_SUCH_OBJECT,   0x80)                                         \
+	_X(NO_SUCH_INSTANCE, 0x81)                                         \
+	_X(END_OF_MIB_VIEW,  0x82)                                         \
+	_X(GET,              0xa0)                                         \
+	_X(GETNEXT,          0xa1)                                         \
+	_X(RESPONSE,         0xa2)                                         \
+	_X(SET,              0xa3)                                         \
+	_X(GETBULK,          0xa5)
+// clang-format on
+
+enum snmp_ber_type {
+#define _X(name, tag) SNMP_BER_##name = tag,
+	SNMP_BER_TYPES_X
+#undef _X
+};
+
+/// SNMP error status
+enum snmp_ber_error {
+	SNMP_BER_ERR_NO_ERROR = 0,
+	SNMP_BER_ERR_TOO_BIG = 1,
+	SNMP_BER_ERR_NO_SUCH_NAME = 2,
+	SNMP_BER_ERR_GEN_ERR = 5,
+};
+
+/// SNMP versions, as they are encoded
+enum snmp_ber_version {
+	SNMP_BER_VERSION_1 = 0,
+	SNMP_BER_VERSION_2c = 1,
+};
+
+/// Object identifier
+struct snmp_ber_oid {
+	size_t len;			    ///< Number of sub-identifiers
+	uint32_t ids[SNMP_BER_MAX_OID_LEN]; ///< Sub-identifiers
+};
+
+/// Variable value
+struct snmp_ber_value {
+	enum snmp_ber_type type; ///< Value type
+	union {
+		int64_t integer;  ///< INTEGER value
+		uint64_t unsigned_integer; ///< Counters, gauges and timeticks
+		struct {
+			const char *buf;
+			size_t len;
+		} string; ///< OCTET STRING and IpAddress (4 bytes) value
+	};
+};
+
+/// Decoded request
+struct snmp_ber_request {
+	int64_t version;		 ///< Request version
+	const char *community;		 ///< Community, not NUL terminated
+	size_t community_len;		 ///< Community length
+	enum snmp_ber_type pdu_type;     ///< GET, GETNEXT or GETBULK
+	int64_t request_id;		 ///< Request id
+	int64_t non_repeaters;		 ///< GETBULK non repeaters
+	int64_t max_repetitions;	 ///< GETBULK max repetitions
+	size_t varbinds_count;		 ///< Number of requested variables
+	struct snmp_ber_oid oids[SNMP_BER_MAX_VARBINDS]; ///< Requested OIDs
+};
+
+/** Decode a request
+  @param buf Message buffer
+  @param len Message length
+  @param req Request to fill. Community points to buf.
+  @return true if it is a valid request
+  */
+bool snmp_ber_decode_request(const uint8_t *buf,
+			     size_t len,
+			     struct snmp_ber_request *req);
+
+/** Encode a response
+  @param buf Buffer to encode response in
+  @param bufsiz Buffer size
+  @param req Request to answer
+  @param error_status Error status
+  @param error_index Error index
+  @param oids Response OIDs
+  @param values Response values
+  @param count Number of response variables
+  @return Encoded response length, or 0 if it does not fit in buf
+  */
+size_t snmp_ber_encode_response(uint8_t *buf,
+				size_t bufsiz,
+				const struct snmp_ber_request *req,
+				enum snmp_ber_error error_status,
+				size_t error_index,
+				const struct snmp_ber_oid *const *oids,
+				const struct snmp_ber_value *values,
+				size_t count);
+
+/** Parse a dotted OID, like 1.3.6.1.2.1.1.3.0 or .1.3.6.1.2.1.1.3.0
+  @param str OID in text format
+  @param oid OID to fill
+  @return true if valid OID
+  */
+bool snmp_ber_oid_parse(const char *str, struct snmp_ber_oid *oid);
+
+/** Print an OID in dotted format
+  @param oid OID to print
+  @param buf Buffer to print in
+  @param bufsiz Buffer size
+  @return buf
+  */
+char *snmp_ber_oid_print(const struct snmp_ber_oid *oid,
+			 char *buf,
+			 size_t bufsiz);
+
+/** Compare OIDs lexicographically
+  @param a First OID
+  @param b Second OID
+  @return Less than, equal to or greater than 0 if a is less than, equal to
+  or greater than b
+  */
+int snmp_ber_oid_cmp(const struct snmp_ber_oid *a,
+		     const struct snmp_ber_oid *b);